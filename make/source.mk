@@ -1,4 +1,6 @@
 COMMON_SRC = \
+            build/benchmark.c \
+            build/benchmark_kernels.c \
             build/build_config.c \
             build/debug.c \
             build/debug_pin.c \
@@ -53,6 +55,7 @@ COMMON_SRC = \
             fc/board_info.c \
             fc/dispatch.c \
             fc/hardfaults.c \
+            fc/latency.c \
             fc/tasks.c \
             fc/runtime_config.c \
             fc/stats.c \
@@ -136,6 +139,7 @@ COMMON_SRC = \
             sensors/gyro_init.c \
             sensors/initialisation.c \
             blackbox/blackbox.c \
+            blackbox/blackbox_compress.c \
             blackbox/blackbox_encoding.c \
             blackbox/blackbox_io.c \
             cms/cms.c \
@@ -227,7 +231,10 @@ SIZE_OPTIMISED_SRC  := ""
 SPEED_OPTIMISED_SRC := $(SPEED_OPTIMISED_SRC) \
             common/encoding.c \
             common/filter.c \
+            common/filter_chain.c \
+            common/filter_fixed.c \
             common/maths.c \
+            common/notch_bank.c \
             common/sdft.c \
             common/typeconversion.c \
             drivers/accgyro/accgyro_mpu.c \
@@ -255,6 +262,7 @@ SPEED_OPTIMISED_SRC := $(SPEED_OPTIMISED_SRC) \
             drivers/system.c \
             drivers/timer.c \
             fc/core.c \
+            fc/latency.c \
             fc/tasks.c \
             fc/rc.c \
             fc/rc_controls.c \
@@ -28,6 +28,7 @@
 #ifdef USE_BLACKBOX
 
 #include "blackbox.h"
+#include "blackbox_compress.h"
 #include "blackbox_encoding.h"
 #include "blackbox_fielddefs.h"
 #include "blackbox_io.h"
@@ -51,6 +52,7 @@
 
 #include "fc/board_info.h"
 #include "fc/controlrate_profile.h"
+#include "fc/latency.h"
 #include "fc/parameter_names.h"
 #include "fc/rc.h"
 #include "fc/rc_controls.h"
@@ -91,20 +93,29 @@
 #define DEFAULT_BLACKBOX_DEVICE     BLACKBOX_DEVICE_SERIAL
 #endif
 
-PG_REGISTER_WITH_RESET_TEMPLATE(blackboxConfig_t, blackboxConfig, PG_BLACKBOX_CONFIG, 3);
+PG_REGISTER_WITH_RESET_TEMPLATE(blackboxConfig_t, blackboxConfig, PG_BLACKBOX_CONFIG, 8);
 
 PG_RESET_TEMPLATE(blackboxConfig_t, blackboxConfig,
-    .fields_disabled_mask = 0, // default log all fields
+    .fields_disabled_mask = (1 << FLIGHT_LOG_FIELD_SELECT_LATENCY), // default log all fields except the gyro to motor latency
     .sample_rate = BLACKBOX_RATE_QUARTER,
     .device = DEFAULT_BLACKBOX_DEVICE,
     .mode = BLACKBOX_MODE_NORMAL,
-    .high_resolution = false
+    .high_resolution = false,
+    .compression = false,
+    .rate_group_denom = { 1, 1, 1, 1, 1, 1 },
+    .sd_prealloc = 0,
+    .deferred = false,
+    .flash_erase_ahead = 0,
 );
 
 STATIC_ASSERT((sizeof(blackboxConfig()->fields_disabled_mask) * 8) >= FLIGHT_LOG_FIELD_SELECT_COUNT, too_many_flight_log_fields_selections);
+STATIC_ASSERT(ARRAYLEN(blackboxConfig()->rate_group_denom) == 6, rate_group_denom_reset_template_out_of_date);
 
 #define BLACKBOX_SHUTDOWN_TIMEOUT_MILLIS 200
 
+#define BLACKBOX_QUEUE_LENGTH 32 // main frames, must be a power of two
+#define BLACKBOX_QUEUE_FRAMES_PER_RUN (BLACKBOX_QUEUE_LENGTH / 4) // most main frames TASK_BLACKBOX logs in one run
+
 // Some macros to make writing FLIGHT_LOG_FIELD_* constants shorter:
 
 #define PREDICT(x) CONCAT(FLIGHT_LOG_FIELD_PREDICTOR_, x)
@@ -118,6 +129,13 @@ static const char blackboxHeader[] =
     "H Product:Blackbox flight data recorder by Nicholas Sherlock\n"
     "H Data version:2\n";
 
+#ifdef USE_BLACKBOX_COMPRESSION
+// Version 3 main frames are adaptively predicted and Rice coded, see blackbox_compress.c
+static const char blackboxCompressedHeader[] =
+    "H Product:Blackbox flight data recorder by Nicholas Sherlock\n"
+    "H Data version:3\n";
+#endif
+
 static const char* const blackboxFieldHeaderNames[] = {
     "name",
     "signed",
@@ -235,6 +253,10 @@ static const blackboxDeltaFieldDefinition_t blackboxMainFields[] = {
     {"debug",       1, SIGNED,   .Ipredict = PREDICT(0),       .Iencode = ENCODING(SIGNED_VB),   .Ppredict = PREDICT(AVERAGE_2),     .Pencode = ENCODING(SIGNED_VB), CONDITION(DEBUG_LOG)},
     {"debug",       2, SIGNED,   .Ipredict = PREDICT(0),       .Iencode = ENCODING(SIGNED_VB),   .Ppredict = PREDICT(AVERAGE_2),     .Pencode = ENCODING(SIGNED_VB), CONDITION(DEBUG_LOG)},
     {"debug",       3, SIGNED,   .Ipredict = PREDICT(0),       .Iencode = ENCODING(SIGNED_VB),   .Ppredict = PREDICT(AVERAGE_2),     .Pencode = ENCODING(SIGNED_VB), CONDITION(DEBUG_LOG)},
+#ifdef USE_LATENCY_STATS
+    /* Time in us from reading the gyro sample to starting the motor outputs computed from it */
+    {"gyroLatency", -1, UNSIGNED, .Ipredict = PREDICT(0),      .Iencode = ENCODING(UNSIGNED_VB), .Ppredict = PREDICT(PREVIOUS),      .Pencode = ENCODING(SIGNED_VB), CONDITION(LATENCY)},
+#endif
     /* Motors only rarely drops under minthrottle (when stick falls below mincommand), so predict minthrottle for it and use *unsigned* encoding (which is large for negative numbers but more compact for positive ones): */
     {"motor",       0, UNSIGNED, .Ipredict = PREDICT(MINMOTOR), .Iencode = ENCODING(UNSIGNED_VB), .Ppredict = PREDICT(AVERAGE_2), .Pencode = ENCODING(SIGNED_VB), CONDITION(AT_LEAST_MOTORS_1)},
     /* Subsequent motors base their I-frame values on the first one, P-frame values on the average of last two frames: */
@@ -328,6 +350,9 @@ typedef struct blackboxMainState_s {
     int32_t surfaceRaw;
 #endif
     uint16_t rssi;
+#ifdef USE_LATENCY_STATS
+    uint16_t gyroLatency;
+#endif
 } blackboxMainState_t;
 
 typedef struct blackboxGpsState_s {
@@ -391,9 +416,18 @@ static float blackboxHighResolutionScale;
  */
 static uint16_t vbatReference;
 
+#ifdef USE_BLACKBOX_COMPRESSION
+static blackboxCompressState_t blackboxCompressState;
+#endif
+
 static blackboxGpsState_t gpsHistory;
 static blackboxSlowState_t slowHistory;
 
+#ifdef USE_BLACKBOX_COMPRESSION
+// Rate groups logged by the P-frame being written
+static uint32_t blackboxRateGroupsDue;
+#endif
+
 // Keep a history of length 2, plus a buffer for MW to store the new values into
 static blackboxMainState_t blackboxHistoryRing[3];
 
@@ -402,6 +436,42 @@ static blackboxMainState_t* blackboxHistory[3];
 
 static bool blackboxModeActivationConditionPresent = false;
 
+#ifdef USE_BLACKBOX_DEFERRED
+// The loop iteration a frame was queued on, which decides what kind of frame it is logged as
+typedef struct blackboxIterationTimers_s {
+    uint32_t iteration;
+    uint16_t loopIndex;
+    uint16_t pFrameIndex;
+    uint16_t iFrameIndex;
+} blackboxIterationTimers_t;
+
+struct blackboxQueuedFrame_s {
+    blackboxMainState_t state;
+    blackboxIterationTimers_t timers;
+    bool resume;                // frames before this one were dropped
+};
+
+/*
+ * With blackbox_deferred on, the PID loop only snapshots the main state into this ring and TASK_BLACKBOX does the
+ * rest. There's one producer and one consumer and each only writes its own index, so publishing the index after the
+ * frame it covers is all the synchronisation that's needed.
+ */
+static struct {
+    blackboxQueuedFrame_t frames[BLACKBOX_QUEUE_LENGTH];
+    volatile uint32_t head;     // only written by blackboxQueueCommit()
+    volatile uint32_t tail;     // only written by blackboxQueueRelease()
+    uint32_t overflows;         // main frames dropped since the log started
+    bool resync;                // drop frames up to the next I-frame
+} blackboxQueue;
+
+STATIC_ASSERT((BLACKBOX_QUEUE_LENGTH & (BLACKBOX_QUEUE_LENGTH - 1)) == 0, blackbox_queue_length_not_power_of_two);
+
+static bool blackboxDeferred;
+
+// The queued frame being logged, if any, which is logged in place of the flight controller's current state
+static const blackboxQueuedFrame_t *blackboxDequeuedFrame;
+#endif
+
 /**
  * Return true if it is safe to edit the Blackbox configuration.
  */
@@ -415,6 +485,137 @@ static bool blackboxIsOnlyLoggingIntraframes(void)
     return blackboxPInterval == 0;
 }
 
+#ifdef USE_BLACKBOX_DEFERRED
+STATIC_UNIT_TESTED void blackboxQueueReset(void)
+{
+    blackboxQueue.head = 0;
+    blackboxQueue.tail = 0;
+    blackboxQueue.overflows = 0;
+    blackboxQueue.resync = false;
+}
+
+// Get the slot for the PID loop's next snapshot, or NULL if TASK_BLACKBOX has fallen behind and the ring is full
+STATIC_UNIT_TESTED blackboxQueuedFrame_t *blackboxQueueReserve(void)
+{
+    const uint32_t head = blackboxQueue.head;
+
+    if (head - blackboxQueue.tail >= BLACKBOX_QUEUE_LENGTH) {
+        return NULL;
+    }
+    return &blackboxQueue.frames[head & (BLACKBOX_QUEUE_LENGTH - 1)];
+}
+
+// Hand the reserved slot over to TASK_BLACKBOX
+STATIC_UNIT_TESTED void blackboxQueueCommit(void)
+{
+    blackboxQueue.head = blackboxQueue.head + 1;
+}
+
+// Get the oldest frame that hasn't been logged yet, or NULL if there isn't one
+STATIC_UNIT_TESTED blackboxQueuedFrame_t *blackboxQueuePeek(void)
+{
+    const uint32_t tail = blackboxQueue.tail;
+
+    if (tail == blackboxQueue.head) {
+        return NULL;
+    }
+    return &blackboxQueue.frames[tail & (BLACKBOX_QUEUE_LENGTH - 1)];
+}
+
+// Hand the peeked frame's slot back to the PID loop
+STATIC_UNIT_TESTED void blackboxQueueRelease(void)
+{
+    blackboxQueue.tail = blackboxQueue.tail + 1;
+}
+
+/**
+ * Get the number of main frames the PID loop has queued that TASK_BLACKBOX is yet to log.
+ */
+uint32_t blackboxGetQueuedFrames(void)
+{
+    return blackboxQueue.head - blackboxQueue.tail;
+}
+
+/**
+ * Get the number of main frames dropped from the current (or last) log because TASK_BLACKBOX fell behind.
+ */
+uint32_t blackboxGetQueueOverflows(void)
+{
+    return blackboxQueue.overflows;
+}
+#endif // USE_BLACKBOX_DEFERRED
+
+#ifdef USE_BLACKBOX_COMPRESSION
+/*
+ * Where each rate group lives in the main state. When a P-frame skips a group, the group's fields are carried forward
+ * in the history so the predictors of the next P-frame logging it work from the last two values that were logged.
+ */
+typedef struct blackboxRateGroupRange_s {
+    uint8_t group;
+    uint8_t offset;
+    uint8_t size;
+} blackboxRateGroupRange_t;
+
+#define RATE_GROUP_RANGE(group, member) { group, offsetof(blackboxMainState_t, member), sizeof(((blackboxMainState_t *)0)->member) }
+
+static const blackboxRateGroupRange_t blackboxRateGroupRanges[] = {
+    RATE_GROUP_RANGE(BLACKBOX_RATE_GROUP_PID,           axisPID_P),
+    RATE_GROUP_RANGE(BLACKBOX_RATE_GROUP_PID,           axisPID_I),
+    RATE_GROUP_RANGE(BLACKBOX_RATE_GROUP_PID,           axisPID_D),
+    RATE_GROUP_RANGE(BLACKBOX_RATE_GROUP_PID,           axisPID_F),
+    RATE_GROUP_RANGE(BLACKBOX_RATE_GROUP_RC_COMMANDS,   rcCommand),
+    RATE_GROUP_RANGE(BLACKBOX_RATE_GROUP_SETPOINT,      setpoint),
+    RATE_GROUP_RANGE(BLACKBOX_RATE_GROUP_GYRO,          gyroADC),
+    RATE_GROUP_RANGE(BLACKBOX_RATE_GROUP_DEBUG,         debug),
+    RATE_GROUP_RANGE(BLACKBOX_RATE_GROUP_MOTOR,         motor),
+    RATE_GROUP_RANGE(BLACKBOX_RATE_GROUP_MOTOR,         servo),
+};
+
+STATIC_ASSERT(sizeof(blackboxMainState_t) <= UINT8_MAX, blackbox_rate_group_offsets_overflow);
+
+// Only data version 3 P-frames can leave groups out, version 2 decoders expect every field in every P-frame
+static uint8_t blackboxRateGroupDenom(blackboxRateGroup_e group)
+{
+    return blackboxConfig()->compression ? blackboxConfig()->rate_group_denom[group] : 1;
+}
+
+/*
+ * The rate groups logged by a P-frame at this iteration: a group with rate_group_denom N is in every Nth P-frame
+ * slot of the I-frame interval, counting the I-frame (which always logs everything) as slot 0. Decoders get the slot
+ * from the iteration number, so a lost frame doesn't throw the schedule off.
+ */
+STATIC_UNIT_TESTED uint32_t blackboxPFrameRateGroups(void)
+{
+    const uint16_t slot = blackboxPInterval ? blackboxLoopIndex / blackboxPInterval : 0;
+
+    uint32_t groups = 0;
+    for (int group = 0; group < BLACKBOX_RATE_GROUP_COUNT; group++) {
+        const uint8_t denom = blackboxRateGroupDenom(group);
+        if (denom <= 1 || slot % denom == 0) {
+            groups |= BIT(group);
+        }
+    }
+    return groups;
+}
+
+static bool blackboxRateGroupDue(blackboxRateGroup_e group)
+{
+    return blackboxRateGroupsDue & BIT(group);
+}
+
+static void blackboxCarryRateGroups(uint32_t skippedGroups)
+{
+    for (unsigned i = 0; i < ARRAYLEN(blackboxRateGroupRanges); i++) {
+        const blackboxRateGroupRange_t *range = &blackboxRateGroupRanges[i];
+        if (skippedGroups & BIT(range->group)) {
+            // straight after an I-frame the two history states are the same buffer, then the second copy does nothing
+            memcpy((uint8_t *)blackboxHistory[0] + range->offset, (uint8_t *)blackboxHistory[1] + range->offset, range->size);
+            memcpy((uint8_t *)blackboxHistory[1] + range->offset, (uint8_t *)blackboxHistory[2] + range->offset, range->size);
+        }
+    }
+}
+#endif
+
 static bool isFieldEnabled(FlightLogFieldSelect_e field)
 {
     return (blackboxConfig()->fields_disabled_mask & (1 << field)) == 0;
@@ -495,6 +696,13 @@ static bool testBlackboxConditionUncached(FlightLogFieldCondition condition)
     case CONDITION(DEBUG_LOG):
         return (debugMode != DEBUG_NONE) && isFieldEnabled(FIELD_SELECT(DEBUG_LOG));
 
+    case CONDITION(LATENCY):
+#ifdef USE_LATENCY_STATS
+        return isFieldEnabled(FIELD_SELECT(LATENCY));
+#else
+        return false;
+#endif
+
     case CONDITION(NEVER):
         return false;
 
@@ -552,6 +760,132 @@ static void blackboxSetState(BlackboxState newState)
     blackboxState = newState;
 }
 
+#ifdef USE_BLACKBOX_COMPRESSION
+// Clears the fields gathered from start onwards when the P-frame being written skips their rate group
+static void blackboxSkipRateGroupFields(uint64_t *loggedFields, int start, int count, blackboxRateGroup_e group)
+{
+    if (loggedFields && !blackboxRateGroupDue(group)) {
+        for (int field = start; field < count; field++) {
+            *loggedFields &= ~(1ULL << field);
+        }
+    }
+}
+
+// The main frame fields in P-frame order, for the adaptive predictors of log data version 3
+static int blackboxGatherMainFields(const blackboxMainState_t *state, int32_t *values, uint64_t *loggedFields)
+{
+    int count = 0;
+    int start;
+
+    if (loggedFields) {
+        *loggedFields = UINT64_MAX;
+    }
+
+    values[count++] = state->time;
+
+    start = count;
+    if (testBlackboxCondition(CONDITION(PID))) {
+        for (int x = 0; x < XYZ_AXIS_COUNT; x++) {
+            values[count++] = state->axisPID_P[x];
+        }
+        for (int x = 0; x < XYZ_AXIS_COUNT; x++) {
+            values[count++] = state->axisPID_I[x];
+        }
+        for (int x = 0; x < XYZ_AXIS_COUNT; x++) {
+            if (testBlackboxCondition(CONDITION(NONZERO_PID_D_0) + x)) {
+                values[count++] = state->axisPID_D[x];
+            }
+        }
+        for (int x = 0; x < XYZ_AXIS_COUNT; x++) {
+            values[count++] = state->axisPID_F[x];
+        }
+    }
+    blackboxSkipRateGroupFields(loggedFields, start, count, BLACKBOX_RATE_GROUP_PID);
+
+    start = count;
+    if (testBlackboxCondition(CONDITION(RC_COMMANDS))) {
+        for (int x = 0; x < 4; x++) {
+            values[count++] = state->rcCommand[x];
+        }
+    }
+    blackboxSkipRateGroupFields(loggedFields, start, count, BLACKBOX_RATE_GROUP_RC_COMMANDS);
+
+    start = count;
+    if (testBlackboxCondition(CONDITION(SETPOINT))) {
+        for (int x = 0; x < 4; x++) {
+            values[count++] = state->setpoint[x];
+        }
+    }
+    blackboxSkipRateGroupFields(loggedFields, start, count, BLACKBOX_RATE_GROUP_SETPOINT);
+
+    if (testBlackboxCondition(CONDITION(VBAT))) {
+        values[count++] = state->vbatLatest;
+    }
+    if (testBlackboxCondition(CONDITION(AMPERAGE_ADC))) {
+        values[count++] = state->amperageLatest;
+    }
+#ifdef USE_MAG
+    if (testBlackboxCondition(CONDITION(MAG))) {
+        for (int x = 0; x < XYZ_AXIS_COUNT; x++) {
+            values[count++] = state->magADC[x];
+        }
+    }
+#endif
+#ifdef USE_BARO
+    if (testBlackboxCondition(CONDITION(BARO))) {
+        values[count++] = state->baroAlt;
+    }
+#endif
+#ifdef USE_RANGEFINDER
+    if (testBlackboxCondition(CONDITION(RANGEFINDER))) {
+        values[count++] = state->surfaceRaw;
+    }
+#endif
+    if (testBlackboxCondition(CONDITION(RSSI))) {
+        values[count++] = state->rssi;
+    }
+
+    start = count;
+    if (testBlackboxCondition(CONDITION(GYRO))) {
+        for (int x = 0; x < XYZ_AXIS_COUNT; x++) {
+            values[count++] = state->gyroADC[x];
+        }
+    }
+    blackboxSkipRateGroupFields(loggedFields, start, count, BLACKBOX_RATE_GROUP_GYRO);
+    if (testBlackboxCondition(CONDITION(ACC))) {
+        for (int x = 0; x < XYZ_AXIS_COUNT; x++) {
+            values[count++] = state->accADC[x];
+        }
+    }
+    start = count;
+    if (testBlackboxCondition(CONDITION(DEBUG_LOG))) {
+        for (int x = 0; x < DEBUG16_VALUE_COUNT; x++) {
+            values[count++] = state->debug[x];
+        }
+    }
+    blackboxSkipRateGroupFields(loggedFields, start, count, BLACKBOX_RATE_GROUP_DEBUG);
+#ifdef USE_LATENCY_STATS
+    if (testBlackboxCondition(CONDITION(LATENCY))) {
+        values[count++] = state->gyroLatency;
+    }
+#endif
+
+    start = count;
+    if (isFieldEnabled(FIELD_SELECT(MOTOR))) {
+        const int motorCount = getMotorCount();
+        for (int x = 0; x < motorCount; x++) {
+            values[count++] = state->motor[x];
+        }
+        if (testBlackboxCondition(FLIGHT_LOG_FIELD_CONDITION_TRICOPTER)) {
+            values[count++] = state->servo[5];
+        }
+    }
+    blackboxSkipRateGroupFields(loggedFields, start, count, BLACKBOX_RATE_GROUP_MOTOR);
+
+    return count;
+}
+#endif
+
 static void writeIntraframe(void)
 {
     blackboxMainState_t *blackboxCurrent = blackboxHistory[0];
@@ -640,6 +974,12 @@ static void writeIntraframe(void)
         blackboxWriteSigned16VBArray(blackboxCurrent->debug, DEBUG16_VALUE_COUNT);
     }
 
+#ifdef USE_LATENCY_STATS
+    if (testBlackboxCondition(CONDITION(LATENCY))) {
+        blackboxWriteUnsignedVB(blackboxCurrent->gyroLatency);
+    }
+#endif
+
     if (isFieldEnabled(FIELD_SELECT(MOTOR))) {
         //Motors can be below minimum output when disarmed, but that doesn't happen much
         blackboxWriteUnsignedVB(blackboxCurrent->motor[0] - getMotorOutputLow());
@@ -656,6 +996,13 @@ static void writeIntraframe(void)
         }
     }
 
+#ifdef USE_BLACKBOX_COMPRESSION
+    if (blackboxConfig()->compression) {
+        int32_t values[BLACKBOX_COMPRESS_MAX_FIELDS];
+        blackboxCompressWriteIntraframe(&blackboxCompressState, blackboxGatherMainFields(blackboxCurrent, values, NULL));
+    }
+#endif
+
     //Rotate our history buffers:
 
     //The current state becomes the new "before" state
@@ -682,8 +1029,41 @@ static void blackboxWriteMainStateArrayUsingAveragePredictor(int arrOffsetInHist
     }
 }
 
+#ifdef USE_BLACKBOX_COMPRESSION
+static void writeCompressedInterframe(void)
+{
+    int32_t curr[BLACKBOX_COMPRESS_MAX_FIELDS];
+    int32_t prev1[BLACKBOX_COMPRESS_MAX_FIELDS];
+    int32_t prev2[BLACKBOX_COMPRESS_MAX_FIELDS];
+    uint64_t loggedFields;
+
+    blackboxGatherMainFields(blackboxHistory[0], curr, &loggedFields);
+    blackboxGatherMainFields(blackboxHistory[1], prev1, NULL);
+    blackboxGatherMainFields(blackboxHistory[2], prev2, NULL);
+
+    blackboxWrite('P');
+    blackboxCompressWriteInterframe(&blackboxCompressState, curr, prev1, prev2, loggedFields);
+
+    //Rotate our history buffers
+    blackboxHistory[2] = blackboxHistory[1];
+    blackboxHistory[1] = blackboxHistory[0];
+    blackboxHistory[0] = ((blackboxHistory[0] - blackboxHistoryRing + 1) % 3) + blackboxHistoryRing;
+
+    blackboxLoggedAnyFrames = true;
+}
+#endif
+
 static void writeInterframe(void)
 {
+#ifdef USE_BLACKBOX_COMPRESSION
+    if (blackboxConfig()->compression) {
+        blackboxRateGroupsDue = blackboxPFrameRateGroups();
+        blackboxCarryRateGroups(~blackboxRateGroupsDue);
+        writeCompressedInterframe();
+        return;
+    }
+#endif
+
     blackboxMainState_t *blackboxCurrent = blackboxHistory[0];
     blackboxMainState_t *blackboxLast = blackboxHistory[1];
 
@@ -788,6 +1168,11 @@ static void writeInterframe(void)
     if (testBlackboxCondition(CONDITION(DEBUG_LOG))) {
         blackboxWriteMainStateArrayUsingAveragePredictor(offsetof(blackboxMainState_t, debug), DEBUG16_VALUE_COUNT);
     }
+#ifdef USE_LATENCY_STATS
+    if (testBlackboxCondition(CONDITION(LATENCY))) {
+        blackboxWriteSignedVB(blackboxCurrent->gyroLatency - blackboxLast->gyroLatency);
+    }
+#endif
 
     if (isFieldEnabled(FIELD_SELECT(MOTOR))) {
         blackboxWriteMainStateArrayUsingAveragePredictor(offsetof(blackboxMainState_t, motor),     getMotorCount());
@@ -888,6 +1273,10 @@ void blackboxValidateConfig(void)
     default:
         blackboxConfigMutable()->device = BLACKBOX_DEVICE_SERIAL;
     }
+
+    for (int group = 0; group < BLACKBOX_RATE_GROUP_COUNT; group++) {
+        blackboxConfigMutable()->rate_group_denom[group] = constrain(blackboxConfig()->rate_group_denom[group], 1, BLACKBOX_RATE_GROUP_DENOM_MAX);
+    }
 }
 
 static void blackboxResetIterationTimers(void)
@@ -917,6 +1306,10 @@ static void blackboxStart(void)
     blackboxHistory[1] = &blackboxHistoryRing[1];
     blackboxHistory[2] = &blackboxHistoryRing[2];
 
+#ifdef USE_BLACKBOX_COMPRESSION
+    blackboxCompressReset(&blackboxCompressState);
+#endif
+
     vbatReference = getBatteryVoltageLatest();
 
     //No need to clear the content of blackboxHistoryRing since our first frame will be an intra which overwrites it
@@ -931,6 +1324,9 @@ static void blackboxStart(void)
     blackboxModeActivationConditionPresent = isModeActivationConditionPresent(BOXBLACKBOX);
 
     blackboxResetIterationTimers();
+#ifdef USE_BLACKBOX_DEFERRED
+    blackboxQueueReset();
+#endif
 
     /*
      * Record the beeper's current idea of the last arming beep time, so that we can detect it changing when
@@ -942,6 +1338,10 @@ static void blackboxStart(void)
     blackboxSetState(BLACKBOX_STATE_PREPARE_LOG_FILE);
 }
 
+#ifdef USE_BLACKBOX_DEFERRED
+static void blackboxLogQueuedFrames(int maxFrames);
+#endif
+
 /**
  * Begin Blackbox shutdown.
  */
@@ -955,6 +1355,12 @@ void blackboxFinish(void)
         break;
     case BLACKBOX_STATE_RUNNING:
     case BLACKBOX_STATE_PAUSED:
+#ifdef USE_BLACKBOX_DEFERRED
+        if (blackboxDeferred) {
+            // Don't leave the last frames the PID loop queued out of the log
+            blackboxLogQueuedFrames(BLACKBOX_QUEUE_LENGTH);
+        }
+#endif
         blackboxLogEvent(FLIGHT_LOG_EVENT_LOG_END, NULL);
         FALLTHROUGH;
     default:
@@ -1056,11 +1462,8 @@ static void writeGPSFrame(timeUs_t currentTimeUs)
 /**
  * Fill the current state of the blackbox using values read from the flight controller
  */
-static void loadMainState(timeUs_t currentTimeUs)
+static void loadMainState(blackboxMainState_t *blackboxCurrent, timeUs_t currentTimeUs)
 {
-#ifndef UNIT_TEST
-    blackboxMainState_t *blackboxCurrent = blackboxHistory[0];
-
     blackboxCurrent->time = currentTimeUs;
 
     for (int i = 0; i < XYZ_AXIS_COUNT; i++) {
@@ -1092,6 +1495,10 @@ static void loadMainState(timeUs_t currentTimeUs)
         blackboxCurrent->debug[i] = debug[i];
     }
 
+#ifdef USE_LATENCY_STATS
+    blackboxCurrent->gyroLatency = latencyGetLastUs(LATENCY_STAGE_MOTOR);
+#endif
+
     const int motorCount = getMotorCount();
     for (int i = 0; i < motorCount; i++) {
         blackboxCurrent->motor[i] = lrintf(motor[i]);
@@ -1115,9 +1522,18 @@ static void loadMainState(timeUs_t currentTimeUs)
     //Tail servo for tricopters
     blackboxCurrent->servo[5] = servo[5];
 #endif
-#else
-    UNUSED(currentTimeUs);
-#endif // UNIT_TEST
+}
+
+// Load the state to log this iteration, either from the queued frame being logged or from the flight controller
+static void blackboxLoadMainState(timeUs_t currentTimeUs)
+{
+#ifdef USE_BLACKBOX_DEFERRED
+    if (blackboxDequeuedFrame) {
+        memcpy(blackboxHistory[0], &blackboxDequeuedFrame->state, sizeof(*blackboxHistory[0]));
+        return;
+    }
+#endif
+    loadMainState(blackboxHistory[0], currentTimeUs);
 }
 
 /**
@@ -1486,7 +1902,18 @@ static bool blackboxWriteSysinfo(void)
         BLACKBOX_PRINT_HEADER_LINE(PARAM_NAME_RATES_TYPE, "%d",             currentControlRateProfile->rates_type);
 
         BLACKBOX_PRINT_HEADER_LINE("fields_disabled_mask", "%d",            blackboxConfig()->fields_disabled_mask);
+#ifdef USE_BLACKBOX_COMPRESSION
+        BLACKBOX_PRINT_HEADER_LINE("rate_group_denom", "%d,%d,%d,%d,%d,%d", blackboxRateGroupDenom(BLACKBOX_RATE_GROUP_PID),
+                                                                            blackboxRateGroupDenom(BLACKBOX_RATE_GROUP_RC_COMMANDS),
+                                                                            blackboxRateGroupDenom(BLACKBOX_RATE_GROUP_SETPOINT),
+                                                                            blackboxRateGroupDenom(BLACKBOX_RATE_GROUP_GYRO),
+                                                                            blackboxRateGroupDenom(BLACKBOX_RATE_GROUP_DEBUG),
+                                                                            blackboxRateGroupDenom(BLACKBOX_RATE_GROUP_MOTOR));
+#endif
         BLACKBOX_PRINT_HEADER_LINE("blackbox_high_resolution", "%d",        blackboxConfig()->high_resolution);
+#ifdef USE_BLACKBOX_COMPRESSION
+        BLACKBOX_PRINT_HEADER_LINE("blackbox_compression", "%d",            blackboxConfig()->compression);
+#endif
 
 #ifdef USE_BATTERY_VOLTAGE_SAG_COMPENSATION
         BLACKBOX_PRINT_HEADER_LINE(PARAM_NAME_VBAT_SAG_COMPENSATION, "%d",   currentPidProfile->vbat_sag_compensation);
@@ -1570,8 +1997,10 @@ static bool blackboxWriteSysinfo(void)
     }
 
     xmitState.headerIndex++;
-#endif // UNIT_TEST
     return false;
+#else
+    return true;
+#endif // UNIT_TEST
 }
 
 /**
@@ -1703,7 +2132,7 @@ STATIC_UNIT_TESTED void blackboxLogIteration(timeUs_t currentTimeUs)
             writeSlowFrameIfNeeded();
         }
 
-        loadMainState(currentTimeUs);
+        blackboxLoadMainState(currentTimeUs);
         writeIntraframe();
     } else {
         blackboxCheckAndLogArmingBeep();
@@ -1716,7 +2145,7 @@ STATIC_UNIT_TESTED void blackboxLogIteration(timeUs_t currentTimeUs)
              */
             writeSlowFrameIfNeeded();
 
-            loadMainState(currentTimeUs);
+            blackboxLoadMainState(currentTimeUs);
             writeInterframe();
         }
 #ifdef USE_GPS
@@ -1738,10 +2167,122 @@ STATIC_UNIT_TESTED void blackboxLogIteration(timeUs_t currentTimeUs)
     blackboxDeviceFlush();
 }
 
+// Log the current iteration while the log is running or paused
+static void blackboxLogRunningIteration(timeUs_t currentTimeUs)
+{
+    if (blackboxState == BLACKBOX_STATE_PAUSED) {
+        // Only allow resume to occur during an I-frame iteration, so that we have an "I" base to work from
+        if (IS_RC_MODE_ACTIVE(BOXBLACKBOX) && blackboxShouldLogIFrame()) {
+            // Write a log entry so the decoder is aware that our large time/iteration skip is intended
+            flightLogEvent_loggingResume_t resume;
+
+            resume.logIteration = blackboxIteration;
+            resume.currentTime = currentTimeUs;
+
+            blackboxLogEvent(FLIGHT_LOG_EVENT_LOGGING_RESUME, (flightLogEventData_t *) &resume);
+            blackboxSetState(BLACKBOX_STATE_RUNNING);
+
+            blackboxLogIteration(currentTimeUs);
+        }
+    } else {
+        // On entry to this state, blackboxIteration, blackboxPFrameIndex and blackboxIFrameIndex are reset to 0
+        // Prevent the Pausing of the log on the mode switch if in Motor Test Mode
+        if (blackboxModeActivationConditionPresent && !IS_RC_MODE_ACTIVE(BOXBLACKBOX) && !startedLoggingInTestMode) {
+            blackboxSetState(BLACKBOX_STATE_PAUSED);
+        } else {
+            blackboxLogIteration(currentTimeUs);
+        }
+    }
+}
+
+#ifdef USE_BLACKBOX_DEFERRED
+// Exchange the iteration timers with the given ones
+static void blackboxSwapIterationTimers(blackboxIterationTimers_t *timers)
+{
+    const blackboxIterationTimers_t current = {
+        .iteration = blackboxIteration,
+        .loopIndex = blackboxLoopIndex,
+        .pFrameIndex = blackboxPFrameIndex,
+        .iFrameIndex = blackboxIFrameIndex,
+    };
+
+    blackboxIteration = timers->iteration;
+    blackboxLoopIndex = timers->loopIndex;
+    blackboxPFrameIndex = timers->pFrameIndex;
+    blackboxIFrameIndex = timers->iFrameIndex;
+
+    *timers = current;
+}
+
 /**
- * Call each flight loop iteration to perform blackbox logging.
+ * Log up to maxFrames of the frames the PID loop has queued, as they would have been logged on the iterations they were
+ * queued on. The rest are left for the next run so that a backlog doesn't hold up the other tasks.
  */
-void blackboxUpdate(timeUs_t currentTimeUs)
+static void blackboxLogQueuedFrames(int maxFrames)
+{
+    blackboxQueuedFrame_t *frame;
+
+    while (maxFrames-- > 0 && (blackboxState == BLACKBOX_STATE_RUNNING || blackboxState == BLACKBOX_STATE_PAUSED) && (frame = blackboxQueuePeek())) {
+        // The frame writers read the iteration timers, so give them the ones from when the frame was queued
+        blackboxSwapIterationTimers(&frame->timers);
+        blackboxDequeuedFrame = frame;
+
+        if (frame->resume && blackboxState == BLACKBOX_STATE_RUNNING) {
+            // Frames were dropped before this I-frame, mark the gap as intended like we do when the log is resumed
+            flightLogEvent_loggingResume_t resume;
+
+            resume.logIteration = blackboxIteration;
+            resume.currentTime = frame->state.time;
+
+            blackboxLogEvent(FLIGHT_LOG_EVENT_LOGGING_RESUME, (flightLogEventData_t *) &resume);
+        }
+        blackboxLogRunningIteration(frame->state.time);
+
+        blackboxDequeuedFrame = NULL;
+        blackboxSwapIterationTimers(&frame->timers);
+        blackboxQueueRelease();
+    }
+}
+
+/**
+ * Snapshot the main state into the queue for TASK_BLACKBOX if a main frame is due on this iteration. With
+ * blackbox_deferred on, this is all the logging the PID loop does.
+ */
+static void blackboxQueueIteration(timeUs_t currentTimeUs)
+{
+    if (blackboxState != BLACKBOX_STATE_RUNNING && blackboxState != BLACKBOX_STATE_PAUSED) {
+        return;
+    }
+
+    if (blackboxShouldLogIFrame() || blackboxShouldLogPFrame()) {
+        blackboxQueuedFrame_t *frame = NULL;
+
+        // After a frame is dropped the log can only pick up again from an I-frame
+        if (!blackboxQueue.resync || blackboxShouldLogIFrame()) {
+            frame = blackboxQueueReserve();
+        }
+
+        if (frame) {
+            loadMainState(&frame->state, currentTimeUs);
+            frame->timers.iteration = blackboxIteration;
+            frame->timers.loopIndex = blackboxLoopIndex;
+            frame->timers.pFrameIndex = blackboxPFrameIndex;
+            frame->timers.iFrameIndex = blackboxIFrameIndex;
+            frame->resume = blackboxQueue.resync;
+            blackboxQueueCommit();
+
+            blackboxQueue.resync = false;
+        } else {
+            blackboxQueue.overflows++;
+            blackboxQueue.resync = true;
+        }
+    }
+
+    blackboxAdvanceIterationTimers();
+}
+#endif // USE_BLACKBOX_DEFERRED
+
+static void blackboxUpdateState(timeUs_t currentTimeUs)
 {
     static BlackboxState cacheFlushNextState;
 
@@ -1772,11 +2313,17 @@ void blackboxUpdate(timeUs_t currentTimeUs)
          */
         if (millis() > xmitState.u.startTime + 100) {
             if (blackboxDeviceReserveBufferSpace(BLACKBOX_TARGET_HEADER_BUDGET_PER_ITERATION) == BLACKBOX_RESERVE_SUCCESS) {
-                for (int i = 0; i < BLACKBOX_TARGET_HEADER_BUDGET_PER_ITERATION && blackboxHeader[xmitState.headerIndex] != '\0'; i++, xmitState.headerIndex++) {
-                    blackboxWrite(blackboxHeader[xmitState.headerIndex]);
+                const char *header = blackboxHeader;
+#ifdef USE_BLACKBOX_COMPRESSION
+                if (blackboxConfig()->compression) {
+                    header = blackboxCompressedHeader;
+                }
+#endif
+                for (int i = 0; i < BLACKBOX_TARGET_HEADER_BUDGET_PER_ITERATION && header[xmitState.headerIndex] != '\0'; i++, xmitState.headerIndex++) {
+                    blackboxWrite(header[xmitState.headerIndex]);
                     blackboxHeaderBudget--;
                 }
-                if (blackboxHeader[xmitState.headerIndex] == '\0') {
+                if (header[xmitState.headerIndex] == '\0') {
                     blackboxSetState(BLACKBOX_STATE_SEND_MAIN_FIELD_HEADER);
                 }
             }
@@ -1844,30 +2391,15 @@ void blackboxUpdate(timeUs_t currentTimeUs)
         }
         break;
     case BLACKBOX_STATE_PAUSED:
-        // Only allow resume to occur during an I-frame iteration, so that we have an "I" base to work from
-        if (IS_RC_MODE_ACTIVE(BOXBLACKBOX) && blackboxShouldLogIFrame()) {
-            // Write a log entry so the decoder is aware that our large time/iteration skip is intended
-            flightLogEvent_loggingResume_t resume;
-
-            resume.logIteration = blackboxIteration;
-            resume.currentTime = currentTimeUs;
-
-            blackboxLogEvent(FLIGHT_LOG_EVENT_LOGGING_RESUME, (flightLogEventData_t *) &resume);
-            blackboxSetState(BLACKBOX_STATE_RUNNING);
-
-            blackboxLogIteration(currentTimeUs);
-        }
-        // Keep the logging timers ticking so our log iteration continues to advance
-        blackboxAdvanceIterationTimers();
-        break;
     case BLACKBOX_STATE_RUNNING:
-        // On entry to this state, blackboxIteration, blackboxPFrameIndex and blackboxIFrameIndex are reset to 0
-        // Prevent the Pausing of the log on the mode switch if in Motor Test Mode
-        if (blackboxModeActivationConditionPresent && !IS_RC_MODE_ACTIVE(BOXBLACKBOX) && !startedLoggingInTestMode) {
-            blackboxSetState(BLACKBOX_STATE_PAUSED);
-        } else {
-            blackboxLogIteration(currentTimeUs);
+#ifdef USE_BLACKBOX_DEFERRED
+        if (blackboxDeferred) {
+            blackboxLogQueuedFrames(BLACKBOX_QUEUE_FRAMES_PER_RUN);
+            break;
         }
+#endif
+        blackboxLogRunningIteration(currentTimeUs);
+        // Keep the logging timers ticking so our log iteration continues to advance
         blackboxAdvanceIterationTimers();
         break;
     case BLACKBOX_STATE_SHUTTING_DOWN:
@@ -1906,6 +2438,9 @@ void blackboxUpdate(timeUs_t currentTimeUs)
         break;
     }
 
+    // Hand anything written this iteration outside of a logged frame, such as headers, to the device
+    blackboxFlushFrame();
+
     // Did we run out of room on the device? Stop!
     if (isBlackboxDeviceFull()) {
 #ifdef USE_FLASHFS
@@ -1949,6 +2484,31 @@ void blackboxUpdate(timeUs_t currentTimeUs)
     }
 }
 
+/**
+ * Call each flight loop iteration to perform blackbox logging.
+ */
+void blackboxUpdate(timeUs_t currentTimeUs)
+{
+#ifdef USE_BLACKBOX_DEFERRED
+    if (blackboxDeferred) {
+        blackboxQueueIteration(currentTimeUs);
+        return;
+    }
+#endif
+    blackboxUpdateState(currentTimeUs);
+}
+
+#ifdef USE_BLACKBOX_DEFERRED
+/**
+ * Called from TASK_BLACKBOX when blackbox_deferred is on, to encode and write the frames queued by blackboxUpdate() and
+ * do everything else that blackboxUpdate() otherwise does inline.
+ */
+void blackboxTaskUpdate(timeUs_t currentTimeUs)
+{
+    blackboxUpdateState(currentTimeUs);
+}
+#endif
+
 int blackboxCalculatePDenom(int rateNum, int rateDenom)
 {
     return blackboxIInterval * rateNum / rateDenom;
@@ -1995,5 +2555,9 @@ void blackboxInit(void)
     blackboxSInterval = blackboxIInterval * 256; // S-frame is written every 256*32 = 8192ms, approx every 8 seconds
 
     blackboxHighResolutionScale = blackboxConfig()->high_resolution ? 10.0f : 1.0f;
+
+#ifdef USE_BLACKBOX_DEFERRED
+    blackboxDeferred = blackboxConfig()->deferred;
+#endif
 }
 #endif
@@ -46,6 +46,21 @@ typedef enum BlackboxSampleRate { // Sample rate is 1/(2^BlackboxSampleRate)
     BLACKBOX_RATE_16TH
 } BlackboxSampleRate_e;
 
+// Field groups that P-frames can log at a fraction of the P-frame rate
+typedef enum {
+    BLACKBOX_RATE_GROUP_PID = 0,
+    BLACKBOX_RATE_GROUP_RC_COMMANDS,
+    BLACKBOX_RATE_GROUP_SETPOINT,
+    BLACKBOX_RATE_GROUP_GYRO,
+    BLACKBOX_RATE_GROUP_DEBUG,
+    BLACKBOX_RATE_GROUP_MOTOR,
+    BLACKBOX_RATE_GROUP_COUNT
+} blackboxRateGroup_e;
+
+#define BLACKBOX_RATE_GROUP_DENOM_MAX 128
+
+#define BLACKBOX_SD_PREALLOC_MAX 2048 // MB
+
 typedef enum FlightLogEvent {
     FLIGHT_LOG_EVENT_SYNC_BEEP = 0,
     FLIGHT_LOG_EVENT_AUTOTUNE_CYCLE_START = 10,   // UNUSED
@@ -64,15 +79,28 @@ typedef struct blackboxConfig_s {
     uint8_t device;
     uint8_t mode;
     uint8_t high_resolution;
+    uint8_t compression;        // log data version 3, adaptive predictors and Rice coded P-frames
+    uint8_t rate_group_denom[BLACKBOX_RATE_GROUP_COUNT];    // log each group in 1 of this many P-frames
+    uint16_t sd_prealloc;       // MB of SD card space a log takes at a time, 0 for one supercluster
+    uint8_t deferred;           // the PID loop only queues snapshots, TASK_BLACKBOX encodes and writes them
+    uint16_t flash_erase_ahead; // flash sectors kept erased ahead of the log, 0 to only ever log onto erased flash
 } blackboxConfig_t;
 
 PG_DECLARE(blackboxConfig_t, blackboxConfig);
 
+// A main state snapshot queued by the PID loop for TASK_BLACKBOX to log
+typedef struct blackboxQueuedFrame_s blackboxQueuedFrame_t;
+
 union flightLogEventData_u;
 void blackboxLogEvent(FlightLogEvent event, union flightLogEventData_u *data);
 
 void blackboxInit(void);
 void blackboxUpdate(timeUs_t currentTimeUs);
+#ifdef USE_BLACKBOX_DEFERRED
+void blackboxTaskUpdate(timeUs_t currentTimeUs);
+uint32_t blackboxGetQueuedFrames(void);
+uint32_t blackboxGetQueueOverflows(void);
+#endif
 void blackboxSetStartDateTime(const char *dateTime, timeMs_t timeNowMs);
 int blackboxCalculatePDenom(int rateNum, int rateDenom);
 uint8_t blackboxGetRateDenom(void);
@@ -85,10 +113,18 @@ bool blackboxMayEditConfig(void);
 STATIC_UNIT_TESTED void blackboxLogIteration(timeUs_t currentTimeUs);
 STATIC_UNIT_TESTED bool blackboxShouldLogPFrame(void);
 STATIC_UNIT_TESTED bool blackboxShouldLogIFrame(void);
+STATIC_UNIT_TESTED uint32_t blackboxPFrameRateGroups(void);
 STATIC_UNIT_TESTED bool blackboxShouldLogGpsHomeFrame(void);
 STATIC_UNIT_TESTED bool writeSlowFrameIfNeeded(void);
 // Called once every FC loop in order to keep track of how many FC loop iterations have passed
 STATIC_UNIT_TESTED void blackboxAdvanceIterationTimers(void);
+#ifdef USE_BLACKBOX_DEFERRED
+STATIC_UNIT_TESTED blackboxQueuedFrame_t *blackboxQueueReserve(void);
+STATIC_UNIT_TESTED void blackboxQueueCommit(void);
+STATIC_UNIT_TESTED blackboxQueuedFrame_t *blackboxQueuePeek(void);
+STATIC_UNIT_TESTED void blackboxQueueRelease(void);
+STATIC_UNIT_TESTED void blackboxQueueReset(void);
+#endif
 extern int32_t blackboxSInterval;
 extern int32_t blackboxSlowFrameIterationTimer;
 #endif
@@ -0,0 +1,195 @@
+/*
+ * This file is part of Cleanflight and Betaflight.
+ *
+ * Cleanflight and Betaflight are free software. You can redistribute
+ * this software and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Cleanflight and Betaflight are distributed in the hope that they
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Main frame compression used by log data version 3 (blackbox_compression = ON).
+ *
+ * I-frames are written exactly as in version 2, followed by a predictor table: one BLACKBOX_COMPRESS_PREDICTOR_BITS
+ * index into blackboxCompressPredictors[] per main field, in P-frame field order. Each field's predictor is the one
+ * that gave the lowest sum of absolute residuals over the previous I-frame interval (PREVIOUS for the first interval).
+ *
+ * P-frames hold, after the 'P', one adaptive Rice code of the zigzag encoded residual from the field's predictor for
+ * each main field the frame logs. Fields of rate groups the frame skips are left out and their statistics untouched.
+ * A code is the quotient (residual >> k) in unary as 1 bits terminated by a 0 bit, then the low k bits of the
+ * residual. A quotient of BLACKBOX_COMPRESS_RICE_ESCAPE or more is sent as that many 1 bits followed by the 32 bit
+ * residual. k is the smallest value for which (riceCount << k) >= riceSum[field], where riceSum is the sum of the
+ * field's residuals (each capped to 2^BLACKBOX_COMPRESS_RICE_MAX_K) and riceCount the number of P-frames since the
+ * I-frame plus one. Both are halved whenever riceCount reaches BLACKBOX_COMPRESS_RICE_WINDOW. Bits are packed most
+ * significant first and the frame is padded with 0 bits to a whole byte.
+ *
+ * The decoder reproduces k from the residuals it has already decoded, so only the predictor table is sent explicitly
+ * and a lost P-frame can never affect anything after the next I-frame.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "platform.h"
+
+#ifdef USE_BLACKBOX_COMPRESSION
+
+#include "blackbox.h"
+#include "blackbox_compress.h"
+#include "blackbox_fielddefs.h"
+#include "blackbox_io.h"
+
+#include "common/encoding.h"
+#include "common/maths.h"
+
+const uint8_t blackboxCompressPredictors[BLACKBOX_COMPRESS_PREDICTOR_COUNT] = {
+    FLIGHT_LOG_FIELD_PREDICTOR_PREVIOUS,
+    FLIGHT_LOG_FIELD_PREDICTOR_STRAIGHT_LINE,
+    FLIGHT_LOG_FIELD_PREDICTOR_AVERAGE_2,
+};
+
+static uint32_t bitBuffer;
+static uint8_t bitCount;
+
+// Appends the low count (at most 24) bits of value
+static void writeBits(uint32_t value, unsigned count)
+{
+    bitBuffer = (bitBuffer << count) | (value & ((1U << count) - 1));
+    bitCount += count;
+
+    while (bitCount >= 8) {
+        bitCount -= 8;
+        blackboxWrite(bitBuffer >> bitCount);
+    }
+}
+
+static void flushBits(void)
+{
+    if (bitCount) {
+        writeBits(0, 8 - bitCount);
+    }
+}
+
+static void writeUnary(unsigned quotient)
+{
+    while (quotient >= 16) {
+        writeBits(0xFFFF, 16);
+        quotient -= 16;
+    }
+    // quotient 1 bits and the terminating 0
+    writeBits(((1U << quotient) - 1) << 1, quotient + 1);
+}
+
+static uint8_t riceParameter(const blackboxCompressState_t *state, int field)
+{
+    uint8_t k = 0;
+    while (k < BLACKBOX_COMPRESS_RICE_MAX_K && ((uint32_t)state->riceCount << k) < state->riceSum[field]) {
+        k++;
+    }
+    return k;
+}
+
+static void writeRice(blackboxCompressState_t *state, int field, uint32_t value)
+{
+    const uint8_t k = riceParameter(state, field);
+    const uint32_t quotient = value >> k;
+
+    if (quotient < BLACKBOX_COMPRESS_RICE_ESCAPE) {
+        writeUnary(quotient);
+        writeBits(value, k);
+    } else {
+        writeBits(0xFFFFF, BLACKBOX_COMPRESS_RICE_ESCAPE);
+        writeBits(value >> 16, 16);
+        writeBits(value, 16);
+    }
+
+    state->riceSum[field] += MIN(value, 1U << BLACKBOX_COMPRESS_RICE_MAX_K);
+}
+
+static void resetRice(blackboxCompressState_t *state)
+{
+    memset(state->riceSum, 0, sizeof(state->riceSum));
+    state->riceCount = 1;
+}
+
+void blackboxCompressReset(blackboxCompressState_t *state)
+{
+    memset(state, 0, sizeof(*state));
+    resetRice(state);
+    bitBuffer = 0;
+    bitCount = 0;
+}
+
+void blackboxCompressWriteIntraframe(blackboxCompressState_t *state, int fieldCount)
+{
+    fieldCount = MIN(fieldCount, BLACKBOX_COMPRESS_MAX_FIELDS);
+
+    if (fieldCount != state->fieldCount) {
+        // field selection changed, nothing learnt so far applies
+        memset(state->predictor, 0, sizeof(state->predictor));
+        state->fieldCount = fieldCount;
+    } else {
+        for (int field = 0; field < fieldCount; field++) {
+            const uint32_t *sums = state->residualSum[field];
+            uint8_t best = 0;
+            for (int predictor = 1; predictor < BLACKBOX_COMPRESS_PREDICTOR_COUNT; predictor++) {
+                if (sums[predictor] < sums[best]) {
+                    best = predictor;
+                }
+            }
+            state->predictor[field] = best;
+        }
+    }
+    memset(state->residualSum, 0, sizeof(state->residualSum));
+    resetRice(state);
+
+    for (int field = 0; field < fieldCount; field++) {
+        writeBits(state->predictor[field], BLACKBOX_COMPRESS_PREDICTOR_BITS);
+    }
+    flushBits();
+}
+
+void blackboxCompressWriteInterframe(blackboxCompressState_t *state, const int32_t *curr, const int32_t *prev1, const int32_t *prev2, uint64_t loggedFields)
+{
+    for (int field = 0; field < state->fieldCount; field++) {
+        if (!(loggedFields & (1ULL << field))) {
+            continue;
+        }
+
+        // wrapping arithmetic, the loop time field is unsigned
+        const uint32_t value = curr[field];
+        int32_t residuals[BLACKBOX_COMPRESS_PREDICTOR_COUNT];
+        residuals[0] = value - (uint32_t)prev1[field];
+        residuals[1] = value - (2 * (uint32_t)prev1[field] - (uint32_t)prev2[field]);
+        residuals[2] = value - (uint32_t)(int32_t)(((int64_t)prev1[field] + prev2[field]) / 2);
+
+        uint32_t *sums = state->residualSum[field];
+        for (int predictor = 0; predictor < BLACKBOX_COMPRESS_PREDICTOR_COUNT; predictor++) {
+            sums[predictor] = MIN((uint64_t)sums[predictor] + ABS((int64_t)residuals[predictor]), UINT32_MAX);
+        }
+
+        writeRice(state, field, zigzagEncode(residuals[state->predictor[field]]));
+    }
+    flushBits();
+
+    if (++state->riceCount == BLACKBOX_COMPRESS_RICE_WINDOW) {
+        for (int field = 0; field < state->fieldCount; field++) {
+            state->riceSum[field] /= 2;
+        }
+        state->riceCount /= 2;
+    }
+}
+
+#endif // USE_BLACKBOX_COMPRESSION
@@ -0,0 +1,44 @@
+/*
+ * This file is part of Cleanflight and Betaflight.
+ *
+ * Cleanflight and Betaflight are free software. You can redistribute
+ * this software and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Cleanflight and Betaflight are distributed in the hope that they
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#define BLACKBOX_COMPRESS_MAX_FIELDS        64
+#define BLACKBOX_COMPRESS_PREDICTOR_COUNT   3    // FLIGHT_LOG_FIELD_PREDICTOR_PREVIOUS, _STRAIGHT_LINE and _AVERAGE_2
+#define BLACKBOX_COMPRESS_PREDICTOR_BITS    2    // width of each entry in the predictor table following an I-frame
+#define BLACKBOX_COMPRESS_RICE_ESCAPE       20   // a unary prefix this long is followed by the raw 32 bit residual
+#define BLACKBOX_COMPRESS_RICE_MAX_K        24
+#define BLACKBOX_COMPRESS_RICE_WINDOW       32   // frames after which the Rice parameter estimates are halved
+
+typedef struct blackboxCompressState_s {
+    uint8_t fieldCount;
+    uint8_t riceCount;
+    uint8_t predictor[BLACKBOX_COMPRESS_MAX_FIELDS];        // index of the predictor in use for this I-frame interval
+    uint32_t riceSum[BLACKBOX_COMPRESS_MAX_FIELDS];
+    uint32_t residualSum[BLACKBOX_COMPRESS_MAX_FIELDS][BLACKBOX_COMPRESS_PREDICTOR_COUNT];
+} blackboxCompressState_t;
+
+extern const uint8_t blackboxCompressPredictors[BLACKBOX_COMPRESS_PREDICTOR_COUNT];
+
+void blackboxCompressReset(blackboxCompressState_t *state);
+void blackboxCompressWriteIntraframe(blackboxCompressState_t *state, int fieldCount);
+void blackboxCompressWriteInterframe(blackboxCompressState_t *state, const int32_t *curr, const int32_t *prev1, const int32_t *prev2, uint64_t loggedFields);
@@ -52,6 +52,7 @@ typedef enum FlightLogFieldCondition {
     FLIGHT_LOG_FIELD_CONDITION_GYRO,
     FLIGHT_LOG_FIELD_CONDITION_ACC,
     FLIGHT_LOG_FIELD_CONDITION_DEBUG_LOG,
+    FLIGHT_LOG_FIELD_CONDITION_LATENCY,
 
     FLIGHT_LOG_FIELD_CONDITION_NEVER,
 
@@ -72,6 +73,7 @@ typedef enum FlightLogFieldSelect_e { // no more than 32
     FLIGHT_LOG_FIELD_SELECT_DEBUG_LOG,
     FLIGHT_LOG_FIELD_SELECT_MOTOR,
     FLIGHT_LOG_FIELD_SELECT_GPS,
+    FLIGHT_LOG_FIELD_SELECT_LATENCY,
     FLIGHT_LOG_FIELD_SELECT_COUNT
 } FlightLogFieldSelect_e;
 
@@ -45,7 +45,12 @@
 #include "blackbox.h"
 #include "blackbox_io.h"
 
+#include "build/version.h"
+
 #include "common/maths.h"
+#include "common/time.h"
+
+#include "config/config.h"
 
 #include "flight/pid.h"
 
@@ -108,41 +113,45 @@ static uint16_t bbRateMax;
 static uint32_t bbDrops;
 #endif
 
-void blackboxWrite(uint8_t value)
+uint8_t blackboxFrameBuffer[BLACKBOX_FRAME_BUFFER_SIZE];
+uint16_t blackboxFrameBufferLength;
+
+// Hand data to the device in a single write
+static void blackboxDeviceWrite(const uint8_t *data, int length)
 {
 #ifdef DEBUG_BB_OUTPUT
-    bbBits += 8;
+    bbBits += length * 8;
 #endif
 
     switch (blackboxConfig()->device) {
 #ifdef USE_FLASHFS
     case BLACKBOX_DEVICE_FLASH:
-        flashfsWriteByte(value); // Write byte asynchronously
+        flashfsWrite(data, length, false); // Write asynchronously
         break;
 #endif
 #ifdef USE_SDCARD
     case BLACKBOX_DEVICE_SDCARD:
-        afatfs_fputc(blackboxSDCard.logFile, value);
+        afatfs_fwrite(blackboxSDCard.logFile, data, length); // Ignore failures due to buffers filling up
         break;
 #endif
     case BLACKBOX_DEVICE_SERIAL:
     default:
         {
-            int txBytesFree = serialTxBytesFree(blackboxPort);
+            const uint32_t txBytesFree = serialTxBytesFree(blackboxPort);
+            const int txLength = MIN((uint32_t)length, txBytesFree);
 
 #ifdef DEBUG_BB_OUTPUT
-            bbBits += 2;
+            bbBits += length * 2;
             DEBUG_SET(DEBUG_BLACKBOX_OUTPUT, 3, txBytesFree);
-#endif
 
-            if (txBytesFree == 0) {
-#ifdef DEBUG_BB_OUTPUT
-                ++bbDrops;
+            if (txLength < length) {
+                bbDrops += length - txLength;
                 DEBUG_SET(DEBUG_BLACKBOX_OUTPUT, 2, bbDrops);
+            }
 #endif
-                return;
+            if (txLength > 0) {
+                serialWriteBuf(blackboxPort, data, txLength);
             }
-            serialWrite(blackboxPort, value);
         }
         break;
     }
@@ -163,39 +172,37 @@ void blackboxWrite(uint8_t value)
 #endif
 }
 
-// Print the null-terminated string 's' to the blackbox device and return the number of bytes written
-int blackboxWriteString(const char *s)
+/**
+ * Write the bytes staged in the frame buffer to the blackbox device.
+ */
+void blackboxFlushFrame(void)
 {
-    int length;
-    const uint8_t *pos;
-
-    switch (blackboxConfig()->device) {
+    if (blackboxFrameBufferLength) {
+        blackboxDeviceWrite(blackboxFrameBuffer, blackboxFrameBufferLength);
+        blackboxFrameBufferLength = 0;
+    }
+}
 
-#ifdef USE_FLASHFS
-    case BLACKBOX_DEVICE_FLASH:
-        length = strlen(s);
-        flashfsWrite((const uint8_t*) s, length, false); // Write asynchronously
-        break;
-#endif // USE_FLASHFS
+void blackboxWriteBuf(const uint8_t *data, int length)
+{
+    if (blackboxFrameBufferLength + length > BLACKBOX_FRAME_BUFFER_SIZE) {
+        blackboxFlushFrame();
+        if (length > BLACKBOX_FRAME_BUFFER_SIZE) {
+            blackboxDeviceWrite(data, length);
+            return;
+        }
+    }
 
-#ifdef USE_SDCARD
-    case BLACKBOX_DEVICE_SDCARD:
-        length = strlen(s);
-        afatfs_fwrite(blackboxSDCard.logFile, (const uint8_t*) s, length); // Ignore failures due to buffers filling up
-        break;
-#endif // USE_SDCARD
+    memcpy(&blackboxFrameBuffer[blackboxFrameBufferLength], data, length);
+    blackboxFrameBufferLength += length;
+}
 
-    case BLACKBOX_DEVICE_SERIAL:
-    default:
-        pos = (uint8_t*) s;
-        while (*pos) {
-            blackboxWrite(*pos);
-            pos++;
-        }
+// Print the null-terminated string 's' to the blackbox device and return the number of bytes written
+int blackboxWriteString(const char *s)
+{
+    const int length = strlen(s);
 
-        length = pos - (uint8_t*) s;
-        break;
-    }
+    blackboxWriteBuf((const uint8_t *)s, length);
 
     return length;
 }
@@ -207,6 +214,8 @@ int blackboxWriteString(const char *s)
  */
 void blackboxDeviceFlush(void)
 {
+    blackboxFlushFrame();
+
     switch (blackboxConfig()->device) {
 #ifdef USE_FLASHFS
         /*
@@ -230,6 +239,8 @@ void blackboxDeviceFlush(void)
  */
 bool blackboxDeviceFlushForce(void)
 {
+    blackboxFlushFrame();
+
     switch (blackboxConfig()->device) {
     case BLACKBOX_DEVICE_SERIAL:
         // Nothing to speed up flushing on serial, as serial is continuously being drained out of its buffer
@@ -259,6 +270,8 @@ bool blackboxDeviceFlushForce(void)
 // Primarily to ensure the async operations of SD card sector writes complete thus freeing the cache entries.
 bool blackboxDeviceFlushForceComplete(void)
 {
+    blackboxFlushFrame();
+
     switch (blackboxConfig()->device) {
 #ifdef USE_SDCARD
     case BLACKBOX_DEVICE_SDCARD:
@@ -280,6 +293,8 @@ bool blackboxDeviceFlushForceComplete(void)
  */
 bool blackboxDeviceOpen(void)
 {
+    blackboxFrameBufferLength = 0;
+
     switch (blackboxConfig()->device) {
     case BLACKBOX_DEVICE_SERIAL:
         {
@@ -366,6 +381,26 @@ bool blackboxDeviceOpen(void)
     }
 }
 
+#ifdef USE_FLASHFS
+// Start an entry for the new log in the flash log index
+static void blackboxFlashBeginLog(void)
+{
+    flashfsLogEntry_t entry;
+    memset(&entry, 0, sizeof(entry));
+
+#ifdef USE_RTC_TIME
+    rtcTime_t now;
+    if (rtcGet(&now)) {
+        entry.timestamp = rtcTimeGetSeconds(&now);
+    }
+#endif
+    strncpy(entry.firmwareRevision, shortGitRevision, sizeof(entry.firmwareRevision));
+    strncpy(entry.craftName, pilotConfig()->craftName, sizeof(entry.craftName));
+
+    flashfsLogBegin(&entry);
+}
+#endif
+
 /**
  * Erase all blackbox logs
  */
@@ -409,6 +444,8 @@ bool isBlackboxErased(void)
  */
 void blackboxDeviceClose(void)
 {
+    blackboxFlushFrame();
+
     switch (blackboxConfig()->device) {
     case BLACKBOX_DEVICE_SERIAL:
         // Can immediately close without attempting to flush any remaining data.
@@ -426,6 +463,7 @@ void blackboxDeviceClose(void)
         break;
 #ifdef USE_FLASHFS
     case BLACKBOX_DEVICE_FLASH:
+        flashfsLogEnd();
         // Some flash device, e.g., NAND devices, require explicit close to flush internally buffered data.
         flashfsClose();
         break;
@@ -456,6 +494,9 @@ static void blackboxLogFileCreated(afatfsFilePtr_t file)
     if (file) {
         blackboxSDCard.logFile = file;
 
+        // Take the card space for the log in large extents, so the FAT isn't updated in the middle of the flight
+        afatfs_fpreallocate(file, (uint32_t)blackboxConfig()->sd_prealloc * 1024 * 1024);
+
         blackboxSDCard.largestLogFileNumber++;
 
         blackboxSDCard.state = BLACKBOX_SDCARD_READY_TO_LOG;
@@ -561,6 +602,11 @@ static bool blackboxSDCardBeginLog(void)
 bool blackboxDeviceBeginLog(void)
 {
     switch (blackboxConfig()->device) {
+#ifdef USE_FLASHFS
+    case BLACKBOX_DEVICE_FLASH:
+        blackboxFlashBeginLog();
+        return true;
+#endif // USE_FLASHFS
 #ifdef USE_SDCARD
     case BLACKBOX_DEVICE_SDCARD:
         return blackboxSDCardBeginLog();
@@ -584,6 +630,8 @@ bool blackboxDeviceEndLog(bool retainLog)
     UNUSED(retainLog);
 #endif
 
+    blackboxFlushFrame();
+
     switch (blackboxConfig()->device) {
 #ifdef USE_SDCARD
     case BLACKBOX_DEVICE_SDCARD:
@@ -667,6 +715,8 @@ void blackboxReplenishHeaderBudget(void)
 {
     int32_t freeSpace;
 
+    blackboxFlushFrame();
+
     switch (blackboxConfig()->device) {
     case BLACKBOX_DEVICE_SERIAL:
         freeSpace = serialTxBytesFree(blackboxPort);
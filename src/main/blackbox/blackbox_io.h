@@ -20,6 +20,8 @@
 
 #pragma once
 
+#include <stdint.h>
+
 typedef enum {
     BLACKBOX_RESERVE_SUCCESS,
     BLACKBOX_RESERVE_TEMPORARY_FAILURE,
@@ -38,12 +40,30 @@ typedef enum {
  */
 #define BLACKBOX_TARGET_HEADER_BUDGET_PER_ITERATION 64
 
+/*
+ * Encoded bytes are staged in the frame buffer and handed to the device in a single write once the frame is complete
+ * (or the buffer fills), rather than dispatching to the device a byte at a time.
+ */
+#define BLACKBOX_FRAME_BUFFER_SIZE 256
+
 extern int32_t blackboxHeaderBudget;
 
+extern uint8_t blackboxFrameBuffer[BLACKBOX_FRAME_BUFFER_SIZE];
+extern uint16_t blackboxFrameBufferLength;
+
 void blackboxOpen(void);
-void blackboxWrite(uint8_t value);
+void blackboxFlushFrame(void);
+void blackboxWriteBuf(const uint8_t *data, int length);
 int blackboxWriteString(const char *s);
 
+static inline void blackboxWrite(uint8_t value)
+{
+    if (blackboxFrameBufferLength >= BLACKBOX_FRAME_BUFFER_SIZE) {
+        blackboxFlushFrame();
+    }
+    blackboxFrameBuffer[blackboxFrameBufferLength++] = value;
+}
+
 void blackboxDeviceFlush(void);
 bool blackboxDeviceFlushForce(void);
 bool blackboxDeviceFlushForceComplete(void);
@@ -0,0 +1,141 @@
+/*
+ * This file is part of Cleanflight and Betaflight.
+ *
+ * Cleanflight and Betaflight are free software. You can redistribute
+ * this software and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Cleanflight and Betaflight are distributed in the hope that they
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+#include "platform.h"
+
+#ifdef USE_BENCHMARK
+
+#include "build/version.h"
+
+#include "common/maths.h"
+#include "common/printf.h"
+#include "common/utils.h"
+
+#include "drivers/system.h"
+
+#include "benchmark.h"
+
+#ifdef SIMULATOR_BUILD
+// The SITL cycle counter counts microseconds, see getCycleCounter(), so the host
+// times batches of calls with the monotonic clock and reports nanoseconds per call
+#define BENCHMARK_BATCH 64
+
+const char * const benchmarkUnit = "ns";
+
+static uint32_t benchmarkTicks(void)
+{
+    return nanos64_real();
+}
+#else
+#define BENCHMARK_BATCH 1
+
+const char * const benchmarkUnit = "cycles";
+
+static uint32_t benchmarkTicks(void)
+{
+    return getCycleCounter();
+}
+#endif
+
+static void benchmarkEmpty(void)
+{
+}
+
+// Not inlined, so that every kernel is called through the same pointer as the empty one
+static NOINLINE uint32_t benchmarkSample(void (*run)(void))
+{
+    const uint32_t startTicks = benchmarkTicks();
+    for (int i = 0; i < BENCHMARK_BATCH; i++) {
+        run();
+    }
+    return benchmarkTicks() - startTicks;
+}
+
+void benchmarkMeasure(const benchmarkKernel_t *kernel, benchmarkResult_t *result)
+{
+    uint32_t samples[BENCHMARK_SAMPLES];
+
+    // reading the counter and the call itself are not part of the kernel
+    uint32_t overhead = UINT32_MAX;
+    for (int i = 0; i < BENCHMARK_SAMPLES; i++) {
+        overhead = MIN(overhead, benchmarkSample(benchmarkEmpty));
+    }
+
+    if (kernel->init) {
+        kernel->init();
+    }
+    for (int i = 0; i < BENCHMARK_WARMUP; i++) {
+        kernel->run();
+    }
+
+    for (int i = 0; i < BENCHMARK_SAMPLES; i++) {
+        const uint32_t ticks = benchmarkSample(kernel->run);
+        const uint32_t sample = ticks > overhead ? (ticks - overhead + BENCHMARK_BATCH / 2) / BENCHMARK_BATCH : 0;
+
+        // insertion sort, most samples are equal or close
+        int j = i;
+        for (; j > 0 && samples[j - 1] > sample; j--) {
+            samples[j] = samples[j - 1];
+        }
+        samples[j] = sample;
+    }
+
+    result->min = samples[0];
+    result->median = samples[BENCHMARK_SAMPLES / 2];
+    result->max = samples[BENCHMARK_SAMPLES - 1];
+}
+
+// Times every kernel whose name starts with prefix, all of them for an empty prefix. The lines
+// are meant to be kept and compared across builds, so the layout must not change:
+//   # benchmark <target> <version> <git revision> <unit> <samples> samples
+//   #     min   median      max  kernel
+//          24       25       61  biquadFilterApply
+unsigned benchmarkRun(const char *prefix, benchmarkPrintFn *printLine)
+{
+    char line[80];
+    const size_t prefixLength = strlen(prefix);
+
+    tfp_sprintf(line, "# benchmark %s %s %s %s %d samples", targetName, FC_VERSION_STRING, shortGitRevision, benchmarkUnit, BENCHMARK_SAMPLES);
+    printLine(line);
+    printLine("#     min   median      max  kernel");
+
+    unsigned count = 0;
+    for (unsigned i = 0; i < benchmarkKernelCount; i++) {
+        const benchmarkKernel_t *kernel = &benchmarkKernels[i];
+        if (strncasecmp(kernel->name, prefix, prefixLength) != 0) {
+            continue;
+        }
+
+        benchmarkResult_t result;
+        benchmarkMeasure(kernel, &result);
+        tfp_sprintf(line, "%9u %8u %8u  %s", result.min, result.median, result.max, kernel->name);
+        printLine(line);
+        count++;
+    }
+
+    return count;
+}
+
+#endif // USE_BENCHMARK
@@ -0,0 +1,49 @@
+/*
+ * This file is part of Cleanflight and Betaflight.
+ *
+ * Cleanflight and Betaflight are free software. You can redistribute
+ * this software and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Cleanflight and Betaflight are distributed in the hope that they
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#define BENCHMARK_SAMPLES   101     // odd, so the median is a sample
+#define BENCHMARK_WARMUP    8       // untimed calls before sampling, to fill caches and settle the kernel state
+
+typedef struct benchmarkKernel_s {
+    const char *name;
+    void (*init)(void);             // prepares the inputs and state of the kernel, not timed, may be NULL
+    void (*run)(void);              // one call of the kernel
+} benchmarkKernel_t;
+
+typedef struct benchmarkResult_s {
+    uint32_t min;                   // per call, in cycles or nanoseconds on the host, see benchmarkUnit
+    uint32_t median;
+    uint32_t max;
+} benchmarkResult_t;
+
+typedef void benchmarkPrintFn(const char *line);
+
+extern const char * const benchmarkUnit;
+
+// The hot path kernels, see benchmark_kernels.c
+extern const benchmarkKernel_t benchmarkKernels[];
+extern const unsigned benchmarkKernelCount;
+
+void benchmarkMeasure(const benchmarkKernel_t *kernel, benchmarkResult_t *result);
+unsigned benchmarkRun(const char *prefix, benchmarkPrintFn *printLine);
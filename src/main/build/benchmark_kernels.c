@@ -0,0 +1,572 @@
+/*
+ * This file is part of Cleanflight and Betaflight.
+ *
+ * Cleanflight and Betaflight are free software. You can redistribute
+ * this software and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Cleanflight and Betaflight are distributed in the hope that they
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "platform.h"
+
+#ifdef USE_BENCHMARK
+
+#include "blackbox/blackbox_compress.h"
+#include "blackbox/blackbox_encoding.h"
+#include "blackbox/blackbox_io.h"
+
+#include "build/benchmark.h"
+
+#include "common/axis.h"
+#include "common/crc.h"
+#include "common/filter.h"
+#include "common/filter_chain.h"
+#include "common/filter_fixed.h"
+#include "common/maths.h"
+#include "common/notch_bank.h"
+#include "common/sdft.h"
+#include "common/utils.h"
+
+#include "config/config.h"
+
+#include "drivers/dshot.h"
+#include "drivers/dshot_bitbang_decode.h"
+#include "drivers/time.h"
+
+#include "flight/imu.h"
+#include "flight/mixer.h"
+#include "flight/pid.h"
+
+// Kernels are fed from a fixed pseudo random sequence, so every build times the same work
+#define BENCHMARK_INPUT_COUNT       64      // power of two
+#define BENCHMARK_LOOPTIME_US       125
+#define BENCHMARK_CRC_BYTES         64      // about the longest CRSF and MSP frames
+#define BENCHMARK_BLACKBOX_FIELDS   8
+#define BENCHMARK_BB_SAMPLES        140     // DSHOT_BB_PORT_IP_BUF_LENGTH
+#define BENCHMARK_BB_PIN            3
+#define BENCHMARK_RPM_NOTCHES       24      // 8 motors with 3 harmonics, as many as the RPM filter uses
+
+static float input[BENCHMARK_INPUT_COUNT];
+static int32_t residual[BENCHMARK_INPUT_COUNT];
+static unsigned inputIndex;
+static volatile float floatSink;
+static volatile uint32_t intSink;
+
+// Only one kernel runs at a time, they share the memory for their state
+static union {
+    biquadFilter_t biquad;
+    pt1Filter_t pt1;
+    pt2Filter_t pt2;
+    pt3Filter_t pt3;
+    filterChain_t filterChain;
+    struct {
+        filterApplyFnPtr notchApplyFn;
+        biquadFilter_t notch[2][XYZ_AXIS_COUNT];
+        filterApplyFnPtr lowpassApplyFn;
+        pt1Filter_t lowpass[XYZ_AXIS_COUNT];
+    } filterCascade;
+    notchBank_t notchBank;
+    biquadFilter_t notches[XYZ_AXIS_COUNT][BENCHMARK_RPM_NOTCHES];
+#ifdef USE_FIXED_POINT_FILTERS
+    pt1FilterFixed_t pt1Fixed;
+    biquadFilterFixed_t biquadFixed;
+#endif
+    struct {
+        sdft_t sdft[XYZ_AXIS_COUNT];
+        float output[SDFT_BIN_COUNT];
+        int batchIdx;
+    } sdft;
+    uint8_t crc[BENCHMARK_CRC_BYTES];
+#ifdef USE_BLACKBOX_COMPRESSION
+    struct {
+        blackboxCompressState_t compress;
+        int32_t frames[3][BENCHMARK_BLACKBOX_FIELDS];
+    } blackbox;
+#endif
+#ifdef USE_DSHOT
+    dshotProtocolControl_t dshot;
+#endif
+#if defined(USE_DSHOT_BITBANG) && defined(USE_DSHOT_TELEMETRY)
+    uint16_t bbBuffer[BENCHMARK_BB_SAMPLES];
+#endif
+} state;
+
+static void initInput(void)
+{
+    uint32_t seed = 1;
+    for (int i = 0; i < BENCHMARK_INPUT_COUNT; i++) {
+        // xorshift32
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        const float noise = (int32_t)seed * (1.0f / INT32_MAX);
+        input[i] = 200.0f * sin_approx(2.0f * M_PIf * i / BENCHMARK_INPUT_COUNT) + 20.0f * noise;
+        residual[i] = lrintf(40.0f * noise);
+    }
+    inputIndex = 0;
+}
+
+static float nextInput(void)
+{
+    inputIndex = (inputIndex + 1) & (BENCHMARK_INPUT_COUNT - 1);
+    return input[inputIndex];
+}
+
+static int32_t *nextResiduals(void)
+{
+    // both are powers of two, so this keeps a whole frame of fields in the table
+    inputIndex = (inputIndex + BENCHMARK_BLACKBOX_FIELDS) & (BENCHMARK_INPUT_COUNT - BENCHMARK_BLACKBOX_FIELDS);
+    return &residual[inputIndex];
+}
+
+// Filters, at the gyro loop rate with typical cutoffs
+
+static void initBiquad(void)
+{
+    initInput();
+    biquadFilterInit(&state.biquad, 200, BENCHMARK_LOOPTIME_US, filterGetNotchQ(200, 160), FILTER_NOTCH, 0.8f);
+}
+
+static void runBiquadFilterApply(void)
+{
+    floatSink = biquadFilterApply(&state.biquad, nextInput());
+}
+
+static void runBiquadFilterApplyDF1(void)
+{
+    floatSink = biquadFilterApplyDF1(&state.biquad, nextInput());
+}
+
+static void runBiquadFilterApplyDF1Weighted(void)
+{
+    floatSink = biquadFilterApplyDF1Weighted(&state.biquad, nextInput());
+}
+
+static void initPt1(void)
+{
+    initInput();
+    pt1FilterInit(&state.pt1, pt1FilterGain(250, BENCHMARK_LOOPTIME_US * 1e-6f));
+}
+
+static void runPt1FilterApply(void)
+{
+    floatSink = pt1FilterApply(&state.pt1, nextInput());
+}
+
+static void initPt2(void)
+{
+    initInput();
+    pt2FilterInit(&state.pt2, pt2FilterGain(250, BENCHMARK_LOOPTIME_US * 1e-6f));
+}
+
+static void runPt2FilterApply(void)
+{
+    floatSink = pt2FilterApply(&state.pt2, nextInput());
+}
+
+static void initPt3(void)
+{
+    initInput();
+    pt3FilterInit(&state.pt3, pt3FilterGain(250, BENCHMARK_LOOPTIME_US * 1e-6f));
+}
+
+static void runPt3FilterApply(void)
+{
+    floatSink = pt3FilterApply(&state.pt3, nextInput());
+}
+
+#ifdef USE_FIXED_POINT_FILTERS
+static void initPt1Fixed(void)
+{
+    initInput();
+    pt1FilterFixedInit(&state.pt1Fixed, pt1FilterGain(250, BENCHMARK_LOOPTIME_US * 1e-6f));
+}
+
+static void runPt1FilterFixedApply(void)
+{
+    intSink = pt1FilterFixedApply(&state.pt1Fixed, fixedFromFloat(nextInput()));
+}
+
+static void initBiquadFixed(void)
+{
+    biquadFilter_t coefficients;
+
+    initInput();
+    biquadFilterInit(&coefficients, 200, BENCHMARK_LOOPTIME_US, filterGetNotchQ(200, 160), FILTER_NOTCH, 1.0f);
+    biquadFilterFixedInit(&state.biquadFixed, &coefficients);
+}
+
+static void runBiquadFilterFixedApplyDF1(void)
+{
+    intSink = biquadFilterFixedApplyDF1(&state.biquadFixed, fixedFromFloat(nextInput()));
+}
+#endif
+
+// Static gyro filter chain of two notches and a PT1, against the function pointer cascade per axis
+// that gyroFilter() runs without it
+
+static const float chainNotchHz[2] = { 260.0f, 190.0f };
+
+static void initFilterChain(void)
+{
+    initInput();
+    filterChainInit(&state.filterChain);
+    for (int i = 0; i < 2; i++) {
+        filterChainAddNotch(&state.filterChain, chainNotchHz[i], filterGetNotchQ(chainNotchHz[i], chainNotchHz[i] * 0.7f), BENCHMARK_LOOPTIME_US);
+    }
+    filterChainSetLowpass(&state.filterChain, FILTER_CHAIN_LPF_PT1);
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        pt1FilterInit(&state.filterChain.lowpass[axis].pt1, pt1FilterGain(250, BENCHMARK_LOOPTIME_US * 1e-6f));
+    }
+}
+
+static void runFilterChainApply(void)
+{
+    float values[XYZ_AXIS_COUNT] = { nextInput(), nextInput(), nextInput() };
+    filterChainApply(&state.filterChain, values);
+    floatSink = values[FD_ROLL] + values[FD_PITCH] + values[FD_YAW];
+}
+
+static void initFilterCascade(void)
+{
+    initInput();
+    state.filterCascade.notchApplyFn = (filterApplyFnPtr)biquadFilterApply;
+    state.filterCascade.lowpassApplyFn = (filterApplyFnPtr)pt1FilterApply;
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        for (int i = 0; i < 2; i++) {
+            biquadFilterInit(&state.filterCascade.notch[i][axis], chainNotchHz[i], BENCHMARK_LOOPTIME_US,
+                filterGetNotchQ(chainNotchHz[i], chainNotchHz[i] * 0.7f), FILTER_NOTCH, 1.0f);
+        }
+        pt1FilterInit(&state.filterCascade.lowpass[axis], pt1FilterGain(250, BENCHMARK_LOOPTIME_US * 1e-6f));
+    }
+}
+
+static void runFilterCascadeApply(void)
+{
+    float sum = 0.0f;
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        float value = nextInput();
+        for (int i = 0; i < 2; i++) {
+            value = state.filterCascade.notchApplyFn((filter_t *)&state.filterCascade.notch[i][axis], value);
+        }
+        sum += state.filterCascade.lowpassApplyFn((filter_t *)&state.filterCascade.lowpass[axis], value);
+    }
+    floatSink = sum;
+}
+
+// RPM notches of an 8 motor craft on all axes, the notch bank against the per axis cascade of
+// biquadFilterApplyDF1Weighted() that rpmFilterApply() used before it
+
+static float rpmNotchHz(int notch)
+{
+    return 100.0f + 23.0f * notch;
+}
+
+static void initNotchBank(void)
+{
+    initInput();
+    notchBankInit(&state.notchBank, BENCHMARK_RPM_NOTCHES);
+    for (int i = 0; i < BENCHMARK_RPM_NOTCHES; i++) {
+        notchBankUpdate(&state.notchBank, i, rpmNotchHz(i), BENCHMARK_LOOPTIME_US, 5.0f, 1.0f);
+    }
+}
+
+static void runNotchBankApply(void)
+{
+    float values[XYZ_AXIS_COUNT] = { nextInput(), nextInput(), nextInput() };
+    notchBankApply(&state.notchBank, values);
+    floatSink = values[FD_ROLL] + values[FD_PITCH] + values[FD_YAW];
+}
+
+static void initNotchCascade(void)
+{
+    initInput();
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        for (int i = 0; i < BENCHMARK_RPM_NOTCHES; i++) {
+            biquadFilterInit(&state.notches[axis][i], rpmNotchHz(i), BENCHMARK_LOOPTIME_US, 5.0f, FILTER_NOTCH, 1.0f);
+        }
+    }
+}
+
+static void runNotchCascadeApply(void)
+{
+    float sum = 0.0f;
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        float value = nextInput();
+        for (int i = 0; i < BENCHMARK_RPM_NOTCHES; i++) {
+            value = biquadFilterApplyDF1Weighted(&state.notches[axis][i], value);
+        }
+        sum += value;
+    }
+    floatSink = sum;
+}
+
+// Spectrum of the dynamic notch, 3 batches per sample as in dynNotchPush()
+
+static void initSdft(void)
+{
+    initInput();
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        sdftInit(&state.sdft.sdft[axis], 1, SDFT_BIN_COUNT - 1, 3);
+    }
+    state.sdft.batchIdx = 0;
+}
+
+static void nextBatch(void)
+{
+    state.sdft.batchIdx = (state.sdft.batchIdx + 1) % 3;
+}
+
+static void runSdftPushBatch(void)
+{
+    sdftPushBatch(&state.sdft.sdft[0], nextInput(), state.sdft.batchIdx);
+    nextBatch();
+}
+
+static void runSdftPushBatchAxes(void)
+{
+    const float samples[XYZ_AXIS_COUNT] = { nextInput(), nextInput(), nextInput() };
+    sdftPushBatchAxes(state.sdft.sdft, samples, state.sdft.batchIdx);
+    nextBatch();
+}
+
+static void initSdftWinSq(void)
+{
+    initSdft();
+    for (int i = 0; i < SDFT_SAMPLE_SIZE * 3; i++) {
+        runSdftPushBatch();
+    }
+}
+
+static void runSdftWinSq(void)
+{
+    sdftWinSq(&state.sdft.sdft[0], state.sdft.output);
+}
+
+// Flight control, on the live configuration and state, which is why the CLI only runs them disarmed
+
+static void runPidController(void)
+{
+    pidController(currentPidProfile, micros());
+}
+
+static void runMixTable(void)
+{
+    mixTable(micros());
+}
+
+#ifdef USE_ACC
+static void runImuMahonyAHRSupdate(void)
+{
+    // at rest, with gravity where the attitude estimate has it, so that the estimate stays put
+    imuMahonyAHRSupdate(0.001f, 0.0f, 0.0f, 0.0f, true, rMat[2][0], rMat[2][1], rMat[2][2], false, false, 0.0f, 0.25f);
+}
+#endif
+
+// Blackbox, into the frame buffer, which is discarded every time before it fills
+
+#ifdef USE_BLACKBOX
+static void runBlackboxWriteSignedVBArray(void)
+{
+    blackboxFrameBufferLength = 0;
+    blackboxWriteSignedVBArray(nextResiduals(), BENCHMARK_BLACKBOX_FIELDS);
+}
+
+static void runBlackboxWriteTag2_3S32(void)
+{
+    blackboxFrameBufferLength = 0;
+    blackboxWriteTag2_3S32(nextResiduals());
+}
+
+static void runBlackboxWriteTag8_4S16(void)
+{
+    blackboxFrameBufferLength = 0;
+    blackboxWriteTag8_4S16(nextResiduals());
+}
+
+static void runBlackboxWriteTag8_8SVB(void)
+{
+    blackboxFrameBufferLength = 0;
+    blackboxWriteTag8_8SVB(nextResiduals(), BENCHMARK_BLACKBOX_FIELDS);
+}
+
+#ifdef USE_BLACKBOX_COMPRESSION
+static void initBlackboxCompress(void)
+{
+    initInput();
+    blackboxCompressReset(&state.blackbox.compress);
+    blackboxCompressWriteIntraframe(&state.blackbox.compress, BENCHMARK_BLACKBOX_FIELDS);
+    memset(state.blackbox.frames, 0, sizeof(state.blackbox.frames));
+}
+
+static void runBlackboxCompressWriteInterframe(void)
+{
+    // the newest frame is a random walk from the previous one
+    memmove(state.blackbox.frames[1], state.blackbox.frames[0], sizeof(state.blackbox.frames) - sizeof(state.blackbox.frames[0]));
+    const int32_t *steps = nextResiduals();
+    for (int field = 0; field < BENCHMARK_BLACKBOX_FIELDS; field++) {
+        state.blackbox.frames[0][field] = state.blackbox.frames[1][field] + steps[field];
+    }
+
+    blackboxFrameBufferLength = 0;
+    blackboxCompressWriteInterframe(&state.blackbox.compress, state.blackbox.frames[0], state.blackbox.frames[1], state.blackbox.frames[2],
+        (1ULL << BENCHMARK_BLACKBOX_FIELDS) - 1);
+}
+#endif
+#endif
+
+// Checksums, over a frame of random bytes
+
+static void initCrc(void)
+{
+    initInput();
+    for (int i = 0; i < BENCHMARK_CRC_BYTES; i++) {
+        state.crc[i] = residual[i];
+    }
+}
+
+static void runCrc8DvbS2Update(void)
+{
+    intSink = crc8_dvb_s2_update(0, state.crc, BENCHMARK_CRC_BYTES);
+}
+
+static void runCrc8XorUpdate(void)
+{
+    intSink = crc8_xor_update(0, state.crc, BENCHMARK_CRC_BYTES);
+}
+
+static void runCrc16CcittUpdate(void)
+{
+    intSink = crc16_ccitt_update(0, state.crc, BENCHMARK_CRC_BYTES);
+}
+
+static void runFnvUpdate(void)
+{
+    intSink = fnv_update(FNV_OFFSET_BASIS, state.crc, BENCHMARK_CRC_BYTES);
+}
+
+// DShot, the packet of every motor update and the bidirectional telemetry decoder
+
+#ifdef USE_DSHOT
+static void initDshot(void)
+{
+    initInput();
+    state.dshot.value = 0;
+    state.dshot.requestTelemetry = false;
+}
+
+static void runPrepareDshotPacket(void)
+{
+    state.dshot.value = DSHOT_MIN_THROTTLE + (inputIndex++ & 0x3ff);
+    state.dshot.requestTelemetry = !(inputIndex & 0x1f);
+    intSink = prepareDshotPacket(&state.dshot);
+}
+#endif
+
+#if defined(USE_DSHOT_BITBANG) && defined(USE_DSHOT_TELEMETRY)
+// GCR code of every nibble, the inverse of the table in decode_bb_value()
+static const uint8_t gcrEncode[16] = {
+    0x19, 0x1b, 0x12, 0x13, 0x1d, 0x15, 0x16, 0x17, 0x1a, 0x09, 0x0a, 0x0b, 0x1e, 0x0d, 0x0e, 0x0f
+};
+
+// A telemetry frame as the port input samples it: idle high, then a start bit and 20 GCR bits,
+// each sampled three times, where every 1 is a change of level
+static void initDecodeBb(void)
+{
+    const uint16_t erpm = 0x2a7;
+    const uint16_t checksum = (erpm ^ (erpm >> 4) ^ (erpm >> 8)) & 0xf;
+    const uint16_t value = (erpm << 4) | (~checksum & 0xf);
+
+    uint32_t gcr = 1;   // start bit
+    for (int shift = 12; shift >= 0; shift -= 4) {
+        gcr = (gcr << 5) | gcrEncode[(value >> shift) & 0xf];
+    }
+
+    const uint16_t high = 1 << BENCHMARK_BB_PIN;
+    int sample = 0;
+    for (; sample < 30; sample++) {
+        state.bbBuffer[sample] = high;
+    }
+    uint16_t level = high;
+    for (int bit = 20; bit >= 0; bit--) {
+        if (gcr & (1 << bit)) {
+            level ^= high;
+        }
+        for (int i = 0; i < 3; i++) {
+            state.bbBuffer[sample++] = level;
+        }
+    }
+    for (; sample < BENCHMARK_BB_SAMPLES; sample++) {
+        state.bbBuffer[sample] = high;
+    }
+}
+
+static void runDecodeBb(void)
+{
+    intSink = decode_bb(state.bbBuffer, BENCHMARK_BB_SAMPLES, BENCHMARK_BB_PIN);
+}
+#endif
+
+const benchmarkKernel_t benchmarkKernels[] = {
+    { "biquadFilterApply",              initBiquad,             runBiquadFilterApply },
+    { "biquadFilterApplyDF1",           initBiquad,             runBiquadFilterApplyDF1 },
+    { "biquadFilterApplyDF1Weighted",   initBiquad,             runBiquadFilterApplyDF1Weighted },
+    { "pt1FilterApply",                 initPt1,                runPt1FilterApply },
+    { "pt2FilterApply",                 initPt2,                runPt2FilterApply },
+    { "pt3FilterApply",                 initPt3,                runPt3FilterApply },
+#ifdef USE_FIXED_POINT_FILTERS
+    { "pt1FilterFixedApply",            initPt1Fixed,           runPt1FilterFixedApply },
+    { "biquadFilterFixedApplyDF1",      initBiquadFixed,        runBiquadFilterFixedApplyDF1 },
+#endif
+    { "filterChainApply(3x2+PT1)",      initFilterChain,        runFilterChainApply },
+    { "filterCascadeApply(3x2+PT1)",    initFilterCascade,      runFilterCascadeApply },
+    { "notchBankApply(3x24)",           initNotchBank,          runNotchBankApply },
+    { "notchCascadeApply(3x24)",        initNotchCascade,       runNotchCascadeApply },
+    { "sdftPushBatch",                  initSdft,               runSdftPushBatch },
+    { "sdftPushBatchAxes",              initSdft,               runSdftPushBatchAxes },
+    { "sdftWinSq",                      initSdftWinSq,          runSdftWinSq },
+    { "pidController",                  NULL,                   runPidController },
+    { "mixTable",                       NULL,                   runMixTable },
+#ifdef USE_ACC
+    { "imuMahonyAHRSupdate",            NULL,                   runImuMahonyAHRSupdate },
+#endif
+#ifdef USE_BLACKBOX
+    { "blackboxWriteSignedVBArray(8)",  initInput,              runBlackboxWriteSignedVBArray },
+    { "blackboxWriteTag2_3S32",         initInput,              runBlackboxWriteTag2_3S32 },
+    { "blackboxWriteTag8_4S16",         initInput,              runBlackboxWriteTag8_4S16 },
+    { "blackboxWriteTag8_8SVB(8)",      initInput,              runBlackboxWriteTag8_8SVB },
+#ifdef USE_BLACKBOX_COMPRESSION
+    { "blackboxCompressWriteInterframe(8)", initBlackboxCompress, runBlackboxCompressWriteInterframe },
+#endif
+#endif
+    { "crc8_dvb_s2_update(64)",         initCrc,                runCrc8DvbS2Update },
+    { "crc8_xor_update(64)",            initCrc,                runCrc8XorUpdate },
+    { "crc16_ccitt_update(64)",         initCrc,                runCrc16CcittUpdate },
+    { "fnv_update(64)",                 initCrc,                runFnvUpdate },
+#ifdef USE_DSHOT
+    { "prepareDshotPacket",             initDshot,              runPrepareDshotPacket },
+#endif
+#if defined(USE_DSHOT_BITBANG) && defined(USE_DSHOT_TELEMETRY)
+    { "decode_bb",                      initDecodeBb,           runDecodeBb },
+#endif
+};
+
+const unsigned benchmarkKernelCount = ARRAYLEN(benchmarkKernels);
+
+#endif // USE_BENCHMARK
@@ -36,6 +36,7 @@ bool cliMode = false;
 
 #include "blackbox/blackbox.h"
 
+#include "build/benchmark.h"
 #include "build/build_config.h"
 #include "build/debug.h"
 #include "build/version.h"
@@ -99,6 +100,7 @@ bool cliMode = false;
 #include "fc/board_info.h"
 #include "fc/controlrate_profile.h"
 #include "fc/core.h"
+#include "fc/latency.h"
 #include "fc/rc.h"
 #include "fc/rc_adjustments.h"
 #include "fc/rc_controls.h"
@@ -2444,6 +2446,8 @@ static void cliSdInfo(const char *cmdName, char *cmdline)
         break;
     }
     cliPrintLinefeed();
+
+    cliPrintLinef("Cache: %u hits, %u misses", afatfs_getCacheHits(), afatfs_getCacheMisses());
 }
 
 #endif
@@ -2477,6 +2481,20 @@ static void cliFlashInfo(const char *cmdName, char *cmdline)
             FLASH_PARTITION_SECTOR_COUNT(flashPartition) * layout->sectorSize,
             flashfsGetOffset()
     );
+
+    flashfsWriteStats_t writeStats;
+    flashfsGetWriteStats(&writeStats);
+    cliPrintLinef("FlashFS programs=%u, droppedBytes=%u, stallUs=%u", writeStats.programs, writeStats.droppedBytes, writeStats.stallUs);
+    cliPrintLinef("FlashFS eraseAhead=%u", flashfsGetEraseAheadHeadroom());
+
+    if (flashfsLogIndexIsAvailable()) {
+        cliPrintLinef("FlashFS logs=%d", flashfsGetLogCount());
+        for (int index = 0; index < flashfsGetLogCount(); index++) {
+            flashfsLogEntry_t entry;
+            flashfsGetLogEntry(index, &entry);
+            cliPrintLinef("  %d: start=%u, length=%u", index, entry.start, entry.length);
+        }
+    }
 #endif
 }
 #endif // USE_FLASH_CHIP
@@ -4812,6 +4830,12 @@ static void cliStatus(const char *cmdName, char *cmdline)
     cliPrintLinef("OSD: %s", lookupTableOsdDisplayPortDevice[displayPortDeviceType]);
 #endif
 
+#ifdef USE_BLACKBOX_DEFERRED
+    if (blackboxConfig()->deferred) {
+        cliPrintLinef("Blackbox queue: %u frames, %u dropped", blackboxGetQueuedFrames(), blackboxGetQueueOverflows());
+    }
+#endif
+
     // Uptime and wall clock
 
     cliPrintf("System Uptime: %d seconds", millis() / 1000);
@@ -4871,12 +4895,71 @@ static void cliStatus(const char *cmdName, char *cmdline)
     cliPrintLinefeed();
 }
 
+#if defined(USE_TASK_TRACE)
+static void cliTaskTrace(void)
+{
+    taskTraceEntry_t entries[TASK_TRACE_LENGTH];
+    const unsigned count = schedulerGetTaskTrace(entries, TASK_TRACE_LENGTH);
+
+    cliPrintLinef("Last %d tasks, oldest first, recording takes %d cycles per task", count, schedulerGetTaskTraceOverheadCycles());
+    cliPrintLine("  start/us                 task run/us slack/us");
+    for (unsigned i = 0; i < count; i++) {
+        taskInfo_t taskInfo;
+        getTaskInfo(entries[i].taskId, &taskInfo);
+        cliPrintLinef("%10u %02d (%15s) %6d %8d", entries[i].startUs, entries[i].taskId, taskInfo.taskName,
+            entries[i].durationUs, entries[i].gyroSlackUs);
+    }
+}
+
+static void cliTaskHistograms(void)
+{
+    cliPrintLine("Task execution time and start delay counts, bucket n is under 2^n us, the last bucket is open ended");
+    for (taskId_e taskId = 0; taskId < TASK_COUNT; taskId++) {
+        taskInfo_t taskInfo;
+        getTaskInfo(taskId, &taskInfo);
+        if (!taskInfo.isEnabled) {
+            continue;
+        }
+
+        taskHistogram_t histogram;
+        schedulerGetTaskHistogram(taskId, &histogram);
+        cliPrintf("%02d - (%15s)   run", taskId, taskInfo.taskName);
+        for (int i = 0; i < TASK_HISTOGRAM_BUCKET_COUNT; i++) {
+            cliPrintf(" %u", histogram.executionTime[i]);
+        }
+        cliPrintLinefeed();
+        cliPrintf("%22s delay", "");
+        for (int i = 0; i < TASK_HISTOGRAM_BUCKET_COUNT; i++) {
+            cliPrintf(" %u", histogram.startDelay[i]);
+        }
+        cliPrintLinefeed();
+    }
+}
+#endif
+
 static void cliTasks(const char *cmdName, char *cmdline)
 {
     UNUSED(cmdName);
-    UNUSED(cmdline);
     int averageLoadSum = 0;
 
+#if defined(USE_TASK_TRACE)
+    if (strcasecmp(cmdline, "trace") == 0) {
+        cliTaskTrace();
+        return;
+    } else if (strcasecmp(cmdline, "histogram") == 0) {
+        cliTaskHistograms();
+        return;
+    } else if (strcasecmp(cmdline, "reset") == 0) {
+        schedulerResetTaskTrace();
+        return;
+    } else if (!isEmpty(cmdline)) {
+        cliShowParseError(cmdName);
+        return;
+    }
+#else
+    UNUSED(cmdline);
+#endif
+
 #ifndef MINIMAL_CLI
     if (systemConfig()->task_statistics) {
 #if defined(USE_LATE_TASK_STATISTICS)
@@ -4924,6 +5007,16 @@ static void cliTasks(const char *cmdName, char *cmdline)
         getCheckFuncInfo(&checkFuncInfo);
         cliPrintLinef("RX Check Function %19d %7d %25d", checkFuncInfo.maxExecutionTimeUs, checkFuncInfo.averageExecutionTimeUs, checkFuncInfo.totalExecutionTimeUs / 1000);
         cliPrintLinef("Total (excluding SERIAL) %33d.%1d%%", averageLoadSum/10, averageLoadSum%10);
+
+#ifdef USE_LATENCY_STATS
+        // since arming or 'latency reset', see the 'latency' command for the stages and percentiles
+        latencyStats_t latencyStats;
+        latencyGetStats(LATENCY_STAGE_MOTOR, &latencyStats);
+        cliPrintLinef("Gyro to motor latency/us min %d avg %d.%1d max %d jitter %d.%1d (%s)",
+            latencyStats.minUs, latencyStats.average10thUs / 10, latencyStats.average10thUs % 10, latencyStats.maxUs,
+            latencyStats.jitter10thUs / 10, latencyStats.jitter10thUs % 10,
+            gyroIsrFilteringActive() ? "ISR filtering" : "task filtering");
+#endif
         if (debugMode == DEBUG_SCHEDULER_DETERMINISM) {
             extern int32_t schedLoopStartCycles, taskGuardCycles;
 
@@ -4933,6 +5026,48 @@ static void cliTasks(const char *cmdName, char *cmdline)
     }
 }
 
+#ifdef USE_LATENCY_STATS
+static void cliLatency(const char *cmdName, char *cmdline)
+{
+    if (strcasecmp(cmdline, "reset") == 0) {
+        latencyReset();
+        return;
+    } else if (!isEmpty(cmdline)) {
+        cliShowParseError(cmdName);
+        return;
+    }
+
+    cliPrintLinef("Gyro sample to   samples  p50/us  p99/us  max/us (%dus buckets, %s)",
+        latencyGetBucketWidthUs(), gyroIsrFilteringActive() ? "ISR filtering" : "task filtering");
+    for (int stage = 0; stage < LATENCY_STAGE_COUNT; stage++) {
+        latencyStats_t stats;
+        latencyGetStats(stage, &stats);
+        cliPrintLinef("%14s %9u %7d %7d %7d", latencyStageNames[stage], stats.count, stats.p50Us, stats.p99Us, stats.maxUs);
+    }
+}
+#endif
+
+#ifdef USE_BENCHMARK
+static void cliBench(const char *cmdName, char *cmdline)
+{
+    // the flight control kernels run on the live state and the blackbox ones write to its frame buffer
+    if (ARMING_FLAG(ARMED)) {
+        cliPrintErrorLinef(cmdName, "NOT ALLOWED WHILE ARMED");
+        return;
+    }
+#ifdef USE_BLACKBOX
+    if (!blackboxMayEditConfig()) {
+        cliPrintErrorLinef(cmdName, "NOT ALLOWED WHILE LOGGING");
+        return;
+    }
+#endif
+
+    if (benchmarkRun(cmdline, cliPrintLine) == 0) {
+        cliPrintErrorLinef(cmdName, "NO KERNEL MATCHES %s", cmdline);
+    }
+}
+#endif
+
 static void printVersion(const char *cmdName, bool printBoardInfo)
 {
 #if !(defined(USE_CUSTOM_DEFAULTS))
@@ -6470,6 +6605,9 @@ const clicmd_t cmdTable[] = {
     CLI_COMMAND_DEF("beeper", "enable/disable beeper for a condition", "list\r\n"
         "\t<->[name]", cliBeeper),
 #endif // USE_BEEPER
+#ifdef USE_BENCHMARK
+    CLI_COMMAND_DEF("bench", "time hot path kernels, min/median/max per call", "[kernel name prefix]", cliBench),
+#endif
 #if defined(USE_RX_BIND)
     CLI_COMMAND_DEF("bind_rx", "initiate binding for RX SPI or SRXL2", NULL, cliRxBind),
 #endif
@@ -6535,6 +6673,9 @@ const clicmd_t cmdTable[] = {
     CLI_COMMAND_DEF("gyroregisters", "dump gyro config registers contents", NULL, cliDumpGyroRegisters),
 #endif
     CLI_COMMAND_DEF("help", "display command help", "[search string]", cliHelp),
+#ifdef USE_LATENCY_STATS
+    CLI_COMMAND_DEF("latency", "show gyro to motor latency, reset on arming", "[reset]", cliLatency),
+#endif
 #ifdef USE_LED_STRIP_STATUS_MODE
         CLI_COMMAND_DEF("led", "configure leds", NULL, cliLed),
 #endif
@@ -6600,7 +6741,11 @@ const clicmd_t cmdTable[] = {
         "\treverse <servo> <source> r|n", cliServoMix),
 #endif
     CLI_COMMAND_DEF("status", "show status", NULL, cliStatus),
+#if defined(USE_TASK_TRACE)
+    CLI_COMMAND_DEF("tasks", "show task stats", "[trace|histogram|reset]", cliTasks),
+#else
     CLI_COMMAND_DEF("tasks", "show task stats", NULL, cliTasks),
+#endif
 #ifdef USE_TIMER_MGMT
     CLI_COMMAND_DEF("timer", "show/set timers", "<> | <pin> list | <pin> [af<alternate function>|none|<option(deprecated)>] | list | show", cliTimer),
 #endif
@@ -6788,6 +6933,27 @@ void cliProcess(void)
     }
 }
 
+#ifdef SIMULATOR_BUILD
+// Runs one command line without a CLI port, e.g. to configure a simulation from a script.
+// Output and errors go to separate writers so that the caller can tell if the command failed.
+void cliRunCommand(bufWriter_t *writer, bufWriter_t *errorWriter, const char *command)
+{
+    cliWriter = writer;
+    cliErrorWriter = errorWriter;
+    bufferIndex = 0;
+
+    while (*command) {
+        processCharacter(*command++);
+    }
+    processCharacter('\r');
+
+    cliWriterFlush();
+    cliWriterFlushInternal(cliErrorWriter);
+    cliWriter = NULL;
+    cliErrorWriter = NULL;
+}
+#endif
+
 #if defined(USE_CUSTOM_DEFAULTS)
 static bool cliProcessCustomDefaults(bool quiet)
 {
@@ -30,6 +30,11 @@ struct serialPort_s;
 void cliEnter(struct serialPort_s *serialPort);
 bool resetConfigToCustomDefaults(void);
 
+#ifdef SIMULATOR_BUILD
+struct bufWriter_s;
+void cliRunCommand(struct bufWriter_s *writer, struct bufWriter_s *errorWriter, const char *command);
+#endif
+
 #ifdef USE_CLI_DEBUG_PRINT
 void cliPrint(const char *str);
 void cliPrintLinefeed(void);
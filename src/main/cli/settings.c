@@ -697,6 +697,12 @@ const clivalue_t valueTable[] = {
     { "gyro_lpf1_dyn_expo",         VAR_UINT8  | MASTER_VALUE, .config.minmaxUnsigned = { 0, 10 }, PG_GYRO_CONFIG, offsetof(gyroConfig_t, gyro_lpf1_dyn_expo) },
 #endif
     { "gyro_filter_debug_axis",     VAR_UINT8  | MASTER_VALUE | MODE_LOOKUP, .config.lookup = { TABLE_GYRO_FILTER_DEBUG }, PG_GYRO_CONFIG, offsetof(gyroConfig_t, gyro_filter_debug_axis) },
+#ifdef USE_FIXED_POINT_FILTERS
+    { "gyro_filter_fixed_point",    VAR_UINT8  | MASTER_VALUE | MODE_LOOKUP, .config.lookup = { TABLE_OFF_ON }, PG_GYRO_CONFIG, offsetof(gyroConfig_t, gyro_filter_fixed_point) },
+#endif
+#ifdef USE_GYRO_ISR_FILTERING
+    { "gyro_isr_filtering",         VAR_UINT8  | MASTER_VALUE | MODE_LOOKUP, .config.lookup = { TABLE_OFF_ON }, PG_GYRO_CONFIG, offsetof(gyroConfig_t, gyro_isr_filtering) },
+#endif
 
 // PG_ACCELEROMETER_CONFIG
 #if defined(USE_ACC)
@@ -826,9 +832,30 @@ const clivalue_t valueTable[] = {
     { "blackbox_disable_motors",    VAR_UINT32 | MASTER_VALUE | MODE_BITSET, .config.bitpos = FLIGHT_LOG_FIELD_SELECT_MOTOR,   PG_BLACKBOX_CONFIG, offsetof(blackboxConfig_t, fields_disabled_mask) },
 #ifdef USE_GPS
     { "blackbox_disable_gps",       VAR_UINT32 | MASTER_VALUE | MODE_BITSET, .config.bitpos = FLIGHT_LOG_FIELD_SELECT_GPS,   PG_BLACKBOX_CONFIG, offsetof(blackboxConfig_t, fields_disabled_mask) },
+#endif
+#ifdef USE_LATENCY_STATS
+    { "blackbox_disable_latency",   VAR_UINT32 | MASTER_VALUE | MODE_BITSET, .config.bitpos = FLIGHT_LOG_FIELD_SELECT_LATENCY,   PG_BLACKBOX_CONFIG, offsetof(blackboxConfig_t, fields_disabled_mask) },
 #endif
     { "blackbox_mode",              VAR_UINT8  | MASTER_VALUE | MODE_LOOKUP, .config.lookup = { TABLE_BLACKBOX_MODE }, PG_BLACKBOX_CONFIG, offsetof(blackboxConfig_t, mode) },
     { "blackbox_high_resolution",   VAR_UINT8  | MASTER_VALUE | MODE_LOOKUP, .config.lookup = { TABLE_OFF_ON }, PG_BLACKBOX_CONFIG, offsetof(blackboxConfig_t, high_resolution) },
+#ifdef USE_BLACKBOX_COMPRESSION
+    { "blackbox_compression",       VAR_UINT8  | MASTER_VALUE | MODE_LOOKUP, .config.lookup = { TABLE_OFF_ON }, PG_BLACKBOX_CONFIG, offsetof(blackboxConfig_t, compression) },
+    { "blackbox_pid_denom",         VAR_UINT8  | MASTER_VALUE, .config.minmaxUnsigned = { 1, BLACKBOX_RATE_GROUP_DENOM_MAX }, PG_BLACKBOX_CONFIG, offsetof(blackboxConfig_t, rate_group_denom[BLACKBOX_RATE_GROUP_PID]) },
+    { "blackbox_rc_denom",          VAR_UINT8  | MASTER_VALUE, .config.minmaxUnsigned = { 1, BLACKBOX_RATE_GROUP_DENOM_MAX }, PG_BLACKBOX_CONFIG, offsetof(blackboxConfig_t, rate_group_denom[BLACKBOX_RATE_GROUP_RC_COMMANDS]) },
+    { "blackbox_setpoint_denom",    VAR_UINT8  | MASTER_VALUE, .config.minmaxUnsigned = { 1, BLACKBOX_RATE_GROUP_DENOM_MAX }, PG_BLACKBOX_CONFIG, offsetof(blackboxConfig_t, rate_group_denom[BLACKBOX_RATE_GROUP_SETPOINT]) },
+    { "blackbox_gyro_denom",        VAR_UINT8  | MASTER_VALUE, .config.minmaxUnsigned = { 1, BLACKBOX_RATE_GROUP_DENOM_MAX }, PG_BLACKBOX_CONFIG, offsetof(blackboxConfig_t, rate_group_denom[BLACKBOX_RATE_GROUP_GYRO]) },
+    { "blackbox_debug_denom",       VAR_UINT8  | MASTER_VALUE, .config.minmaxUnsigned = { 1, BLACKBOX_RATE_GROUP_DENOM_MAX }, PG_BLACKBOX_CONFIG, offsetof(blackboxConfig_t, rate_group_denom[BLACKBOX_RATE_GROUP_DEBUG]) },
+    { "blackbox_motor_denom",       VAR_UINT8  | MASTER_VALUE, .config.minmaxUnsigned = { 1, BLACKBOX_RATE_GROUP_DENOM_MAX }, PG_BLACKBOX_CONFIG, offsetof(blackboxConfig_t, rate_group_denom[BLACKBOX_RATE_GROUP_MOTOR]) },
+#endif
+#ifdef USE_SDCARD
+    { "blackbox_sd_prealloc",       VAR_UINT16 | MASTER_VALUE, .config.minmaxUnsigned = { 0, BLACKBOX_SD_PREALLOC_MAX }, PG_BLACKBOX_CONFIG, offsetof(blackboxConfig_t, sd_prealloc) },
+#endif
+#ifdef USE_BLACKBOX_DEFERRED
+    { "blackbox_deferred",          VAR_UINT8  | MASTER_VALUE | MODE_LOOKUP, .config.lookup = { TABLE_OFF_ON }, PG_BLACKBOX_CONFIG, offsetof(blackboxConfig_t, deferred) },
+#endif
+#ifdef USE_FLASHFS
+    { "blackbox_flash_erase_ahead", VAR_UINT16 | MASTER_VALUE, .config.minmaxUnsigned = { 0, 4096 }, PG_BLACKBOX_CONFIG, offsetof(blackboxConfig_t, flash_erase_ahead) },
+#endif
 #endif
 
 // PG_MOTOR_CONFIG
@@ -0,0 +1,330 @@
+/*
+ * This file is part of Cleanflight and Betaflight.
+ *
+ * Cleanflight and Betaflight are free software. You can redistribute
+ * this software and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Cleanflight and Betaflight are distributed in the hope that they
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "platform.h"
+
+#include "common/filter.h"
+#include "common/filter_fixed.h"
+
+#include "filter_chain.h"
+
+// Same math as biquadFilterApply(), direct form 2 transposed
+static inline float chainBiquadApplyDF2(biquadFilter_t *filter, float input)
+{
+    const float result = filter->b0 * input + filter->x1;
+
+    filter->x1 = filter->b1 * input - filter->a1 * result + filter->x2;
+    filter->x2 = filter->b2 * input - filter->a2 * result;
+
+    return result;
+}
+
+// Same math as biquadFilterApplyDF1(), which tolerates coefficient updates of the dynamic lowpass
+static inline float chainBiquadApplyDF1(biquadFilter_t *filter, float input)
+{
+    const float result = filter->b0 * input + filter->b1 * filter->x1 + filter->b2 * filter->x2 - filter->a1 * filter->y1 - filter->a2 * filter->y2;
+
+    filter->x2 = filter->x1;
+    filter->x1 = input;
+
+    filter->y2 = filter->y1;
+    filter->y1 = result;
+
+    return result;
+}
+
+static inline float chainLowpassApply(filterChainLowpass_t *filter, float input, const filterChainLowpass_e type)
+{
+    switch (type) {
+    case FILTER_CHAIN_LPF_PT1:
+        filter->pt1.state = filter->pt1.state + filter->pt1.k * (input - filter->pt1.state);
+        return filter->pt1.state;
+    case FILTER_CHAIN_LPF_BIQUAD:
+#ifdef USE_DYN_LPF
+        return chainBiquadApplyDF1(&filter->biquad, input);
+#else
+        return chainBiquadApplyDF2(&filter->biquad, input);
+#endif
+    case FILTER_CHAIN_LPF_PT2:
+        filter->pt2.state1 = filter->pt2.state1 + filter->pt2.k * (input - filter->pt2.state1);
+        filter->pt2.state = filter->pt2.state + filter->pt2.k * (filter->pt2.state1 - filter->pt2.state);
+        return filter->pt2.state;
+    case FILTER_CHAIN_LPF_PT3:
+        filter->pt3.state1 = filter->pt3.state1 + filter->pt3.k * (input - filter->pt3.state1);
+        filter->pt3.state2 = filter->pt3.state2 + filter->pt3.k * (filter->pt3.state1 - filter->pt3.state2);
+        filter->pt3.state = filter->pt3.state + filter->pt3.k * (filter->pt3.state2 - filter->pt3.state);
+        return filter->pt3.state;
+    default:
+        return input;
+    }
+}
+
+// Body shared by all kernels, notchCount and lowpass are compile time constants at each use
+static inline __attribute__((always_inline)) void chainApply(filterChain_t *chain, float *values, const int notchCount, const filterChainLowpass_e lowpass)
+{
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        float value = values[axis];
+        for (int i = 0; i < notchCount; i++) {
+            value = chainBiquadApplyDF2(&chain->notch[i][axis].biquad, value);
+        }
+        values[axis] = chainLowpassApply(&chain->lowpass[axis], value, lowpass);
+    }
+}
+
+#define FILTER_CHAIN_KERNEL(notches, lowpass) \
+    static FAST_CODE void chainApply ## notches ## lowpass(filterChain_t *chain, float *values) \
+    { \
+        chainApply(chain, values, notches, FILTER_CHAIN_LPF_ ## lowpass); \
+    }
+
+#define FILTER_CHAIN_KERNELS(kernel, notches) \
+    kernel(notches, NONE) \
+    kernel(notches, PT1) \
+    kernel(notches, BIQUAD) \
+    kernel(notches, PT2) \
+    kernel(notches, PT3)
+
+FILTER_CHAIN_KERNELS(FILTER_CHAIN_KERNEL, 0)
+FILTER_CHAIN_KERNELS(FILTER_CHAIN_KERNEL, 1)
+FILTER_CHAIN_KERNELS(FILTER_CHAIN_KERNEL, 2)
+
+#define FILTER_CHAIN_KERNEL_ROW(prefix, notches) \
+    { prefix ## notches ## NONE, prefix ## notches ## PT1, prefix ## notches ## BIQUAD, prefix ## notches ## PT2, prefix ## notches ## PT3 }
+
+static filterChainApplyFn * const chainKernels[FILTER_CHAIN_NOTCH_MAX + 1][FILTER_CHAIN_LPF_COUNT] = {
+    FILTER_CHAIN_KERNEL_ROW(chainApply, 0),
+    FILTER_CHAIN_KERNEL_ROW(chainApply, 1),
+    FILTER_CHAIN_KERNEL_ROW(chainApply, 2),
+};
+
+#ifdef USE_FIXED_POINT_FILTERS
+static inline int32_t chainLowpassApplyFixed(filterChainLowpass_t *filter, int32_t input, const filterChainLowpass_e type)
+{
+    switch (type) {
+    case FILTER_CHAIN_LPF_PT1:
+        return pt1FilterFixedApply(&filter->pt1Fixed, input);
+    case FILTER_CHAIN_LPF_BIQUAD:
+        return biquadFilterFixedApplyDF1(&filter->biquadFixed, input);
+    case FILTER_CHAIN_LPF_PT2:
+        return pt2FilterFixedApply(&filter->pt2Fixed, input);
+    case FILTER_CHAIN_LPF_PT3:
+        return pt3FilterFixedApply(&filter->pt3Fixed, input);
+    default:
+        return input;
+    }
+}
+
+// Integer variant, all notches run in direct form 1 which keeps the state within the sample range
+static inline __attribute__((always_inline)) void chainApplyFixed(filterChain_t *chain, float *values, const int notchCount, const filterChainLowpass_e lowpass)
+{
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        int32_t value = fixedFromFloat(values[axis]);
+        for (int i = 0; i < notchCount; i++) {
+            value = biquadFilterFixedApplyDF1(&chain->notch[i][axis].biquadFixed, value);
+        }
+        values[axis] = fixedToFloat(chainLowpassApplyFixed(&chain->lowpass[axis], value, lowpass));
+    }
+}
+
+#define FILTER_CHAIN_KERNEL_FIXED(notches, lowpass) \
+    static FAST_CODE void chainApplyFixed ## notches ## lowpass(filterChain_t *chain, float *values) \
+    { \
+        chainApplyFixed(chain, values, notches, FILTER_CHAIN_LPF_ ## lowpass); \
+    }
+
+FILTER_CHAIN_KERNELS(FILTER_CHAIN_KERNEL_FIXED, 0)
+FILTER_CHAIN_KERNELS(FILTER_CHAIN_KERNEL_FIXED, 1)
+FILTER_CHAIN_KERNELS(FILTER_CHAIN_KERNEL_FIXED, 2)
+
+static filterChainApplyFn * const chainKernelsFixed[FILTER_CHAIN_NOTCH_MAX + 1][FILTER_CHAIN_LPF_COUNT] = {
+    FILTER_CHAIN_KERNEL_ROW(chainApplyFixed, 0),
+    FILTER_CHAIN_KERNEL_ROW(chainApplyFixed, 1),
+    FILTER_CHAIN_KERNEL_ROW(chainApplyFixed, 2),
+};
+#endif
+
+static void chainSelectKernel(filterChain_t *chain)
+{
+#ifdef USE_FIXED_POINT_FILTERS
+    if (chain->fixedPoint) {
+        chain->apply = chainKernelsFixed[chain->notchCount][chain->lowpassType];
+        return;
+    }
+#endif
+    chain->apply = chainKernels[chain->notchCount][chain->lowpassType];
+}
+
+// Resets the chain to pass samples through unfiltered
+void filterChainInit(filterChain_t *chain)
+{
+    memset(chain, 0, sizeof(*chain));
+    chainSelectKernel(chain);
+}
+
+// Appends a notch applied ahead of the lowpass, returns false if the chain is full
+bool filterChainAddNotch(filterChain_t *chain, float notchHz, float q, uint32_t looptimeUs)
+{
+    if (chain->notchCount >= FILTER_CHAIN_NOTCH_MAX) {
+        return false;
+    }
+
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        biquadFilterInit(&chain->notch[chain->notchCount][axis].biquad, notchHz, looptimeUs, q, FILTER_NOTCH, 1.0f);
+    }
+    chain->notchCount++;
+    chainSelectKernel(chain);
+
+    return true;
+}
+
+// Selects the lowpass type, the caller initialises the matching member of chain->lowpass[] for each axis
+void filterChainSetLowpass(filterChain_t *chain, filterChainLowpass_e type)
+{
+    chain->lowpassType = type < FILTER_CHAIN_LPF_COUNT ? type : FILTER_CHAIN_LPF_NONE;
+    chainSelectKernel(chain);
+}
+
+filterChainLowpass_e filterChainLowpassType(lowpassFilterType_e type)
+{
+    switch (type) {
+    case FILTER_PT1:
+        return FILTER_CHAIN_LPF_PT1;
+    case FILTER_BIQUAD:
+        return FILTER_CHAIN_LPF_BIQUAD;
+    case FILTER_PT2:
+        return FILTER_CHAIN_LPF_PT2;
+    case FILTER_PT3:
+        return FILTER_CHAIN_LPF_PT3;
+    default:
+        return FILTER_CHAIN_LPF_NONE;
+    }
+}
+
+// Sets the gain of all axes when the lowpass is PT1, PT2 or PT3
+FAST_CODE void filterChainUpdateLowpassGain(filterChain_t *chain, float k)
+{
+#ifdef USE_FIXED_POINT_FILTERS
+    if (chain->fixedPoint) {
+        const int32_t gain = fixedGain(k);
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            switch (chain->lowpassType) {
+            case FILTER_CHAIN_LPF_PT1:
+                chain->lowpass[axis].pt1Fixed.k = gain;
+                break;
+            case FILTER_CHAIN_LPF_PT2:
+                chain->lowpass[axis].pt2Fixed.k = gain;
+                break;
+            case FILTER_CHAIN_LPF_PT3:
+                chain->lowpass[axis].pt3Fixed.k = gain;
+                break;
+            default:
+                break;
+            }
+        }
+        return;
+    }
+#endif
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        switch (chain->lowpassType) {
+        case FILTER_CHAIN_LPF_PT1:
+            pt1FilterUpdateCutoff(&chain->lowpass[axis].pt1, k);
+            break;
+        case FILTER_CHAIN_LPF_PT2:
+            pt2FilterUpdateCutoff(&chain->lowpass[axis].pt2, k);
+            break;
+        case FILTER_CHAIN_LPF_PT3:
+            pt3FilterUpdateCutoff(&chain->lowpass[axis].pt3, k);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+// Moves the cutoff of a biquad lowpass, coefficients are computed once and shared by the axes
+FAST_CODE void filterChainUpdateLowpassBiquad(filterChain_t *chain, float cutoffHz, uint32_t looptimeUs)
+{
+    if (chain->lowpassType != FILTER_CHAIN_LPF_BIQUAD) {
+        return;
+    }
+
+    biquadFilter_t coefficients;
+    biquadFilterUpdateLPF(&coefficients, cutoffHz, looptimeUs);
+
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+#ifdef USE_FIXED_POINT_FILTERS
+        if (chain->fixedPoint) {
+            biquadFilterFixedUpdate(&chain->lowpass[axis].biquadFixed, &coefficients);
+            continue;
+        }
+#endif
+        biquadFilter_t *filter = &chain->lowpass[axis].biquad;
+        filter->b0 = coefficients.b0;
+        filter->b1 = coefficients.b1;
+        filter->b2 = coefficients.b2;
+        filter->a1 = coefficients.a1;
+        filter->a2 = coefficients.a2;
+    }
+}
+
+#ifdef USE_FIXED_POINT_FILTERS
+// Switches a configured chain to integer filtering, the float coefficients are converted
+// and the filter state restarts from zero. Call after all notches and the lowpass are set up.
+void filterChainSetFixedPoint(filterChain_t *chain, bool fixedPoint)
+{
+    if (!fixedPoint || chain->fixedPoint) {
+        return;
+    }
+
+    for (int i = 0; i < chain->notchCount; i++) {
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            const biquadFilter_t notch = chain->notch[i][axis].biquad;
+            biquadFilterFixedInit(&chain->notch[i][axis].biquadFixed, &notch);
+        }
+    }
+
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        filterChainLowpass_t *lowpass = &chain->lowpass[axis];
+        switch (chain->lowpassType) {
+        case FILTER_CHAIN_LPF_PT1:
+            pt1FilterFixedInit(&lowpass->pt1Fixed, lowpass->pt1.k);
+            break;
+        case FILTER_CHAIN_LPF_BIQUAD: {
+            const biquadFilter_t biquad = lowpass->biquad;
+            biquadFilterFixedInit(&lowpass->biquadFixed, &biquad);
+            break;
+        }
+        case FILTER_CHAIN_LPF_PT2:
+            pt2FilterFixedInit(&lowpass->pt2Fixed, lowpass->pt2.k);
+            break;
+        case FILTER_CHAIN_LPF_PT3:
+            pt3FilterFixedInit(&lowpass->pt3Fixed, lowpass->pt3.k);
+            break;
+        default:
+            break;
+        }
+    }
+
+    chain->fixedPoint = true;
+    chainSelectKernel(chain);
+}
+#endif
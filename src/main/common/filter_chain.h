@@ -0,0 +1,94 @@
+/*
+ * This file is part of Cleanflight and Betaflight.
+ *
+ * Cleanflight and Betaflight are free software. You can redistribute
+ * this software and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Cleanflight and Betaflight are distributed in the hope that they
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Static filter chain applied to all three axes at once: up to two notches
+// followed by one lowpass. Each combination of notch count and lowpass type has
+// its own kernel with the filter math inlined, the kernel is selected when the
+// chain is configured so the loop makes one call per sample for all axes.
+//
+// With USE_FIXED_POINT_FILTERS the chain can be switched to the integer filters
+// of filter_fixed.h once configured, samples are converted on entry and exit.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "common/axis.h"
+#include "common/filter.h"
+#include "common/filter_fixed.h"
+
+#define FILTER_CHAIN_NOTCH_MAX 2
+
+typedef enum {
+    FILTER_CHAIN_LPF_NONE = 0,
+    FILTER_CHAIN_LPF_PT1,
+    FILTER_CHAIN_LPF_BIQUAD,
+    FILTER_CHAIN_LPF_PT2,
+    FILTER_CHAIN_LPF_PT3,
+    FILTER_CHAIN_LPF_COUNT
+} filterChainLowpass_e;
+
+typedef union filterChainNotch_u {
+    biquadFilter_t biquad;
+    biquadFilterFixed_t biquadFixed;
+} filterChainNotch_t;
+
+typedef union filterChainLowpass_u {
+    pt1Filter_t pt1;
+    biquadFilter_t biquad;
+    pt2Filter_t pt2;
+    pt3Filter_t pt3;
+    pt1FilterFixed_t pt1Fixed;
+    biquadFilterFixed_t biquadFixed;
+    pt2FilterFixed_t pt2Fixed;
+    pt3FilterFixed_t pt3Fixed;
+} filterChainLowpass_t;
+
+struct filterChain_s;
+typedef void filterChainApplyFn(struct filterChain_s *chain, float *values);
+
+typedef struct filterChain_s {
+
+    filterChainApplyFn *apply;
+
+    filterChainNotch_t notch[FILTER_CHAIN_NOTCH_MAX][XYZ_AXIS_COUNT];
+    filterChainLowpass_t lowpass[XYZ_AXIS_COUNT];
+
+    uint8_t notchCount;
+    uint8_t lowpassType;
+    bool fixedPoint;
+
+} filterChain_t;
+
+void filterChainInit(filterChain_t *chain);
+bool filterChainAddNotch(filterChain_t *chain, float notchHz, float q, uint32_t looptimeUs);
+void filterChainSetLowpass(filterChain_t *chain, filterChainLowpass_e type);
+filterChainLowpass_e filterChainLowpassType(lowpassFilterType_e type);
+void filterChainUpdateLowpassGain(filterChain_t *chain, float k);
+void filterChainUpdateLowpassBiquad(filterChain_t *chain, float cutoffHz, uint32_t looptimeUs);
+#ifdef USE_FIXED_POINT_FILTERS
+void filterChainSetFixedPoint(filterChain_t *chain, bool fixedPoint);
+#endif
+
+static inline void filterChainApply(filterChain_t *chain, float *values)
+{
+    chain->apply(chain, values);
+}
@@ -0,0 +1,80 @@
+/*
+ * This file is part of Cleanflight and Betaflight.
+ *
+ * Cleanflight and Betaflight are free software. You can redistribute
+ * this software and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Cleanflight and Betaflight are distributed in the hope that they
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "platform.h"
+
+#include "common/filter.h"
+#include "common/maths.h"
+
+#include "filter_fixed.h"
+
+void pt1FilterFixedInit(pt1FilterFixed_t *filter, float k)
+{
+    filter->state = 0;
+    filter->k = fixedGain(k);
+}
+
+void pt1FilterFixedUpdateCutoff(pt1FilterFixed_t *filter, float k)
+{
+    filter->k = fixedGain(k);
+}
+
+void pt2FilterFixedInit(pt2FilterFixed_t *filter, float k)
+{
+    filter->state = 0;
+    filter->state1 = 0;
+    filter->k = fixedGain(k);
+}
+
+void pt2FilterFixedUpdateCutoff(pt2FilterFixed_t *filter, float k)
+{
+    filter->k = fixedGain(k);
+}
+
+void pt3FilterFixedInit(pt3FilterFixed_t *filter, float k)
+{
+    filter->state = 0;
+    filter->state1 = 0;
+    filter->state2 = 0;
+    filter->k = fixedGain(k);
+}
+
+void pt3FilterFixedUpdateCutoff(pt3FilterFixed_t *filter, float k)
+{
+    filter->k = fixedGain(k);
+}
+
+void biquadFilterFixedInit(biquadFilterFixed_t *filter, const biquadFilter_t *coefficients)
+{
+    biquadFilterFixedUpdate(filter, coefficients);
+
+    // zero initial samples
+    filter->x1 = filter->x2 = 0;
+    filter->y1 = filter->y2 = 0;
+}
+
+FAST_CODE void biquadFilterFixedUpdate(biquadFilterFixed_t *filter, const biquadFilter_t *coefficients)
+{
+    filter->b0 = fixedCoeff(coefficients->b0);
+    filter->b1 = fixedCoeff(coefficients->b1);
+    filter->b2 = fixedCoeff(coefficients->b2);
+    filter->a1 = fixedCoeff(coefficients->a1);
+    filter->a2 = fixedCoeff(coefficients->a2);
+}
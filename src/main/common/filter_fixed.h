@@ -0,0 +1,147 @@
+/*
+ * This file is part of Cleanflight and Betaflight.
+ *
+ * Cleanflight and Betaflight are free software. You can redistribute
+ * this software and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Cleanflight and Betaflight are distributed in the hope that they
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Integer versions of the PT1/PT2/PT3 lowpass and biquad filters in filter.h.
+//
+// Samples are Q16.16 signed values, limited to +/-FIXED_SAMPLE_LIMIT so that a
+// biquad accumulating five products can not overflow its 64 bit accumulator.
+// Lowpass gains are Q31 (0 <= k < 1), biquad coefficients are Q30 (|c| < 2).
+// Every result is rounded to nearest and saturated to the int32_t range.
+//
+// Coefficients are always computed in float by the functions in filter.h and
+// converted once, only the per sample work is done in integer arithmetic.
+
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+#include "common/filter.h"
+#include "common/maths.h"
+
+#define FIXED_SAMPLE_SHIFT  16
+#define FIXED_GAIN_SHIFT    31
+#define FIXED_COEFF_SHIFT   30
+#define FIXED_SAMPLE_LIMIT  8192.0f     // deg/s, largest sample magnitude representable without overflow risk
+
+typedef struct pt1FilterFixed_s {
+    int32_t state;
+    int32_t k;
+} pt1FilterFixed_t;
+
+typedef struct pt2FilterFixed_s {
+    int32_t state;
+    int32_t state1;
+    int32_t k;
+} pt2FilterFixed_t;
+
+typedef struct pt3FilterFixed_s {
+    int32_t state;
+    int32_t state1;
+    int32_t state2;
+    int32_t k;
+} pt3FilterFixed_t;
+
+typedef struct biquadFilterFixed_s {
+    int32_t b0, b1, b2, a1, a2;
+    int32_t x1, x2, y1, y2;
+} biquadFilterFixed_t;
+
+void pt1FilterFixedInit(pt1FilterFixed_t *filter, float k);
+void pt1FilterFixedUpdateCutoff(pt1FilterFixed_t *filter, float k);
+void pt2FilterFixedInit(pt2FilterFixed_t *filter, float k);
+void pt2FilterFixedUpdateCutoff(pt2FilterFixed_t *filter, float k);
+void pt3FilterFixedInit(pt3FilterFixed_t *filter, float k);
+void pt3FilterFixedUpdateCutoff(pt3FilterFixed_t *filter, float k);
+
+void biquadFilterFixedInit(biquadFilterFixed_t *filter, const biquadFilter_t *coefficients);
+void biquadFilterFixedUpdate(biquadFilterFixed_t *filter, const biquadFilter_t *coefficients);
+
+static inline int32_t fixedFromFloat(float value)
+{
+    return lrintf(constrainf(value, -FIXED_SAMPLE_LIMIT, FIXED_SAMPLE_LIMIT) * (1 << FIXED_SAMPLE_SHIFT));
+}
+
+static inline float fixedToFloat(int32_t value)
+{
+    return value * (1.0f / (1 << FIXED_SAMPLE_SHIFT));
+}
+
+static inline int32_t fixedSaturate(int64_t value)
+{
+    return value > INT32_MAX ? INT32_MAX : value < INT32_MIN ? INT32_MIN : (int32_t)value;
+}
+
+// Q31 gain in [0, 1)
+static inline int32_t fixedGain(float k)
+{
+    const float gain = constrainf(k, 0.0f, 1.0f) * 2147483648.0f;
+    return gain >= 2147483647.0f ? INT32_MAX : (int32_t)lrintf(gain);
+}
+
+// Q30 coefficient in (-2, 2)
+static inline int32_t fixedCoeff(float coefficient)
+{
+    const float value = constrainf(coefficient * (1 << FIXED_COEFF_SHIFT), -2147483648.0f, 2147483647.0f);
+    return value >= 2147483647.0f ? INT32_MAX : (int32_t)lrintf(value);
+}
+
+// (a * b) >> shift, rounded to nearest and saturated
+static inline int32_t fixedMultiply(int32_t a, int64_t b, int shift)
+{
+    return fixedSaturate((a * b + (1LL << (shift - 1))) >> shift);
+}
+
+static inline int32_t pt1FilterFixedApply(pt1FilterFixed_t *filter, int32_t input)
+{
+    filter->state = fixedSaturate(filter->state + (int64_t)fixedMultiply(filter->k, (int64_t)input - filter->state, FIXED_GAIN_SHIFT));
+    return filter->state;
+}
+
+static inline int32_t pt2FilterFixedApply(pt2FilterFixed_t *filter, int32_t input)
+{
+    filter->state1 = fixedSaturate(filter->state1 + (int64_t)fixedMultiply(filter->k, (int64_t)input - filter->state1, FIXED_GAIN_SHIFT));
+    filter->state = fixedSaturate(filter->state + (int64_t)fixedMultiply(filter->k, (int64_t)filter->state1 - filter->state, FIXED_GAIN_SHIFT));
+    return filter->state;
+}
+
+static inline int32_t pt3FilterFixedApply(pt3FilterFixed_t *filter, int32_t input)
+{
+    filter->state1 = fixedSaturate(filter->state1 + (int64_t)fixedMultiply(filter->k, (int64_t)input - filter->state1, FIXED_GAIN_SHIFT));
+    filter->state2 = fixedSaturate(filter->state2 + (int64_t)fixedMultiply(filter->k, (int64_t)filter->state1 - filter->state2, FIXED_GAIN_SHIFT));
+    filter->state = fixedSaturate(filter->state + (int64_t)fixedMultiply(filter->k, (int64_t)filter->state2 - filter->state, FIXED_GAIN_SHIFT));
+    return filter->state;
+}
+
+// Direct form 1, the state only holds past samples so coefficients may change at any time
+static inline int32_t biquadFilterFixedApplyDF1(biquadFilterFixed_t *filter, int32_t input)
+{
+    const int64_t accumulator = (int64_t)filter->b0 * input + (int64_t)filter->b1 * filter->x1 + (int64_t)filter->b2 * filter->x2
+        - (int64_t)filter->a1 * filter->y1 - (int64_t)filter->a2 * filter->y2;
+    const int32_t result = fixedSaturate((accumulator + (1LL << (FIXED_COEFF_SHIFT - 1))) >> FIXED_COEFF_SHIFT);
+
+    filter->x2 = filter->x1;
+    filter->x1 = input;
+
+    filter->y2 = filter->y1;
+    filter->y1 = result;
+
+    return result;
+}
@@ -0,0 +1,194 @@
+/*
+ * This file is part of Cleanflight and Betaflight.
+ *
+ * Cleanflight and Betaflight are free software. You can redistribute
+ * this software and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Cleanflight and Betaflight are distributed in the hope that they
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "platform.h"
+
+#include "common/filter.h"
+#include "common/filter_fixed.h"
+#include "common/maths.h"
+#include "common/utils.h"
+
+#include "notch_bank.h"
+
+
+void notchBankInit(notchBank_t *bank, int count)
+{
+    memset(bank, 0, sizeof(*bank));
+    bank->count = constrain(count, 0, NOTCH_BANK_SIZE);
+}
+
+static inline void updateFixedCoefficients(notchBank_t *bank, int index)
+{
+#ifdef USE_FIXED_POINT_FILTERS
+    if (bank->fixedPoint) {
+        bank->b0Fixed[index] = fixedCoeff(bank->b0[index]);
+        bank->b1Fixed[index] = fixedCoeff(bank->b1[index]);
+        bank->a2Fixed[index] = fixedCoeff(bank->a2[index]);
+        bank->weightFixed[index] = fixedCoeff(bank->weight[index]);
+    }
+#else
+    UNUSED(bank);
+    UNUSED(index);
+#endif
+}
+
+// Coefficients are computed exactly as for a biquadFilter_t notch
+FAST_CODE void notchBankUpdate(notchBank_t *bank, int index, float frequencyHz, uint32_t looptimeUs, float q, float weight)
+{
+    biquadFilter_t notch;
+    biquadFilterUpdate(&notch, frequencyHz, looptimeUs, q, FILTER_NOTCH, weight);
+
+    bank->b0[index] = notch.b0;
+    bank->b1[index] = notch.b1;
+    bank->a2[index] = notch.a2;
+    bank->weight[index] = notch.weight;
+    updateFixedCoefficients(bank, index);
+}
+
+void notchBankTableInit(notchBankTable_t *table, uint32_t looptimeUs, float q)
+{
+    const float nyquistHz = 0.5f * 1e6f / looptimeUs;
+    table->hzToIndex = NOTCH_BANK_TABLE_STEPS / nyquistHz;
+
+    for (int i = 0; i <= NOTCH_BANK_TABLE_STEPS; i++) {
+        biquadFilter_t notch;
+        biquadFilterUpdate(&notch, i / table->hzToIndex, looptimeUs, q, FILTER_NOTCH, 1.0f);
+
+        table->b0[i] = notch.b0;
+        table->b1[i] = notch.b1;
+        table->a2[i] = notch.a2;
+    }
+}
+
+// Cheap alternative to notchBankUpdate(), no trigonometry or division involved
+FAST_CODE void notchBankUpdateFromTable(notchBank_t *bank, int index, const notchBankTable_t *table, float frequencyHz, float weight)
+{
+    const float position = constrainf(frequencyHz * table->hzToIndex, 0.0f, NOTCH_BANK_TABLE_STEPS);
+    const int i = MIN((int)position, NOTCH_BANK_TABLE_STEPS - 1);
+    const float fraction = position - i;
+
+    bank->b0[index] = table->b0[i] + fraction * (table->b0[i + 1] - table->b0[i]);
+    bank->b1[index] = table->b1[i] + fraction * (table->b1[i + 1] - table->b1[i]);
+    bank->a2[index] = table->a2[i] + fraction * (table->a2[i + 1] - table->a2[i]);
+    bank->weight[index] = weight;
+    updateFixedCoefficients(bank, index);
+}
+
+#ifdef USE_FIXED_POINT_FILTERS
+// Integer version of notchBankApply(), Q16.16 samples and Q30 coefficients with a 64 bit accumulator
+static FAST_CODE void notchBankApplyFixed(notchBank_t *bank, float *values)
+{
+    int32_t x[XYZ_AXIS_COUNT];
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        x[axis] = fixedFromFloat(values[axis]);
+    }
+
+    for (int i = 0; i < bank->count; i++) {
+        const int64_t b0 = bank->b0Fixed[i];
+        const int64_t b1 = bank->b1Fixed[i];
+        const int64_t a2 = bank->a2Fixed[i];
+        const int32_t weight = bank->weightFixed[i];
+
+        int32_t *x1 = bank->x1.q[i];
+        int32_t *x2 = bank->x2.q[i];
+        int32_t *y1 = bank->y1.q[i];
+        int32_t *y2 = bank->y2.q[i];
+
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            const int32_t input = x[axis];
+            const int64_t accumulator = b0 * ((int64_t)input + x2[axis]) + b1 * ((int64_t)x1[axis] - y1[axis]) - a2 * y2[axis];
+            const int32_t result = fixedSaturate((accumulator + (1LL << (FIXED_COEFF_SHIFT - 1))) >> FIXED_COEFF_SHIFT);
+
+            x2[axis] = x1[axis];
+            x1[axis] = input;
+            y2[axis] = y1[axis];
+            y1[axis] = result;
+
+            x[axis] = fixedSaturate(input + (int64_t)fixedMultiply(weight, (int64_t)result - input, FIXED_COEFF_SHIFT));
+        }
+    }
+
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        values[axis] = fixedToFloat(x[axis]);
+    }
+}
+
+// Switches the bank between float and integer filtering, the filter state restarts from zero
+void notchBankSetFixedPoint(notchBank_t *bank, bool fixedPoint)
+{
+    bank->fixedPoint = fixedPoint;
+    memset(&bank->x1, 0, sizeof(bank->x1));
+    memset(&bank->x2, 0, sizeof(bank->x2));
+    memset(&bank->y1, 0, sizeof(bank->y1));
+    memset(&bank->y2, 0, sizeof(bank->y2));
+    for (int i = 0; i < NOTCH_BANK_SIZE; i++) {
+        updateFixedCoefficients(bank, i);
+    }
+}
+#endif
+
+// Applies all notches of the bank in cascade (DF1, crossfaded by weight) to one sample of each axis.
+// Equivalent to biquadFilterApplyDF1Weighted() per notch and axis, but coefficients are loaded once
+// for all axes and the notch symmetry saves two multiplications per notch and axis.
+FAST_CODE void notchBankApply(notchBank_t *bank, float *values)
+{
+#ifdef USE_FIXED_POINT_FILTERS
+    if (bank->fixedPoint) {
+        notchBankApplyFixed(bank, values);
+        return;
+    }
+#endif
+
+    float x[XYZ_AXIS_COUNT];
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        x[axis] = values[axis];
+    }
+
+    for (int i = 0; i < bank->count; i++) {
+        const float b0 = bank->b0[i];
+        const float b1 = bank->b1[i];
+        const float a2 = bank->a2[i];
+        const float weight = bank->weight[i];
+
+        float *x1 = bank->x1.f[i];
+        float *x2 = bank->x2.f[i];
+        float *y1 = bank->y1.f[i];
+        float *y2 = bank->y2.f[i];
+
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            const float input = x[axis];
+            const float result = b0 * (input + x2[axis]) + b1 * (x1[axis] - y1[axis]) - a2 * y2[axis];
+
+            x2[axis] = x1[axis];
+            x1[axis] = input;
+            y2[axis] = y1[axis];
+            y1[axis] = result;
+
+            // crossfading of input and output to turn notch on/off gradually
+            x[axis] = input + weight * (result - input);
+        }
+    }
+
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        values[axis] = x[axis];
+    }
+}
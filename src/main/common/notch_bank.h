@@ -0,0 +1,84 @@
+/*
+ * This file is part of Cleanflight and Betaflight.
+ *
+ * Cleanflight and Betaflight are free software. You can redistribute
+ * this software and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Cleanflight and Betaflight are distributed in the hope that they
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Bank of weighted biquad notches applied in cascade to all three axes at once.
+// Coefficients are shared by the axes and stored structure-of-arrays, the filter
+// state is interleaved per axis so one pass over the bank filters roll, pitch and yaw.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "common/axis.h"
+
+#define NOTCH_BANK_SIZE 24  // enough for 8 motors with 3 harmonics each
+#define NOTCH_BANK_TABLE_STEPS 256  // table intervals between 0 Hz and Nyquist
+
+// Filter state, float or Q16.16 samples depending on the mode of the bank
+typedef union notchBankState_u {
+    float f[NOTCH_BANK_SIZE][XYZ_AXIS_COUNT];
+    int32_t q[NOTCH_BANK_SIZE][XYZ_AXIS_COUNT];
+} notchBankState_t;
+
+typedef struct notchBank_s {
+
+    int count;
+    bool fixedPoint;
+
+    // notch biquads have b2 == b0 and a1 == b1, so only three coefficients are stored
+    float b0[NOTCH_BANK_SIZE];
+    float b1[NOTCH_BANK_SIZE];
+    float a2[NOTCH_BANK_SIZE];
+    float weight[NOTCH_BANK_SIZE];
+
+#ifdef USE_FIXED_POINT_FILTERS
+    // Q30 copies of the coefficients, kept up to date in fixed point mode
+    int32_t b0Fixed[NOTCH_BANK_SIZE];
+    int32_t b1Fixed[NOTCH_BANK_SIZE];
+    int32_t a2Fixed[NOTCH_BANK_SIZE];
+    int32_t weightFixed[NOTCH_BANK_SIZE];
+#endif
+
+    notchBankState_t x1;
+    notchBankState_t x2;
+    notchBankState_t y1;
+    notchBankState_t y2;
+
+} notchBank_t;
+
+// Notch coefficients for one looptime and Q, tabulated over frequency for linear interpolation
+typedef struct notchBankTable_s {
+
+    float hzToIndex;
+    float b0[NOTCH_BANK_TABLE_STEPS + 1];
+    float b1[NOTCH_BANK_TABLE_STEPS + 1];
+    float a2[NOTCH_BANK_TABLE_STEPS + 1];
+
+} notchBankTable_t;
+
+void notchBankInit(notchBank_t *bank, int count);
+void notchBankUpdate(notchBank_t *bank, int index, float frequencyHz, uint32_t looptimeUs, float q, float weight);
+void notchBankTableInit(notchBankTable_t *table, uint32_t looptimeUs, float q);
+void notchBankUpdateFromTable(notchBank_t *bank, int index, const notchBankTable_t *table, float frequencyHz, float weight);
+void notchBankApply(notchBank_t *bank, float *values);
+#ifdef USE_FIXED_POINT_FILTERS
+void notchBankSetFixedPoint(notchBank_t *bank, bool fixedPoint);
+#endif
@@ -23,10 +23,14 @@
 
 #include "platform.h"
 
+#include "common/axis.h"
 #include "common/maths.h"
 #include "common/sdft.h"
+#include "common/utils.h"
 
-#define SDFT_R 0.9999f  // damping factor for guaranteed SDFT stability (r < 1.0f) 
+#define SDFT_R 0.9999f  // damping factor for guaranteed SDFT stability (r < 1.0f)
+
+STATIC_ASSERT(SDFT_SAMPLE_SIZE % 2 == 0 && SDFT_BIN_COUNT >= 4, sdft_sample_size_invalid);
 
 static FAST_DATA_ZERO_INIT float     rPowerN;  // SDFT_R to the power of SDFT_SAMPLE_SIZE
 static FAST_DATA_ZERO_INIT bool      isInitialized;
@@ -67,39 +71,59 @@ void sdftInit(sdft_t *sdft, const int startBin, const int endBin, const int numB
 }
 
 
-// Add new sample to frequency spectrum
-FAST_CODE void sdftPush(sdft_t *sdft, const float sample)
+// Update bins [binStart, binEnd) of sdftCount spectra with the same bin range
+static FAST_CODE void updateBins(sdft_t *sdft, const int sdftCount, const float *samples, const int binStart, const int binEnd, const bool lastBatch)
 {
-    const float delta = sample - rPowerN * sdft->samples[sdft->idx];
-    
-    sdft->samples[sdft->idx] = sample;
-    sdft->idx = (sdft->idx + 1) % SDFT_SAMPLE_SIZE;
+    float delta[XYZ_AXIS_COUNT];
 
-    for (int i = sdft->startBin; i <= sdft->endBin; i++) {
-        sdft->data[i] = twiddle[i] * (sdft->data[i] + delta);
+    for (int n = 0; n < sdftCount; n++) {
+        delta[n] = samples[n] - rPowerN * sdft[n].samples[sdft[n].idx];
+
+        if (lastBatch) {
+            sdft[n].samples[sdft[n].idx] = samples[n];
+            sdft[n].idx = (sdft[n].idx + 1) % SDFT_SAMPLE_SIZE;
+        }
+    }
+
+    for (int i = binStart; i < binEnd; i++) {
+        const complex_t t = twiddle[i];
+
+        for (int n = 0; n < sdftCount; n++) {
+            sdft[n].data[i] = t * (sdft[n].data[i] + delta[n]);
+        }
     }
 }
 
 
-// Add new sample to frequency spectrum in parts
-FAST_CODE void sdftPushBatch(sdft_t* sdft, const float sample, const int batchIdx)
+static FAST_CODE void pushBatch(sdft_t *sdft, const int sdftCount, const float *samples, const int batchIdx)
 {
-    const int batchStart = sdft->batchSize * batchIdx;
-    int batchEnd = batchStart;
+    const int batchStart = sdft->startBin + sdft->batchSize * batchIdx;
+    const bool lastBatch = batchIdx == sdft->numBatches - 1;
+    const int batchEnd = lastBatch ? sdft->endBin + 1 : MIN(batchStart + sdft->batchSize, sdft->endBin + 1);
 
-    const float delta = sample - rPowerN * sdft->samples[sdft->idx];
+    updateBins(sdft, sdftCount, samples, batchStart, batchEnd, lastBatch);
+}
 
-    if (batchIdx == sdft->numBatches - 1) {
-        sdft->samples[sdft->idx] = sample;
-        sdft->idx = (sdft->idx + 1) % SDFT_SAMPLE_SIZE;
-        batchEnd += sdft->endBin - batchStart + 1;
-    } else {
-        batchEnd += sdft->batchSize;
-    }
 
-    for (int i = batchStart; i < batchEnd; i++) {
-        sdft->data[i] = twiddle[i] * (sdft->data[i] + delta);
-    }
+// Add new sample to frequency spectrum
+FAST_CODE void sdftPush(sdft_t *sdft, const float sample)
+{
+    updateBins(sdft, 1, &sample, sdft->startBin, sdft->endBin + 1, true);
+}
+
+
+// Add new sample to frequency spectrum in parts
+FAST_CODE void sdftPushBatch(sdft_t *sdft, const float sample, const int batchIdx)
+{
+    pushBatch(sdft, 1, &sample, batchIdx);
+}
+
+
+// Add new samples of all axes to their frequency spectra in parts, sharing the twiddle factors in one loop.
+// sdft points to XYZ_AXIS_COUNT instances initialised with the same bin range and number of batches.
+FAST_CODE void sdftPushBatchAxes(sdft_t *sdft, const float *samples, const int batchIdx)
+{
+    pushBatch(sdft, XYZ_AXIS_COUNT, samples, batchIdx);
 }
 
 
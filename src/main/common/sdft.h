@@ -28,7 +28,10 @@
 #undef I  // avoid collision of imaginary unit I with variable I in pid.h
 typedef float complex complex_t; // Better readability for type "float complex"
 
+// Frequency resolution can be traded for RAM and CPU per target, e.g. 48, 72 or 128 samples
+#ifndef SDFT_SAMPLE_SIZE
 #define SDFT_SAMPLE_SIZE 72
+#endif
 #define SDFT_BIN_COUNT   (SDFT_SAMPLE_SIZE / 2)
 
 typedef struct sdft_s {
@@ -46,6 +49,7 @@ typedef struct sdft_s {
 void sdftInit(sdft_t *sdft, const int startBin, const int endBin, const int numBatches);
 void sdftPush(sdft_t *sdft, const float sample);
 void sdftPushBatch(sdft_t *sdft, const float sample, const int batchIdx);
+void sdftPushBatchAxes(sdft_t *sdft, const float *samples, const int batchIdx);
 void sdftMagSq(const sdft_t *sdft, float *output);
 void sdftMagnitude(const sdft_t *sdft, float *output);
 void sdftWinSq(const sdft_t *sdft, float *output);
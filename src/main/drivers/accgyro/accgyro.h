@@ -97,6 +97,7 @@ typedef struct gyroDev_s {
     sensorGyroInitFuncPtr initFn;                             // initialize function
     sensorGyroReadFuncPtr readFn;                             // read 3 axis data function
     sensorGyroReadDataFuncPtr temperatureFn;                  // read temperature if available
+    sensorGyroSampleFuncPtr sampleFn;                         // called in ISR context when a DMA read completes, if set
     extiCallbackRec_t exti;
     extDevice_t dev;
     float scale;                                             // scalefactor
@@ -129,6 +129,10 @@ busStatus_e mpuIntcallback(uint32_t arg)
 
     gyro->dataReady = true;
 
+    if (gyro->sampleFn) {
+        gyro->sampleFn(gyro);
+    }
+
     return BUS_READY;
 }
 
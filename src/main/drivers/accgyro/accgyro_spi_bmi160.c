@@ -278,6 +278,10 @@ busStatus_e bmi160Intcallback(uint32_t arg)
 
     gyro->dataReady = true;
 
+    if (gyro->sampleFn) {
+        gyro->sampleFn(gyro);
+    }
+
     return BUS_READY;
 }
 
@@ -289,6 +289,10 @@ busStatus_e bmi270Intcallback(uint32_t arg)
 
     gyro->dataReady = true;
 
+    if (gyro->sampleFn) {
+        gyro->sampleFn(gyro);
+    }
+
     return BUS_READY;
 }
 
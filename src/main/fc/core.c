@@ -53,6 +53,7 @@
 #include "drivers/transponder_ir.h"
 
 #include "fc/controlrate_profile.h"
+#include "fc/latency.h"
 #include "fc/rc.h"
 #include "fc/rc_adjustments.h"
 #include "fc/rc_controls.h"
@@ -569,6 +570,10 @@ void tryArm(void)
         resetMaxFFT();
 #endif
 
+#ifdef USE_LATENCY_STATS
+        latencyReset();
+#endif
+
         disarmAt = currentTimeUs + armingConfig()->auto_disarm_delay * 1e6;   // start disarm timeout, will be extended when throttle is nonzero
 
         lastArmingDisabledReason = 0;
@@ -1103,6 +1108,9 @@ static FAST_CODE_NOINLINE void subTaskPidController(timeUs_t currentTimeUs)
     // PID - note this is function pointer set by setPIDController()
     pidController(currentPidProfile, currentTimeUs);
     DEBUG_SET(DEBUG_PIDLOOP, 1, micros() - startTime);
+#ifdef USE_LATENCY_STATS
+    latencyRecord(LATENCY_STAGE_PID, gyroGetFilteredSampleCycles(), getCycleCounter());
+#endif
 
 #ifdef USE_RUNAWAY_TAKEOFF
     // Check to see if runaway takeoff detection is active (anti-taz), the pidSum is over the threshold,
@@ -1212,6 +1220,9 @@ static FAST_CODE void subTaskMotorUpdate(timeUs_t currentTimeUs)
 #endif
 
     writeMotors();
+#ifdef USE_LATENCY_STATS
+    latencyRecord(LATENCY_STAGE_MOTOR, gyroGetFilteredSampleCycles(), getCycleCounter());
+#endif
 
 #ifdef USE_DSHOT_TELEMETRY_STATS
     if (debugMode == DEBUG_DSHOT_RPM_ERRORS && useDshotTelemetry) {
@@ -1251,7 +1262,9 @@ static FAST_CODE_NOINLINE void subTaskRcCommand(timeUs_t currentTimeUs)
 FAST_CODE void taskGyroSample(timeUs_t currentTimeUs)
 {
     UNUSED(currentTimeUs);
-    gyroUpdate();
+    if (!gyroIsrFilteringActive()) {
+        gyroUpdate();
+    }
     if (pidUpdateCounter % activePidLoopDenom == 0) {
         pidUpdateCounter = 0;
     }
@@ -87,6 +87,7 @@
 #include "fc/board_info.h"
 #include "fc/dispatch.h"
 #include "fc/init.h"
+#include "fc/latency.h"
 #include "fc/rc_controls.h"
 #include "fc/runtime_config.h"
 #include "fc/stats.h"
@@ -179,6 +180,10 @@
 void targetPreInit(void);
 #endif
 
+#ifdef TARGET_POSTINIT
+void targetPostInit(void);
+#endif
+
 uint8_t systemState = SYSTEM_STATE_INITIALISING;
 
 #ifdef BUS_SWITCH_PIN
@@ -583,6 +588,11 @@ void init(void)
 #endif
 
 
+#if defined(USE_FLASHFS) && defined(USE_BLACKBOX)
+    // before flashfs is set up, either for MSC below or for logging further down
+    flashfsSetEraseAheadSectors(blackboxConfig()->flash_erase_ahead);
+#endif
+
 #ifdef TARGET_BUS_INIT
     targetBusInit();
 
@@ -707,6 +717,10 @@ void init(void)
 
     pidInit(currentPidProfile);
 
+#ifdef USE_LATENCY_STATS
+    latencyReset();
+#endif
+
     mixerInitProfile();
 
 #ifdef USE_PID_AUDIO
@@ -1011,5 +1025,9 @@ void init(void)
 
     tasksInit();
 
+#ifdef TARGET_POSTINIT
+    targetPostInit();
+#endif
+
     systemState |= SYSTEM_STATE_READY;
 }
@@ -0,0 +1,136 @@
+/*
+ * This file is part of Cleanflight and Betaflight.
+ *
+ * Cleanflight and Betaflight are free software. You can redistribute
+ * this software and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Cleanflight and Betaflight are distributed in the hope that they
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Gyro to motor latency histograms.
+//
+// Each stage of the PID loop records the time since the gyro sample it is working on was read, into a
+// histogram of LATENCY_BUCKET_COUNT fixed width buckets. The bucket width is chosen on reset so the
+// histograms span LATENCY_RANGE_LOOPS PID loop periods, percentiles are reported as the upper edge of
+// the bucket they fall into. Minimum, maximum, mean and standard deviation (jitter) are tracked exactly.
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "platform.h"
+
+#ifdef USE_LATENCY_STATS
+
+#include "common/maths.h"
+#include "common/time.h"
+#include "common/utils.h"
+
+#include "drivers/system.h"
+
+#include "flight/pid.h"
+
+#include "latency.h"
+
+const char * const latencyStageNames[LATENCY_STAGE_COUNT] = { "FILTER", "PID", "MOTOR" };
+
+static latencyHistogram_t latencyHistograms[LATENCY_STAGE_COUNT];
+static uint16_t bucketWidthUs;
+static uint32_t bucketWidthCycles;
+
+void latencyReset(void)
+{
+    memset(latencyHistograms, 0, sizeof(latencyHistograms));
+
+    bucketWidthUs = MAX((LATENCY_RANGE_LOOPS * targetPidLooptime + LATENCY_BUCKET_COUNT - 1) / LATENCY_BUCKET_COUNT, 1U);
+    bucketWidthCycles = MAX(clockMicrosToCycles(bucketWidthUs), 1U);
+}
+
+FAST_CODE void latencyRecord(latencyStage_e stage, uint32_t sampleCycles, uint32_t stageCycles)
+{
+    latencyHistogram_t *histogram = &latencyHistograms[stage];
+
+    // a sample taken after the stage started (or none at all yet) counts as no latency
+    const uint32_t latencyCycles = MAX(cmpTimeCycles(stageCycles, sampleCycles), 0);
+    const uint32_t bucket = bucketWidthCycles ? MIN(latencyCycles / bucketWidthCycles, LATENCY_BUCKET_COUNT - 1U) : LATENCY_BUCKET_COUNT - 1;
+
+    if (histogram->count == 0) {
+        histogram->offsetCycles = latencyCycles;
+        histogram->minCycles = latencyCycles;
+    }
+    const int64_t deviationCycles = (int64_t)latencyCycles - histogram->offsetCycles;
+    histogram->sumCycles += deviationCycles;
+    histogram->sumSqCycles += deviationCycles * deviationCycles;
+
+    histogram->buckets[bucket]++;
+    histogram->count++;
+    histogram->minCycles = MIN(histogram->minCycles, latencyCycles);
+    histogram->maxCycles = MAX(histogram->maxCycles, latencyCycles);
+    histogram->lastCycles = latencyCycles;
+}
+
+static uint16_t latencyCyclesToUs(uint32_t cycles)
+{
+    return MIN(clockCyclesToMicros(cycles), UINT16_MAX);
+}
+
+// Upper edge of the bucket holding the given percentile, never more than the largest latency seen
+static uint16_t latencyPercentileUs(const latencyHistogram_t *histogram, uint32_t percent)
+{
+    const uint32_t maxUs = latencyCyclesToUs(histogram->maxCycles);
+    const uint64_t target = (uint64_t)histogram->count * percent;
+
+    uint64_t cumulative = 0;
+    for (unsigned bucket = 0; bucket < LATENCY_BUCKET_COUNT - 1; bucket++) {
+        cumulative += (uint64_t)histogram->buckets[bucket] * 100;
+        if (cumulative >= target) {
+            return MIN((bucket + 1) * bucketWidthUs, maxUs);
+        }
+    }
+
+    return maxUs;
+}
+
+void latencyGetStats(latencyStage_e stage, latencyStats_t *stats)
+{
+    const latencyHistogram_t *histogram = &latencyHistograms[stage];
+
+    memset(stats, 0, sizeof(*stats));
+
+    const uint32_t count = histogram->count;
+    stats->count = count;
+    if (count) {
+        stats->minUs = latencyCyclesToUs(histogram->minCycles);
+        stats->p50Us = latencyPercentileUs(histogram, 50);
+        stats->p99Us = latencyPercentileUs(histogram, 99);
+        stats->maxUs = latencyCyclesToUs(histogram->maxCycles);
+
+        const float meanDeviationCycles = (float)histogram->sumCycles / count;
+        const float varianceCycles = (float)histogram->sumSqCycles / count - sq(meanDeviationCycles);
+        stats->average10thUs = clockCyclesTo10thMicros(histogram->offsetCycles + lrintf(meanDeviationCycles));
+        stats->jitter10thUs = clockCyclesTo10thMicros(lrintf(sqrtf(MAX(varianceCycles, 0.0f))));
+    }
+}
+
+uint16_t latencyGetLastUs(latencyStage_e stage)
+{
+    return latencyCyclesToUs(latencyHistograms[stage].lastCycles);
+}
+
+uint16_t latencyGetBucketWidthUs(void)
+{
+    return bucketWidthUs;
+}
+
+#endif // USE_LATENCY_STATS
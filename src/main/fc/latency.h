@@ -0,0 +1,63 @@
+/*
+ * This file is part of Cleanflight and Betaflight.
+ *
+ * Cleanflight and Betaflight are free software. You can redistribute
+ * this software and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Cleanflight and Betaflight are distributed in the hope that they
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#define LATENCY_BUCKET_COUNT 64            // the last bucket also counts everything beyond the histogram range
+#define LATENCY_RANGE_LOOPS  2             // histograms cover this many PID loop periods
+
+// Every stage is measured from the time the gyro driver read the newest sample used
+typedef enum {
+    LATENCY_STAGE_FILTER = 0,              // until filtering of the sample is complete
+    LATENCY_STAGE_PID,                     // until the PID controller has run on it
+    LATENCY_STAGE_MOTOR,                   // until the motor outputs computed from it have been started
+    LATENCY_STAGE_COUNT
+} latencyStage_e;
+
+typedef struct latencyHistogram_s {
+    uint32_t count;
+    uint32_t minCycles;
+    uint32_t maxCycles;
+    uint32_t lastCycles;
+    uint32_t offsetCycles;                 // first latency since the reset, the sums are taken relative to it
+    int64_t sumCycles;                     // so the sum of squares keeps its precision over long runs
+    int64_t sumSqCycles;
+    uint32_t buckets[LATENCY_BUCKET_COUNT];
+} latencyHistogram_t;
+
+typedef struct latencyStats_s {
+    uint32_t count;
+    uint16_t minUs;
+    uint16_t p50Us;
+    uint16_t p99Us;
+    uint16_t maxUs;
+    int32_t average10thUs;
+    int32_t jitter10thUs;                  // standard deviation of the latency
+} latencyStats_t;
+
+extern const char * const latencyStageNames[LATENCY_STAGE_COUNT];
+
+void latencyReset(void);
+void latencyRecord(latencyStage_e stage, uint32_t sampleCycles, uint32_t stageCycles);
+void latencyGetStats(latencyStage_e stage, latencyStats_t *stats);
+uint16_t latencyGetLastUs(latencyStage_e stage);
+uint16_t latencyGetBucketWidthUs(void);
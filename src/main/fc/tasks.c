@@ -24,6 +24,8 @@
 
 #include "platform.h"
 
+#include "blackbox/blackbox.h"
+
 #include "build/debug.h"
 
 #include "cli/cli.h"
@@ -131,6 +133,7 @@ static void taskMain(timeUs_t currentTimeUs)
 
 #ifdef USE_FLASHFS
     flashfsEraseAsync();
+    flashfsEraseAheadAsync();
 #endif
 }
 
@@ -164,6 +167,15 @@ static void taskBatteryAlerts(timeUs_t currentTimeUs)
     batteryUpdateAlarms();
 }
 
+#ifdef USE_BLACKBOX_DEFERRED
+static void taskBlackbox(timeUs_t currentTimeUs)
+{
+    if (!cliMode) {
+        blackboxTaskUpdate(currentTimeUs);
+    }
+}
+#endif
+
 #ifdef USE_ACC
 static void taskUpdateAccelerometer(timeUs_t currentTimeUs)
 {
@@ -457,6 +469,10 @@ task_attribute_t task_attributes[TASK_COUNT] = {
 #ifdef USE_CRSF_V3
     [TASK_SPEED_NEGOTIATION] = DEFINE_TASK("SPEED_NEGOTIATION", NULL, NULL, speedNegotiationProcess, TASK_PERIOD_HZ(100), TASK_PRIORITY_LOW),
 #endif
+
+#ifdef USE_BLACKBOX_DEFERRED
+    [TASK_BLACKBOX] = DEFINE_TASK("BLACKBOX", NULL, NULL, taskBlackbox, TASK_PERIOD_HZ(1000), TASK_PRIORITY_LOW),
+#endif
 };
 
 task_t *getTask(unsigned taskId)
@@ -624,5 +640,9 @@ void tasksInit(void)
     const bool useCRSF = rxRuntimeState.serialrxProvider == SERIALRX_CRSF;
     setTaskEnabled(TASK_SPEED_NEGOTIATION, useCRSF);
 #endif
+
+#ifdef USE_BLACKBOX_DEFERRED
+    setTaskEnabled(TASK_BLACKBOX, blackboxConfig()->device && blackboxConfig()->deferred);
+#endif
 }
 
@@ -26,6 +26,9 @@
  * 
  * 2021_02 updated by KarateBrot: switched FFT with SDFT, multiple notches per axis
  * test pilots: Sugar K, bizmar
+ *
+ * Peaks are followed by per-axis tracks with a constant velocity Kalman filter,
+ * notch depth follows how consistently a track is confirmed by peaks.
  */
 
 #include <math.h>
@@ -52,14 +55,13 @@
 
 #include "dyn_notch_filter.h"
 
-// SDFT_SAMPLE_SIZE defaults to 72 (common/sdft.h).
-// We get 36 frequency bins from 72 consecutive data values, called SDFT_BIN_COUNT (common/sdft.h)
-// Bin 0 is DC and can't be used.
-// Only bins 1 to 35 are usable.
+// The SDFT (common/sdft.h) gives SDFT_BIN_COUNT = SDFT_SAMPLE_SIZE / 2 frequency bins from SDFT_SAMPLE_SIZE
+// consecutive data values. Targets may override SDFT_SAMPLE_SIZE for finer or coarser resolution.
+// Bin 0 is DC and can't be used, only bins 1 to SDFT_BIN_COUNT - 1 are usable.
 
 // A gyro sample is collected every PID loop.
 // sampleCount recent gyro values are accumulated and averaged
-// to ensure that 72 samples are collected at the right rate for the required SDFT bandwidth.
+// to ensure that samples are pushed into the SDFT at the right rate for the required bandwidth.
 
 // For an 8k PID loop, at default 600hz max, 6 sequential gyro data points are averaged, SDFT runs 1333Hz.
 // Upper limit of SDFT is half that frequency, eg 666Hz by default.
@@ -70,7 +72,7 @@
 
 // When sampleIndex reaches sampleCount, the averaged gyro value is put into the corresponding SDFT.
 // At 8k, with 600Hz max, sampleCount = 6, this happens every 6 * 0.125us, or every 0.75ms.
-// Hence to completely replace all 72 samples of the SDFT input buffer with clean new data takes 54ms.
+// Hence to completely replace the SDFT input buffer with clean new data takes SDFT_SAMPLE_SIZE * 0.75ms.
 
 // The SDFT code is split into steps. It takes 4 PID loops to calculate the SDFT, track peaks and update the filters for one axis.
 // Since there are three axes, it takes 12 PID loops to completely update all axes.
@@ -80,11 +82,18 @@
 // Four points in the buffer will have changed in that time, and each point will be the average of three samples.
 // Hence output jitter at 4k is about four times worse than at 8k. At 2k output jitter is quite bad.
 
-// Each SDFT output bin has width sdftSampleRateHz/72, ie 18.5Hz per bin at 1333Hz.
-// Usable bandwidth is half this, ie 666Hz if sdftSampleRateHz is 1333Hz, i.e. bin 1 is 18.5Hz, bin 2 is 37.0Hz etc.
+// Each SDFT output bin has width sdftSampleRateHz / SDFT_SAMPLE_SIZE, i.e. bin n is centred on
+// n * sdftSampleRateHz / SDFT_SAMPLE_SIZE. Usable bandwidth is half of sdftSampleRateHz, ie 666Hz if sdftSampleRateHz is 1333Hz.
+
+// The Hann window is applied to the spectrum once per axis update in STEP_WINDOW. Folding it into the batched
+// sample push was tried and dropped, as it windowed every bin of every axis on every sample, about twice the work.
 
-#define DYN_NOTCH_SMOOTH_HZ        4
 #define DYN_NOTCH_CALC_TICKS       (XYZ_AXIS_COUNT * STEP_COUNT) // 3 axes and 4 steps per axis
+#define DYN_NOTCH_TRACK_ACCEL      50000.0f  // Hz/s^2, expected peak acceleration (e.g. throttle punch), Kalman process noise
+#define DYN_NOTCH_TRACK_GATE       3.0f      // peaks further away from a track than this many standard deviations start a new track
+#define DYN_NOTCH_MEASUREMENT_BINS 0.25f     // standard deviation of a peak position at noise threshold, in bins
+#define DYN_NOTCH_FULL_DEPTH_SNR   5.0f      // peaks this many times above noise threshold get a full depth notch
+#define DYN_NOTCH_CONFIDENCE_HZ    10.0f     // cutoff of notch depth smoothing
 #define DYN_NOTCH_OSD_MIN_THROTTLE 20
 #define DYN_NOTCH_UPDATE_MIN_HZ    2000
 
@@ -105,6 +114,23 @@ typedef struct peak_s {
 
 } peak_t;
 
+typedef struct measurement_s {
+
+    float freq;
+    float snr;  // peak value relative to noise threshold
+
+} measurement_t;
+
+// Notch center frequency track: state (freq, rate), its covariance and the resulting notch weight
+typedef struct track_s {
+
+    float freq;        // Hz
+    float rate;        // Hz/s
+    float p00, p01, p11;
+    float confidence;  // 0..1
+
+} track_t;
+
 typedef struct state_s {
 
     // state machine step information
@@ -122,8 +148,8 @@ typedef struct dynNotch_s {
     int count;
 
     int maxCenterFreq;
-    float centerFreq[XYZ_AXIS_COUNT][DYN_NOTCH_COUNT_MAX];
-    
+    track_t track[XYZ_AXIS_COUNT][DYN_NOTCH_COUNT_MAX];
+
     timeUs_t looptimeUs;
     biquadFilter_t notch[XYZ_AXIS_COUNT][DYN_NOTCH_COUNT_MAX];
 
@@ -151,7 +177,14 @@ static FAST_DATA_ZERO_INIT float   sdftResolutionHz;
 static FAST_DATA_ZERO_INIT int     sdftStartBin;
 static FAST_DATA_ZERO_INIT int     sdftEndBin;
 static FAST_DATA_ZERO_INIT float   sdftNoiseThreshold;
-static FAST_DATA_ZERO_INIT float   pt1LooptimeS;
+
+// parameters for peak tracking
+static FAST_DATA_ZERO_INIT float   trackIntervalS;  // time between two updates of the same axis
+static FAST_DATA_ZERO_INIT float   trackQ00, trackQ01, trackQ11;
+static FAST_DATA_ZERO_INIT float   trackMeasurementVar;
+static FAST_DATA_ZERO_INIT float   trackMaxVar;
+static FAST_DATA_ZERO_INIT float   trackMaxRateVar;
+static FAST_DATA_ZERO_INIT float   confidenceGain;
 
 
 void dynNotchInit(const dynNotchConfig_t *config, const timeUs_t targetLooptimeUs)
@@ -186,17 +219,40 @@ void dynNotchInit(const dynNotchConfig_t *config, const timeUs_t targetLooptimeU
     sdftResolutionHz = sdftSampleRateHz / SDFT_SAMPLE_SIZE; // 18.5hz per bin at 8k and 600Hz maxHz
     sdftStartBin = MAX(2, lrintf(dynNotch.minHz / sdftResolutionHz)); // can't use bin 0 because it is DC.
     sdftEndBin = MIN(SDFT_BIN_COUNT - 1, lrintf(dynNotch.maxHz / sdftResolutionHz)); // can't use more than SDFT_BIN_COUNT bins.
-    pt1LooptimeS = DYN_NOTCH_CALC_TICKS / looprateHz;
+    trackIntervalS = DYN_NOTCH_CALC_TICKS / looprateHz;
+
+    // discrete white noise acceleration model
+    const float dt = trackIntervalS;
+    const float accelVar = sq(DYN_NOTCH_TRACK_ACCEL);
+    trackQ00 = accelVar * sq(dt) * sq(dt) / 4;
+    trackQ01 = accelVar * sq(dt) * dt / 2;
+    trackQ11 = accelVar * sq(dt);
+    trackMeasurementVar = sq(DYN_NOTCH_MEASUREMENT_BINS * sdftResolutionHz);
+    trackMaxVar = sq(sdftResolutionHz);
+    trackMaxRateVar = sq(DYN_NOTCH_TRACK_ACCEL * trackIntervalS);
+    confidenceGain = pt1FilterGain(DYN_NOTCH_CONFIDENCE_HZ, trackIntervalS);
 
     for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
         sdftInit(&sdft[axis], sdftStartBin, sdftEndBin, sampleCount);
+        sampleAccumulator[axis] = 0.0f;
+        sampleAvg[axis] = 0.0f;
     }
+    sampleIndex = 0;
+    state.tick = 0;
+    state.step = 0;
+    state.axis = 0;
 
     for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
         for (int p = 0; p < dynNotch.count; p++) {
-            // any init value is fine, but evenly spreading centerFreqs across frequency range makes notch filters stick to peaks quicker
-            dynNotch.centerFreq[axis][p] = (p + 0.5f) * (dynNotch.maxHz - dynNotch.minHz) / (float)dynNotch.count + dynNotch.minHz;
-            biquadFilterInit(&dynNotch.notch[axis][p], dynNotch.centerFreq[axis][p], dynNotch.looptimeUs, dynNotch.q, FILTER_NOTCH, 1.0f);
+            // any init value is fine, but evenly spreading tracks across frequency range makes notch filters stick to peaks quicker
+            track_t *track = &dynNotch.track[axis][p];
+            track->freq = (p + 0.5f) * (dynNotch.maxHz - dynNotch.minHz) / (float)dynNotch.count + dynNotch.minHz;
+            track->rate = 0.0f;
+            track->p00 = trackMaxVar;
+            track->p01 = 0.0f;
+            track->p11 = trackMaxRateVar;
+            track->confidence = 0.5f;
+            biquadFilterInit(&dynNotch.notch[axis][p], track->freq, dynNotch.looptimeUs, dynNotch.q, FILTER_NOTCH, track->confidence);
         }
     }
 }
@@ -209,6 +265,44 @@ FAST_CODE void dynNotchPush(const int axis, const float sample)
 
 static void dynNotchProcess(void);
 
+// Constant velocity prediction of track over one update interval
+static FAST_CODE void trackPredict(track_t *track)
+{
+    const float dt = trackIntervalS;
+
+    track->freq += track->rate * dt;
+    track->p00 += dt * (2.0f * track->p01 + dt * track->p11) + trackQ00;
+    track->p01 += dt * track->p11 + trackQ01;
+    track->p11 += trackQ11;
+
+    // uncertainty of a track without peaks saturates, otherwise its gate would swallow any peak
+    track->p00 = MIN(track->p00, trackMaxVar);
+    track->p11 = MIN(track->p11, trackMaxRateVar);
+    track->p01 = constrainf(track->p01, -sqrtf(track->p00 * track->p11), sqrtf(track->p00 * track->p11));
+
+    // stop at range limits
+    if (track->freq < dynNotch.minHz || track->freq > dynNotch.maxHz) {
+        track->freq = constrainf(track->freq, dynNotch.minHz, dynNotch.maxHz);
+        track->rate = 0.0f;
+    }
+}
+
+// Kalman correction of track with a measured peak frequency
+static FAST_CODE void trackCorrect(track_t *track, const float freq, const float measurementVar)
+{
+    const float s = track->p00 + measurementVar;
+    const float k0 = track->p00 / s;
+    const float k1 = track->p01 / s;
+    const float innovation = freq - track->freq;
+
+    track->freq += k0 * innovation;
+    track->rate += k1 * innovation;
+
+    track->p11 -= k1 * track->p01;
+    track->p01 -= k0 * track->p01;
+    track->p00 -= k0 * track->p00;
+}
+
 // Downsample and analyse gyro data
 FAST_CODE void dynNotchUpdate(void)
 {
@@ -221,7 +315,7 @@ FAST_CODE void dynNotchUpdate(void)
         for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
             sampleAvg[axis] = sampleAccumulator[axis] * sampleCountRcp;
             sampleAccumulator[axis] = 0;
-            if (axis == gyro.gyroDebugAxis) {
+            if (axis == (int)gyro.gyroDebugAxis) {
                 DEBUG_SET(DEBUG_FFT, 2, lrintf(sampleAvg[axis]));
             }
         }
@@ -234,10 +328,8 @@ FAST_CODE void dynNotchUpdate(void)
     }
 
     // 2us @ F722
-    // SDFT processing in batches to synchronize with incoming downsampled data
-    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
-        sdftPushBatch(&sdft[axis], sampleAvg[axis], sampleIndex);
-    }
+    // SDFT processing in batches to synchronize with incoming downsampled data, all axes in one pass
+    sdftPushBatchAxes(sdft, sampleAvg, sampleIndex);
     sampleIndex++;
 
     // Find frequency peaks and update filters
@@ -262,7 +354,7 @@ static FAST_CODE_NOINLINE void dynNotchProcess(void)
         case STEP_WINDOW: // 4.1us (3-6us) @ F722
         {
             sdftWinSq(&sdft[state.axis], sdftData);
-            
+
             // Get total vibrational power in dyn notch range for noise floor estimate in STEP_CALC_FREQUENCIES
             sdftNoiseThreshold = 0.0f;
             for (int bin = (sdftStartBin + 1); bin < sdftEndBin; bin++) {   // don't use startBin or endBin because they are not windowed properly
@@ -335,9 +427,10 @@ static FAST_CODE_NOINLINE void dynNotchProcess(void)
             // A noise threshold 2 times the noise floor prevents peak tracking being too sensitive to noise
             sdftNoiseThreshold *= 2.0f;
 
+            // Sub-bin peak positions of all peaks above noise floor, strongest first
+            measurement_t measurements[DYN_NOTCH_COUNT_MAX];
+            int measurementCount = 0;
             for (int p = 0; p < dynNotch.count; p++) {
-
-                // Only update dynNotch.centerFreq if there is a peak (ignore void peaks) and if peak is above noise floor
                 if (peaks[p].bin != 0 && peaks[p].value > sdftNoiseThreshold) {
 
                     float meanBin = peaks[p].bin;
@@ -353,29 +446,83 @@ static FAST_CODE_NOINLINE void dynNotchProcess(void)
                         meanBin += (y0 - y2) / denom;
                     }
 
-                    // Convert bin to frequency: freq = bin * binResoultion (bin 0 is 0Hz)
-                    const float centerFreq = constrainf(meanBin * sdftResolutionHz, dynNotch.minHz, dynNotch.maxHz);
+                    measurement_t measurement = {
+                        // Convert bin to frequency: freq = bin * binResoultion (bin 0 is 0Hz)
+                        .freq = constrainf(meanBin * sdftResolutionHz, dynNotch.minHz, dynNotch.maxHz),
+                        .snr = sdftNoiseThreshold > 0.0f ? peaks[p].value / sdftNoiseThreshold : DYN_NOTCH_FULL_DEPTH_SNR,
+                    };
+
+                    int k = measurementCount++;
+                    for (; k > 0 && measurements[k - 1].snr < measurement.snr; k--) {
+                        measurements[k] = measurements[k - 1];
+                    }
+                    measurements[k] = measurement;
+                }
+            }
+
+            track_t *tracks = dynNotch.track[state.axis];
+            bool assigned[DYN_NOTCH_COUNT_MAX] = { false };
+
+            for (int p = 0; p < dynNotch.count; p++) {
+                trackPredict(&tracks[p]);
+            }
+
+            // Assign each peak to the closest free track within the gate, or restart the least confident free track on it
+            for (int m = 0; m < measurementCount; m++) {
+                // Strong peaks are located more precisely, up to the bias of the sub-bin interpolation
+                const float measurementVar = trackMeasurementVar / MIN(measurements[m].snr, DYN_NOTCH_FULL_DEPTH_SNR);
+
+                int best = -1;
+                float bestDistance = 0.0f;
+                for (int p = 0; p < dynNotch.count; p++) {
+                    const float distance = fabsf(measurements[m].freq - tracks[p].freq);
+                    const bool inGate = sq(distance) < sq(DYN_NOTCH_TRACK_GATE) * (tracks[p].p00 + measurementVar);
+                    if (!assigned[p] && inGate && (best < 0 || distance < bestDistance)) {
+                        best = p;
+                        bestDistance = distance;
+                    }
+                }
+
+                if (best < 0) {
+                    for (int p = 0; p < dynNotch.count; p++) {
+                        if (!assigned[p] && (best < 0 || tracks[p].confidence < tracks[best].confidence)) {
+                            best = p;
+                        }
+                    }
+                    tracks[best].freq = measurements[m].freq;
+                    tracks[best].rate = 0.0f;
+                    tracks[best].p00 = measurementVar;
+                    tracks[best].p01 = 0.0f;
+                    tracks[best].p11 = trackMaxRateVar;
+                } else {
+                    trackCorrect(&tracks[best], measurements[m].freq, measurementVar);
+                }
 
-                    // PT1 style smoothing moves notch center freqs rapidly towards big peaks and slowly away, up to 10x faster 
-                    const float cutoffMult = constrainf(peaks[p].value / sdftNoiseThreshold, 1.0f, 10.0f);
-                    const float gain = pt1FilterGain(DYN_NOTCH_SMOOTH_HZ * cutoffMult, pt1LooptimeS); // dynamic PT1 k value
+                // Notch depth follows peak strength, up to full depth at DYN_NOTCH_FULL_DEPTH_SNR
+                const float depth = constrainf((measurements[m].snr - 1.0f) / (DYN_NOTCH_FULL_DEPTH_SNR - 1.0f), 0.0f, 1.0f);
+                tracks[best].confidence += confidenceGain * (depth - tracks[best].confidence);
+                assigned[best] = true;
+            }
 
-                    // Finally update notch center frequency p on current axis
-                    dynNotch.centerFreq[state.axis][p] += gain * (centerFreq - dynNotch.centerFreq[state.axis][p]);
+            // Tracks without a peak fade out and stop
+            for (int p = 0; p < dynNotch.count; p++) {
+                if (!assigned[p]) {
+                    tracks[p].confidence -= confidenceGain * tracks[p].confidence;
+                    tracks[p].rate -= confidenceGain * tracks[p].rate;
                 }
             }
 
             if(calculateThrottlePercentAbs() > DYN_NOTCH_OSD_MIN_THROTTLE) {
                 for (int p = 0; p < dynNotch.count; p++) {
-                    dynNotch.maxCenterFreq = MAX(dynNotch.maxCenterFreq, dynNotch.centerFreq[state.axis][p]);
+                    dynNotch.maxCenterFreq = MAX(dynNotch.maxCenterFreq, tracks[p].freq);
                 }
             }
 
-            if (state.axis == gyro.gyroDebugAxis) {
+            if (state.axis == (int)gyro.gyroDebugAxis) {
                 for (int p = 0; p < dynNotch.count && p < 3; p++) {
-                    DEBUG_SET(DEBUG_FFT_FREQ, p, lrintf(dynNotch.centerFreq[state.axis][p]));
+                    DEBUG_SET(DEBUG_FFT_FREQ, p, lrintf(tracks[p].freq));
                 }
-                DEBUG_SET(DEBUG_DYN_LPF, 1, lrintf(dynNotch.centerFreq[state.axis][0]));
+                DEBUG_SET(DEBUG_DYN_LPF, 1, lrintf(tracks[0].freq));
             }
 
             DEBUG_SET(DEBUG_FFT_TIME, 1, micros() - startTime);
@@ -385,10 +532,9 @@ static FAST_CODE_NOINLINE void dynNotchProcess(void)
         case STEP_UPDATE_FILTERS: // 5.4us (2-9us) @ F722
         {
             for (int p = 0; p < dynNotch.count; p++) {
-                // Only update notch filter coefficients if the corresponding peak got its center frequency updated in the previous step
-                if (peaks[p].bin != 0 && peaks[p].value > sdftNoiseThreshold) {
-                    biquadFilterUpdate(&dynNotch.notch[state.axis][p], dynNotch.centerFreq[state.axis][p], dynNotch.looptimeUs, dynNotch.q, FILTER_NOTCH, 1.0f);
-                }
+                // All tracks moved (prediction) or changed depth in the previous step
+                const track_t *track = &dynNotch.track[state.axis][p];
+                biquadFilterUpdate(&dynNotch.notch[state.axis][p], track->freq, dynNotch.looptimeUs, dynNotch.q, FILTER_NOTCH, track->confidence);
             }
 
             DEBUG_SET(DEBUG_FFT_TIME, 1, micros() - startTime);
@@ -403,12 +549,22 @@ static FAST_CODE_NOINLINE void dynNotchProcess(void)
 FAST_CODE float dynNotchFilter(const int axis, float value) 
 {
     for (int p = 0; p < dynNotch.count; p++) {
-        value = biquadFilterApplyDF1(&dynNotch.notch[axis][p], value);
+        value = biquadFilterApplyDF1Weighted(&dynNotch.notch[axis][p], value);
     }
 
     return value;
 }
 
+float dynNotchGetCenterFreq(const int axis, const int index)
+{
+    return dynNotch.track[axis][index].freq;
+}
+
+float dynNotchGetWeight(const int axis, const int index)
+{
+    return dynNotch.track[axis][index].confidence;
+}
+
 bool isDynNotchActive(void)
 {
     return dynNotch.count > 0;
@@ -32,6 +32,8 @@ void dynNotchInit(const dynNotchConfig_t *config, const timeUs_t targetLooptimeU
 void dynNotchPush(const int axis, const float sample);
 void dynNotchUpdate(void);
 float dynNotchFilter(const int axis, float value);
+float dynNotchGetCenterFreq(const int axis, const int index);
+float dynNotchGetWeight(const int axis, const int index);
 bool isDynNotchActive(void);
 int getMaxFFT(void);
 void resetMaxFFT(void);
@@ -198,10 +198,10 @@ static float invSqrt(float x)
     return 1.0f / sqrtf(x);
 }
 
-static void imuMahonyAHRSupdate(float dt, float gx, float gy, float gz,
-                                bool useAcc, float ax, float ay, float az,
-                                bool useMag,
-                                bool useCOG, float courseOverGround, const float dcmKpGain)
+void imuMahonyAHRSupdate(float dt, float gx, float gy, float gz,
+                         bool useAcc, float ax, float ay, float az,
+                         bool useMag,
+                         bool useCOG, float courseOverGround, const float dcmKpGain)
 {
     static float integralFBx = 0.0f,  integralFBy = 0.0f, integralFBz = 0.0f;    // integral error terms scaled by Ki
 
@@ -74,6 +74,14 @@ void imuUpdateAttitude(timeUs_t currentTimeUs);
 
 void imuInit(void);
 
+#ifdef USE_ACC
+// Exported for the benchmarks, see benchmark_kernels.c
+void imuMahonyAHRSupdate(float dt, float gx, float gy, float gz,
+                         bool useAcc, float ax, float ay, float az,
+                         bool useMag,
+                         bool useCOG, float courseOverGround, const float dcmKpGain);
+#endif
+
 #ifdef SIMULATOR_BUILD
 void imuSetAttitudeRPY(float roll, float pitch, float yaw);  // in deg
 void imuSetAttitudeQuat(float w, float x, float y, float z);
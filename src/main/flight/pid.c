@@ -919,16 +919,18 @@ void FAST_CODE pidController(const pidProfile_t *pidProfile, timeUs_t currentTim
             previousRawGyroRateDterm[axis] = gyroRateDterm[axis];
             DEBUG_SET(DEBUG_D_LPF, axis, lrintf(delta));
         }
-
-        gyroRateDterm[axis] = pidRuntime.dtermNotchApplyFn((filter_t *) &pidRuntime.dtermNotch[axis], gyroRateDterm[axis]);
-        gyroRateDterm[axis] = pidRuntime.dtermLowpassApplyFn((filter_t *) &pidRuntime.dtermLowpass[axis], gyroRateDterm[axis]);
-        gyroRateDterm[axis] = pidRuntime.dtermLowpass2ApplyFn((filter_t *) &pidRuntime.dtermLowpass2[axis], gyroRateDterm[axis]);
     }
 
+    filterChainApply(&pidRuntime.dtermFilter, gyroRateDterm);
+    filterChainApply(&pidRuntime.dtermLowpass2, gyroRateDterm);
+
     rotateItermAndAxisError();
 
 #ifdef USE_RPM_FILTER
-    rpmFilterUpdate();
+    if (!gyroIsrFilteringActive()) {
+        // otherwise updated by the gyro ISR together with the filtering
+        rpmFilterUpdate();
+    }
 #endif
 
 #ifdef USE_FEEDFORWARD
@@ -1236,24 +1238,16 @@ void dynLpfDTermUpdate(float throttle)
 
         switch (pidRuntime.dynLpfFilter) {
         case DYN_LPF_PT1:
-            for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
-                pt1FilterUpdateCutoff(&pidRuntime.dtermLowpass[axis].pt1Filter, pt1FilterGain(cutoffFreq, pidRuntime.dT));
-            }
+            filterChainUpdateLowpassGain(&pidRuntime.dtermFilter, pt1FilterGain(cutoffFreq, pidRuntime.dT));
             break;
         case DYN_LPF_BIQUAD:
-            for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
-                biquadFilterUpdateLPF(&pidRuntime.dtermLowpass[axis].biquadFilter, cutoffFreq, targetPidLooptime);
-            }
+            filterChainUpdateLowpassBiquad(&pidRuntime.dtermFilter, cutoffFreq, targetPidLooptime);
             break;
         case DYN_LPF_PT2:
-            for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
-                pt2FilterUpdateCutoff(&pidRuntime.dtermLowpass[axis].pt2Filter, pt2FilterGain(cutoffFreq, pidRuntime.dT));
-            }
+            filterChainUpdateLowpassGain(&pidRuntime.dtermFilter, pt2FilterGain(cutoffFreq, pidRuntime.dT));
             break;
         case DYN_LPF_PT3:
-            for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
-                pt3FilterUpdateCutoff(&pidRuntime.dtermLowpass[axis].pt3Filter, pt3FilterGain(cutoffFreq, pidRuntime.dT));
-            }
+            filterChainUpdateLowpassGain(&pidRuntime.dtermFilter, pt3FilterGain(cutoffFreq, pidRuntime.dT));
             break;
         }
     }
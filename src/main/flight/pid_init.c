@@ -68,11 +68,11 @@ void pidInitFilters(const pidProfile_t *pidProfile)
 {
     STATIC_ASSERT(FD_YAW == 2, FD_YAW_incorrect); // ensure yaw axis is 2
 
+    filterChainInit(&pidRuntime.dtermFilter);
+    filterChainInit(&pidRuntime.dtermLowpass2);
+
     if (targetPidLooptime == 0) {
         // no looptime set, so set all the filters to null
-        pidRuntime.dtermNotchApplyFn = nullFilterApply;
-        pidRuntime.dtermLowpassApplyFn = nullFilterApply;
-        pidRuntime.dtermLowpass2ApplyFn = nullFilterApply;
         pidRuntime.ptermYawLowpassApplyFn = nullFilterApply;
         return;
     }
@@ -91,13 +91,8 @@ void pidInitFilters(const pidProfile_t *pidProfile)
     }
 
     if (dTermNotchHz != 0 && pidProfile->dterm_notch_cutoff != 0) {
-        pidRuntime.dtermNotchApplyFn = (filterApplyFnPtr)biquadFilterApply;
         const float notchQ = filterGetNotchQ(dTermNotchHz, pidProfile->dterm_notch_cutoff);
-        for (int axis = FD_ROLL; axis <= FD_YAW; axis++) {
-            biquadFilterInit(&pidRuntime.dtermNotch[axis], dTermNotchHz, targetPidLooptime, notchQ, FILTER_NOTCH, 1.0f);
-        }
-    } else {
-        pidRuntime.dtermNotchApplyFn = nullFilterApply;
+        filterChainAddNotch(&pidRuntime.dtermFilter, dTermNotchHz, notchQ, targetPidLooptime);
     }
 
     //1st Dterm Lowpass Filter
@@ -110,84 +105,72 @@ void pidInitFilters(const pidProfile_t *pidProfile)
 #endif
 
     if (dterm_lpf1_init_hz > 0) {
+        filterChainLowpass_t *lowpass = pidRuntime.dtermFilter.lowpass;
         switch (pidProfile->dterm_lpf1_type) {
         case FILTER_PT1:
-            pidRuntime.dtermLowpassApplyFn = (filterApplyFnPtr)pt1FilterApply;
+            filterChainSetLowpass(&pidRuntime.dtermFilter, FILTER_CHAIN_LPF_PT1);
             for (int axis = FD_ROLL; axis <= FD_YAW; axis++) {
-                pt1FilterInit(&pidRuntime.dtermLowpass[axis].pt1Filter, pt1FilterGain(dterm_lpf1_init_hz, pidRuntime.dT));
+                pt1FilterInit(&lowpass[axis].pt1, pt1FilterGain(dterm_lpf1_init_hz, pidRuntime.dT));
             }
             break;
         case FILTER_BIQUAD:
             if (pidProfile->dterm_lpf1_static_hz < pidFrequencyNyquist) {
-#ifdef USE_DYN_LPF
-                pidRuntime.dtermLowpassApplyFn = (filterApplyFnPtr)biquadFilterApplyDF1;
-#else
-                pidRuntime.dtermLowpassApplyFn = (filterApplyFnPtr)biquadFilterApply;
-#endif
+                filterChainSetLowpass(&pidRuntime.dtermFilter, FILTER_CHAIN_LPF_BIQUAD);
                 for (int axis = FD_ROLL; axis <= FD_YAW; axis++) {
-                    biquadFilterInitLPF(&pidRuntime.dtermLowpass[axis].biquadFilter, dterm_lpf1_init_hz, targetPidLooptime);
+                    biquadFilterInitLPF(&lowpass[axis].biquad, dterm_lpf1_init_hz, targetPidLooptime);
                 }
-            } else {
-                pidRuntime.dtermLowpassApplyFn = nullFilterApply;
             }
             break;
         case FILTER_PT2:
-            pidRuntime.dtermLowpassApplyFn = (filterApplyFnPtr)pt2FilterApply;
+            filterChainSetLowpass(&pidRuntime.dtermFilter, FILTER_CHAIN_LPF_PT2);
             for (int axis = FD_ROLL; axis <= FD_YAW; axis++) {
-                pt2FilterInit(&pidRuntime.dtermLowpass[axis].pt2Filter, pt2FilterGain(dterm_lpf1_init_hz, pidRuntime.dT));
+                pt2FilterInit(&lowpass[axis].pt2, pt2FilterGain(dterm_lpf1_init_hz, pidRuntime.dT));
             }
             break;
         case FILTER_PT3:
-            pidRuntime.dtermLowpassApplyFn = (filterApplyFnPtr)pt3FilterApply;
+            filterChainSetLowpass(&pidRuntime.dtermFilter, FILTER_CHAIN_LPF_PT3);
             for (int axis = FD_ROLL; axis <= FD_YAW; axis++) {
-                pt3FilterInit(&pidRuntime.dtermLowpass[axis].pt3Filter, pt3FilterGain(dterm_lpf1_init_hz, pidRuntime.dT));
+                pt3FilterInit(&lowpass[axis].pt3, pt3FilterGain(dterm_lpf1_init_hz, pidRuntime.dT));
             }
             break;
         default:
-            pidRuntime.dtermLowpassApplyFn = nullFilterApply;
             break;
         }
-    } else {
-        pidRuntime.dtermLowpassApplyFn = nullFilterApply;
     }
 
     //2nd Dterm Lowpass Filter
     if (pidProfile->dterm_lpf2_static_hz > 0) {
+        filterChainLowpass_t *lowpass = pidRuntime.dtermLowpass2.lowpass;
         switch (pidProfile->dterm_lpf2_type) {
         case FILTER_PT1:
-            pidRuntime.dtermLowpass2ApplyFn = (filterApplyFnPtr)pt1FilterApply;
+            filterChainSetLowpass(&pidRuntime.dtermLowpass2, FILTER_CHAIN_LPF_PT1);
             for (int axis = FD_ROLL; axis <= FD_YAW; axis++) {
-                pt1FilterInit(&pidRuntime.dtermLowpass2[axis].pt1Filter, pt1FilterGain(pidProfile->dterm_lpf2_static_hz, pidRuntime.dT));
+                pt1FilterInit(&lowpass[axis].pt1, pt1FilterGain(pidProfile->dterm_lpf2_static_hz, pidRuntime.dT));
             }
             break;
         case FILTER_BIQUAD:
             if (pidProfile->dterm_lpf2_static_hz < pidFrequencyNyquist) {
-                pidRuntime.dtermLowpass2ApplyFn = (filterApplyFnPtr)biquadFilterApply;
+                filterChainSetLowpass(&pidRuntime.dtermLowpass2, FILTER_CHAIN_LPF_BIQUAD);
                 for (int axis = FD_ROLL; axis <= FD_YAW; axis++) {
-                    biquadFilterInitLPF(&pidRuntime.dtermLowpass2[axis].biquadFilter, pidProfile->dterm_lpf2_static_hz, targetPidLooptime);
+                    biquadFilterInitLPF(&lowpass[axis].biquad, pidProfile->dterm_lpf2_static_hz, targetPidLooptime);
                 }
-            } else {
-                pidRuntime.dtermLowpassApplyFn = nullFilterApply;
             }
             break;
         case FILTER_PT2:
-            pidRuntime.dtermLowpass2ApplyFn = (filterApplyFnPtr)pt2FilterApply;
+            filterChainSetLowpass(&pidRuntime.dtermLowpass2, FILTER_CHAIN_LPF_PT2);
             for (int axis = FD_ROLL; axis <= FD_YAW; axis++) {
-                pt2FilterInit(&pidRuntime.dtermLowpass2[axis].pt2Filter, pt2FilterGain(pidProfile->dterm_lpf2_static_hz, pidRuntime.dT));
+                pt2FilterInit(&lowpass[axis].pt2, pt2FilterGain(pidProfile->dterm_lpf2_static_hz, pidRuntime.dT));
             }
             break;
         case FILTER_PT3:
-            pidRuntime.dtermLowpass2ApplyFn = (filterApplyFnPtr)pt3FilterApply;
+            filterChainSetLowpass(&pidRuntime.dtermLowpass2, FILTER_CHAIN_LPF_PT3);
             for (int axis = FD_ROLL; axis <= FD_YAW; axis++) {
-                pt3FilterInit(&pidRuntime.dtermLowpass2[axis].pt3Filter, pt3FilterGain(pidProfile->dterm_lpf2_static_hz, pidRuntime.dT));
+                pt3FilterInit(&lowpass[axis].pt3, pt3FilterGain(pidProfile->dterm_lpf2_static_hz, pidRuntime.dT));
             }
             break;
         default:
-            pidRuntime.dtermLowpass2ApplyFn = nullFilterApply;
             break;
         }
-    } else {
-        pidRuntime.dtermLowpass2ApplyFn = nullFilterApply;
     }
 
     if (pidProfile->yaw_lowpass_hz == 0) {
@@ -251,6 +234,10 @@ void pidInit(const pidProfile_t *pidProfile)
     pidInitFilters(pidProfile);
     pidInitConfig(pidProfile);
 #ifdef USE_RPM_FILTER
+#ifdef USE_GYRO_ISR_FILTERING
+    // the ISR applies the RPM notches when it does the gyro filtering
+    gyroStopIsrFiltering();
+#endif
     rpmFilterInit(rpmFilterConfig(), gyro.targetLooptime);
 #endif
 }
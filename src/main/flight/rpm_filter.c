@@ -30,6 +30,8 @@
 
 #include "common/filter.h"
 #include "common/maths.h"
+#include "common/notch_bank.h"
+#include "common/utils.h"
 
 #include "drivers/dshot.h"
 
@@ -45,7 +47,6 @@
 #include "rpm_filter.h"
 
 #define RPM_FILTER_HARMONICS_MAX 3
-#define RPM_FILTER_DURATION_S    0.001f  // Maximum duration allowed to update all RPM notches once
 #define SECONDS_PER_MINUTE       60.0f
 #define ERPM_PER_LSB             100.0f
 
@@ -59,10 +60,13 @@ typedef struct rpmFilter_s {
     float q;
 
     timeUs_t looptimeUs;
-    biquadFilter_t notch[XYZ_AXIS_COUNT][MAX_SUPPORTED_MOTORS][RPM_FILTER_HARMONICS_MAX];
+    notchBank_t notches;  // notch of harmonic h of motor m is at index m * numHarmonics + h
+    notchBankTable_t coefficients;
 
 } rpmFilter_t;
 
+STATIC_ASSERT(MAX_SUPPORTED_MOTORS * RPM_FILTER_HARMONICS_MAX <= NOTCH_BANK_SIZE, rpm_notch_bank_too_small);
+
 // Singleton
 FAST_DATA_ZERO_INIT static rpmFilter_t rpmFilter;
 
@@ -71,18 +75,12 @@ FAST_DATA_ZERO_INIT static float motorFrequencyHz[MAX_SUPPORTED_MOTORS];
 FAST_DATA_ZERO_INIT static float minMotorFrequencyHz;
 FAST_DATA_ZERO_INIT static float erpmToHz;
 
-// batch processing of RPM notches
-FAST_DATA_ZERO_INIT static int notchUpdatesPerIteration;
-FAST_DATA_ZERO_INIT static int motorIndex;
-FAST_DATA_ZERO_INIT static int harmonicIndex;
-
 
 void rpmFilterInit(const rpmFilterConfig_t *config, const timeUs_t looptimeUs)
 {
-    motorIndex = 0;
-    harmonicIndex = 0;
     minMotorFrequencyHz = 0;
     rpmFilter.numHarmonics = 0; // disable RPM Filtering
+    rpmFilter.notches.count = 0;
 
     // if bidirectional DShot is not available
     if (!motorConfig()->dev.useDshotTelemetry) {
@@ -107,19 +105,18 @@ void rpmFilterInit(const rpmFilterConfig_t *config, const timeUs_t looptimeUs)
     rpmFilter.q = config->rpm_filter_q / 100.0f;
     rpmFilter.looptimeUs = looptimeUs;
 
-    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
-        for (int motor = 0; motor < getMotorCount(); motor++) {
-            for (int i = 0; i < rpmFilter.numHarmonics; i++) {
-                biquadFilterInit(&rpmFilter.notch[axis][motor][i], rpmFilter.minHz * i, rpmFilter.looptimeUs, rpmFilter.q, FILTER_NOTCH, 0.0f);
-            }
+    notchBankTableInit(&rpmFilter.coefficients, rpmFilter.looptimeUs, rpmFilter.q);
+    notchBankInit(&rpmFilter.notches, getMotorCount() * rpmFilter.numHarmonics);
+#ifdef USE_FIXED_POINT_FILTERS
+    notchBankSetFixedPoint(&rpmFilter.notches, gyroConfig()->gyro_filter_fixed_point);
+#endif
+    for (int motor = 0; motor < getMotorCount(); motor++) {
+        for (int i = 0; i < rpmFilter.numHarmonics; i++) {
+            notchBankUpdate(&rpmFilter.notches, motor * rpmFilter.numHarmonics + i, rpmFilter.minHz * i, rpmFilter.looptimeUs, rpmFilter.q, 0.0f);
         }
     }
 
     erpmToHz = ERPM_PER_LSB / SECONDS_PER_MINUTE  / (motorConfig()->motorPoleCount / 2.0f);
-
-    const float loopIterationsPerUpdate = RPM_FILTER_DURATION_S / (looptimeUs * 1e-6f);
-    const float numNotchesPerAxis = getMotorCount() * rpmFilter.numHarmonics;
-    notchUpdatesPerIteration = ceilf(numNotchesPerAxis / loopIterationsPerUpdate); // round to ceiling
 }
 
 FAST_CODE_NOINLINE void rpmFilterUpdate(void)
@@ -142,54 +139,31 @@ FAST_CODE_NOINLINE void rpmFilterUpdate(void)
         return;
     }
 
-    // update RPM notches
-    for (int i = 0; i < notchUpdatesPerIteration; i++) {
+    // update all RPM notches every loop, interpolating coefficients is cheap enough
+    for (int notchIndex = 0; notchIndex < rpmFilter.notches.count; notchIndex++) {
 
-        // select current notch on ROLL
-        biquadFilter_t *template = &rpmFilter.notch[0][motorIndex][harmonicIndex];
+        const int motorIndex = notchIndex / rpmFilter.numHarmonics;
+        const int harmonicIndex = notchIndex % rpmFilter.numHarmonics;
 
         const float frequencyHz = constrainf((harmonicIndex + 1) * motorFrequencyHz[motorIndex], rpmFilter.minHz, rpmFilter.maxHz);
         const float marginHz = frequencyHz - rpmFilter.minHz;
-        
+
         // fade out notch when approaching minHz (turn it off)
         float weight = 1.0f;
         if (marginHz < rpmFilter.fadeRangeHz) {
             weight = marginHz / rpmFilter.fadeRangeHz;
         }
 
-        // update notch
-        biquadFilterUpdate(template, frequencyHz, rpmFilter.looptimeUs, rpmFilter.q, FILTER_NOTCH, weight);
-
-        // copy notch properties to corresponding notches on PITCH and YAW
-        for (int axis = 1; axis < XYZ_AXIS_COUNT; axis++) {
-            biquadFilter_t *dest = &rpmFilter.notch[axis][motorIndex][harmonicIndex];
-            dest->b0 = template->b0;
-            dest->b1 = template->b1;
-            dest->b2 = template->b2;
-            dest->a1 = template->a1;
-            dest->a2 = template->a2;
-            dest->weight = template->weight;
-        }
-
-        // cycle through all notches on ROLL (takes RPM_FILTER_DURATION_S at max.)
-        harmonicIndex = (harmonicIndex + 1) % rpmFilter.numHarmonics;
-        if (harmonicIndex == 0) {
-            motorIndex = (motorIndex + 1) % getMotorCount();
-        }
+        // update notch, coefficients are shared by all axes
+        notchBankUpdateFromTable(&rpmFilter.notches, notchIndex, &rpmFilter.coefficients, frequencyHz, weight);
     }
 }
 
-FAST_CODE float rpmFilterApply(const int axis, float value)
+FAST_CODE void rpmFilterApply(float *values)
 {
-    // Iterate over all notches on axis and apply each one to value.
+    // Apply all notches to roll, pitch and yaw in one pass.
     // Order of application doesn't matter because biquads are linear time-invariant filters.
-    for (int i = 0; i < rpmFilter.numHarmonics; i++) {
-        for (int motor = 0; motor < getMotorCount(); motor++) {
-            value = biquadFilterApplyDF1Weighted(&rpmFilter.notch[axis][motor][i], value);
-        }
-    }
-
-    return value;
+    notchBankApply(&rpmFilter.notches, values);
 }
 
 bool isRpmFilterEnabled(void)
@@ -28,6 +28,6 @@
 
 void rpmFilterInit(const rpmFilterConfig_t *config, const timeUs_t looptimeUs);
 void rpmFilterUpdate(void);
-float rpmFilterApply(const int axis, float value);
+void rpmFilterApply(float *values);
 bool isRpmFilterEnabled(void);
 float getMinMotorFrequency(void);
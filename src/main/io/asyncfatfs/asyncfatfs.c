@@ -105,6 +105,13 @@
 #define AFATFS_CACHE_DISCARDABLE  8
 // Increase the retain counter of the cache sector to prevent it from being discarded when in the in-sync state
 #define AFATFS_CACHE_RETAIN       16
+// The sector holds the contents of a file rather than filesystem metadata, so it may be flushed out of write-order
+#define AFATFS_CACHE_FILE_DATA    32
+// The sector is being read before it was asked for, so don't count this as a cache miss
+#define AFATFS_CACHE_READ_AHEAD   64
+
+// How many sectors beyond the cursor to read ahead of a file that's being read sequentially
+#define AFATFS_READ_AHEAD_SECTORS 2
 
 // Turn the largest free block on the disk into one contiguous file for efficient fragment-free allocation
 #define AFATFS_USE_FREEFILE
@@ -213,6 +220,16 @@ typedef struct afatfsCacheBlockDescriptor_t {
      * is overridden by the locked and retainCount flags.
      */
     unsigned discardable:1;
+
+    /*
+     * This block holds file contents rather than FAT or directory sectors. Metadata must reach the disk in the order
+     * it was changed, but file contents can be flushed ahead of it to continue a multiple block write, since we
+     * never rely on data being written after the metadata that points to it.
+     */
+    unsigned fileData:1;
+
+    // A read was started for a cache miss, so the read completing shouldn't then count as a hit
+    unsigned missPending:1;
 } afatfsCacheBlockDescriptor_t;
 
 typedef enum {
@@ -329,8 +346,24 @@ typedef struct afatfsDeleteFile_t {
     afatfsCallback_t callback;
 } afatfsUnlinkFile_t;
 
+typedef enum {
+    AFATFS_CLOSE_FILE_PHASE_INITIAL = 0,
+    AFATFS_CLOSE_FILE_PHASE_UPDATE_DIRECTORY = 0,
+#ifdef AFATFS_USE_FREEFILE
+    AFATFS_CLOSE_FILE_PHASE_TERMINATE_FAT_CHAIN,
+    AFATFS_CLOSE_FILE_PHASE_RELEASE_FAT_CHAIN,
+    AFATFS_CLOSE_FILE_PHASE_PREPEND_TO_FREEFILE,
+#endif
+    AFATFS_CLOSE_FILE_PHASE_RELEASE_FILE
+} afatfsCloseFilePhase_e;
+
 typedef struct afatfsCloseFile_t {
     afatfsCallback_t callback;
+    afatfsCloseFilePhase_e phase;
+#ifdef AFATFS_USE_FREEFILE
+    uint32_t releaseStartCluster; // First cluster of the preallocated superclusters we return to the freefile, or 0
+    uint32_t currentCluster; // Used to mark progress
+#endif
 } afatfsCloseFile_t;
 
 typedef enum {
@@ -420,6 +453,11 @@ typedef struct afatfsFile_t {
     // The first cluster number of the file, or 0 if this file is empty
     uint32_t firstCluster;
 
+#ifdef AFATFS_USE_FREEFILE
+    // The number of superclusters a contiguous file takes from the freefile each time it runs out of space
+    uint16_t superclustersPerAppend;
+#endif
+
     // State for a queued operation on the file
     struct afatfsFileOperation_t operation;
 } afatfsFile_t;
@@ -469,6 +507,11 @@ typedef struct afatfs_t {
 
     int cacheDirtyEntries; // The number of cache entries in the AFATFS_CACHE_STATE_DIRTY state
     bool cacheFlushInProgress;
+    uint32_t cacheNextFlushSector; // The sector after the one we last sent to the card
+    uint32_t cacheFlushRunEndSector; // The sector after the end of the last multiple block write we started
+
+    uint32_t cacheHits;
+    uint32_t cacheMisses;
 
     afatfsFile_t openFiles[AFATFS_MAX_OPEN_FILES];
 
@@ -645,6 +688,8 @@ static void afatfs_cacheSectorInit(afatfsCacheBlockDescriptor_t *descriptor, uin
     descriptor->locked = locked;
     descriptor->retainCount = 0;
     descriptor->discardable = 0;
+    descriptor->fileData = 0;
+    descriptor->missPending = 0;
 }
 
 /**
@@ -704,6 +749,22 @@ static void afatfs_sdcardWriteComplete(sdcardBlockOperation_e operation, uint32_
     }
 }
 
+/**
+ * Remember where the card's write has got to after the given sector was handed to it, so that we can keep a multiple
+ * block write going.
+ */
+static void afatfs_cacheSectorFlushStarted(afatfsCacheBlockDescriptor_t *descriptor)
+{
+    if (descriptor->consecutiveEraseBlockCount) {
+        afatfs.cacheFlushRunEndSector = descriptor->sectorIndex + descriptor->consecutiveEraseBlockCount;
+
+        // Don't pre-erase again if the sector is dirtied again later
+        descriptor->consecutiveEraseBlockCount = 0;
+    }
+
+    afatfs.cacheNextFlushSector = descriptor->sectorIndex + 1;
+}
+
 /**
  * Attempt to flush the dirty cache entry with the given index to the SDcard.
  */
@@ -723,12 +784,14 @@ static void afatfs_cacheFlushSector(int cacheIndex)
             afatfs.cacheDirtyEntries--;
             cacheDescriptor->state = AFATFS_CACHE_STATE_WRITING;
             afatfs.cacheFlushInProgress = true;
+            afatfs_cacheSectorFlushStarted(cacheDescriptor);
             break;
 
         case SDCARD_OPERATION_SUCCESS:
             // Buffer is already transmitted
             afatfs.cacheDirtyEntries--;
             cacheDescriptor->state = AFATFS_CACHE_STATE_IN_SYNC;
+            afatfs_cacheSectorFlushStarted(cacheDescriptor);
             break;
 
         case SDCARD_OPERATION_BUSY:
@@ -771,15 +834,18 @@ static afatfsCacheBlockDescriptor_t* afatfs_findCacheSector(uint32_t sectorIndex
  *
  * - The requested sector that already exists in the cache
  * - The index of an empty sector
- * - The index of a synced discardable sector
- * - The index of the oldest synced sector
+ * - The index of the least recently used synced discardable sector
+ * - The index of the least recently used synced sector
  *
  * Otherwise it returns -1 to signal failure (cache is full!)
  */
 static int afatfs_allocateCacheSector(uint32_t sectorIndex)
 {
     int allocateIndex;
-    int emptyIndex = -1, discardableIndex = -1;
+    int emptyIndex = -1;
+
+    uint32_t oldestDiscardableSectorLastUse = 0xFFFFFFFF;
+    int oldestDiscardableSectorIndex = -1;
 
     uint32_t oldestSyncedSectorLastUse = 0xFFFFFFFF;
     int oldestSyncedSectorIndex = -1;
@@ -817,7 +883,10 @@ static int afatfs_allocateCacheSector(uint32_t sectorIndex)
                 // Is this a synced sector that we could evict from the cache?
                 if (!afatfs.cacheDescriptor[i].locked && afatfs.cacheDescriptor[i].retainCount == 0) {
                     if (afatfs.cacheDescriptor[i].discardable) {
-                        discardableIndex = i;
+                        if (afatfs.cacheDescriptor[i].accessTimestamp < oldestDiscardableSectorLastUse) {
+                            oldestDiscardableSectorLastUse = afatfs.cacheDescriptor[i].accessTimestamp;
+                            oldestDiscardableSectorIndex = i;
+                        }
                     } else if (afatfs.cacheDescriptor[i].accessTimestamp < oldestSyncedSectorLastUse) {
                         // This is older than last block we decided to evict, so evict this one in preference
                         oldestSyncedSectorLastUse = afatfs.cacheDescriptor[i].accessTimestamp;
@@ -832,8 +901,8 @@ static int afatfs_allocateCacheSector(uint32_t sectorIndex)
 
     if (emptyIndex > -1) {
         allocateIndex = emptyIndex;
-    } else if (discardableIndex > -1) {
-        allocateIndex = discardableIndex;
+    } else if (oldestDiscardableSectorIndex > -1) {
+        allocateIndex = oldestDiscardableSectorIndex;
     } else if (oldestSyncedSectorIndex > -1) {
         allocateIndex = oldestSyncedSectorIndex;
     } else {
@@ -847,6 +916,32 @@ static int afatfs_allocateCacheSector(uint32_t sectorIndex)
     return allocateIndex;
 }
 
+/**
+ * Count the dirty file data sectors that directly follow the cache entry with the given index, which can be sent to
+ * the card along with it in one multiple block write.
+ */
+static uint32_t afatfs_cacheCountConsecutiveFileData(int cacheIndex)
+{
+    uint32_t sectorIndex = afatfs.cacheDescriptor[cacheIndex].sectorIndex;
+    uint32_t count = 1;
+    bool found;
+
+    do {
+        found = false;
+
+        for (int i = 0; i < AFATFS_NUM_CACHE_SECTORS; i++) {
+            if (afatfs.cacheDescriptor[i].sectorIndex == sectorIndex + count && afatfs.cacheDescriptor[i].state == AFATFS_CACHE_STATE_DIRTY
+                && afatfs.cacheDescriptor[i].fileData && !afatfs.cacheDescriptor[i].locked) {
+                count++;
+                found = true;
+                break;
+            }
+        }
+    } while (found);
+
+    return count;
+}
+
 /**
  * Attempt to flush dirty cache pages out to the sdcard, returning true if all flushable data has been flushed.
  */
@@ -856,17 +951,50 @@ bool afatfs_flush(void)
         // Flush the oldest flushable sector
         uint32_t earliestSectorTime = 0xFFFFFFFF;
         int earliestSectorIndex = -1;
+        int consecutiveSectorIndex = -1;
 
         for (int i = 0; i < AFATFS_NUM_CACHE_SECTORS; i++) {
-            if (afatfs.cacheDescriptor[i].state == AFATFS_CACHE_STATE_DIRTY && !afatfs.cacheDescriptor[i].locked
-                && (earliestSectorIndex == -1 || afatfs.cacheDescriptor[i].writeTimestamp < earliestSectorTime)
-            ) {
-                earliestSectorIndex = i;
-                earliestSectorTime = afatfs.cacheDescriptor[i].writeTimestamp;
+            if (afatfs.cacheDescriptor[i].state == AFATFS_CACHE_STATE_DIRTY && !afatfs.cacheDescriptor[i].locked) {
+                if (earliestSectorIndex == -1 || afatfs.cacheDescriptor[i].writeTimestamp < earliestSectorTime) {
+                    earliestSectorIndex = i;
+                    earliestSectorTime = afatfs.cacheDescriptor[i].writeTimestamp;
+                }
+
+                if (afatfs.cacheDescriptor[i].sectorIndex == afatfs.cacheNextFlushSector) {
+                    consecutiveSectorIndex = i;
+                }
             }
         }
 
         if (earliestSectorIndex > -1) {
+            const bool multipleBlockWriteInProgress = afatfs.cacheNextFlushSector < afatfs.cacheFlushRunEndSector;
+
+            /*
+             * Unless it would overtake metadata, prefer the sector that follows the one we flushed last, so that the
+             * card can carry on with the multiple block write it has in progress.
+             */
+            if (multipleBlockWriteInProgress && consecutiveSectorIndex > -1 && afatfs.cacheDescriptor[consecutiveSectorIndex].fileData) {
+                earliestSectorIndex = consecutiveSectorIndex;
+            }
+
+#ifdef AFATFS_MIN_MULTIPLE_BLOCK_WRITE_COUNT
+            /*
+             * If we're starting a new write and the file data that follows this sector is dirty too, send it all as one
+             * multiple block write. We only pre-erase sectors we're holding dirty, so any that don't make it into
+             * this write will still be written later.
+             */
+            afatfsCacheBlockDescriptor_t *descriptor = &afatfs.cacheDescriptor[earliestSectorIndex];
+
+            if (descriptor->fileData && descriptor->consecutiveEraseBlockCount == 0
+                && !(multipleBlockWriteInProgress && descriptor->sectorIndex == afatfs.cacheNextFlushSector)) {
+                uint32_t consecutiveCount = afatfs_cacheCountConsecutiveFileData(earliestSectorIndex);
+
+                if (consecutiveCount >= AFATFS_MIN_MULTIPLE_BLOCK_WRITE_COUNT) {
+                    descriptor->consecutiveEraseBlockCount = consecutiveCount;
+                }
+            }
+#endif
+
             afatfs_cacheFlushSector(earliestSectorIndex);
 
             // That flush will take time to complete so we may as well tell caller to come back later
@@ -951,7 +1079,19 @@ static afatfsOperationStatus_e afatfs_cacheSector(uint32_t physicalSectorIndex,
         return AFATFS_OPERATION_IN_PROGRESS;
     }
 
-    switch (afatfs.cacheDescriptor[cacheSectorIndex].state) {
+    afatfsCacheBlockDescriptor_t *descriptor = &afatfs.cacheDescriptor[cacheSectorIndex];
+
+    // Reads of sectors that were already cached are hits, reads that had to go to the card are misses
+    if ((sectorFlags & (AFATFS_CACHE_READ | AFATFS_CACHE_READ_AHEAD)) == AFATFS_CACHE_READ
+        && descriptor->state != AFATFS_CACHE_STATE_EMPTY && descriptor->state != AFATFS_CACHE_STATE_READING) {
+        if (descriptor->missPending) {
+            descriptor->missPending = 0;
+        } else {
+            afatfs.cacheHits++;
+        }
+    }
+
+    switch (descriptor->state) {
         case AFATFS_CACHE_STATE_READING:
             return AFATFS_OPERATION_IN_PROGRESS;
         break;
@@ -959,13 +1099,18 @@ static afatfsOperationStatus_e afatfs_cacheSector(uint32_t physicalSectorIndex,
         case AFATFS_CACHE_STATE_EMPTY:
             if ((sectorFlags & AFATFS_CACHE_READ) != 0) {
                 if (sdcard_readBlock(physicalSectorIndex, afatfs_cacheSectorGetMemory(cacheSectorIndex), afatfs_sdcardReadComplete, 0)) {
-                    afatfs.cacheDescriptor[cacheSectorIndex].state = AFATFS_CACHE_STATE_READING;
+                    descriptor->state = AFATFS_CACHE_STATE_READING;
+
+                    if ((sectorFlags & AFATFS_CACHE_READ_AHEAD) == 0) {
+                        afatfs.cacheMisses++;
+                        descriptor->missPending = 1;
+                    }
                 }
                 return AFATFS_OPERATION_IN_PROGRESS;
             }
 
             // We only get to decide these fields if we're the first ones to cache the sector:
-            afatfs.cacheDescriptor[cacheSectorIndex].discardable = (sectorFlags & AFATFS_CACHE_DISCARDABLE) != 0 ? 1 : 0;
+            descriptor->discardable = (sectorFlags & AFATFS_CACHE_DISCARDABLE) != 0 ? 1 : 0;
 
 #ifdef AFATFS_MIN_MULTIPLE_BLOCK_WRITE_COUNT
             // Don't bother pre-erasing for small block sequences
@@ -975,7 +1120,7 @@ static afatfsOperationStatus_e afatfs_cacheSector(uint32_t physicalSectorIndex,
                 eraseCount = MIN(eraseCount, (uint32_t)UINT16_MAX); // If caller asked for a longer chain of sectors we silently truncate that here
             }
 
-            afatfs.cacheDescriptor[cacheSectorIndex].consecutiveEraseBlockCount = eraseCount;
+            descriptor->consecutiveEraseBlockCount = eraseCount;
 #endif
 
             FALLTHROUGH;
@@ -983,16 +1128,20 @@ static afatfsOperationStatus_e afatfs_cacheSector(uint32_t physicalSectorIndex,
         case AFATFS_CACHE_STATE_WRITING:
         case AFATFS_CACHE_STATE_IN_SYNC:
             if ((sectorFlags & AFATFS_CACHE_WRITE) != 0) {
-                afatfs_cacheSectorMarkDirty(&afatfs.cacheDescriptor[cacheSectorIndex]);
+                afatfs_cacheSectorMarkDirty(descriptor);
             }
             FALLTHROUGH;
 
         case AFATFS_CACHE_STATE_DIRTY:
+            if ((sectorFlags & AFATFS_CACHE_WRITE) != 0) {
+                // Whoever wrote to the sector last decides whether it holds file contents or metadata
+                descriptor->fileData = (sectorFlags & AFATFS_CACHE_FILE_DATA) != 0 ? 1 : 0;
+            }
             if ((sectorFlags & AFATFS_CACHE_LOCK) != 0) {
-                afatfs.cacheDescriptor[cacheSectorIndex].locked = 1;
+                descriptor->locked = 1;
             }
             if ((sectorFlags & AFATFS_CACHE_RETAIN) != 0) {
-                afatfs.cacheDescriptor[cacheSectorIndex].retainCount++;
+                descriptor->retainCount++;
             }
 
             *buffer = afatfs_cacheSectorGetMemory(cacheSectorIndex);
@@ -1682,17 +1831,19 @@ static afatfsOperationStatus_e afatfs_appendSuperclusterContinue(afatfsFile_t *f
     afatfsAppendSupercluster_t *opState = &file->operation.state.appendSupercluster;
 
     afatfsOperationStatus_e status = AFATFS_OPERATION_FAILURE;
+    uint32_t superclusters;
 
     doMore:
     switch (opState->phase) {
         case AFATFS_APPEND_SUPERCLUSTER_PHASE_INIT:
-            // Our file steals the first cluster of the freefile
+            // Our file steals the first superclusters of the freefile (as many as it preallocates, if the freefile has them)
+            superclusters = MIN(MAX(file->superclustersPerAppend, 1u), afatfs.freeFile.logicalSize / afatfs_superClusterSize());
 
             // We can go ahead and write to that space before the FAT and directory are updated
             file->cursorCluster = afatfs.freeFile.firstCluster;
-            file->physicalSize += afatfs_superClusterSize();
+            file->physicalSize += superclusters * afatfs_superClusterSize();
 
-            /* Remove the first supercluster from the freefile
+            /* Remove those superclusters from the freefile
              *
              * Even if the freefile becomes empty, we still don't set its first cluster to zero. This is so that
              * afatfs_fileGetNextCluster() can tell where a contiguous file ends (at the start of the freefile).
@@ -1700,13 +1851,13 @@ static afatfsOperationStatus_e afatfs_appendSuperclusterContinue(afatfsFile_t *f
              * Note that normally the freefile can't become empty because it is allocated as a non-integer number
              * of superclusters to avoid precisely this situation.
              */
-            afatfs.freeFile.firstCluster += afatfs_fatEntriesPerSector();
-            afatfs.freeFile.logicalSize -= afatfs_superClusterSize();
-            afatfs.freeFile.physicalSize -= afatfs_superClusterSize();
+            afatfs.freeFile.firstCluster += superclusters * afatfs_fatEntriesPerSector();
+            afatfs.freeFile.logicalSize -= superclusters * afatfs_superClusterSize();
+            afatfs.freeFile.physicalSize -= superclusters * afatfs_superClusterSize();
 
-            // The new supercluster needs to have its clusters chained contiguously and marked with a terminator at the end
+            // The new superclusters need to have their clusters chained contiguously and marked with a terminator at the end
             opState->fatRewriteStartCluster = file->cursorCluster;
-            opState->fatRewriteEndCluster = opState->fatRewriteStartCluster + afatfs_fatEntriesPerSector();
+            opState->fatRewriteEndCluster = opState->fatRewriteStartCluster + superclusters * afatfs_fatEntriesPerSector();
 
             if (opState->previousCluster == 0) {
                 // This is the new first cluster in the file so we need to update the directory entry
@@ -1826,6 +1977,29 @@ static bool afatfs_isEndOfAllocatedFile(afatfsFilePtr_t file)
     }
 }
 
+/**
+ * Start reading the sectors that follow the one at the file's cursor into the cache, so they're ready by the time a
+ * sequential reader gets to them. This stops at the end of the cursor's cluster, since finding the next one would
+ * mean a FAT lookup.
+ */
+static void afatfs_fileReadAhead(afatfsFilePtr_t file, uint32_t physicalSector)
+{
+    uint32_t sectorInCluster = afatfs_sectorIndexInCluster(file->cursorOffset);
+    uint32_t offsetOfStartOfSector = file->cursorOffset & ~((uint32_t) AFATFS_SECTOR_SIZE - 1);
+    uint8_t *buffer;
+
+    for (uint32_t i = 1; i <= AFATFS_READ_AHEAD_SECTORS; i++) {
+        if (sectorInCluster + i >= afatfs.sectorsPerCluster || offsetOfStartOfSector + i * AFATFS_SECTOR_SIZE >= file->logicalSize) {
+            break;
+        }
+
+        // The card can only read one sector at a time, so once a read is in progress the rest will have to wait
+        if (afatfs_cacheSector(physicalSector + i, &buffer, AFATFS_CACHE_READ | AFATFS_CACHE_READ_AHEAD, 0) != AFATFS_OPERATION_SUCCESS) {
+            break;
+        }
+    }
+}
+
 /**
  * Take a lock on the sector at the current file cursor position.
  *
@@ -1867,6 +2041,8 @@ static uint8_t* afatfs_fileRetainCursorSectorForRead(afatfsFilePtr_t file)
         }
 
         file->readRetainCacheIndex = afatfs_getCacheDescriptorIndexForBuffer(result);
+
+        afatfs_fileReadAhead(file, physicalSector);
     }
 
     return result;
@@ -1903,6 +2079,10 @@ static uint8_t* afatfs_fileLockCursorSectorForWrite(afatfsFilePtr_t file)
 
         uint32_t physicalSector = afatfs_fileGetCursorPhysicalSector(file);
         uint8_t cacheFlags = AFATFS_CACHE_WRITE | AFATFS_CACHE_LOCK;
+
+        if (file->type == AFATFS_FILE_TYPE_NORMAL) {
+            cacheFlags |= AFATFS_CACHE_FILE_DATA;
+        }
         uint32_t cursorOffsetInSector = file->cursorOffset % AFATFS_SECTOR_SIZE;
         uint32_t offsetOfStartOfSector = file->cursorOffset & ~((uint32_t) AFATFS_SECTOR_SIZE - 1);
         uint32_t offsetOfEndOfSector = offsetOfStartOfSector + AFATFS_SECTOR_SIZE;
@@ -1918,11 +2098,12 @@ static uint8_t* afatfs_fileLockCursorSectorForWrite(afatfsFilePtr_t file)
             cacheFlags |= AFATFS_CACHE_READ;
         }
 
-        // In contiguous append mode, we'll pre-erase the whole supercluster
+        /*
+         * In contiguous append mode, we'll pre-erase the rest of the space allocated to the file (which ends where the
+         * freefile begins), so that the card can stream the whole extent in a single multiple block write
+         */
         if ((file->mode & (AFATFS_FILE_MODE_APPEND | AFATFS_FILE_MODE_CONTIGUOUS)) == (AFATFS_FILE_MODE_APPEND | AFATFS_FILE_MODE_CONTIGUOUS)) {
-            uint32_t cursorOffsetInSupercluster = file->cursorOffset & (afatfs_superClusterSize() - 1);
-
-            eraseBlockCount = afatfs_fatEntriesPerSector() * afatfs.sectorsPerCluster - cursorOffsetInSupercluster / AFATFS_SECTOR_SIZE;
+            eraseBlockCount = (afatfs.freeFile.firstCluster - file->cursorCluster) * afatfs.sectorsPerCluster - afatfs_sectorIndexInCluster(file->cursorOffset);
         } else {
             eraseBlockCount = 0;
         }
@@ -2155,6 +2336,26 @@ afatfsOperationStatus_e afatfs_fseek(afatfsFilePtr_t file, int32_t offset, afatf
     return afatfs_fseekInternal(file, MIN((uint32_t) offset, file->logicalSize), NULL);
 }
 
+/**
+ * Have a file that was opened in contiguous mode take at least `size` bytes from the freefile each time it runs out of
+ * space, rather than a single supercluster. The FAT and directory entries are then only updated once per extent, so
+ * the card can stream the file's data in one long multiple block write. Whatever the file hasn't used by the time it is
+ * closed is returned to the freefile.
+ *
+ * If power is lost before the file is closed, its directory entry will claim the whole extent.
+ */
+void afatfs_fpreallocate(afatfsFilePtr_t file, uint32_t size)
+{
+#ifdef AFATFS_USE_FREEFILE
+    uint32_t superclusters = size / afatfs_superClusterSize() + (size % afatfs_superClusterSize() != 0 ? 1 : 0);
+
+    file->superclustersPerAppend = MIN(superclusters, (uint32_t) UINT16_MAX);
+#else
+    UNUSED(file);
+    UNUSED(size);
+#endif
+}
+
 /**
  * Get the byte-offset of the file's cursor from the start of the file.
  *
@@ -2869,18 +3070,74 @@ static void afatfs_fcloseContinue(afatfsFilePtr_t file)
     afatfsCacheBlockDescriptor_t *descriptor;
     afatfsCloseFile_t *opState = &file->operation.state.closeFile;
 
-    /*
-     * Directories don't update their parent directory entries over time, because their fileSize field in the directory
-     * never changes (when we add the first cluster to the directory we save the directory entry at that point and it
-     * doesn't change afterwards). So don't bother trying to save their directory entries during fclose().
-     *
-     * Also if we only opened the file for read then we didn't change the directory entry either.
-     */
-    if (file->type != AFATFS_FILE_TYPE_DIRECTORY && file->type != AFATFS_FILE_TYPE_FAT16_ROOT_DIRECTORY
-            && (file->mode & (AFATFS_FILE_MODE_APPEND | AFATFS_FILE_MODE_WRITE)) != 0) {
-        if (afatfs_saveDirectoryEntry(file, AFATFS_SAVE_DIRECTORY_FOR_CLOSE) != AFATFS_OPERATION_SUCCESS) {
-            return;
+    doMore:
+    switch (opState->phase) {
+        case AFATFS_CLOSE_FILE_PHASE_UPDATE_DIRECTORY:
+            /*
+             * Directories don't update their parent directory entries over time, because their fileSize field in the
+             * directory never changes (when we add the first cluster to the directory we save the directory entry at
+             * that point and it doesn't change afterwards). So don't bother trying to save their directory entries
+             * during fclose().
+             *
+             * Also if we only opened the file for read then we didn't change the directory entry either.
+             */
+            if (file->type != AFATFS_FILE_TYPE_DIRECTORY && file->type != AFATFS_FILE_TYPE_FAT16_ROOT_DIRECTORY
+                    && (file->mode & (AFATFS_FILE_MODE_APPEND | AFATFS_FILE_MODE_WRITE)) != 0) {
+                if (afatfs_saveDirectoryEntry(file, AFATFS_SAVE_DIRECTORY_FOR_CLOSE) != AFATFS_OPERATION_SUCCESS) {
+                    return;
+                }
+            }
+
+#ifdef AFATFS_USE_FREEFILE
+            // The file no longer claims any superclusters it preallocated but didn't use, so we can give them back
+            if (opState->releaseStartCluster != 0) {
+                opState->phase = AFATFS_CLOSE_FILE_PHASE_TERMINATE_FAT_CHAIN;
+                goto doMore;
+            }
+#endif
+
+            opState->phase = AFATFS_CLOSE_FILE_PHASE_RELEASE_FILE;
+            goto doMore;
+        break;
+#ifdef AFATFS_USE_FREEFILE
+        case AFATFS_CLOSE_FILE_PHASE_TERMINATE_FAT_CHAIN:
+            // Move the terminator of the file's chain to the end of the last supercluster it keeps
+            if (afatfs_FATFillWithPattern(AFATFS_FAT_PATTERN_TERMINATED_CHAIN, &opState->currentCluster, opState->releaseStartCluster) != AFATFS_OPERATION_SUCCESS) {
+                return;
+            }
+
+            opState->phase = AFATFS_CLOSE_FILE_PHASE_RELEASE_FAT_CHAIN;
+            goto doMore;
+        break;
+        case AFATFS_CLOSE_FILE_PHASE_RELEASE_FAT_CHAIN:
+            // Chain the released superclusters onto the start of the freefile
+            if (afatfs_FATFillWithPattern(AFATFS_FAT_PATTERN_UNTERMINATED_CHAIN, &opState->currentCluster, afatfs.freeFile.firstCluster) != AFATFS_OPERATION_SUCCESS) {
+                return;
+            }
+
+            opState->phase = AFATFS_CLOSE_FILE_PHASE_PREPEND_TO_FREEFILE;
+            goto doMore;
+        break;
+        case AFATFS_CLOSE_FILE_PHASE_PREPEND_TO_FREEFILE:
+        {
+            // Note, it's okay to run this code several times:
+            uint32_t releasedSize = (afatfs.freeFile.firstCluster - opState->releaseStartCluster) * afatfs_clusterSize();
+
+            afatfs.freeFile.firstCluster = opState->releaseStartCluster;
+            afatfs.freeFile.logicalSize += releasedSize;
+            afatfs.freeFile.physicalSize += releasedSize;
+
+            if (afatfs_saveDirectoryEntry(&afatfs.freeFile, AFATFS_SAVE_DIRECTORY_NORMAL) != AFATFS_OPERATION_SUCCESS) {
+                return;
+            }
+
+            opState->phase = AFATFS_CLOSE_FILE_PHASE_RELEASE_FILE;
+            goto doMore;
         }
+        break;
+#endif
+        case AFATFS_CLOSE_FILE_PHASE_RELEASE_FILE:
+        break;
     }
 
     // Release our reservation on the directory cache if needed
@@ -2927,10 +3184,29 @@ bool afatfs_fclose(afatfsFilePtr_t file, afatfsCallback_t callback)
     } else if (afatfs_fileIsBusy(file)) {
         return false;
     } else {
+        afatfsCloseFile_t *opState = &file->operation.state.closeFile;
+
         afatfs_fileUpdateFilesize(file);
 
         file->operation.operation = AFATFS_FILE_OPERATION_CLOSE;
-        file->operation.state.closeFile.callback = callback;
+        opState->callback = callback;
+        opState->phase = AFATFS_CLOSE_FILE_PHASE_INITIAL;
+
+#ifdef AFATFS_USE_FREEFILE
+        opState->releaseStartCluster = 0;
+
+        // Return the superclusters that a contiguous file preallocated past the end of its data to the freefile
+        if ((file->mode & AFATFS_FILE_MODE_CONTIGUOUS) != 0 && file->firstCluster != 0) {
+            uint32_t keepSuperclusters = MAX(file->logicalSize / afatfs_superClusterSize() + (file->logicalSize % afatfs_superClusterSize() != 0 ? 1 : 0), 1u);
+            uint32_t keepEndCluster = file->firstCluster + keepSuperclusters * afatfs_fatEntriesPerSector();
+
+            if (keepEndCluster < afatfs.freeFile.firstCluster) {
+                opState->releaseStartCluster = keepEndCluster;
+                opState->currentCluster = keepEndCluster - afatfs_fatEntriesPerSector();
+            }
+        }
+#endif
+
         afatfs_fcloseContinue(file);
         return true;
     }
@@ -3716,6 +3992,23 @@ bool afatfs_destroy(bool dirty)
     return true;
 }
 
+/**
+ * Get the number of sector reads that were served from the cache since the filesystem was initialised.
+ */
+uint32_t afatfs_getCacheHits(void)
+{
+    return afatfs.cacheHits;
+}
+
+/**
+ * Get the number of sector reads that had to wait for the card since the filesystem was initialised (reads started
+ * ahead of a sequential reader don't count).
+ */
+uint32_t afatfs_getCacheMisses(void)
+{
+    return afatfs.cacheMisses;
+}
+
 /**
  * Get a pessimistic estimate of the amount of buffer space that we have available to write to immediately.
  */
@@ -74,6 +74,7 @@ uint32_t afatfs_fwrite(afatfsFilePtr_t file, const uint8_t *buffer, uint32_t len
 uint32_t afatfs_fread(afatfsFilePtr_t file, uint8_t *buffer, uint32_t len);
 afatfsOperationStatus_e afatfs_fseek(afatfsFilePtr_t file, int32_t offset, afatfsSeek_e whence);
 bool afatfs_ftell(afatfsFilePtr_t file, uint32_t *position);
+void afatfs_fpreallocate(afatfsFilePtr_t file, uint32_t size);
 
 bool afatfs_mkdir(const char *filename, afatfsFileCallback_t complete);
 bool afatfs_chdir(afatfsFilePtr_t dirHandle);
@@ -88,6 +89,8 @@ bool afatfs_destroy(bool dirty);
 void afatfs_poll(void);
 
 uint32_t afatfs_getFreeBufferSpace(void);
+uint32_t afatfs_getCacheHits(void);
+uint32_t afatfs_getCacheMisses(void);
 uint32_t afatfs_getContiguousFreeSpace(void);
 bool afatfs_isFull(void);
 
@@ -32,6 +32,7 @@
  * and make calls through that, at the moment flashfs just calls m25p16_* routines explicitly.
  */
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
@@ -39,9 +40,12 @@
 #include "platform.h"
 
 #include "build/debug.h"
+#include "common/maths.h"
 #include "common/printf.h"
+#include "common/time.h"
 #include "drivers/flash.h"
 #include "drivers/light_led.h"
+#include "drivers/time.h"
 
 #include "io/flashfs.h"
 
@@ -56,29 +60,91 @@ static uint32_t flashfsSize = 0;
 static flashfsState_e flashfsState = FLASHFS_IDLE;
 static flashSector_t eraseSectorCurrent = 0;
 
-static DMA_DATA_ZERO_INIT uint8_t flashWriteBuffer[FLASHFS_WRITE_BUFFER_SIZE];
+/* Writes are staged in two page aligned buffers used in turn. One fills while the other is being programmed, and
+ * each buffer only ever holds bytes that fall into one FLASHFS_WRITE_BUFFER_SIZE aligned block of the flash, so a
+ * program never straddles a page boundary.
+ *
+ * The buffer being programmed is released by the flash driver's completion callback, flashfsWriteCallback(), which
+ * also advances tailAddress. Until then programLength holds the size of the program in flight.
+ */
+static DMA_DATA_ZERO_INIT uint8_t flashWriteBuffer[2][FLASHFS_WRITE_BUFFER_SIZE];
+
+static uint8_t fillIndex;                   // the buffer accepting new bytes
+static uint16_t fillLength;
+static uint32_t fillAddress;                // flash address of the first byte in the fill buffer
+static volatile uint16_t programLength;     // bytes of the other buffer still being programmed, 0 when it's free
+
+// The flash address up to which all programs have completed
+static volatile uint32_t tailAddress = 0;
 
-/* The position of our head and tail in the circular flash write buffer.
+/* With erase ahead on, nothing past the write head is assumed to be erased. [erasedStart, erasedEnd) is the range
+ * flashfs has erased itself (or found erased by a full erase), sectors are erased ahead of the head while flashfs
+ * has nothing to write and, if the head catches up, before the program that needs them.
  *
- * The head is the index that a byte would be inserted into on writing, while the tail is the index of the
- * oldest byte that has yet to be written to flash.
+ * This is what lets an erase of a volume with a log index finish after one sector: the index is erased and the head
+ * goes back to the start, and the old logs are erased sector by sector as they are logged over.
+ */
+static uint16_t eraseAheadSectors;          // as set by the client, applied by flashfsInit()
+static uint32_t eraseAheadBytes;            // 0 when erase ahead is off
+static uint32_t erasedStart;
+static uint32_t erasedEnd;
+
+/* Log index, NOR flash only.
  *
- * When the circular buffer is empty, head == tail
+ * The last sector of the partition is kept out of the volume and holds FLASHFS_LOG_RECORD_SIZE byte records, a header
+ * then one entry per log in the order they were started. An entry is programmed when its log starts, with the length
+ * left erased, and the length is programmed into it when the log is closed. Erasing the volume erases the index with
+ * it, the header is put back once the device is done.
  *
- * The tail is advanced once a write is complete up to the location behind head. The tail is advanced
- * by a callback from the FLASH write routine. This prevents data being overwritten whilst a write is in progress.
+ * Starting and closing a log only note the update, flashfsLogIndexProgramAsync() programs it once the device and the
+ * write buffers are free, like the erase and flush state machines. Until then the entry is served from RAM.
+ *
+ * At startup the free space starts where the last closed log ends, after checking the flash is erased there. Only if
+ * the index can't tell (a log that was never closed, or data written without an entry) is the chip searched. A
+ * partition written before there was an index gets one if its last sector is erased, with an entry covering whatever
+ * is on it, and is left unindexed otherwise.
  */
-static uint8_t bufferHead = 0;
-static volatile uint8_t bufferTail = 0;
-
-/* Track if there is new data to write. Until the contents of the buffer have been completely
- * written flashfsFlushAsync() will be repeatedly called. The tail pointer is only updated
- * once an asynchronous write has completed. To do so any earlier could result in data being
- * overwritten in the ring buffer. This routine checks that flashfsFlushAsync() should attempt
- * to write new data and avoids it writing old data during the race condition that occurs if
- * its called again before the previous write to FLASH has completed.
-  */
-static volatile bool dataWritten = true;
+#define FLASHFS_LOG_RECORD_SIZE     64
+#define FLASHFS_LOG_INDEX_MAGIC     0x49474F4C  // "LOGI"
+#define FLASHFS_LOG_INDEX_VERSION   1
+#define FLASHFS_LOG_ENTRY_MAGIC     0x45474F4C  // "LOGE"
+
+typedef enum {
+    FLASHFS_LOG_INDEX_NONE,
+    FLASHFS_LOG_INDEX_ERASED,                   // the header is still to be written
+    FLASHFS_LOG_INDEX_READY,
+} flashfsLogIndexState_e;
+
+typedef struct flashfsLogIndexHeader_s {
+    uint32_t magic;
+    uint32_t version;
+} flashfsLogIndexHeader_t;
+
+typedef struct flashfsLogRecord_s {
+    uint32_t magic;
+    flashfsLogEntry_t entry;
+} flashfsLogRecord_t;
+
+static flashfsLogIndexState_e logIndexState;
+static uint32_t logIndexAddress;            // 0 when the partition can't have an index
+static uint16_t logSlots;                   // entries the index has room for
+static uint16_t logCount;
+static bool logOpen;                        // the last entry's length is still to be written
+static uint32_t logStart;
+static DMA_DATA_ZERO_INIT uint8_t logRecordBuffer[FLASHFS_LOG_RECORD_SIZE];
+
+// Index updates still to be programmed, the length of an earlier log goes before the entry of the last one
+static bool logLengthPending;
+static uint16_t logLengthSlot;
+static uint32_t logLength;
+static bool logEntryPending;
+static flashfsLogRecord_t logEntryRecord;   // the record for slot logCount
+
+static flashfsWriteStats_t writeStats;
+
+static bool flashfsLogIndexProgramAsync(void);
+static timeUs_t stallStartUs;
+static bool stalled;
 
 //#define CHECK_FLASH
 
@@ -92,27 +158,31 @@ uint8_t checkFlashExpected = 0x00;
 uint32_t checkFlashErrors = 0;
 #endif
 
-// The position of the buffer's tail in the overall flash address space:
-static uint32_t tailAddress = 0;
-
 static void flashfsClearBuffer(void)
 {
-    bufferTail = bufferHead = 0;
+    fillLength = 0;
 }
 
 static bool flashfsBufferIsEmpty(void)
 {
-    return bufferTail == bufferHead;
+    return fillLength == 0 && programLength == 0;
 }
 
 static void flashfsSetTailAddress(uint32_t address)
 {
     tailAddress = address;
+    fillAddress = address;
 }
 
 void flashfsEraseCompletely(void)
 {
-    if (flashGeometry->sectors > 0 && flashPartitionCount() > 0) {
+    const bool eraseIndexOnly = eraseAheadBytes && logIndexAddress;
+
+    if (eraseIndexOnly) {
+        // the log index is the last sector of the partition
+        eraseSectorCurrent = flashPartition->endSector;
+        flashfsState = FLASHFS_ERASING;
+    } else if (flashGeometry->sectors > 0 && flashPartitionCount() > 0) {
         // if there's a single FLASHFS partition and it uses the entire flash then do a full erase
         const bool doFullErase = (flashPartitionCount() == 1) && (FLASH_PARTITION_SECTOR_COUNT(flashPartition) == flashGeometry->sectors);
         if (doFullErase) {
@@ -127,6 +197,19 @@ void flashfsEraseCompletely(void)
     flashfsClearBuffer();
 
     flashfsSetTailAddress(0);
+
+    if (logIndexAddress) {
+        // whatever was in the last sector has gone too, so it can hold an index from now on
+        flashfsSize = logIndexAddress;
+        logIndexState = FLASHFS_LOG_INDEX_ERASED;
+        logCount = 0;
+        logOpen = false;
+        logLengthPending = false;
+        logEntryPending = false;
+    }
+
+    erasedStart = 0;
+    erasedEnd = eraseIndexOnly ? 0 : flashfsSize;
 }
 
 /**
@@ -175,12 +258,19 @@ uint32_t flashfsGetSize(void)
     return flashfsSize;
 }
 
-static uint32_t flashfsTransmitBufferUsed(void)
+// Bytes the fill buffer can take before it reaches the end of its block (or of the volume)
+static uint32_t flashfsFillCapacity(void)
 {
-    if (bufferHead >= bufferTail)
-        return bufferHead - bufferTail;
+    if (fillAddress >= flashfsSize) {
+        return 0;
+    }
+    const uint32_t blockStart = fillAddress - fillAddress % FLASHFS_WRITE_BUFFER_SIZE;
+    return MIN(blockStart + FLASHFS_WRITE_BUFFER_SIZE, flashfsSize) - fillAddress;
+}
 
-    return FLASHFS_WRITE_BUFFER_SIZE - bufferTail + bufferHead;
+static bool flashfsFillBufferIsFull(void)
+{
+    return fillLength >= flashfsFillCapacity();
 }
 
 /**
@@ -188,7 +278,7 @@ static uint32_t flashfsTransmitBufferUsed(void)
  */
 uint32_t flashfsGetWriteBufferSize(void)
 {
-    return FLASHFS_WRITE_BUFFER_USABLE;
+    return FLASHFS_WRITE_BUFFER_SIZE;
 }
 
 /**
@@ -196,172 +286,189 @@ uint32_t flashfsGetWriteBufferSize(void)
  */
 uint32_t flashfsGetWriteBufferFreeSpace(void)
 {
-    return flashfsGetWriteBufferSize() - flashfsTransmitBufferUsed();
+    const uint32_t fillCapacity = flashfsFillCapacity();
+    uint32_t freeSpace = fillCapacity - fillLength;
+
+    // the next block starts aligned, so once the other buffer is free it can take a whole one
+    const uint32_t nextBlockAddress = fillAddress + fillCapacity;
+    if (programLength == 0 && nextBlockAddress < flashfsSize) {
+        freeSpace += MIN((uint32_t)FLASHFS_WRITE_BUFFER_SIZE, flashfsSize - nextBlockAddress);
+    }
+
+    return freeSpace;
 }
 
-/**
- * Called after bytes have been written from the buffer to advance the position of the tail by the given amount.
- */
-static void flashfsAdvanceTailInBuffer(uint32_t delta)
+void flashfsGetWriteStats(flashfsWriteStats_t *stats)
 {
-    bufferTail += delta;
+    *stats = writeStats;
+}
 
-    // Wrap tail around the end of the buffer
-    if (bufferTail >= FLASHFS_WRITE_BUFFER_SIZE) {
-        bufferTail -= FLASHFS_WRITE_BUFFER_SIZE;
-    }
+void flashfsResetWriteStats(void)
+{
+    memset(&writeStats, 0, sizeof(writeStats));
+    stalled = false;
 }
 
 /**
- * Write the given buffers to flash sequentially at the current tail address, advancing the tail address after
- * each write.
- *
- * In synchronous mode, waits for the flash to become ready before writing so that every byte requested can be written.
- *
- * In asynchronous mode, if the flash is busy, then the write is aborted and the routine returns immediately.
- * In this case the returned number of bytes written will be less than the total amount requested.
- *
- * Modifies the supplied buffer pointers and sizes to reflect how many bytes remain in each of them.
- *
- * bufferCount: the number of buffers provided
- * buffers: an array of pointers to the beginning of buffers
- * bufferSizes: an array of the sizes of those buffers
- * sync: true if we should wait for the device to be idle before writes, otherwise if the device is busy the
- *       write will be aborted and this routine will return immediately.
- *
- * Returns the number of bytes written
+ * Called by the flash driver once the bytes of a program have been handed to the device (which may still be busy
+ * committing them), frees the buffer they came from.
  */
 void flashfsWriteCallback(uint32_t arg)
 {
     // Advance the cursor in the file system to match the bytes we wrote
-    flashfsSetTailAddress(tailAddress + arg);
+    tailAddress += arg;
 
-    // Free bytes in the ring buffer
-    flashfsAdvanceTailInBuffer(arg);
+    programLength = 0;
+}
 
-    // Mark that data has been written from the buffer
-    dataWritten = true;
+static void flashfsStallBegin(void)
+{
+    if (!stalled) {
+        stallStartUs = micros();
+        stalled = true;
+    }
 }
 
-static uint32_t flashfsWriteBuffers(uint8_t const **buffers, uint32_t *bufferSizes, int bufferCount, bool sync)
+static void flashfsStallEnd(void)
 {
-    uint32_t bytesWritten;
+    if (stalled) {
+        writeStats.stallUs += cmpTimeUs(micros(), stallStartUs);
+        stalled = false;
+    }
+}
 
-    // It's OK to overwrite the buffer addresses/lengths being passed in
+// True when the flash below the given address and from the write head up is known to be erased
+static bool flashfsIsErasedUpTo(uint32_t address)
+{
+    return eraseAheadBytes == 0 || address <= erasedEnd;
+}
 
-    // If sync is true, block until the FLASH device is ready, otherwise return 0 if the device isn't ready
-    if (sync) {
-        while (!flashIsReady());
-    } else {
-        if (!flashIsReady()) {
-            return 0;
-        }
-    }
+// Starts erasing the sector at the erased watermark, the caller checks the device is idle
+static void flashfsEraseNextSector(void)
+{
+    flashEraseSector(erasedEnd);
+    erasedEnd = MIN(erasedEnd + flashGeometry->sectorSize, flashfsSize);
+}
 
-    // Are we at EOF already? Abort.
-    if (flashfsIsEOF()) {
-        return 0;
+/**
+ * Returns true if the block the fill buffer goes to is erased. If not and the device is free, starts erasing the
+ * sector at the watermark, which the head has caught up with.
+ */
+static bool flashfsFillBufferIsErased(void)
+{
+    if (flashfsIsErasedUpTo(fillAddress + flashfsFillCapacity())) {
+        return true;
     }
 
-#ifdef CHECK_FLASH
-    checkFlashPtr = tailAddress;
-#endif
-
-    flashPageProgramBegin(tailAddress, flashfsWriteCallback);
+    if (programLength == 0 && flashIsReady()) {
+        flashfsEraseNextSector();
+    }
 
-    /* Mark that data has yet to be written. There is no race condition as the DMA engine is known
-     * to be idle at this point
-     */
-    dataWritten = false;
+    return false;
+}
 
-    bytesWritten = flashPageProgramContinue(buffers, bufferSizes, bufferCount);
+/**
+ * Keep eraseAheadBytes of erased flash ahead of the write head, one sector per call.
+ *
+ * Only erases while nothing is waiting to be written, so the time the device is busy erasing never holds up a
+ * program. Call regularly from idle time.
+ */
+void flashfsEraseAheadAsync(void)
+{
+    if (eraseAheadBytes == 0 || flashfsState != FLASHFS_IDLE || !flashfsIsSupported()) {
+        return;
+    }
 
-#ifdef CHECK_FLASH
-    checkFlashLen = bytesWritten;
-#endif
+    if (erasedEnd < flashfsSize && erasedEnd < flashfsGetOffset() + eraseAheadBytes
+        && flashfsBufferIsEmpty() && flashIsReady()) {
+        flashfsEraseNextSector();
+    }
+}
 
-    flashPageProgramFinish();
+/**
+ * Get the number of bytes from the write head that can be written without waiting for an erase.
+ */
+uint32_t flashfsGetEraseAheadHeadroom(void)
+{
+    const uint32_t offset = flashfsGetOffset();
+    const uint32_t erased = eraseAheadBytes ? erasedEnd : flashfsSize;
 
-    return bytesWritten;
+    return erased > offset ? erased - offset : 0;
 }
 
-/*
- * Since the buffered data might wrap around the end of the circular buffer, we can have two segments of data to write,
- * an initial portion and a possible wrapped portion.
+/**
+ * Start programming the fill buffer and switch to filling the other one.
  *
- * This routine will fill the details of those buffers into the provided arrays, which must be at least 2 elements long.
+ * In synchronous mode, waits for the previous program and the device so the buffer is always written. In asynchronous
+ * mode, returns false straight away if either is still busy.
  */
-static int flashfsGetDirtyDataBuffers(uint8_t const *buffers[], uint32_t bufferSizes[])
-{
-    buffers[0] = flashWriteBuffer + bufferTail;
-    buffers[1] = flashWriteBuffer + 0;
-
-    if (bufferHead > bufferTail) {
-        bufferSizes[0] = bufferHead - bufferTail;
-        bufferSizes[1] = 0;
-        return 1;
-    } else if (bufferHead < bufferTail) {
-        bufferSizes[0] = FLASHFS_WRITE_BUFFER_SIZE - bufferTail;
-        bufferSizes[1] = bufferHead;
-        if (bufferSizes[1] == 0) {
-            return 1;
-        } else {
-            return 2;
+static bool flashfsProgramFillBuffer(bool sync)
+{
+    if (fillLength == 0) {
+        return true;
+    }
+
+    while (programLength != 0 || !flashIsReady() || !flashfsFillBufferIsErased()) {
+        flashfsStallBegin();
+        if (!sync) {
+            return false;
         }
     }
+    flashfsStallEnd();
 
-    bufferSizes[0] = 0;
-    bufferSizes[1] = 0;
+    const uint8_t *buffers[1] = { flashWriteBuffer[fillIndex] };
+    uint32_t bufferSizes[1] = { fillLength };
 
-    return 0;
-}
+#ifdef CHECK_FLASH
+    checkFlashPtr = fillAddress;
+    checkFlashLen = fillLength;
+#endif
 
+    // The driver may call back before returning, so everything it touches must be set up first
+    programLength = fillLength;
+    const uint32_t address = fillAddress;
+    fillAddress += fillLength;
+    fillLength = 0;
+    fillIndex ^= 1;
 
-static bool flashfsNewData(void)
-{
-    return dataWritten;
-}
+    writeStats.programs++;
 
+    flashPageProgramBegin(address, flashfsWriteCallback);
+    flashPageProgramContinue(buffers, bufferSizes, 1);
+    flashPageProgramFinish();
+
+    return true;
+}
 
 /**
  * Get the current offset of the file pointer within the volume.
  */
 uint32_t flashfsGetOffset(void)
 {
-    uint8_t const * buffers[2];
-    uint32_t bufferSizes[2];
-
-    // Dirty data in the buffers contributes to the offset
-
-    flashfsGetDirtyDataBuffers(buffers, bufferSizes);
-
-    return tailAddress + bufferSizes[0] + bufferSizes[1];
+    // Buffered data contributes to the offset
+    return fillAddress + fillLength;
 }
 
 /**
  * If the flash is ready to accept writes, flush the buffer to it.
  *
+ * A partly filled buffer is only written when forced, otherwise it waits to fill up to its block boundary.
+ *
  * Returns true if all data in the buffer has been flushed to the device, or false if
  * there is still data to be written (call flush again later).
  */
 bool flashfsFlushAsync(bool force)
 {
-    uint8_t const * buffers[2];
-    uint32_t bufferSizes[2];
-    int bufCount;
+    // index updates are small and rare, they go ahead of the next buffer
+    flashfsLogIndexProgramAsync();
 
     if (flashfsBufferIsEmpty()) {
         return true; // Nothing to flush
     }
 
-    if (!flashfsNewData()) {
-        // The previous write has yet to complete
-        return false;
-    }
-
 #ifdef CHECK_FLASH
     // Verify the data written last time
-    if (checkFlashLen) {
+    if (checkFlashLen && programLength == 0) {
         while (!flashIsReady());
         flashReadBytes(checkFlashPtr, checkFlashBuffer, checkFlashLen);
 
@@ -370,41 +477,36 @@ bool flashfsFlushAsync(bool force)
                 checkFlashErrors++; // <-- insert breakpoint here to catch errors
             }
         }
+        checkFlashLen = 0;
     }
 #endif
 
-    bufCount = flashfsGetDirtyDataBuffers(buffers, bufferSizes);
-    uint32_t bufferedBytes = bufferSizes[0] + bufferSizes[1];
+    // If the head has caught up with the erased watermark, start on the sector while the buffer is still filling
+    flashfsFillBufferIsErased();
 
-    if (bufCount && (force || (bufferedBytes >= FLASHFS_WRITE_BUFFER_AUTO_FLUSH_LEN))) {
-        flashfsWriteBuffers(buffers, bufferSizes, bufCount, false);
+    if (force || flashfsFillBufferIsFull()) {
+        flashfsProgramFillBuffer(false);
     }
 
     return flashfsBufferIsEmpty();
 }
 
 /**
- * Wait for the flash to become ready and begin flushing any buffered data to flash.
+ * Wait for the flash to become ready and begin flushing any buffered data and log index updates to flash.
  *
  * The flash will still be busy some time after this sync completes, but space will
  * be freed up to accept more writes in the write buffer.
  */
 void flashfsFlushSync(void)
 {
-    uint8_t const * buffers[2];
-    uint32_t bufferSizes[2];
-    int bufCount;
+    if (!flashfsBufferIsEmpty()) {
+        flashfsProgramFillBuffer(true);
 
-    if (flashfsBufferIsEmpty()) {
-        return; // Nothing to flush
+        while (!flashIsReady() || programLength != 0);
     }
 
-    bufCount = flashfsGetDirtyDataBuffers(buffers, bufferSizes);
-    if (bufCount) {
-        flashfsWriteBuffers(buffers, bufferSizes, bufCount, true);
-    }
-
-    while (!flashIsReady());
+    // an erase in progress is only advanced by flashfsEraseAsync(), the index waits for it
+    while (flashfsState == FLASHFS_IDLE && !flashfsLogIndexProgramAsync());
 }
 
 /**
@@ -426,6 +528,8 @@ void flashfsEraseAsync(void)
                 LED1_OFF;
             }
         }
+    } else {
+        flashfsLogIndexProgramAsync();
     }
 }
 
@@ -434,6 +538,13 @@ void flashfsSeekAbs(uint32_t offset)
     flashfsFlushSync();
 
     flashfsSetTailAddress(offset);
+
+    // Only the rest of the sector the head lands in can be taken to be erased, unless this is within the known range
+    if (offset < erasedStart || offset > erasedEnd) {
+        const uint32_t sectorSize = flashGeometry->sectorSize;
+        erasedStart = offset;
+        erasedEnd = MIN((offset + sectorSize - 1) / sectorSize * sectorSize, flashfsSize);
+    }
 }
 
 /**
@@ -441,49 +552,45 @@ void flashfsSeekAbs(uint32_t offset)
  */
 void flashfsWriteByte(uint8_t byte)
 {
-#ifdef CHECK_FLASH
-    byte = checkFlashWrite++;
-#endif
-
-    flashWriteBuffer[bufferHead++] = byte;
-
-    if (bufferHead >= FLASHFS_WRITE_BUFFER_SIZE) {
-        bufferHead = 0;
-    }
-
-    if (flashfsTransmitBufferUsed() >= FLASHFS_WRITE_BUFFER_AUTO_FLUSH_LEN) {
-        flashfsFlushAsync(false);
-    }
+    flashfsWrite(&byte, 1, false);
 }
 
 /**
  * Write the given buffer to the flash either synchronously or asynchronously depending on the 'sync' parameter.
  *
- * If writing asynchronously, data will be silently discarded if the buffer overflows.
+ * If writing asynchronously, data will be discarded (and counted in the write stats) if both buffers are full.
  * If writing synchronously, the routine will block waiting for the flash to become ready so will never drop data.
  */
 void flashfsWrite(const uint8_t *data, unsigned int len, bool sync)
 {
-    uint8_t const * buffers[2];
-    uint32_t bufferSizes[2];
-    int bufCount;
-    uint32_t totalBufSize;
+    while (len > 0) {
+        if (flashfsFillBufferIsFull() && !flashfsProgramFillBuffer(sync)) {
+            writeStats.droppedBytes += len;
+            return;
+        }
 
-    // Buffer up the data the user supplied instead of writing it right away
-    for (unsigned int i = 0; i < len; i++) {
-        flashfsWriteByte(data[i]);
-    }
+        const uint32_t chunk = MIN(len, flashfsFillCapacity() - fillLength);
+        if (chunk == 0) {
+            // End of the volume
+            writeStats.droppedBytes += len;
+            return;
+        }
 
-    // There could be two dirty buffers to write out already:
-    bufCount = flashfsGetDirtyDataBuffers(buffers, bufferSizes);
-    totalBufSize = bufferSizes[0] + bufferSizes[1];
+#ifdef CHECK_FLASH
+        for (uint32_t i = 0; i < chunk; i++) {
+            flashWriteBuffer[fillIndex][fillLength + i] = checkFlashWrite++;
+        }
+#else
+        memcpy(&flashWriteBuffer[fillIndex][fillLength], data, chunk);
+#endif
+        fillLength += chunk;
+        data += chunk;
+        len -= chunk;
+    }
 
-    /*
-     * Would writing this data to our buffer cause our buffer to reach the flush threshold? If so try to write through
-     * to the flash now
-     */
-    if (bufCount && (totalBufSize >= FLASHFS_WRITE_BUFFER_AUTO_FLUSH_LEN)) {
-        flashfsWriteBuffers(buffers, bufferSizes, bufCount, sync);
+    // Start on a full buffer right away, the sooner the other buffer is free again
+    if (flashfsFillBufferIsFull()) {
+        flashfsProgramFillBuffer(sync);
     }
 }
 
@@ -536,6 +643,7 @@ int flashfsIdentifyStartOfFreeSpace(void)
     };
 
     STATIC_ASSERT(FREE_BLOCK_SIZE >= FLASH_MAX_PAGE_SIZE, FREE_BLOCK_SIZE_too_small);
+    STATIC_ASSERT(FLASH_MAX_PAGE_SIZE % FLASHFS_WRITE_BUFFER_SIZE == 0, FLASHFS_WRITE_BUFFER_SIZE_straddles_pages);
 
     STATIC_DMA_DATA_AUTO union {
         uint8_t bytes[FREE_BLOCK_TEST_SIZE_BYTES];
@@ -606,12 +714,262 @@ void flashfsClose(void)
     }
 }
 
+static uint32_t flashfsLogRecordAddress(int slot)
+{
+    return logIndexAddress + slot * FLASHFS_LOG_RECORD_SIZE;
+}
+
+// Programs the start of logRecordBuffer, the caller checks the device and the write buffers are free
+static void flashfsLogIndexProgram(uint32_t address, uint32_t length)
+{
+    flashPageProgram(address, logRecordBuffer, length, NULL);
+}
+
+// Reads only come from startup, MSP and the CLI, which wait for the flash like flashfsReadAbs() does
+static void flashfsLogIndexRead(int slot, uint32_t length)
+{
+    while (programLength != 0);
+
+    flashReadBytes(flashfsLogRecordAddress(slot), logRecordBuffer, length);
+}
+
+static bool flashfsLogIndexIsPending(void)
+{
+    return logIndexState == FLASHFS_LOG_INDEX_ERASED || logLengthPending || logEntryPending;
+}
+
+/**
+ * Program the next log index update, the header of an erased index first, if the device and the write buffers are
+ * free. Returns true once nothing is left to program.
+ */
+static bool flashfsLogIndexProgramAsync(void)
+{
+    if (!flashfsLogIndexIsPending()) {
+        return true;
+    }
+    if (flashfsState != FLASHFS_IDLE || programLength != 0 || !flashIsReady()) {
+        return false;
+    }
+
+    memset(logRecordBuffer, 0xff, sizeof(logRecordBuffer));
+
+    if (logIndexState == FLASHFS_LOG_INDEX_ERASED) {
+        const flashfsLogIndexHeader_t header = { FLASHFS_LOG_INDEX_MAGIC, FLASHFS_LOG_INDEX_VERSION };
+        memcpy(logRecordBuffer, &header, sizeof(header));
+        flashfsLogIndexProgram(logIndexAddress, sizeof(header));
+        logIndexState = FLASHFS_LOG_INDEX_READY;
+    } else if (logLengthPending) {
+        memcpy(logRecordBuffer, &logLength, sizeof(logLength));
+        flashfsLogIndexProgram(flashfsLogRecordAddress(logLengthSlot) + offsetof(flashfsLogRecord_t, entry.length), sizeof(logLength));
+        logLengthPending = false;
+    } else {
+        memcpy(logRecordBuffer, &logEntryRecord, sizeof(logEntryRecord));
+        flashfsLogIndexProgram(flashfsLogRecordAddress(logCount), sizeof(logEntryRecord));
+        logEntryPending = false;
+    }
+
+    return !flashfsLogIndexIsPending();
+}
+
+static void flashfsLogIndexAdd(const flashfsLogEntry_t *entry)
+{
+    logEntryRecord.magic = FLASHFS_LOG_ENTRY_MAGIC;
+    logEntryRecord.entry = *entry;
+    logEntryPending = true;
+
+    logCount++;
+}
+
+static void flashfsLogIndexInit(void)
+{
+    STATIC_ASSERT(sizeof(flashfsLogRecord_t) <= FLASHFS_LOG_RECORD_SIZE, flashfsLogRecord_t_too_large);
+    STATIC_ASSERT(FLASHFS_WRITE_BUFFER_SIZE % FLASHFS_LOG_RECORD_SIZE == 0, FLASHFS_LOG_RECORD_SIZE_straddles_pages);
+
+    logIndexState = FLASHFS_LOG_INDEX_NONE;
+    logIndexAddress = 0;
+    logCount = 0;
+    logOpen = false;
+    logLengthPending = false;
+    logEntryPending = false;
+
+    if (flashGeometry->flashType != FLASH_TYPE_NOR || FLASH_PARTITION_SECTOR_COUNT(flashPartition) < 2) {
+        return;
+    }
+
+    logIndexAddress = flashfsSize - flashGeometry->sectorSize;
+    logSlots = MIN(flashGeometry->sectorSize / FLASHFS_LOG_RECORD_SIZE - 1, (uint32_t)UINT16_MAX);
+
+    flashfsLogIndexHeader_t header;
+    flashfsLogIndexRead(0, sizeof(header));
+    memcpy(&header, logRecordBuffer, sizeof(header));
+
+    if (header.magic == FLASHFS_LOG_INDEX_MAGIC && header.version == FLASHFS_LOG_INDEX_VERSION) {
+        logIndexState = FLASHFS_LOG_INDEX_READY;
+
+        uint32_t magic;
+        while (logCount < logSlots) {
+            flashfsLogIndexRead(logCount + 1, sizeof(magic));
+            memcpy(&magic, logRecordBuffer, sizeof(magic));
+            if (magic != FLASHFS_LOG_ENTRY_MAGIC) {
+                break;
+            }
+            logCount++;
+        }
+    } else if (header.magic == 0xFFFFFFFF) {
+        logIndexState = FLASHFS_LOG_INDEX_ERASED;
+    } else {
+        // the sector holds log data from before there was an index, keep it readable
+        return;
+    }
+
+    flashfsSize = logIndexAddress;
+}
+
+static bool flashfsIsErasedAt(uint32_t address)
+{
+    STATIC_DMA_DATA_AUTO uint8_t testBuffer[16];
+    const uint32_t length = MIN(sizeof(testBuffer), flashfsSize - address);
+
+    if (flashReadBytes(address, testBuffer, length) < (int)length) {
+        return false;
+    }
+    for (uint32_t i = 0; i < length; i++) {
+        if (testBuffer[i] != 0xff) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The start of the free space from the index if it knows, otherwise by searching the chip
+static uint32_t flashfsFindStartOfFreeSpace(void)
+{
+    if (logIndexState == FLASHFS_LOG_INDEX_READY) {
+        flashfsLogEntry_t last = { .start = 0, .length = 0 };
+        if (logCount) {
+            flashfsGetLogEntry(logCount - 1, &last);
+        }
+
+        // with erase ahead on, stale data past the end of the last log is expected
+        if (last.length != FLASHFS_LOG_LENGTH_UNKNOWN && last.start <= flashfsSize && last.length <= flashfsSize - last.start) {
+            const uint32_t end = last.start + last.length;
+            if (eraseAheadBytes || end == flashfsSize || flashfsIsErasedAt(end)) {
+                return end;
+            }
+        }
+    }
+
+    const uint32_t freeSpace = flashfsIdentifyStartOfFreeSpace();
+
+    if (logIndexState == FLASHFS_LOG_INDEX_ERASED && freeSpace > 0) {
+        // cover what was logged before there was an index
+        const flashfsLogEntry_t entry = { .start = 0, .length = freeSpace };
+        flashfsLogIndexAdd(&entry);
+    }
+
+    return freeSpace;
+}
+
+/**
+ * Returns true if the volume has a log index, even if it is still to be set up after an erase.
+ */
+bool flashfsLogIndexIsAvailable(void)
+{
+    return logIndexState != FLASHFS_LOG_INDEX_NONE;
+}
+
+int flashfsGetLogCount(void)
+{
+    return logIndexState != FLASHFS_LOG_INDEX_NONE ? logCount : 0;
+}
+
+/**
+ * Read the index entry of the given log, the oldest first. The length of the log being written is its current one.
+ */
+bool flashfsGetLogEntry(int index, flashfsLogEntry_t *entry)
+{
+    if (index < 0 || index >= flashfsGetLogCount()) {
+        return false;
+    }
+
+    if (logEntryPending && index == logCount - 1) {
+        *entry = logEntryRecord.entry;
+    } else {
+        flashfsLogRecord_t record;
+        flashfsLogIndexRead(index + 1, sizeof(record));
+        memcpy(&record, logRecordBuffer, sizeof(record));
+        *entry = record.entry;
+    }
+
+    if (logLengthPending && index == logLengthSlot - 1) {
+        entry->length = logLength;
+    }
+    if (logOpen && index == logCount - 1) {
+        entry->length = flashfsGetOffset() - entry->start;
+    }
+
+    return true;
+}
+
+/**
+ * Add an index entry for a log starting at the current offset. The start and length in the given entry are ignored.
+ *
+ * Nothing is recorded if there is no index, it is full, or the entry of the previous log is still to be programmed.
+ */
+void flashfsLogBegin(const flashfsLogEntry_t *entry)
+{
+    flashfsLogEnd();
+
+    if (logIndexState == FLASHFS_LOG_INDEX_NONE || logCount >= logSlots || logEntryPending) {
+        return;
+    }
+
+    flashfsLogEntry_t indexEntry = *entry;
+    indexEntry.start = flashfsGetOffset();
+    indexEntry.length = FLASHFS_LOG_LENGTH_UNKNOWN;
+    flashfsLogIndexAdd(&indexEntry);
+
+    logStart = indexEntry.start;
+    logOpen = true;
+}
+
+/**
+ * Record the length of the log started by flashfsLogBegin(), as what has been written since.
+ */
+void flashfsLogEnd(void)
+{
+    if (!logOpen) {
+        return;
+    }
+    logOpen = false;
+
+    const uint32_t length = flashfsGetOffset() - logStart;
+    if (logEntryPending) {
+        // still in RAM, the whole entry goes in one program
+        logEntryRecord.entry.length = length;
+    } else {
+        logLength = length;
+        logLengthSlot = logCount;
+        logLengthPending = true;
+    }
+}
+
+/**
+ * Set how many sectors to keep erased ahead of the write head, 0 to only ever write onto erased flash. Takes effect
+ * from the next flashfsInit(), as finding the free space depends on it.
+ */
+void flashfsSetEraseAheadSectors(uint16_t sectors)
+{
+    eraseAheadSectors = sectors;
+}
+
 /**
  * Call after initializing the flash chip in order to set up the filesystem.
  */
 void flashfsInit(void)
 {
     flashfsSize = 0;
+    flashfsResetWriteStats();
 
     flashPartition = flashPartitionFindByType(FLASH_PARTITION_TYPE_FLASHFS);
     flashGeometry = flashGetGeometry();
@@ -622,8 +980,14 @@ void flashfsInit(void)
 
     flashfsSize = FLASH_PARTITION_SECTOR_COUNT(flashPartition) * flashGeometry->sectorSize;
 
+    eraseAheadBytes = MIN(eraseAheadSectors * flashGeometry->sectorSize, flashfsSize);
+    erasedStart = 0;
+    erasedEnd = 0;
+
+    flashfsLogIndexInit();
+
     // Start the file pointer off at the beginning of free space so caller can start writing immediately
-    flashfsSeekAbs(flashfsIdentifyStartOfFreeSpace());
+    flashfsSeekAbs(flashfsFindStartOfFreeSpace());
 }
 
 #ifdef USE_FLASH_TOOLS
@@ -20,11 +20,30 @@
 
 #pragma once
 
-#define FLASHFS_WRITE_BUFFER_SIZE 128
-#define FLASHFS_WRITE_BUFFER_USABLE (FLASHFS_WRITE_BUFFER_SIZE - 1)
+#include <stdbool.h>
+#include <stdint.h>
 
-// Automatically trigger a flush when this much data is in the buffer
-#define FLASHFS_WRITE_BUFFER_AUTO_FLUSH_LEN 64
+// Size of each of the two write buffers, a divisor of the page size of every supported device
+#define FLASHFS_WRITE_BUFFER_SIZE 256
+
+#define FLASHFS_LOG_REVISION_LENGTH     8
+#define FLASHFS_LOG_NAME_LENGTH         16
+#define FLASHFS_LOG_LENGTH_UNKNOWN      0xFFFFFFFF
+
+// A log in the index, the strings are NUL padded and only NUL terminated if shorter than their field
+typedef struct flashfsLogEntry_s {
+    uint32_t start;
+    uint32_t length;            // FLASHFS_LOG_LENGTH_UNKNOWN if the log was never closed
+    uint32_t timestamp;         // seconds since 1970, 0 if the time wasn't set
+    char firmwareRevision[FLASHFS_LOG_REVISION_LENGTH];
+    char craftName[FLASHFS_LOG_NAME_LENGTH];
+} flashfsLogEntry_t;
+
+typedef struct flashfsWriteStats_s {
+    uint32_t programs;          // page programs started
+    uint32_t droppedBytes;      // asynchronous writes discarded with both buffers full
+    uint32_t stallUs;           // time a full buffer waited for the device or the other buffer
+} flashfsWriteStats_t;
 
 void flashfsEraseCompletely(void);
 void flashfsEraseRange(uint32_t start, uint32_t end);
@@ -47,8 +66,11 @@ int flashfsReadAbs(uint32_t offset, uint8_t *data, unsigned int len);
 bool flashfsFlushAsync(bool force);
 void flashfsFlushSync(void);
 void flashfsEraseAsync(void);
+void flashfsEraseAheadAsync(void);
+uint32_t flashfsGetEraseAheadHeadroom(void);
 
 void flashfsClose(void);
+void flashfsSetEraseAheadSectors(uint16_t sectors);
 void flashfsInit(void);
 bool flashfsIsSupported(void);
 
@@ -57,3 +79,12 @@ bool flashfsIsEOF(void);
 
 bool flashfsVerifyEntireFlash(void);
 
+bool flashfsLogIndexIsAvailable(void);
+int flashfsGetLogCount(void);
+bool flashfsGetLogEntry(int index, flashfsLogEntry_t *entry);
+void flashfsLogBegin(const flashfsLogEntry_t *entry);
+void flashfsLogEnd(void);
+
+void flashfsGetWriteStats(flashfsWriteStats_t *stats);
+void flashfsResetWriteStats(void);
+
@@ -29,8 +29,14 @@
 
 void run(void);
 
+#ifdef SIMULATOR_BUILD
+int main(int argc, char *argv[])
+{
+    targetParseArgs(argc, argv);
+#else
 int main(void)
 {
+#endif
     init();
 
     run();
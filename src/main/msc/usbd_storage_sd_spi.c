@@ -235,6 +235,12 @@ static int8_t STORAGE_Write (uint8_t lun,
                   uint16_t blk_len)
 {
 	UNUSED(lun);
+	// Let the card pre-erase the blocks and take them in one multiple block write (falls back to single writes on failure)
+	if (blk_len > 1) {
+		while (sdcard_beginWriteBlocks(blk_addr, blk_len) == SDCARD_OPERATION_BUSY) {
+			sdcard_poll();
+		}
+	}
 	for (int i = 0; i < blk_len; i++) {
 		while (sdcard_writeBlock(blk_addr + i, buf + (i * 512), NULL, 0) != SDCARD_OPERATION_IN_PROGRESS) {
 			sdcard_poll();
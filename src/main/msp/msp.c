@@ -40,6 +40,7 @@
 #include "common/axis.h"
 #include "common/bitarray.h"
 #include "common/color.h"
+#include "common/crc.h"
 #include "common/huffman.h"
 #include "common/maths.h"
 #include "common/streambuf.h"
@@ -76,6 +77,7 @@
 #include "fc/controlrate_profile.h"
 #include "fc/core.h"
 #include "fc/dispatch.h"
+#include "fc/latency.h"
 #include "fc/rc.h"
 #include "fc/rc_adjustments.h"
 #include "fc/rc_controls.h"
@@ -499,6 +501,8 @@ static void serializeDataflashSummaryReply(sbuf_t *dst)
         sbufWriteU32(dst, FLASH_PARTITION_SECTOR_COUNT(flashPartition));
         sbufWriteU32(dst, flashfsGetSize());
         sbufWriteU32(dst, flashfsGetOffset()); // Effectively the current number of bytes stored on the volume
+        // Added in MSP API 1.45
+        sbufWriteU32(dst, flashfsGetEraseAheadHeadroom()); // Bytes that can be logged without waiting for an erase
     } else
 #endif
 
@@ -508,6 +512,8 @@ static void serializeDataflashSummaryReply(sbuf_t *dst)
         sbufWriteU32(dst, 0);
         sbufWriteU32(dst, 0);
         sbufWriteU32(dst, 0);
+        // Added in MSP API 1.45
+        sbufWriteU32(dst, 0);
     }
 }
 
@@ -517,7 +523,8 @@ enum compressionType_e {
     HUFFMAN
 };
 
-static void serializeDataflashReadReply(sbuf_t *dst, uint32_t address, const uint16_t size, bool useLegacyFormat, bool allowCompression)
+// Returns the number of bytes of flash the reply holds
+static uint16_t serializeDataflashReadReply(sbuf_t *dst, uint32_t address, const uint16_t size, bool useLegacyFormat, bool allowCompression)
 {
     STATIC_ASSERT(MSP_PORT_DATAFLASH_INFO_SIZE >= 16, MSP_PORT_DATAFLASH_INFO_SIZE_invalid);
 
@@ -566,6 +573,8 @@ static void serializeDataflashReadReply(sbuf_t *dst, uint32_t address, const uin
                 sbufWriteU8(dst, 0);
             }
         }
+
+        return bytesRead;
     } else {
 #ifdef USE_HUFFMAN
         // compress in 256-byte chunks
@@ -606,9 +615,33 @@ static void serializeDataflashReadReply(sbuf_t *dst, uint32_t address, const uin
         // payload
         sbufWriteU16(dst, bytesReadTotal);
         sbufAdvance(dst, state.bytesWritten);
+
+        return bytesReadTotal;
+#else
+        return 0;
 #endif
     }
 }
+
+static struct {
+    uint32_t address;
+    uint32_t end;
+    bool allowCompression;
+} dataflashStream;
+
+// Each frame is an MSP_DATAFLASH_READ reply followed by the CRC16-CCITT of the reply. A compressed frame may hold
+// data beyond the end of the stream. The frame after the last one holding data is empty.
+static bool mspFcDataflashStreamFrame(sbuf_t *dst)
+{
+    uint8_t *frameStart = sbufPtr(dst);
+    const uint32_t size = dataflashStream.address < dataflashStream.end ? dataflashStream.end - dataflashStream.address : 0;
+
+    // the CRC fits in the room the reply keeps for its header
+    dataflashStream.address += serializeDataflashReadReply(dst, dataflashStream.address, MIN(size, (uint32_t)UINT16_MAX), false, dataflashStream.allowCompression);
+    crc16_ccitt_sbuf_append(dst, frameStart);
+
+    return size > 0;
+}
 #endif // USE_FLASHFS
 
 /*
@@ -1301,6 +1334,21 @@ case MSP_NAME:
         break;
 #endif
 
+#ifdef USE_LATENCY_STATS
+    case MSP2_LATENCY_STATS:
+        sbufWriteU8(dst, LATENCY_STAGE_COUNT);
+        sbufWriteU16(dst, latencyGetBucketWidthUs());
+        for (int stage = 0; stage < LATENCY_STAGE_COUNT; stage++) {
+            latencyStats_t stats;
+            latencyGetStats(stage, &stats);
+            sbufWriteU32(dst, stats.count);
+            sbufWriteU16(dst, stats.p50Us);
+            sbufWriteU16(dst, stats.p99Us);
+            sbufWriteU16(dst, stats.maxUs);
+        }
+        break;
+#endif
+
 #ifdef USE_OSD
     case MSP2_GET_OSD_WARNINGS:
         {
@@ -2556,6 +2604,93 @@ static mspResult_e mspFcProcessOutCommandWithArg(mspDescriptor_t srcDesc, int16_
         }
         break;
 
+#if defined(USE_TASK_TRACE)
+    case MSP2_TASK_TRACE:
+        {
+            // optional maximum number of entries, limited to what fits the reply
+            const unsigned requested = sbufBytesRemaining(src) ? sbufReadU8(src) : TASK_TRACE_LENGTH;
+            const unsigned fits = (sbufBytesRemaining(dst) - 5) / 9;
+            taskTraceEntry_t entries[TASK_TRACE_LENGTH];
+            const unsigned count = schedulerGetTaskTrace(entries, MIN(requested, fits));
+
+            sbufWriteU8(dst, count);
+            sbufWriteU32(dst, schedulerGetTaskTraceOverheadCycles());
+            for (unsigned i = 0; i < count; i++) {
+                sbufWriteU8(dst, entries[i].taskId);
+                sbufWriteU32(dst, entries[i].startUs);
+                sbufWriteU16(dst, entries[i].durationUs);
+                sbufWriteU16(dst, entries[i].gyroSlackUs);
+            }
+        }
+        break;
+
+    case MSP2_TASK_HISTOGRAM:
+        {
+            const uint8_t taskId = sbufBytesRemaining(src) ? sbufReadU8(src) : TASK_COUNT;
+            if (taskId >= TASK_COUNT) {
+                return MSP_RESULT_ERROR;
+            }
+
+            taskHistogram_t histogram;
+            schedulerGetTaskHistogram(taskId, &histogram);
+
+            sbufWriteU8(dst, taskId);
+            sbufWriteU8(dst, TASK_HISTOGRAM_BUCKET_COUNT);
+            for (int i = 0; i < TASK_HISTOGRAM_BUCKET_COUNT; i++) {
+                sbufWriteU32(dst, histogram.executionTime[i]);
+            }
+            for (int i = 0; i < TASK_HISTOGRAM_BUCKET_COUNT; i++) {
+                sbufWriteU32(dst, histogram.startDelay[i]);
+            }
+        }
+        break;
+#endif
+
+#ifdef USE_FLASHFS
+    case MSP2_BLACKBOX_LOG_INDEX:
+        {
+            // optional index of the first log, followed by as many as fit the reply
+            const unsigned first = sbufBytesRemaining(src) >= 2 ? sbufReadU16(src) : 0;
+            const unsigned count = flashfsGetLogCount();
+            const unsigned entrySize = 12 + FLASHFS_LOG_REVISION_LENGTH + FLASHFS_LOG_NAME_LENGTH;
+            const unsigned fits = (sbufBytesRemaining(dst) - 7) / entrySize;
+            const unsigned sent = first < count ? MIN(count - first, fits) : 0;
+
+            sbufWriteU8(dst, flashfsLogIndexIsAvailable());
+            sbufWriteU16(dst, count);
+            sbufWriteU16(dst, first);
+            sbufWriteU16(dst, sent);
+            for (unsigned i = first; i < first + sent; i++) {
+                flashfsLogEntry_t entry;
+                flashfsGetLogEntry(i, &entry);
+
+                sbufWriteU32(dst, entry.start);
+                sbufWriteU32(dst, entry.length);
+                sbufWriteU32(dst, entry.timestamp);
+                sbufWriteData(dst, entry.firmwareRevision, FLASHFS_LOG_REVISION_LENGTH);
+                sbufWriteData(dst, entry.craftName, FLASHFS_LOG_NAME_LENGTH);
+            }
+        }
+        break;
+
+    case MSP2_DATAFLASH_STREAM:
+        // start address, optional end address (default the end of the used space) and allow compression flag,
+        // no payload stops the stream
+        if (sbufBytesRemaining(src) >= 4) {
+            dataflashStream.address = sbufReadU32(src);
+            dataflashStream.end = sbufBytesRemaining(src) >= 4 ? sbufReadU32(src) : flashfsGetOffset();
+            dataflashStream.end = MIN(dataflashStream.end, flashfsGetSize());
+            dataflashStream.allowCompression = sbufBytesRemaining(src) ? sbufReadU8(src) : false;
+
+            if (!flashfsIsSupported() || !mspSerialStreamStart(srcDesc, cmdMSP, mspFcDataflashStreamFrame)) {
+                return MSP_RESULT_ERROR;
+            }
+        } else {
+            mspSerialStreamStop(mspFcDataflashStreamFrame);
+        }
+        break;
+#endif
+
     default:
         return MSP_RESULT_CMD_UNKNOWN;
     }
@@ -26,6 +26,11 @@
 #define MSP2_GET_OSD_WARNINGS               0x3005  // returns active OSD warning message text
 #define MSP2_GET_TEXT                       0x3006
 #define MSP2_SET_TEXT                       0x3007
+#define MSP2_LATENCY_STATS                  0x3008  // gyro to motor latency percentiles per PID loop stage
+#define MSP2_TASK_TRACE                     0x3009  // most recent scheduler decisions, oldest first
+#define MSP2_TASK_HISTOGRAM                 0x300A  // execution time and start delay histograms of a task
+#define MSP2_BLACKBOX_LOG_INDEX             0x300B  // start, length and origin of the logs on the dataflash
+#define MSP2_DATAFLASH_STREAM               0x300C  // dataflash read frames pushed without a request each
 
 // MSP2_SET_TEXT and MSP2_GET_TEXT variable types
 #define MSP2TEXT_PILOT_NAME                      1
@@ -31,6 +31,7 @@
 #include "common/streambuf.h"
 #include "common/utils.h"
 #include "common/crc.h"
+#include "common/maths.h"
 
 #include "drivers/system.h"
 
@@ -44,6 +45,8 @@
 
 static mspPort_t mspPorts[MAX_MSP_PORT_COUNT];
 
+static uint8_t mspSerialOutBuf[MSP_PORT_OUTBUF_SIZE];
+
 static void resetMspPort(mspPort_t *mspPortToReset, serialPort_t *serialPort, bool sharedWithTelemetry)
 {
     memset(mspPortToReset, 0, sizeof(mspPort_t));
@@ -413,8 +416,6 @@ static int mspSerialEncode(mspPort_t *msp, mspPacket_t *packet, mspVersion_e msp
 
 static mspPostProcessFnPtr mspSerialProcessReceivedCommand(mspPort_t *msp, mspProcessCommandFnPtr mspProcessCommandFn)
 {
-    static uint8_t mspSerialOutBuf[MSP_PORT_OUTBUF_SIZE];
-
     mspPacket_t reply = {
         .buf = { .ptr = mspSerialOutBuf, .end = ARRAYEND(mspSerialOutBuf), },
         .cmd = -1,
@@ -503,6 +504,84 @@ static void mspSerialProcessReceivedReply(mspPort_t *msp, mspProcessReplyFnPtr m
     msp->c_state = MSP_IDLE;
 }
 
+// Payload size of the next stream frame. A frame has to fit in the free space of the transmit buffer so that queueing
+// it never blocks and the next one can be queued while it drains, except that USB VCP, which drains quickly enough,
+// takes frames as large as a reply once its buffer is empty.
+static int mspSerialStreamFrameSize(const mspPort_t *msp)
+{
+    if (msp->port->identifier == SERIAL_PORT_USB_VCP && isSerialTransmitBufferEmpty(msp->port)) {
+        return MSP_PORT_OUTBUF_SIZE;
+    }
+    return constrain((int)serialTxBytesFree(msp->port) - MSP_MAX_HEADER_SIZE - MSP_MAX_CHECKSUM_SIZE, 0, MSP_PORT_OUTBUF_SIZE);
+}
+
+static void mspSerialProcessStream(mspPort_t *msp)
+{
+    for (int frame = 0; frame < MSP_STREAM_MAX_FRAMES_PER_PROCESS && msp->streamFn; frame++) {
+        // decided before the frame is built, as building it consumes the data
+        const int frameSize = mspSerialStreamFrameSize(msp);
+        if (frameSize < MSP_STREAM_MIN_FRAME_SIZE) {
+            break;
+        }
+
+        mspPacket_t packet = {
+            .buf = { .ptr = mspSerialOutBuf, .end = mspSerialOutBuf + frameSize, },
+            .cmd = msp->streamCmd,
+            .flags = 0,
+            .result = MSP_RESULT_ACK,
+            .direction = MSP_DIRECTION_REPLY,
+        };
+
+        if (!msp->streamFn(&packet.buf)) {
+            // that was the last frame
+            msp->streamFn = NULL;
+        }
+
+        sbufSwitchToReader(&packet.buf, mspSerialOutBuf);
+        mspSerialEncode(msp, &packet, msp->mspVersion);
+    }
+}
+
+/*
+ * Pushes the frames streamFn fills, as replies to cmd, to the port a command from descriptor came in on whenever its
+ * transmit buffer has room for one, until streamFn returns false. Returns false if descriptor is not a serial MSP port.
+ * A stream function runs on one port at a time, starting it again moves it to the new port.
+ */
+bool mspSerialStreamStart(mspDescriptor_t descriptor, int16_t cmd, mspStreamFnPtr streamFn)
+{
+    mspPort_t *streamPort = NULL;
+
+    for (uint8_t portIndex = 0; portIndex < MAX_MSP_PORT_COUNT; portIndex++) {
+        mspPort_t *candidateMspPort = &mspPorts[portIndex];
+        if (!candidateMspPort->port) {
+            continue;
+        }
+        if (candidateMspPort->descriptor == descriptor) {
+            streamPort = candidateMspPort;
+        }
+    }
+
+    if (!streamPort) {
+        return false;
+    }
+
+    mspSerialStreamStop(streamFn);
+    streamPort->streamFn = streamFn;
+    streamPort->streamCmd = cmd;
+
+    return true;
+}
+
+void mspSerialStreamStop(mspStreamFnPtr streamFn)
+{
+    for (uint8_t portIndex = 0; portIndex < MAX_MSP_PORT_COUNT; portIndex++) {
+        mspPort_t *candidateMspPort = &mspPorts[portIndex];
+        if (candidateMspPort->streamFn == streamFn) {
+            candidateMspPort->streamFn = NULL;
+        }
+    }
+}
+
 /*
  * Process MSP commands from serial ports configured as MSP ports.
  *
@@ -550,6 +629,10 @@ void mspSerialProcess(mspEvaluateNonMspData_e evaluateNonMspData, mspProcessComm
         } else {
             mspProcessPendingRequest(mspPort);
         }
+
+        if (mspPort->streamFn) {
+            mspSerialProcessStream(mspPort);
+        }
     }
 }
 
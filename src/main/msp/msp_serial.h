@@ -94,6 +94,10 @@ typedef struct __attribute__((packed)) {
 } mspHeaderV2_t;
 
 #define MSP_MAX_HEADER_SIZE     9
+#define MSP_MAX_CHECKSUM_SIZE   2
+
+#define MSP_STREAM_MIN_FRAME_SIZE 64       // payload bytes, smaller frames would mostly be overhead
+#define MSP_STREAM_MAX_FRAMES_PER_PROCESS 4
 
 struct serialPort_s;
 typedef struct mspPort_s {
@@ -112,6 +116,8 @@ typedef struct mspPort_s {
     uint8_t checksum2;
     bool sharedWithTelemetry;
     mspDescriptor_t descriptor;
+    mspStreamFnPtr streamFn;    // null when not streaming
+    int16_t streamCmd;
 } mspPort_t;
 
 void mspSerialInit(void);
@@ -123,3 +129,5 @@ void mspSerialReleaseSharedTelemetryPorts(void);
 mspDescriptor_t getMspSerialPortDescriptor(const uint8_t portIdentifier);
 int mspSerialPush(serialPortIdentifier_e port, uint8_t cmd, uint8_t *data, int datalen, mspDirection_e direction, mspVersion_e mspVersion);
 uint32_t mspSerialTxBytesFree(void);
+bool mspSerialStreamStart(mspDescriptor_t descriptor, int16_t cmd, mspStreamFnPtr streamFn);
+void mspSerialStreamStop(mspStreamFnPtr streamFn);
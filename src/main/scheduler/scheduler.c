@@ -23,6 +23,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
+#include <math.h>
 
 #include "platform.h"
 
@@ -108,15 +109,61 @@ static uint32_t nextTimingCycles;
 
 static timeMs_t lastFailsafeCheckMs = 0;
 
+#if defined(USE_TASK_TRACE)
+// Per task log2 histograms of execution time and start delay, and a ring of the last TASK_TRACE_LENGTH tasks run.
+// The time taken to record them is measured so the cost of the feature can be checked on target.
+static taskHistogram_t taskHistograms[TASK_COUNT];
+static taskTraceEntry_t taskTrace[TASK_TRACE_LENGTH];
+static FAST_DATA_ZERO_INIT uint32_t taskTraceHead;                // total entries written, the ring index is the low bits
+static FAST_DATA_ZERO_INIT uint32_t taskTraceTargetCycles;        // start of the next gyro loop while a task runs
+static FAST_DATA_ZERO_INIT uint64_t taskTraceOverheadCycles;
+#endif
+
 // No need for a linked list for the queue, since items are only inserted at startup
 
 STATIC_UNIT_TESTED FAST_DATA_ZERO_INIT task_t* taskQueueArray[TASK_COUNT + 1]; // extra item for NULL pointer at end of queue
 
+// Non realtime tasks are tracked in bitmaps indexed by their position in taskQueueArray. The queue is sorted by
+// static priority so the most significant set bit, found with CLZ, is the highest priority task of a bitmap and
+// scanning a bitmap visits tasks in queue order. The bitmaps are rebuilt from the task state whenever the queue changes.
+#define TASK_BITMAP_WORDS       ((TASK_COUNT + 31) / 32)
+#define TASK_QUEUE_INDEX_NONE   0xff
+
+typedef struct taskBitmap_s {
+    uint32_t word[TASK_BITMAP_WORDS];
+} taskBitmap_t;
+
+static FAST_DATA_ZERO_INIT taskBitmap_t readyTasks;                         // due time driven tasks and signalled event driven tasks
+static FAST_DATA_ZERO_INIT taskBitmap_t eventTasks;                         // event driven tasks waiting on their check function
+static FAST_DATA_ZERO_INIT taskBitmap_t taskWheel[TASK_WHEEL_SLOT_COUNT];   // time driven tasks waiting to become due
+static FAST_DATA_ZERO_INIT uint32_t taskWheelSlot;                          // last slot processed
+static FAST_DATA_ZERO_INIT uint8_t taskQueueIndex[TASK_COUNT];              // position of each task in taskQueueArray
+static FAST_DATA_ZERO_INIT bool taskBitmapsValid;
+
+static inline void taskBitmapSet(taskBitmap_t *bitmap, int index)
+{
+    bitmap->word[index / 32] |= 0x80000000U >> (index % 32);
+}
+
+static inline void taskBitmapClear(taskBitmap_t *bitmap, int index)
+{
+    bitmap->word[index / 32] &= ~(0x80000000U >> (index % 32));
+}
+
+// Removes and returns the lowest index set in bits, which must not be zero
+static inline int taskBitmapTakeFirst(uint32_t *bits)
+{
+    const int bit = __builtin_clz(*bits);
+    *bits &= ~(0x80000000U >> bit);
+    return bit;
+}
+
 void queueClear(void)
 {
     memset(taskQueueArray, 0, sizeof(taskQueueArray));
     taskQueuePos = 0;
     taskQueueSize = 0;
+    taskBitmapsValid = false;
 }
 
 bool queueContains(task_t *task)
@@ -139,6 +186,7 @@ bool queueAdd(task_t *task)
             memmove(&taskQueueArray[ii+1], &taskQueueArray[ii], sizeof(task) * (taskQueueSize - ii));
             taskQueueArray[ii] = task;
             ++taskQueueSize;
+            taskBitmapsValid = false;
             return true;
         }
     }
@@ -151,6 +199,7 @@ bool queueRemove(task_t *task)
         if (taskQueueArray[ii] == task) {
             memmove(&taskQueueArray[ii], &taskQueueArray[ii+1], sizeof(task) * (taskQueueSize - ii));
             --taskQueueSize;
+            taskBitmapsValid = false;
             return true;
         }
     }
@@ -174,6 +223,85 @@ FAST_CODE task_t *queueNext(void)
     return taskQueueArray[++taskQueuePos]; // guaranteed to be NULL at end of queue
 }
 
+// Places a task in the bitmap matching its state. A time driven task is ready once a whole period has passed
+// since it last ran and an event driven task once its check function has signalled it.
+static FAST_CODE void taskFile(task_t *task, int index, timeUs_t currentTimeUs)
+{
+    if (task->attribute->staticPriority == TASK_PRIORITY_REALTIME) {
+        return;
+    }
+
+    if (task->attribute->checkFunc) {
+        taskBitmapSet(task->dynamicPriority > 0 ? &readyTasks : &eventTasks, index);
+    } else {
+        const timeDelta_t remainingUs = task->attribute->desiredPeriodUs - cmpTimeUs(currentTimeUs, task->lastExecutedAtUs);
+        if (remainingUs <= 0) {
+            taskBitmapSet(&readyTasks, index);
+        } else {
+            const uint32_t slot = (currentTimeUs + remainingUs) >> TASK_WHEEL_SLOT_SHIFT;
+            taskBitmapSet(&taskWheel[slot % TASK_WHEEL_SLOT_COUNT], index);
+        }
+    }
+}
+
+static FAST_CODE void taskRefile(task_t *task, timeUs_t currentTimeUs)
+{
+    const int index = taskQueueIndex[task - tasks];
+
+    if (!taskBitmapsValid || index == TASK_QUEUE_INDEX_NONE) {
+        return;
+    }
+
+    taskBitmapClear(&readyTasks, index);
+    taskBitmapClear(&eventTasks, index);
+    for (int slot = 0; slot < TASK_WHEEL_SLOT_COUNT; slot++) {
+        taskBitmapClear(&taskWheel[slot], index);
+    }
+    taskFile(task, index, currentTimeUs);
+}
+
+static void taskBitmapsRebuild(timeUs_t currentTimeUs)
+{
+    memset(&readyTasks, 0, sizeof(readyTasks));
+    memset(&eventTasks, 0, sizeof(eventTasks));
+    memset(taskWheel, 0, sizeof(taskWheel));
+    memset(taskQueueIndex, TASK_QUEUE_INDEX_NONE, sizeof(taskQueueIndex));
+
+    taskWheelSlot = currentTimeUs >> TASK_WHEEL_SLOT_SHIFT;
+
+    for (int index = 0; index < taskQueueSize; index++) {
+        task_t *task = taskQueueArray[index];
+        taskQueueIndex[task - tasks] = index;
+        taskFile(task, index, currentTimeUs);
+    }
+
+    taskBitmapsValid = true;
+}
+
+// Moves the time driven tasks that have become due from the wheel slots passed since the last call to the ready bitmap
+static FAST_CODE void taskWheelAdvance(timeUs_t currentTimeUs)
+{
+    const uint32_t nowSlot = currentTimeUs >> TASK_WHEEL_SLOT_SHIFT;
+    const uint32_t slotCount = MIN(nowSlot - taskWheelSlot + 1, (uint32_t)TASK_WHEEL_SLOT_COUNT);
+
+    for (uint32_t i = 0; i < slotCount; i++) {
+        taskBitmap_t *slot = &taskWheel[(nowSlot - i) % TASK_WHEEL_SLOT_COUNT];
+        for (int word = 0; word < TASK_BITMAP_WORDS; word++) {
+            uint32_t bits = slot->word[word];
+            while (bits) {
+                const int index = word * 32 + taskBitmapTakeFirst(&bits);
+                const task_t *task = taskQueueArray[index];
+                if (cmpTimeUs(currentTimeUs, task->lastExecutedAtUs) >= task->attribute->desiredPeriodUs) {
+                    taskBitmapClear(slot, index);
+                    taskBitmapSet(&readyTasks, index);
+                }
+            }
+        }
+    }
+
+    taskWheelSlot = nowSlot;
+}
+
 static timeUs_t taskTotalExecutionTime = 0;
 
 void taskSystemLoad(timeUs_t currentTimeUs)
@@ -226,6 +354,9 @@ void getTaskInfo(taskId_e taskId, taskInfo_t * taskInfo)
     taskInfo->runCount = getTask(taskId)->runCount;
     taskInfo->execTime = getTask(taskId)->execTime;
 #endif
+#if defined(SIMULATOR_BUILD)
+    taskInfo->hostCpuTimeNs = getTask(taskId)->hostCpuTimeNs;
+#endif
 }
 
 void rescheduleTask(taskId_e taskId, timeDelta_t newPeriodUs)
@@ -240,6 +371,7 @@ void rescheduleTask(taskId_e taskId, timeDelta_t newPeriodUs)
         return;
     }
     task->attribute->desiredPeriodUs = MAX(SCHEDULER_DELAY_LIMIT, newPeriodUs);  // Limit delay to 100us (10 kHz) to prevent scheduler clogging
+    taskRefile(task, micros());
 
     // Catch the case where the gyro loop is adjusted
     if (taskId == TASK_GYRO) {
@@ -328,6 +460,61 @@ void schedulerResetCheckFunctionMaxExecutionTime(void)
     checkFuncMaxExecutionTimeUs = 0;
 }
 
+#if defined(USE_TASK_TRACE)
+static FAST_CODE int taskHistogramBucket(timeDelta_t timeUs)
+{
+    return timeUs <= 0 ? 0 : MIN(32 - __builtin_clz(timeUs), TASK_HISTOGRAM_BUCKET_COUNT - 1);
+}
+
+static FAST_CODE void taskTraceRecord(task_t *task, timeUs_t startUs, timeDelta_t startDelayUs, timeUs_t executionTimeUs)
+{
+    const uint32_t startCycles = getCycleCounter();
+    taskHistogram_t *histogram = &taskHistograms[task - tasks];
+
+    histogram->executionTime[taskHistogramBucket(executionTimeUs)]++;
+    histogram->startDelay[taskHistogramBucket(startDelayUs)]++;
+
+    taskTraceEntry_t *entry = &taskTrace[taskTraceHead++ % TASK_TRACE_LENGTH];
+    entry->taskId = task - tasks;
+    entry->startUs = startUs;
+    entry->durationUs = MIN(executionTimeUs, (timeUs_t)UINT16_MAX);
+    entry->gyroSlackUs = constrain(clockCyclesToMicros(cmpTimeCycles(taskTraceTargetCycles, startCycles)), INT16_MIN, INT16_MAX);
+
+    taskTraceOverheadCycles += getCycleCounter() - startCycles;
+}
+
+void schedulerGetTaskHistogram(taskId_e taskId, taskHistogram_t *histogram)
+{
+    *histogram = taskHistograms[taskId];
+}
+
+// Copies up to maxEntries of the most recent trace entries, oldest first, returning the number copied
+unsigned schedulerGetTaskTrace(taskTraceEntry_t *entries, unsigned maxEntries)
+{
+    const uint32_t head = taskTraceHead;
+    const unsigned count = MIN(MIN(head, (uint32_t)TASK_TRACE_LENGTH), maxEntries);
+
+    for (unsigned i = 0; i < count; i++) {
+        entries[i] = taskTrace[(head - count + i) % TASK_TRACE_LENGTH];
+    }
+
+    return count;
+}
+
+// Average cycles spent recording each task run
+uint32_t schedulerGetTaskTraceOverheadCycles(void)
+{
+    return taskTraceHead ? taskTraceOverheadCycles / taskTraceHead : 0;
+}
+
+void schedulerResetTaskTrace(void)
+{
+    memset(taskHistograms, 0, sizeof(taskHistograms));
+    taskTraceHead = 0;
+    taskTraceOverheadCycles = 0;
+}
+#endif
+
 void schedulerInit(void)
 {
     queueClear();
@@ -380,13 +567,24 @@ FAST_CODE timeUs_t schedulerExecuteTask(task_t *selectedTask, timeUs_t currentTi
         ignoreCurrentTaskExecTime = false;
         taskNextStateTime = -1;
         float period = currentTimeUs - selectedTask->lastExecutedAtUs;
+#if defined(USE_TASK_TRACE)
+        const timeDelta_t startDelayUs = selectedTask->attribute->checkFunc ? cmpTimeUs(currentTimeUs, selectedTask->lastSignaledAtUs)
+            : cmpTimeUs(currentTimeUs, selectedTask->lastExecutedAtUs) - selectedTask->attribute->desiredPeriodUs;
+#endif
         selectedTask->lastExecutedAtUs = currentTimeUs;
         selectedTask->lastDesiredAt += selectedTask->attribute->desiredPeriodUs;
         selectedTask->dynamicPriority = 0;
 
         // Execute task
         const timeUs_t currentTimeBeforeTaskCallUs = micros();
+#if defined(SIMULATOR_BUILD)
+        // in lockstep micros() only advances as the clock is read, so also time the task on the host
+        const uint64_t hostCpuBeforeTaskCallNs = nanos64_thread_cpu();
+#endif
         selectedTask->attribute->taskFunc(currentTimeBeforeTaskCallUs);
+#if defined(SIMULATOR_BUILD)
+        selectedTask->hostCpuTimeNs += nanos64_thread_cpu() - hostCpuBeforeTaskCallNs;
+#endif
         taskExecutionTimeUs = micros() - currentTimeBeforeTaskCallUs;
         taskTotalExecutionTime += taskExecutionTimeUs;
         selectedTask->movingSumExecutionTime10thUs += (taskExecutionTimeUs * 10) - selectedTask->movingSumExecutionTime10thUs / TASK_STATS_MOVING_SUM_COUNT;
@@ -417,6 +615,9 @@ FAST_CODE timeUs_t schedulerExecuteTask(task_t *selectedTask, timeUs_t currentTi
         selectedTask->movingAverageCycleTimeUs += 0.05f * (period - selectedTask->movingAverageCycleTimeUs);
 #if defined(USE_LATE_TASK_STATISTICS)
         selectedTask->runCount++;
+#endif
+#if defined(USE_TASK_TRACE)
+        taskTraceRecord(selectedTask, currentTimeUs, startDelayUs, taskExecutionTimeUs);
 #endif
     }
 
@@ -495,6 +696,9 @@ FAST_CODE void scheduler(void)
             DEBUG_SET(DEBUG_SCHEDULER_DETERMINISM, 0, clockCyclesTo10thMicros(cmpTimeCycles(nowCycles, lastTargetCycles)));
 #endif
             currentTimeUs = micros();
+#if defined(USE_TASK_TRACE)
+            taskTraceTargetCycles = nextTargetCycles + desiredPeriodCycles;
+#endif
             taskExecutionTimeUs += schedulerExecuteTask(gyroTask, currentTimeUs);
 
             if (gyroFilterReady()) {
@@ -592,27 +796,42 @@ FAST_CODE void scheduler(void)
     if (!gyroEnabled || (schedLoopRemainingCycles > (int32_t)clockMicrosToCycles(CHECK_GUARD_MARGIN_US))) {
         currentTimeUs = micros();
 
-        // Update task dynamic priorities
-        for (task_t *task = queueFirst(); task != NULL; task = queueNext()) {
-            if (task->attribute->staticPriority != TASK_PRIORITY_REALTIME) {
-                // Task has checkFunc - event driven
+        if (!taskBitmapsValid) {
+            taskBitmapsRebuild(currentTimeUs);
+        }
+        taskWheelAdvance(currentTimeUs);
+
+        // Run the check functions of event driven tasks not yet signalled
+        for (int word = 0; word < TASK_BITMAP_WORDS; word++) {
+            uint32_t bits = eventTasks.word[word];
+            while (bits) {
+                const int index = word * 32 + taskBitmapTakeFirst(&bits);
+                task_t *task = taskQueueArray[index];
+                if (task->attribute->checkFunc(currentTimeUs, cmpTimeUs(currentTimeUs, task->lastExecutedAtUs))) {
+                    const uint32_t checkFuncExecutionTimeUs = cmpTimeUs(micros(), currentTimeUs);
+                    checkFuncMovingSumExecutionTimeUs += checkFuncExecutionTimeUs - checkFuncMovingSumExecutionTimeUs / TASK_STATS_MOVING_SUM_COUNT;
+                    checkFuncMovingSumDeltaTimeUs += task->taskLatestDeltaTimeUs - checkFuncMovingSumDeltaTimeUs / TASK_STATS_MOVING_SUM_COUNT;
+                    checkFuncTotalExecutionTimeUs += checkFuncExecutionTimeUs;   // time consumed by scheduler + task
+                    checkFuncMaxExecutionTimeUs = MAX(checkFuncMaxExecutionTimeUs, checkFuncExecutionTimeUs);
+                    task->lastSignaledAtUs = currentTimeUs;
+                    task->dynamicPriority = 1 + task->attribute->staticPriority;
+                    taskBitmapClear(&eventTasks, index);
+                    taskBitmapSet(&readyTasks, index);
+                } else {
+                    task->taskAgePeriods = 0;
+                }
+            }
+        }
+
+        // Update dynamic priorities of the ready tasks, in queue order so ties go to the higher static priority
+        for (int word = 0; word < TASK_BITMAP_WORDS; word++) {
+            uint32_t bits = readyTasks.word[word];
+            while (bits) {
+                task_t *task = taskQueueArray[word * 32 + taskBitmapTakeFirst(&bits)];
                 if (task->attribute->checkFunc) {
                     // Increase priority for event driven tasks
-                    if (task->dynamicPriority > 0) {
-                        task->taskAgePeriods = 1 + (cmpTimeUs(currentTimeUs, task->lastSignaledAtUs) / task->attribute->desiredPeriodUs);
-                        task->dynamicPriority = 1 + task->attribute->staticPriority * task->taskAgePeriods;
-                    } else if (task->attribute->checkFunc(currentTimeUs, cmpTimeUs(currentTimeUs, task->lastExecutedAtUs))) {
-                        const uint32_t checkFuncExecutionTimeUs = cmpTimeUs(micros(), currentTimeUs);
-                        checkFuncMovingSumExecutionTimeUs += checkFuncExecutionTimeUs - checkFuncMovingSumExecutionTimeUs / TASK_STATS_MOVING_SUM_COUNT;
-                        checkFuncMovingSumDeltaTimeUs += task->taskLatestDeltaTimeUs - checkFuncMovingSumDeltaTimeUs / TASK_STATS_MOVING_SUM_COUNT;
-                        checkFuncTotalExecutionTimeUs += checkFuncExecutionTimeUs;   // time consumed by scheduler + task
-                        checkFuncMaxExecutionTimeUs = MAX(checkFuncMaxExecutionTimeUs, checkFuncExecutionTimeUs);
-                        task->lastSignaledAtUs = currentTimeUs;
-                        task->taskAgePeriods = 1;
-                        task->dynamicPriority = 1 + task->attribute->staticPriority;
-                    } else {
-                        task->taskAgePeriods = 0;
-                    }
+                    task->taskAgePeriods = 1 + (cmpTimeUs(currentTimeUs, task->lastSignaledAtUs) / task->attribute->desiredPeriodUs);
+                    task->dynamicPriority = 1 + task->attribute->staticPriority * task->taskAgePeriods;
                 } else {
                     // Task is time-driven, dynamicPriority is last execution age (measured in desiredPeriods)
                     // Task age is calculated from last execution
@@ -638,7 +857,6 @@ FAST_CODE void scheduler(void)
                     }
                 }
             }
-
         }
 
         // The number of cycles taken to run the checkers is quite consistent with some higher spikes, but
@@ -661,7 +879,11 @@ FAST_CODE void scheduler(void)
 
             if (!gyroEnabled || (taskRequiredTimeCycles < schedLoopRemainingCycles)) {
                 uint32_t antipatedEndCycles = nowCycles + taskRequiredTimeCycles;
+#if defined(USE_TASK_TRACE)
+                taskTraceTargetCycles = nextTargetCycles;
+#endif
                 taskExecutionTimeUs += schedulerExecuteTask(selectedTask, currentTimeUs);
+                taskRefile(selectedTask, currentTimeUs);
                 nowCycles = getCycleCounter();
                 int32_t cyclesOverdue = cmpTimeCycles(nowCycles, antipatedEndCycles);
 
@@ -46,6 +46,11 @@
 
 #define CHECK_GUARD_MARGIN_US           2   // Add a margin to the amount of time allowed for a check function to run
 
+// Time driven tasks wait for their due time on a timer wheel of TASK_WHEEL_SLOT_COUNT slots, each 1 << TASK_WHEEL_SLOT_SHIFT us
+// wide. Tasks due beyond the span of the wheel stay in their slot for further turns.
+#define TASK_WHEEL_SLOT_SHIFT           7
+#define TASK_WHEEL_SLOT_COUNT           32
+
 // Some tasks have occasional peaks in execution time so normal moving average duration estimation doesn't work
 // Decay the estimated max task duration by 1/(1 << TASK_EXEC_TIME_SHIFT) on every invocation
 #define TASK_EXEC_TIME_SHIFT            7
@@ -93,6 +98,9 @@ typedef struct {
     uint32_t     lateCount;
     timeUs_t     execTime;
 #endif
+#if defined(SIMULATOR_BUILD)
+    uint64_t     hostCpuTimeNs;
+#endif
 } taskInfo_t;
 
 typedef enum {
@@ -176,6 +184,9 @@ typedef enum {
 #ifdef USE_CRSF_V3
     TASK_SPEED_NEGOTIATION,
 #endif
+#ifdef USE_BLACKBOX_DEFERRED
+    TASK_BLACKBOX,
+#endif
 
     /* Count of real tasks */
     TASK_COUNT,
@@ -220,8 +231,33 @@ typedef struct {
     uint32_t lateCount;
     timeUs_t execTime;
 #endif
+#if defined(SIMULATOR_BUILD)
+    uint64_t hostCpuTimeNs;             // host CPU time consumed by task since boot
+#endif
 } task_t;
 
+#if defined(USE_TASK_TRACE)
+#define TASK_HISTOGRAM_BUCKET_COUNT     16  // bucket 0 counts 0us, bucket n counts 2^(n-1) to 2^n - 1 us, the last bucket also everything longer
+#define TASK_TRACE_LENGTH               64  // scheduling decisions kept, a power of two
+
+typedef struct {
+    uint32_t executionTime[TASK_HISTOGRAM_BUCKET_COUNT];
+    uint32_t startDelay[TASK_HISTOGRAM_BUCKET_COUNT];   // since a time driven task became due or an event driven task was signalled
+} taskHistogram_t;
+
+typedef struct {
+    timeUs_t startUs;
+    uint16_t durationUs;
+    int16_t  gyroSlackUs;               // time left before the next gyro loop when the task completed, negative if it overran
+    uint8_t  taskId;
+} taskTraceEntry_t;
+
+void schedulerGetTaskHistogram(taskId_e taskId, taskHistogram_t *histogram);
+unsigned schedulerGetTaskTrace(taskTraceEntry_t *entries, unsigned maxEntries);
+uint32_t schedulerGetTaskTraceOverheadCycles(void);
+void schedulerResetTaskTrace(void);
+#endif
+
 void getCheckFuncInfo(cfCheckFuncInfo_t *checkFuncInfo);
 void getTaskInfo(taskId_e taskId, taskInfo_t *taskInfo);
 void rescheduleTask(taskId_e taskId, timeDelta_t newPeriodUs);
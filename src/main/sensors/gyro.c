@@ -41,8 +41,10 @@
 
 #include "drivers/bus_spi.h"
 #include "drivers/io.h"
+#include "drivers/system.h"
 
 #include "config/config.h"
+#include "fc/latency.h"
 #include "fc/runtime_config.h"
 
 #ifdef USE_DYN_NOTCH_FILTER
@@ -85,6 +87,10 @@ FAST_DATA uint8_t activePidLoopDenom = 1;
 
 static bool firstArmingCalibrationWasStarted = false;
 
+#if defined(USE_GYRO_ISR_FILTERING) && defined(USE_DYN_LPF)
+static void dynLpfGyroApply(float throttle);
+#endif
+
 #ifdef UNIT_TEST
 STATIC_UNIT_TESTED gyroSensor_t * const gyroSensorPtr = &gyro.gyroSensor1;
 STATIC_UNIT_TESTED gyroDev_t * const gyroDevPtr = &gyro.gyroSensor1.gyroDev;
@@ -96,7 +102,7 @@ STATIC_UNIT_TESTED gyroDev_t * const gyroDevPtr = &gyro.gyroSensor1.gyroDev;
 #define GYRO_OVERFLOW_TRIGGER_THRESHOLD 31980  // 97.5% full scale (1950dps for 2000dps gyro)
 #define GYRO_OVERFLOW_RESET_THRESHOLD 30340    // 92.5% full scale (1850dps for 2000dps gyro)
 
-PG_REGISTER_WITH_RESET_FN(gyroConfig_t, gyroConfig, PG_GYRO_CONFIG, 9);
+PG_REGISTER_WITH_RESET_FN(gyroConfig_t, gyroConfig, PG_GYRO_CONFIG, 11);
 
 #ifndef GYRO_CONFIG_USE_GYRO_DEFAULT
 #define GYRO_CONFIG_USE_GYRO_DEFAULT GYRO_CONFIG_USE_GYRO_1
@@ -131,6 +137,8 @@ void pgResetFn_gyroConfig(gyroConfig_t *gyroConfig)
     gyroConfig->gyro_lpf1_dyn_expo = 5;
     gyroConfig->simplified_gyro_filter = true;
     gyroConfig->simplified_gyro_filter_multiplier = SIMPLIFIED_TUNING_DEFAULT;
+    gyroConfig->gyro_filter_fixed_point = false;
+    gyroConfig->gyro_isr_filtering = false;
 }
 
 FAST_CODE bool isGyroSensorCalibrationComplete(const gyroSensor_t *gyroSensor)
@@ -188,6 +196,11 @@ void gyroStartCalibration(bool isFirstArmingCalibration)
         return;
     }
 
+#ifdef USE_GYRO_ISR_FILTERING
+    // calibration runs from the gyro task, gyroIsrFilteringActive() hands sampling back to the ISR when it completes
+    gyroStopIsrFiltering();
+#endif
+
     gyroSetCalibrationCycles(&gyro.gyroSensor1);
 #ifdef USE_MULTI_GYRO
     gyroSetCalibrationCycles(&gyro.gyroSensor2);
@@ -402,6 +415,14 @@ static FAST_CODE void gyroUpdateSensor(gyroSensor_t *gyroSensor)
 
 FAST_CODE void gyroUpdate(void)
 {
+    const gyroModeSPI_e gyroModeSPI = gyro.rawSensorDev->gyroModeSPI;
+    if (gyroModeSPI == GYRO_EXTI_INT_DMA || gyroModeSPI == GYRO_EXTI_INT) {
+        // the data was read in response to the data ready interrupt
+        gyro.sampleCycles = gyro.rawSensorDev->gyroLastEXTI;
+    } else {
+        gyro.sampleCycles = getCycleCounter();
+    }
+
     switch (gyro.gyroToUse) {
     case GYRO_CONFIG_USE_GYRO_1:
         gyroUpdateSensor(&gyro.gyroSensor1);
@@ -462,12 +483,12 @@ FAST_CODE void gyroUpdate(void)
 #undef GYRO_FILTER_DEBUG_SET
 #undef GYRO_FILTER_AXIS_DEBUG_SET
 
-FAST_CODE void gyroFiltering(timeUs_t currentTimeUs)
+static FAST_CODE void gyroFilterSamples(float *gyroADCf)
 {
     if (gyro.gyroDebugMode == DEBUG_NONE) {
-        filterGyro();
+        filterGyro(gyroADCf);
     } else {
-        filterGyroDebug();
+        filterGyroDebug(gyroADCf);
     }
 
 #ifdef USE_DYN_NOTCH_FILTER
@@ -475,6 +496,133 @@ FAST_CODE void gyroFiltering(timeUs_t currentTimeUs)
         dynNotchUpdate();
     }
 #endif
+}
+
+#ifdef USE_GYRO_ISR_FILTERING
+static FAST_CODE void gyroFilterIsr(void)
+{
+    gyroUpdate();
+
+    if (++gyro.isrSampleCount < activePidLoopDenom) {
+        return;
+    }
+    gyro.isrSampleCount = 0;
+
+    // coefficient updates are made here so the filters are only ever touched by the ISR
+#ifdef USE_DYN_LPF
+    if (gyro.dynLpfUpdatePending) {
+        gyro.dynLpfUpdatePending = false;
+        dynLpfGyroApply(gyro.dynLpfThrottle);
+    }
+#endif
+#ifdef USE_RPM_FILTER
+    rpmFilterUpdate();
+#endif
+
+    const uint32_t sequence = gyro.isrSamples.sequence + 1;
+    gyroSample_t *sample = &gyro.isrSamples.slot[sequence & 1];
+
+    gyroFilterSamples(sample->gyroADCf);
+    sample->sampleCycles = gyro.sampleCycles;
+    sample->filteredCycles = getCycleCounter();
+
+    // the slot must be complete before it is published
+    __sync_synchronize();
+    gyro.isrSamples.sequence = sequence;
+}
+
+// Called from the gyro DMA completion interrupt once the main loop has handed over sampling.
+// Every activePidLoopDenom samples the filters run and the result is published for the PID loop.
+FAST_CODE void gyroSampleIsr(gyroDev_t *gyroDev)
+{
+    UNUSED(gyroDev);
+
+    // isrRunning is raised before the check, so gyroStopIsrFiltering() either sees it or this sees the stop
+    gyro.isrRunning = true;
+    __sync_synchronize();
+    if (gyro.isrFilteringActive) {
+        gyroFilterIsr();
+    }
+    __sync_synchronize();
+    gyro.isrRunning = false;
+}
+
+// Takes sampling and filtering back from the ISR, returns once no call of gyroSampleIsr() is using the
+// filters, so they can be reinitialised. gyroIsrFilteringActive() hands them over again from the gyro task.
+void gyroStopIsrFiltering(void)
+{
+    if (!gyro.rawSensorDev) {
+        // no gyro yet, the ISR was never handed anything
+        return;
+    }
+    gyro.rawSensorDev->sampleFn = NULL;
+    gyro.isrFilteringActive = false;
+    __sync_synchronize();
+    while (gyro.isrRunning);
+}
+
+// Copies the newest sample published by the ISR into gyroADCf. The ISR only rewrites the slot being
+// copied after publishing twice, in which case the copy is repeated. Without a new sample the
+// previous values are kept.
+static FAST_CODE void gyroReadIsrSample(void)
+{
+    uint32_t sequence;
+    do {
+        sequence = gyro.isrSamples.sequence;
+        if (sequence == gyro.isrSequenceRead) {
+            return;
+        }
+        __sync_synchronize();
+
+        const gyroSample_t *sample = &gyro.isrSamples.slot[sequence & 1];
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            gyro.gyroADCf[axis] = sample->gyroADCf[axis];
+        }
+        gyro.filteredSampleCycles = sample->sampleCycles;
+        gyro.filteredCycles = sample->filteredCycles;
+
+        __sync_synchronize();
+    } while (gyro.isrSamples.sequence - sequence > 1);
+
+    gyro.isrSequenceRead = sequence;
+}
+#endif
+
+// Called from the main loop, hands sampling and filtering to the gyro ISR when it is enabled and the
+// gyro is being read by DMA, and reports whether the ISR is doing the work.
+FAST_CODE bool gyroIsrFilteringActive(void)
+{
+#ifdef USE_GYRO_ISR_FILTERING
+    if (!gyro.isrFilteringActive && gyro.isrFiltering
+        && gyro.rawSensorDev->gyroModeSPI == GYRO_EXTI_INT_DMA && gyroIsCalibrationComplete()) {
+        gyro.isrSampleCount = 0;
+        gyro.isrSequenceRead = gyro.isrSamples.sequence;
+        gyro.isrFilteringActive = true;
+        __sync_synchronize();
+        gyro.rawSensorDev->sampleFn = gyroSampleIsr;
+    }
+    return gyro.isrFilteringActive;
+#else
+    return false;
+#endif
+}
+
+FAST_CODE void gyroFiltering(timeUs_t currentTimeUs)
+{
+#ifdef USE_GYRO_ISR_FILTERING
+    if (gyro.isrFilteringActive) {
+        gyroReadIsrSample();
+    } else
+#endif
+    {
+        gyroFilterSamples(gyro.gyroADCf);
+        gyro.filteredSampleCycles = gyro.sampleCycles;
+        gyro.filteredCycles = getCycleCounter();
+    }
+
+#ifdef USE_LATENCY_STATS
+    latencyRecord(LATENCY_STAGE_FILTER, gyro.filteredSampleCycles, gyro.filteredCycles);
+#endif
 
     if (gyro.useDualGyroDebugging) {
         switch (gyro.gyroToUse) {
@@ -538,6 +686,11 @@ float gyroGetFilteredDownsampled(int axis)
     return gyroFilteredDownsampled[axis];
 }
 
+uint32_t gyroGetFilteredSampleCycles(void)
+{
+    return gyro.filteredSampleCycles;
+}
+
 int16_t gyroReadSensorTemperature(gyroSensor_t gyroSensor)
 {
     if (gyroSensor.gyroDev.temperatureFn) {
@@ -598,7 +751,7 @@ float dynThrottle(float throttle)
     return throttle * (1 - (throttle * throttle) / 3.0f) * 1.5f;
 }
 
-void dynLpfGyroUpdate(float throttle)
+static void dynLpfGyroApply(float throttle)
 {
     if (gyro.dynLpfFilter != DYN_LPF_NONE) {
         float cutoffFreq;
@@ -611,28 +764,33 @@ void dynLpfGyroUpdate(float throttle)
         const float gyroDt = gyro.targetLooptime * 1e-6f;
         switch (gyro.dynLpfFilter) {
         case DYN_LPF_PT1:
-            for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
-                pt1FilterUpdateCutoff(&gyro.lowpassFilter[axis].pt1FilterState, pt1FilterGain(cutoffFreq, gyroDt));
-            }
+            filterChainUpdateLowpassGain(&gyro.filterChain, pt1FilterGain(cutoffFreq, gyroDt));
             break;
         case DYN_LPF_BIQUAD:
-            for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
-                biquadFilterUpdateLPF(&gyro.lowpassFilter[axis].biquadFilterState, cutoffFreq, gyro.targetLooptime);
-            }
+            filterChainUpdateLowpassBiquad(&gyro.filterChain, cutoffFreq, gyro.targetLooptime);
             break;
-        case  DYN_LPF_PT2:
-            for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
-                pt2FilterUpdateCutoff(&gyro.lowpassFilter[axis].pt2FilterState, pt2FilterGain(cutoffFreq, gyroDt));
-            }
+        case DYN_LPF_PT2:
+            filterChainUpdateLowpassGain(&gyro.filterChain, pt2FilterGain(cutoffFreq, gyroDt));
             break;
         case DYN_LPF_PT3:
-            for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
-                pt3FilterUpdateCutoff(&gyro.lowpassFilter[axis].pt3FilterState, pt3FilterGain(cutoffFreq, gyroDt));
-            }
+            filterChainUpdateLowpassGain(&gyro.filterChain, pt3FilterGain(cutoffFreq, gyroDt));
             break;
         }
     }
 }
+
+void dynLpfGyroUpdate(float throttle)
+{
+#ifdef USE_GYRO_ISR_FILTERING
+    if (gyro.isrFilteringActive) {
+        // the ISR owns the filters, it applies the new cutoff before filtering the next sample
+        gyro.dynLpfThrottle = throttle;
+        gyro.dynLpfUpdatePending = true;
+        return;
+    }
+#endif
+    dynLpfGyroApply(throttle);
+}
 #endif
 
 #ifdef USE_YAW_SPIN_RECOVERY
@@ -22,6 +22,7 @@
 
 #include "common/axis.h"
 #include "common/filter.h"
+#include "common/filter_chain.h"
 #include "common/time.h"
 #include "common/utils.h"
 
@@ -51,12 +52,7 @@
 
 #define GYRO_IMU_DOWNSAMPLE_CUTOFF_HZ 200
 
-typedef union gyroLowpassFilter_u {
-    pt1Filter_t pt1FilterState;
-    biquadFilter_t biquadFilterState;
-    pt2Filter_t pt2FilterState;
-    pt3Filter_t pt3FilterState;
-} gyroLowpassFilter_t;
+typedef filterChainLowpass_t gyroLowpassFilter_t;
 
 typedef enum gyroDetectionFlags_e {
     GYRO_NONE_MASK = 0,
@@ -79,6 +75,22 @@ typedef struct gyroSensor_s {
     gyroCalibration_t calibration;
 } gyroSensor_t;
 
+#ifdef USE_GYRO_ISR_FILTERING
+typedef struct gyroSample_s {
+    float gyroADCf[XYZ_AXIS_COUNT];
+    uint32_t sampleCycles;             // cycle count when the newest raw sample of the group was read
+    uint32_t filteredCycles;           // cycle count when filtering was complete
+} gyroSample_t;
+
+// Filtered samples handed from the gyro ISR to the PID loop without disabling interrupts.
+// Only the ISR writes: it fills slot[(sequence + 1) & 1] and then increments sequence,
+// so slot[sequence & 1] always holds the newest complete sample.
+typedef struct gyroSampleBuffer_s {
+    volatile uint32_t sequence;
+    gyroSample_t slot[2];
+} gyroSampleBuffer_t;
+#endif
+
 typedef struct gyro_s {
     uint16_t sampleRateHz;
     uint32_t targetLooptime;
@@ -89,6 +101,9 @@ typedef struct gyro_s {
     uint8_t sampleCount;               // gyro sensor sample counter
     float sampleSum[XYZ_AXIS_COUNT];   // summed samples used for downsampling
     bool downsampleFilterEnabled;      // if true then downsample using gyro lowpass 2, otherwise use averaging
+    uint32_t sampleCycles;             // cycle count when the latest raw sample was read
+    uint32_t filteredSampleCycles;     // sampleCycles of the newest raw sample contributing to gyroADCf
+    uint32_t filteredCycles;           // cycle count when gyroADCf was filtered
 
     gyroSensor_t gyroSensor1;
 #ifdef USE_MULTI_GYRO
@@ -97,21 +112,13 @@ typedef struct gyro_s {
 
     gyroDev_t *rawSensorDev;           // pointer to the sensor providing the raw data for DEBUG_GYRO_RAW
 
-    // lowpass gyro soft filter
-    filterApplyFnPtr lowpassFilterApplyFn;
-    gyroLowpassFilter_t lowpassFilter[XYZ_AXIS_COUNT];
+    // static notches and lowpass gyro soft filter
+    filterChain_t filterChain;
 
     // lowpass2 gyro soft filter
     filterApplyFnPtr lowpass2FilterApplyFn;
     gyroLowpassFilter_t lowpass2Filter[XYZ_AXIS_COUNT];
 
-    // notch filters
-    filterApplyFnPtr notchFilter1ApplyFn;
-    biquadFilter_t notchFilter1[XYZ_AXIS_COUNT];
-
-    filterApplyFnPtr notchFilter2ApplyFn;
-    biquadFilter_t notchFilter2[XYZ_AXIS_COUNT];
-
     uint16_t accSampleRateHz;
     uint8_t gyroToUse;
     uint8_t gyroDebugMode;
@@ -130,6 +137,19 @@ typedef struct gyro_s {
     uint8_t overflowAxisMask;
 #endif
     pt1Filter_t imuGyroFilter[XYZ_AXIS_COUNT];
+
+#ifdef USE_GYRO_ISR_FILTERING
+    bool isrFiltering;                 // sampling and filtering requested to run in the gyro ISR
+    volatile bool isrFilteringActive;  // set by the main loop once the ISR owns sampling and filtering
+    volatile bool isrRunning;          // set while gyroSampleIsr() runs
+    uint8_t isrSampleCount;
+    uint32_t isrSequenceRead;          // sequence of the last sample consumed by the PID loop
+    gyroSampleBuffer_t isrSamples;
+#ifdef USE_DYN_LPF
+    volatile bool dynLpfUpdatePending; // cutoff change for the ISR to apply before the next filtering
+    volatile float dynLpfThrottle;
+#endif
+#endif
 } gyro_t;
 
 extern gyro_t gyro;
@@ -198,13 +218,21 @@ typedef struct gyroConfig_s {
     uint8_t gyro_lpf1_dyn_expo; // set the curve for dynamic gyro lowpass filter
     uint8_t simplified_gyro_filter;
     uint8_t simplified_gyro_filter_multiplier;
+    uint8_t gyro_filter_fixed_point;    // run the static gyro filters and RPM notches in integer arithmetic
+    uint8_t gyro_isr_filtering;         // sample and filter in the gyro DMA completion interrupt
 } gyroConfig_t;
 
 PG_DECLARE(gyroConfig_t, gyroConfig);
 
 void gyroUpdate(void);
 void gyroFiltering(timeUs_t currentTimeUs);
+bool gyroIsrFilteringActive(void);
+#ifdef USE_GYRO_ISR_FILTERING
+void gyroSampleIsr(gyroDev_t *gyroDev);
+void gyroStopIsrFiltering(void);
+#endif
 float gyroGetFilteredDownsampled(int axis);
+uint32_t gyroGetFilteredSampleCycles(void);
 void gyroStartCalibration(bool isFirstArmingCalibration);
 bool isFirstArmingGyroCalibrationRunning(void);
 bool gyroIsCalibrationComplete(void);
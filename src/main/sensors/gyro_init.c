@@ -106,49 +106,26 @@ static uint16_t calculateNyquistAdjustedNotchHz(uint16_t notchHz, uint16_t notch
     return notchHz;
 }
 
-static void gyroInitFilterNotch1(uint16_t notchHz, uint16_t notchCutoffHz)
+static void gyroInitFilterNotch(uint16_t notchHz, uint16_t notchCutoffHz)
 {
-    gyro.notchFilter1ApplyFn = nullFilterApply;
-
     notchHz = calculateNyquistAdjustedNotchHz(notchHz, notchCutoffHz);
 
     if (notchHz != 0 && notchCutoffHz != 0) {
-        gyro.notchFilter1ApplyFn = (filterApplyFnPtr)biquadFilterApply;
         const float notchQ = filterGetNotchQ(notchHz, notchCutoffHz);
-        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
-            biquadFilterInit(&gyro.notchFilter1[axis], notchHz, gyro.targetLooptime, notchQ, FILTER_NOTCH, 1.0f);
-        }
-    }
-}
-
-static void gyroInitFilterNotch2(uint16_t notchHz, uint16_t notchCutoffHz)
-{
-    gyro.notchFilter2ApplyFn = nullFilterApply;
-
-    notchHz = calculateNyquistAdjustedNotchHz(notchHz, notchCutoffHz);
-
-    if (notchHz != 0 && notchCutoffHz != 0) {
-        gyro.notchFilter2ApplyFn = (filterApplyFnPtr)biquadFilterApply;
-        const float notchQ = filterGetNotchQ(notchHz, notchCutoffHz);
-        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
-            biquadFilterInit(&gyro.notchFilter2[axis], notchHz, gyro.targetLooptime, notchQ, FILTER_NOTCH, 1.0f);
-        }
+        filterChainAddNotch(&gyro.filterChain, notchHz, notchQ, gyro.targetLooptime);
     }
 }
 
 static bool gyroInitLowpassFilterLpf(int slot, int type, uint16_t lpfHz, uint32_t looptime)
 {
-    filterApplyFnPtr *lowpassFilterApplyFn;
     gyroLowpassFilter_t *lowpassFilter = NULL;
 
     switch (slot) {
     case FILTER_LPF1:
-        lowpassFilterApplyFn = &gyro.lowpassFilterApplyFn;
-        lowpassFilter = gyro.lowpassFilter;
+        lowpassFilter = gyro.filterChain.lowpass;
         break;
 
     case FILTER_LPF2:
-        lowpassFilterApplyFn = &gyro.lowpass2FilterApplyFn;
         lowpassFilter = gyro.lowpass2Filter;
         break;
 
@@ -156,8 +133,6 @@ static bool gyroInitLowpassFilterLpf(int slot, int type, uint16_t lpfHz, uint32_
         return false;
     }
 
-    bool ret = false;
-
     // Establish some common constants
     const uint32_t gyroFrequencyNyquist = 1000000 / 2 / looptime;
     const float gyroDt = looptime * 1e-6f;
@@ -165,50 +140,59 @@ static bool gyroInitLowpassFilterLpf(int slot, int type, uint16_t lpfHz, uint32_
     // Gain could be calculated a little later as it is specific to the pt1/bqrcf2/fkf branches
     const float gain = pt1FilterGain(lpfHz, gyroDt);
 
-    // Dereference the pointer to null before checking valid cutoff and filter
-    // type. It will be overridden for positive cases.
-    *lowpassFilterApplyFn = nullFilterApply;
+    // Start with no filter, overridden below for valid cutoff and filter type.
+    filterApplyFnPtr lowpassFilterApplyFn = nullFilterApply;
+    filterChainLowpass_e lowpassType = FILTER_CHAIN_LPF_NONE;
 
     // If lowpass cutoff has been specified
     if (lpfHz) {
         switch (type) {
         case FILTER_PT1:
-            *lowpassFilterApplyFn = (filterApplyFnPtr) pt1FilterApply;
+            lowpassFilterApplyFn = (filterApplyFnPtr) pt1FilterApply;
+            lowpassType = FILTER_CHAIN_LPF_PT1;
             for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
-                pt1FilterInit(&lowpassFilter[axis].pt1FilterState, gain);
+                pt1FilterInit(&lowpassFilter[axis].pt1, gain);
             }
-            ret = true;
             break;
         case FILTER_BIQUAD:
             if (lpfHz <= gyroFrequencyNyquist) {
 #ifdef USE_DYN_LPF
-                *lowpassFilterApplyFn = (filterApplyFnPtr) biquadFilterApplyDF1;
+                lowpassFilterApplyFn = (filterApplyFnPtr) biquadFilterApplyDF1;
 #else
-                *lowpassFilterApplyFn = (filterApplyFnPtr) biquadFilterApply;
+                lowpassFilterApplyFn = (filterApplyFnPtr) biquadFilterApply;
 #endif
+                lowpassType = FILTER_CHAIN_LPF_BIQUAD;
                 for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
-                    biquadFilterInitLPF(&lowpassFilter[axis].biquadFilterState, lpfHz, looptime);
+                    biquadFilterInitLPF(&lowpassFilter[axis].biquad, lpfHz, looptime);
                 }
-                ret = true;
             }
             break;
         case FILTER_PT2:
-            *lowpassFilterApplyFn = (filterApplyFnPtr) pt2FilterApply;
+            lowpassFilterApplyFn = (filterApplyFnPtr) pt2FilterApply;
+            lowpassType = FILTER_CHAIN_LPF_PT2;
             for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
-                pt2FilterInit(&lowpassFilter[axis].pt2FilterState, gain);
+                pt2FilterInit(&lowpassFilter[axis].pt2, gain);
             }
-            ret = true;
             break;
         case FILTER_PT3:
-            *lowpassFilterApplyFn = (filterApplyFnPtr) pt3FilterApply;
+            lowpassFilterApplyFn = (filterApplyFnPtr) pt3FilterApply;
+            lowpassType = FILTER_CHAIN_LPF_PT3;
             for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
-                pt3FilterInit(&lowpassFilter[axis].pt3FilterState, gain);
+                pt3FilterInit(&lowpassFilter[axis].pt3, gain);
             }
-            ret = true;
             break;
         }
     }
-    return ret;
+
+    if (slot == FILTER_LPF1) {
+        // lowpass 1 runs at the filter rate as the last stage of the static filter chain
+        filterChainSetLowpass(&gyro.filterChain, lowpassType);
+    } else {
+        // lowpass 2 runs per gyro sample for downsampling
+        gyro.lowpass2FilterApplyFn = lowpassFilterApplyFn;
+    }
+
+    return lowpassType != FILTER_CHAIN_LPF_NONE;
 }
 
 #ifdef USE_DYN_LPF
@@ -241,16 +225,32 @@ static void dynLpfFilterInit(void)
 }
 #endif
 
+#ifdef USE_GYRO_ISR_FILTERING
+static void gyroInitIsrFiltering(void)
+{
+    // take sampling back from the ISR before the filters are reinitialised,
+    // gyroIsrFilteringActive() hands it over again from the gyro task
+    gyroStopIsrFiltering();
+    gyro.isrFiltering = gyroConfig()->gyro_isr_filtering && gyro.gyroToUse != GYRO_CONFIG_USE_GYRO_BOTH;
+}
+#endif
+
 void gyroInitFilters(void)
 {
     uint16_t gyro_lpf1_init_hz = gyroConfig()->gyro_lpf1_static_hz;
 
+#ifdef USE_GYRO_ISR_FILTERING
+    gyroInitIsrFiltering();
+#endif
+
 #ifdef USE_DYN_LPF
     if (gyroConfig()->gyro_lpf1_dyn_min_hz > 0) {
         gyro_lpf1_init_hz = gyroConfig()->gyro_lpf1_dyn_min_hz;
     }
 #endif
 
+    filterChainInit(&gyro.filterChain);
+
     gyroInitLowpassFilterLpf(
       FILTER_LPF1,
       gyroConfig()->gyro_lpf1_type,
@@ -265,8 +265,11 @@ void gyroInitFilters(void)
       gyro.sampleLooptime
     );
 
-    gyroInitFilterNotch1(gyroConfig()->gyro_soft_notch_hz_1, gyroConfig()->gyro_soft_notch_cutoff_1);
-    gyroInitFilterNotch2(gyroConfig()->gyro_soft_notch_hz_2, gyroConfig()->gyro_soft_notch_cutoff_2);
+    gyroInitFilterNotch(gyroConfig()->gyro_soft_notch_hz_1, gyroConfig()->gyro_soft_notch_cutoff_1);
+    gyroInitFilterNotch(gyroConfig()->gyro_soft_notch_hz_2, gyroConfig()->gyro_soft_notch_cutoff_2);
+#ifdef USE_FIXED_POINT_FILTERS
+    filterChainSetFixedPoint(&gyro.filterChain, gyroConfig()->gyro_filter_fixed_point);
+#endif
 #ifdef USE_DYN_LPF
     dynLpfFilterInit();
 #endif
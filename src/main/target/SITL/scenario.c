@@ -0,0 +1,612 @@
+/*
+ * This file is part of Cleanflight and Betaflight.
+ *
+ * Cleanflight and Betaflight are free software. You can redistribute
+ * this software and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Cleanflight and Betaflight are distributed in the hope that they
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <time.h>
+
+#include "platform.h"
+
+#include "cli/cli.h"
+
+#include "common/axis.h"
+#include "common/filter.h"
+#include "common/utils.h"
+
+#include "config/config.h"
+
+#include "drivers/buf_writer.h"
+
+#include "fc/rc.h"
+#include "fc/rc_controls.h"
+#include "fc/runtime_config.h"
+
+#include "pg/rx.h"
+
+#include "rx/rx.h"
+#include "rx/msp.h"
+
+#include "scheduler/scheduler.h"
+
+#include "sensors/gyro.h"
+
+#include "target/SITL/scenario.h"
+
+// A scenario file has one directive per line, '#' starts a comment:
+//   cli <command>                  CLI command, run on the default configuration before the motors are initialised
+//   at <s> <channel>=<us> ...      RC channel values from that time on, channels roll pitch yaw throttle aux1-aux8
+//   score <s>                      the scorecard covers the flight from that time on
+//   limit <metric> <max>           the run fails if the metric is above max
+//   end <s>                        end of the flight
+
+#define SCENARIO_AUX_COUNT 8
+#define SCENARIO_CHANNEL_COUNT (THROTTLE + 1 + SCENARIO_AUX_COUNT)
+#define SCENARIO_MAX_COMMANDS 64
+#define SCENARIO_MAX_EVENTS 512
+#define SCENARIO_MAX_LIMITS 32
+#define SCENARIO_LINE_LENGTH 256
+
+#define SCENARIO_RC_INTERVAL_S 0.004        // 250Hz, the rate of a typical RC link
+#define SCENARIO_MIN_STEP_DPS 50.0f         // smaller stick changes are not scored as steps
+#define SCENARIO_SETTLING_BAND 0.05f        // of the step size
+#define SCENARIO_MIN_SETTLING_BAND_DPS 5.0f
+#define SCENARIO_MOTOR_NOISE_HZ 20.0f       // motor noise is the part of the output above this frequency
+
+static const char * const channelNames[SCENARIO_CHANNEL_COUNT] = {
+    "roll", "pitch", "yaw", "throttle", "aux1", "aux2", "aux3", "aux4", "aux5", "aux6", "aux7", "aux8"
+};
+
+static const char * const axisNames[XYZ_AXIS_COUNT] = { "roll", "pitch", "yaw" };
+
+typedef struct scenarioEvent_s {
+    double time;
+    uint8_t channel;
+    uint16_t value;
+} scenarioEvent_t;
+
+typedef struct scenarioLimit_s {
+    char metric[32];
+    double max;
+} scenarioLimit_t;
+
+typedef struct scenarioSample_s {
+    double time;
+    bool armed;
+    float altitude;                     // m, above the ground
+    float setpoint[XYZ_AXIS_COUNT];     // deg/s
+    float gyro[XYZ_AXIS_COUNT];         // deg/s, filtered as the PID controller sees it
+    float motor[4];                     // fraction of full output
+} scenarioSample_t;
+
+// A change of the stick on one axis, scored until the next change on the same axis
+typedef struct scenarioStepResponse_s {
+    uint8_t axis;
+    unsigned startSample;
+    unsigned endSample;
+} scenarioStepResponse_t;
+
+static struct {
+    const char *filename;
+    const char *scorecardFilename;
+    const char *traceFilename;
+
+    char *commands[SCENARIO_MAX_COMMANDS];
+    unsigned commandCount;
+    scenarioEvent_t events[SCENARIO_MAX_EVENTS];
+    unsigned eventCount;
+    scenarioLimit_t limits[SCENARIO_MAX_LIMITS];
+    unsigned limitCount;
+    double scoreTime;
+    double endTime;
+
+    // playback
+    unsigned nextEvent;
+    uint16_t channels[SCENARIO_CHANNEL_COUNT];
+    double nextRcTime;
+    struct timespec hostStart;
+    struct timespec hostCpuStart;   // CPU time of the thread running the firmware
+
+    // recording
+    scenarioSample_t *samples;
+    unsigned sampleCount;
+    unsigned sampleCapacity;
+    unsigned scoreSample;
+    scenarioStepResponse_t responses[SCENARIO_MAX_EVENTS];
+    unsigned responseCount;
+} scenario;
+
+static bool scenarioError(unsigned line, const char *message, const char *detail)
+{
+    fprintf(stderr, "%s:%u: %s '%s'\n", scenario.filename, line, message, detail);
+    return false;
+}
+
+static bool parseTime(const char *token, double *time)
+{
+    char *end;
+    *time = token ? strtod(token, &end) : -1;
+    return token && end != token && *end == '\0' && *time >= 0;
+}
+
+static bool parseChannel(unsigned line, double time, char *token)
+{
+    char *value = strchr(token, '=');
+    if (!value) {
+        return scenarioError(line, "expected <channel>=<value>", token);
+    }
+    *value++ = '\0';
+
+    for (unsigned channel = 0; channel < SCENARIO_CHANNEL_COUNT; channel++) {
+        if (strcasecmp(token, channelNames[channel]) == 0) {
+            char *end;
+            const long us = strtol(value, &end, 10);
+            if (end == value || *end != '\0' || us < PWM_PULSE_MIN || us > PWM_PULSE_MAX) {
+                return scenarioError(line, "invalid channel value", value);
+            }
+            if (scenario.eventCount >= SCENARIO_MAX_EVENTS) {
+                return scenarioError(line, "too many RC changes", token);
+            }
+            scenarioEvent_t *event = &scenario.events[scenario.eventCount++];
+            event->time = time;
+            event->channel = channel;
+            event->value = us;
+            return true;
+        }
+    }
+    return scenarioError(line, "unknown channel", token);
+}
+
+static bool parseLine(unsigned line, char *text)
+{
+    char *comment = strchr(text, '#');
+    if (comment) {
+        *comment = '\0';
+    }
+    text[strcspn(text, "\r\n")] = '\0';
+
+    const char *directive = strtok(text, " \t");
+    if (!directive) {
+        return true;
+    }
+
+    if (strcmp(directive, "cli") == 0) {
+        const char *command = strtok(NULL, "");
+        if (!command) {
+            return scenarioError(line, "missing command", directive);
+        }
+        if (scenario.commandCount >= SCENARIO_MAX_COMMANDS) {
+            return scenarioError(line, "too many commands", command);
+        }
+        scenario.commands[scenario.commandCount++] = strdup(command + strspn(command, " \t"));
+    } else if (strcmp(directive, "at") == 0) {
+        const char *token = strtok(NULL, " \t");
+        double time;
+        if (!parseTime(token, &time)) {
+            return scenarioError(line, "invalid time", token ? token : "");
+        }
+        if (scenario.eventCount && time < scenario.events[scenario.eventCount - 1].time) {
+            return scenarioError(line, "time goes backwards", token);
+        }
+        char *channel;
+        while ((channel = strtok(NULL, " \t"))) {
+            if (!parseChannel(line, time, channel)) {
+                return false;
+            }
+        }
+    } else if (strcmp(directive, "score") == 0 || strcmp(directive, "end") == 0) {
+        const char *token = strtok(NULL, " \t");
+        if (!parseTime(token, directive[0] == 's' ? &scenario.scoreTime : &scenario.endTime)) {
+            return scenarioError(line, "invalid time", token ? token : "");
+        }
+    } else if (strcmp(directive, "limit") == 0) {
+        const char *metric = strtok(NULL, " \t");
+        const char *max = strtok(NULL, " \t");
+        if (!metric || !max || scenario.limitCount >= SCENARIO_MAX_LIMITS) {
+            return scenarioError(line, "expected limit <metric> <max>", metric ? metric : "");
+        }
+        scenarioLimit_t *limit = &scenario.limits[scenario.limitCount++];
+        strncpy(limit->metric, metric, sizeof(limit->metric) - 1);
+        limit->max = atof(max);
+    } else {
+        return scenarioError(line, "unknown directive", directive);
+    }
+
+    return true;
+}
+
+bool scenarioLoad(const char *filename, const char *scorecardFilename, const char *traceFilename)
+{
+    scenario.filename = filename;
+    scenario.scorecardFilename = scorecardFilename;
+    scenario.traceFilename = traceFilename;
+
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        fprintf(stderr, "Cannot open scenario '%s'\n", filename);
+        return false;
+    }
+
+    char text[SCENARIO_LINE_LENGTH];
+    bool success = true;
+    for (unsigned line = 1; success && fgets(text, sizeof(text), file); line++) {
+        success = parseLine(line, text);
+    }
+    fclose(file);
+
+    if (success && scenario.endTime <= scenario.scoreTime) {
+        success = scenarioError(0, "end must come after score", filename);
+    }
+
+    for (unsigned channel = 0; channel < SCENARIO_CHANNEL_COUNT; channel++) {
+        scenario.channels[channel] = channel >= THROTTLE ? PWM_RANGE_MIN : PWM_RANGE_MIDDLE;
+    }
+
+    return success;
+}
+
+static void scenarioWrite(void *arg, void *data, int count)
+{
+    fwrite(data, 1, count, arg);
+}
+
+static void scenarioWriteError(void *arg, void *data, int count)
+{
+    *(bool *)arg = true;
+    fwrite(data, 1, count, stderr);
+}
+
+// Called once the stored configuration is loaded, before anything is initialised from it
+void scenarioConfigure(void)
+{
+    static uint8_t outputBuffer[64];
+    static uint8_t errorBuffer[64];
+    bufWriter_t output;
+    bufWriter_t error;
+    bool failed = false;
+
+    bufWriterInit(&output, outputBuffer, sizeof(outputBuffer), scenarioWrite, stdout);
+    bufWriterInit(&error, errorBuffer, sizeof(errorBuffer), scenarioWriteError, &failed);
+
+    for (unsigned i = 0; i < scenario.commandCount && !failed; i++) {
+        cliRunCommand(&output, &error, scenario.commands[i]);
+    }
+    if (failed) {
+        fprintf(stderr, "\n%s: configuration failed\n", scenario.filename);
+        exit(1);
+    }
+
+    // validates and activates the configuration, the EEPROM only lives in memory for a scenario
+    writeEEPROM();
+    readEEPROM();
+
+    clock_gettime(CLOCK_MONOTONIC, &scenario.hostStart);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &scenario.hostCpuStart);
+}
+
+static void sendRcFrame(void)
+{
+    uint16_t frame[SCENARIO_CHANNEL_COUNT];
+
+    for (unsigned channel = 0; channel < SCENARIO_CHANNEL_COUNT; channel++) {
+        const unsigned rawChannel = channel < RX_MAPPABLE_CHANNEL_COUNT ? rxConfig()->rcmap[channel] : channel;
+        frame[rawChannel] = scenario.channels[channel];
+    }
+
+    rxMspFrameReceive(frame, SCENARIO_CHANNEL_COUNT);
+}
+
+static void recordSample(const servo_packet *pwm, const fdm_packet *state)
+{
+    if (scenario.sampleCount == scenario.sampleCapacity) {
+        scenario.sampleCapacity = scenario.sampleCapacity ? 2 * scenario.sampleCapacity : 65536;
+        scenario.samples = realloc(scenario.samples, scenario.sampleCapacity * sizeof(scenarioSample_t));
+        if (!scenario.samples) {
+            fprintf(stderr, "%s: out of memory for the trace\n", scenario.filename);
+            exit(1);
+        }
+    }
+
+    scenarioSample_t *sample = &scenario.samples[scenario.sampleCount++];
+    sample->time = state->timestamp;
+    sample->armed = ARMING_FLAG(ARMED);
+    sample->altitude = -state->position_xyz[2];
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        sample->setpoint[axis] = getSetpointRate(axis);
+        sample->gyro[axis] = gyro.gyroADCf[axis];
+    }
+    for (int i = 0; i < 4; i++) {
+        // the packet holds the outputs in the order the Gazebo plugin expects, see pwmCompleteMotorUpdate()
+        sample->motor[i] = pwm->motor_speed[(i + 3) % 4];
+    }
+}
+
+// Called for every step of the model, false once the flight has ended
+bool scenarioStep(const servo_packet *pwm, const fdm_packet *state)
+{
+    const double now = state->timestamp;
+
+    if (now >= scenario.endTime) {
+        return false;
+    }
+
+    if (now >= scenario.scoreTime && !scenario.scoreSample) {
+        scenario.scoreSample = scenario.sampleCount;
+    }
+
+    for (; scenario.nextEvent < scenario.eventCount && scenario.events[scenario.nextEvent].time <= now; scenario.nextEvent++) {
+        const scenarioEvent_t *event = &scenario.events[scenario.nextEvent];
+        if (event->channel <= YAW && event->value != scenario.channels[event->channel] && now >= scenario.scoreTime) {
+            scenarioStepResponse_t *response = &scenario.responses[scenario.responseCount++];
+            response->axis = event->channel;
+            response->startSample = scenario.sampleCount;
+        }
+        scenario.channels[event->channel] = event->value;
+        scenario.nextRcTime = now;
+    }
+
+    if (now >= scenario.nextRcTime) {
+        sendRcFrame();
+        scenario.nextRcTime = now + SCENARIO_RC_INTERVAL_S;
+    }
+
+    recordSample(pwm, state);
+
+    return true;
+}
+
+typedef struct scenarioAxisScore_s {
+    float trackingRms;
+    float overshootPercent;             // worst of the step responses
+    float settlingMs;                   // worst of the step responses
+} scenarioAxisScore_t;
+
+static float responseOvershoot(const scenarioStepResponse_t *response, float *settlingMs, float *step)
+{
+    const scenarioSample_t *samples = scenario.samples;
+    const unsigned axis = response->axis;
+    const float target = samples[response->endSample - 1].setpoint[axis];
+    *step = target - samples[response->startSample].setpoint[axis];
+
+    const float band = MAX(fabsf(*step) * SCENARIO_SETTLING_BAND, SCENARIO_MIN_SETTLING_BAND_DPS);
+    float overshoot = 0;
+    unsigned settledSample = response->startSample;
+    for (unsigned i = response->startSample; i < response->endSample; i++) {
+        const float error = samples[i].gyro[axis] - target;
+        overshoot = MAX(overshoot, *step > 0 ? error : -error);
+        if (fabsf(error) > band) {
+            settledSample = i + 1;
+        }
+    }
+
+    *settlingMs = (samples[MIN(settledSample, response->endSample - 1)].time - samples[response->startSample].time) * 1000;
+    return 100 * overshoot / fabsf(*step);
+}
+
+static void writeTrace(void)
+{
+    FILE *file = fopen(scenario.traceFilename, "w");
+    if (!file) {
+        fprintf(stderr, "Cannot write trace '%s'\n", scenario.traceFilename);
+        return;
+    }
+
+    fprintf(file, "time,armed,altitude,setpoint[0],setpoint[1],setpoint[2],gyroADCf[0],gyroADCf[1],gyroADCf[2],motor[0],motor[1],motor[2],motor[3]\n");
+    for (unsigned i = 0; i < scenario.sampleCount; i++) {
+        const scenarioSample_t *sample = &scenario.samples[i];
+        fprintf(file, "%.6f,%d,%.3f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.4f,%.4f,%.4f,%.4f\n",
+            sample->time, sample->armed, (double)sample->altitude,
+            (double)sample->setpoint[0], (double)sample->setpoint[1], (double)sample->setpoint[2],
+            (double)sample->gyro[0], (double)sample->gyro[1], (double)sample->gyro[2],
+            (double)sample->motor[0], (double)sample->motor[1], (double)sample->motor[2], (double)sample->motor[3]);
+    }
+    fclose(file);
+}
+
+static double secondsSince(const struct timespec *start, clockid_t clock)
+{
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+// The scheduler's execution times are on the simulated clock in lockstep, so the load is from the host CPU time
+static void writeTasks(FILE *file, double hostCpuSeconds)
+{
+    bool first = true;
+
+    fprintf(file, "  \"tasks\": [");
+    for (taskId_e taskId = 0; taskId < TASK_COUNT; taskId++) {
+        taskInfo_t taskInfo;
+        getTaskInfo(taskId, &taskInfo);
+        if (!taskInfo.isEnabled) {
+            continue;
+        }
+        const float rateHz = taskInfo.averageDeltaTime10thUs ? 1e7f / taskInfo.averageDeltaTime10thUs : 0;
+        const double cpuMs = taskInfo.hostCpuTimeNs * 1e-6;
+        fprintf(file, "%s\n    { \"id\": %d, \"name\": \"%s\", \"rate_hz\": %.0f, \"host_cpu_ms\": %.1f, \"host_cpu_pct\": %.2f }",
+            first ? "" : ",", taskId, taskInfo.taskName, (double)rateHz, cpuMs, hostCpuSeconds > 0 ? cpuMs / (10 * hostCpuSeconds) : 0.0);
+        first = false;
+    }
+    fprintf(file, "\n  ],\n");
+}
+
+// Scores the flight, writes the trace and the scorecard and returns the exit status of the run
+int scenarioFinish(void)
+{
+    const double hostSeconds = secondsSince(&scenario.hostStart, CLOCK_MONOTONIC);
+    const double hostCpuSeconds = secondsSince(&scenario.hostCpuStart, CLOCK_THREAD_CPUTIME_ID);
+
+    if (scenario.traceFilename) {
+        writeTrace();
+    }
+
+    if (!scenario.sampleCount) {
+        fprintf(stderr, "%s: nothing was recorded\n", scenario.filename);
+        return 1;
+    }
+
+    FILE *file = scenario.scorecardFilename ? fopen(scenario.scorecardFilename, "w") : stdout;
+    if (!file) {
+        fprintf(stderr, "Cannot write scorecard '%s'\n", scenario.scorecardFilename);
+        return 1;
+    }
+
+    const scenarioSample_t *samples = scenario.samples;
+    const unsigned first = scenario.scoreSample;
+    const unsigned count = scenario.sampleCount - first;
+    const double flightTime = samples[scenario.sampleCount - 1].time - scenario.scoreTime;
+
+    // tracking error, and the time disarmed or on the ground, over the scored part of the flight
+    scenarioAxisScore_t axisScores[XYZ_AXIS_COUNT] = { 0 };
+    double squaredError[XYZ_AXIS_COUNT] = { 0 };
+    unsigned disarmedCount = 0;
+    unsigned groundCount = 0;
+    for (unsigned i = first; i < scenario.sampleCount; i++) {
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            const float error = samples[i].setpoint[axis] - samples[i].gyro[axis];
+            squaredError[axis] += (double)(error * error);
+        }
+        disarmedCount += !samples[i].armed;
+        groundCount += samples[i].altitude <= 0;
+    }
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        axisScores[axis].trackingRms = count ? sqrt(squaredError[axis] / count) : 0;
+    }
+    const double disarmedSeconds = flightTime * disarmedCount / MAX(count, 1u);
+    const double groundSeconds = flightTime * groundCount / MAX(count, 1u);
+
+    fprintf(file, "{\n  \"scenario\": \"%s\",\n", scenario.filename);
+    fprintf(file, "  \"flight_s\": %.3f,\n  \"host_s\": %.3f,\n  \"host_cpu_s\": %.3f,\n", flightTime, hostSeconds, hostCpuSeconds);
+    fprintf(file, "  \"disarmed_s\": %.3f,\n  \"ground_s\": %.3f,\n", disarmedSeconds, groundSeconds);
+
+    fprintf(file, "  \"steps\": [");
+    bool firstResponse = true;
+    for (unsigned i = 0; i < scenario.responseCount; i++) {
+        scenarioStepResponse_t *response = &scenario.responses[i];
+        response->endSample = scenario.sampleCount;
+        for (unsigned j = i + 1; j < scenario.responseCount; j++) {
+            if (scenario.responses[j].axis == response->axis) {
+                response->endSample = scenario.responses[j].startSample;
+                break;
+            }
+        }
+        if (response->endSample <= response->startSample) {
+            // replaced by another change at the same time
+            continue;
+        }
+
+        float settlingMs;
+        float step;
+        const float overshoot = responseOvershoot(response, &settlingMs, &step);
+        const bool scored = fabsf(step) >= SCENARIO_MIN_STEP_DPS;
+        if (scored) {
+            scenarioAxisScore_t *axisScore = &axisScores[response->axis];
+            axisScore->overshootPercent = MAX(axisScore->overshootPercent, overshoot);
+            axisScore->settlingMs = MAX(axisScore->settlingMs, settlingMs);
+        }
+        fprintf(file, "%s\n    { \"axis\": \"%s\", \"time_s\": %.3f, \"step_dps\": %.1f, \"overshoot_pct\": %.1f, \"settling_ms\": %.1f, \"scored\": %s }",
+            firstResponse ? "" : ",", axisNames[response->axis], samples[response->startSample].time, (double)step,
+            scored ? (double)overshoot : 0.0, (double)settlingMs, scored ? "true" : "false");
+        firstResponse = false;
+    }
+    fprintf(file, "\n  ],\n");
+
+    fprintf(file, "  \"axes\": {");
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        fprintf(file, "%s\n    \"%s\": { \"tracking_rms\": %.2f, \"overshoot_pct\": %.1f, \"settling_ms\": %.1f }",
+            axis ? "," : "", axisNames[axis], (double)axisScores[axis].trackingRms,
+            (double)axisScores[axis].overshootPercent, (double)axisScores[axis].settlingMs);
+    }
+    fprintf(file, "\n  },\n");
+
+    // motor noise, the RMS of the output above SCENARIO_MOTOR_NOISE_HZ
+    float motorNoise[4];
+    float motorNoiseMax = 0;
+    const float dt = count > 1 ? (samples[scenario.sampleCount - 1].time - samples[first].time) / (count - 1) : 1;
+    for (int i = 0; i < 4; i++) {
+        pt1Filter_t lowpass;
+        pt1FilterInit(&lowpass, pt1FilterGain(SCENARIO_MOTOR_NOISE_HZ, dt));
+        lowpass.state = count ? samples[first].motor[i] : 0;
+        double sum = 0;
+        for (unsigned j = first; j < scenario.sampleCount; j++) {
+            const float noise = samples[j].motor[i] - pt1FilterApply(&lowpass, samples[j].motor[i]);
+            sum += (double)(noise * noise);
+        }
+        motorNoise[i] = count ? 100 * sqrt(sum / count) : 0;
+        motorNoiseMax = MAX(motorNoiseMax, motorNoise[i]);
+    }
+    fprintf(file, "  \"motor_noise_pct\": [ %.3f, %.3f, %.3f, %.3f ],\n",
+        (double)motorNoise[0], (double)motorNoise[1], (double)motorNoise[2], (double)motorNoise[3]);
+
+    writeTasks(file, hostCpuSeconds);
+
+    // limits on the overall metrics, by the names they have in the scorecard
+    struct {
+        char name[32];
+        double value;
+    } metrics[3 * XYZ_AXIS_COUNT + 3];
+    unsigned metricCount = 0;
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        snprintf(metrics[metricCount].name, sizeof(metrics[0].name), "%s.tracking_rms", axisNames[axis]);
+        metrics[metricCount++].value = axisScores[axis].trackingRms;
+        snprintf(metrics[metricCount].name, sizeof(metrics[0].name), "%s.overshoot_pct", axisNames[axis]);
+        metrics[metricCount++].value = axisScores[axis].overshootPercent;
+        snprintf(metrics[metricCount].name, sizeof(metrics[0].name), "%s.settling_ms", axisNames[axis]);
+        metrics[metricCount++].value = axisScores[axis].settlingMs;
+    }
+    strcpy(metrics[metricCount].name, "motor_noise_pct");
+    metrics[metricCount++].value = motorNoiseMax;
+    strcpy(metrics[metricCount].name, "disarmed_s");
+    metrics[metricCount++].value = disarmedSeconds;
+    strcpy(metrics[metricCount].name, "ground_s");
+    metrics[metricCount++].value = groundSeconds;
+
+    bool pass = true;
+    fprintf(file, "  \"limits\": [");
+    for (unsigned i = 0; i < scenario.limitCount; i++) {
+        const scenarioLimit_t *limit = &scenario.limits[i];
+        unsigned metric = 0;
+        while (metric < metricCount && strcmp(limit->metric, metrics[metric].name) != 0) {
+            metric++;
+        }
+
+        fprintf(file, "%s\n    { \"metric\": \"%s\", \"max\": %g, ", i ? "," : "", limit->metric, limit->max);
+        if (metric < metricCount) {
+            const bool limitPass = metrics[metric].value <= limit->max;
+            pass = pass && limitPass;
+            fprintf(file, "\"value\": %.3f, \"pass\": %s }", metrics[metric].value, limitPass ? "true" : "false");
+        } else {
+            // an unknown metric fails, so that a typo does not silently pass
+            pass = false;
+            fprintf(file, "\"value\": null, \"pass\": false }");
+        }
+    }
+    fprintf(file, "\n  ],\n");
+    fprintf(file, "  \"pass\": %s\n}\n", pass ? "true" : "false");
+
+    if (file != stdout) {
+        fclose(file);
+    }
+
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,31 @@
+/*
+ * This file is part of Cleanflight and Betaflight.
+ *
+ * Cleanflight and Betaflight are free software. You can redistribute
+ * this software and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Cleanflight and Betaflight are distributed in the hope that they
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+// Scripted flight with the built-in quad model: configures the firmware, plays RC inputs at
+// simulated times, records gyro, setpoint and motor traces and scores the response at the end.
+
+bool scenarioLoad(const char *filename, const char *scorecardFilename, const char *traceFilename);
+void scenarioConfigure(void);
+bool scenarioStep(const servo_packet *pwm, const fdm_packet *state);
+int scenarioFinish(void);
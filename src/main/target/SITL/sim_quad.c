@@ -0,0 +1,270 @@
+/*
+ * This file is part of Cleanflight and Betaflight.
+ *
+ * Cleanflight and Betaflight are free software. You can redistribute
+ * this software and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Cleanflight and Betaflight are distributed in the hope that they
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "platform.h"
+
+#include "common/utils.h"
+
+#include "target/SITL/sim_quad.h"
+
+// The state is kept in the frames the Gazebo plugin uses for the state packet: body forward-right-down,
+// earth north-east-down. Motors are in Betaflight quad X order and spin in the default direction.
+
+#define GRAVITY 9.80665
+#define MOTOR_COUNT 4
+#define DEG2RAD (M_PI / 180.0)
+
+static simQuadParameters_t params = {
+    .mass = 0.6,
+    .armLength = 0.11,
+    .inertia = { 1.5e-3, 1.5e-3, 2.5e-3 },
+    .thrustMax = 12.0,
+    .torqueCoefficient = 0.015,
+    .motorTimeConstant = 0.02,
+    .motorMaxRpm = 30000,
+    .rotorInertia = 2e-6,
+    .drag = 0.05,
+    .rotationalDrag = 1e-3,
+    .gyroNoise = 0,
+    .accNoise = 0,
+    .vibration = 0,
+    .stepUs = 125,
+    .seed = 1,
+};
+
+static const struct {
+    const char *name;
+    double *value;
+} parameterTable[] = {
+    { "mass", &params.mass },
+    { "arm", &params.armLength },
+    { "inertia_x", &params.inertia[0] },
+    { "inertia_y", &params.inertia[1] },
+    { "inertia_z", &params.inertia[2] },
+    { "thrust_max", &params.thrustMax },
+    { "torque_coef", &params.torqueCoefficient },
+    { "motor_tau", &params.motorTimeConstant },
+    { "motor_rpm", &params.motorMaxRpm },
+    { "rotor_inertia", &params.rotorInertia },
+    { "drag", &params.drag },
+    { "rot_drag", &params.rotationalDrag },
+    { "gyro_noise", &params.gyroNoise },
+    { "acc_noise", &params.accNoise },
+    { "vibration", &params.vibration },
+    { "step_us", &params.stepUs },
+    { "seed", &params.seed },
+};
+
+typedef struct motorGeometry_s {
+    double x, y;            // position as a fraction of the arm length
+    double spin;            // sign of the yaw reaction torque
+    double vibrationAxis[3];
+} motorGeometry_t;
+
+static const motorGeometry_t motorGeometry[MOTOR_COUNT] = {
+    { -M_SQRT1_2,  M_SQRT1_2, -1, { 0.7, 1.0, 0.3 } },     // REAR_R, CW
+    {  M_SQRT1_2,  M_SQRT1_2,  1, { 0.8, 0.9, 0.4 } },     // FRONT_R, CCW
+    { -M_SQRT1_2, -M_SQRT1_2,  1, { 1.0, 0.7, 0.3 } },     // REAR_L, CCW
+    {  M_SQRT1_2, -M_SQRT1_2, -1, { 0.9, 0.8, 0.4 } },     // FRONT_L, CW
+};
+
+static struct {
+    double time;                        // s
+    double position[3];                 // m, earth
+    double velocity[3];                 // m/s, earth
+    double attitude[4];                 // w, x, y, z, body to earth
+    double rate[3];                     // rad/s, body
+    double motorSpeed[MOTOR_COUNT];     // fraction of full speed
+    double motorPhase[MOTOR_COUNT];     // rad, for the vibration
+    uint32_t noiseState;
+} quad;
+
+bool simQuadSetParameter(const char *name, const char *value)
+{
+    for (unsigned i = 0; i < ARRAYLEN(parameterTable); i++) {
+        if (strcmp(name, parameterTable[i].name) == 0) {
+            char *end;
+            const double parsed = strtod(value, &end);
+            if (end == value || *end != '\0') {
+                return false;
+            }
+            *parameterTable[i].value = parsed;
+            return true;
+        }
+    }
+    return false;
+}
+
+void simQuadPrintParameters(void)
+{
+    for (unsigned i = 0; i < ARRAYLEN(parameterTable); i++) {
+        printf("  --%s=%g\n", parameterTable[i].name, *parameterTable[i].value);
+    }
+}
+
+void simQuadInit(void)
+{
+    memset(&quad, 0, sizeof(quad));
+    quad.attitude[0] = 1;
+    quad.noiseState = (uint32_t)params.seed ? (uint32_t)params.seed : 1;
+}
+
+// xorshift32, the same sequence on every run for the same seed
+static double noiseUniform(void)
+{
+    quad.noiseState ^= quad.noiseState << 13;
+    quad.noiseState ^= quad.noiseState >> 17;
+    quad.noiseState ^= quad.noiseState << 5;
+    return (quad.noiseState + 1.0) / 4294967297.0;
+}
+
+static double noiseGaussian(double rms)
+{
+    if (rms <= 0) {
+        return 0;
+    }
+    return rms * sqrt(-2 * log(noiseUniform())) * cos(2 * M_PI * noiseUniform());
+}
+
+// v_earth = q v_body q*
+static void rotateBodyToEarth(const double q[4], const double v[3], double out[3])
+{
+    const double w = q[0], x = q[1], y = q[2], z = q[3];
+
+    out[0] = (1 - 2 * (y * y + z * z)) * v[0] + 2 * (x * y - w * z) * v[1] + 2 * (x * z + w * y) * v[2];
+    out[1] = 2 * (x * y + w * z) * v[0] + (1 - 2 * (x * x + z * z)) * v[1] + 2 * (y * z - w * x) * v[2];
+    out[2] = 2 * (x * z - w * y) * v[0] + 2 * (y * z + w * x) * v[1] + (1 - 2 * (x * x + y * y)) * v[2];
+}
+
+static void rotateEarthToBody(const double q[4], const double v[3], double out[3])
+{
+    const double conjugate[4] = { q[0], -q[1], -q[2], -q[3] };
+    rotateBodyToEarth(conjugate, v, out);
+}
+
+void simQuadStep(const servo_packet *pwm, fdm_packet *state)
+{
+    const double dt = params.stepUs * 1e-6;
+    double thrust = 0;
+    double torque[3] = { 0, 0, 0 };
+    double vibration[3] = { 0, 0, 0 };
+
+    for (int i = 0; i < MOTOR_COUNT; i++) {
+        // the packet holds the outputs in the order the Gazebo plugin expects, see pwmCompleteMotorUpdate()
+        const double command = fmax(0, fmin(1, pwm->motor_speed[(i + 3) % MOTOR_COUNT]));
+        const double speedChange = (command - quad.motorSpeed[i]) * dt / (params.motorTimeConstant + dt);
+        quad.motorSpeed[i] += speedChange;
+
+        const double motorThrust = params.thrustMax * quad.motorSpeed[i] * quad.motorSpeed[i];
+        thrust += motorThrust;
+        torque[0] -= motorGeometry[i].y * params.armLength * motorThrust;
+        torque[1] += motorGeometry[i].x * params.armLength * motorThrust;
+        // yaw from the drag of the propeller and the reaction to its acceleration
+        const double rotorAcceleration = speedChange * params.motorMaxRpm * (2 * M_PI / 60) / dt;
+        torque[2] += motorGeometry[i].spin * (params.torqueCoefficient * motorThrust + params.rotorInertia * rotorAcceleration);
+
+        quad.motorPhase[i] = fmod(quad.motorPhase[i] + 2 * M_PI * quad.motorSpeed[i] * params.motorMaxRpm / 60 * dt, 2 * M_PI);
+        const double amplitude = params.vibration * DEG2RAD * quad.motorSpeed[i] * quad.motorSpeed[i] * sin(quad.motorPhase[i]);
+        for (int axis = 0; axis < 3; axis++) {
+            vibration[axis] += amplitude * motorGeometry[i].vibrationAxis[axis];
+        }
+    }
+
+    // rotation, Euler's equations with aerodynamic damping
+    const double *inertia = params.inertia;
+    double *rate = quad.rate;
+    const double angularAcceleration[3] = {
+        (torque[0] - params.rotationalDrag * rate[0] - (inertia[2] - inertia[1]) * rate[1] * rate[2]) / inertia[0],
+        (torque[1] - params.rotationalDrag * rate[1] - (inertia[0] - inertia[2]) * rate[2] * rate[0]) / inertia[1],
+        (torque[2] - params.rotationalDrag * rate[2] - (inertia[1] - inertia[0]) * rate[0] * rate[1]) / inertia[2],
+    };
+
+    // translation, thrust along body up plus quadratic drag
+    const double thrustBody[3] = { 0, 0, -thrust };
+    double force[3];
+    rotateBodyToEarth(quad.attitude, thrustBody, force);
+    const double speed = sqrt(quad.velocity[0] * quad.velocity[0] + quad.velocity[1] * quad.velocity[1] + quad.velocity[2] * quad.velocity[2]);
+    double acceleration[3];
+    for (int axis = 0; axis < 3; axis++) {
+        acceleration[axis] = (force[axis] - params.drag * speed * quad.velocity[axis]) / params.mass;
+    }
+    acceleration[2] += GRAVITY;
+
+    const bool onGround = quad.position[2] >= 0 && acceleration[2] >= 0;
+    if (onGround) {
+        // resting on the ground, which holds the attitude and takes the load
+        memset(quad.velocity, 0, sizeof(quad.velocity));
+        memset(acceleration, 0, sizeof(acceleration));
+        memset(quad.rate, 0, sizeof(quad.rate));
+        quad.position[2] = 0;
+    } else {
+        for (int axis = 0; axis < 3; axis++) {
+            quad.velocity[axis] += acceleration[axis] * dt;
+            quad.position[axis] += quad.velocity[axis] * dt;
+            rate[axis] += angularAcceleration[axis] * dt;
+        }
+        if (quad.position[2] > 0) {
+            // touched down while still pushing up, the ground stops the fall
+            quad.position[2] = 0;
+            quad.velocity[2] = 0;
+        }
+
+        // q += q (0, rate) dt / 2
+        double *q = quad.attitude;
+        const double dq[4] = {
+            0.5 * (-q[1] * rate[0] - q[2] * rate[1] - q[3] * rate[2]),
+            0.5 * ( q[0] * rate[0] + q[2] * rate[2] - q[3] * rate[1]),
+            0.5 * ( q[0] * rate[1] - q[1] * rate[2] + q[3] * rate[0]),
+            0.5 * ( q[0] * rate[2] + q[1] * rate[1] - q[2] * rate[0]),
+        };
+        double norm = 0;
+        for (int i = 0; i < 4; i++) {
+            q[i] += dq[i] * dt;
+            norm += q[i] * q[i];
+        }
+        norm = sqrt(norm);
+        for (int i = 0; i < 4; i++) {
+            q[i] /= norm;
+        }
+    }
+
+    quad.time += dt;
+
+    // the accelerometer measures everything but gravity
+    const double specificForceEarth[3] = { acceleration[0], acceleration[1], acceleration[2] - GRAVITY };
+    double specificForce[3];
+    rotateEarthToBody(quad.attitude, specificForceEarth, specificForce);
+
+    state->timestamp = quad.time;
+    for (int axis = 0; axis < 3; axis++) {
+        state->imu_angular_velocity_rpy[axis] = quad.rate[axis] + vibration[axis] + noiseGaussian(params.gyroNoise * DEG2RAD);
+        state->imu_linear_acceleration_xyz[axis] = specificForce[axis] + noiseGaussian(params.accNoise);
+        state->velocity_xyz[axis] = quad.velocity[axis];
+        state->position_xyz[axis] = quad.position[axis];
+    }
+    for (int i = 0; i < 4; i++) {
+        state->imu_orientation_quat[i] = quad.attitude[i];
+    }
+}
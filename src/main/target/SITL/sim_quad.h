@@ -0,0 +1,50 @@
+/*
+ * This file is part of Cleanflight and Betaflight.
+ *
+ * Cleanflight and Betaflight are free software. You can redistribute
+ * this software and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Cleanflight and Betaflight are distributed in the hope that they
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Built-in rigid body model of a quad X, used instead of an external simulator.
+// It consumes the motor outputs and produces the state packet the simulator would send.
+
+typedef struct simQuadParameters_s {
+    double mass;                    // kg
+    double armLength;               // m, from the centre to each motor
+    double inertia[3];              // kg m^2, about the forward, right and down axes
+    double thrustMax;               // N, per motor at full speed
+    double torqueCoefficient;       // m, yaw reaction torque per N of thrust
+    double motorTimeConstant;       // s, first order lag of the motor speed
+    double motorMaxRpm;             // rpm at full speed
+    double rotorInertia;            // kg m^2, of each propeller and motor bell
+    double drag;                    // N per (m/s)^2
+    double rotationalDrag;          // N m per rad/s
+    double gyroNoise;               // deg/s RMS
+    double accNoise;                // m/s^2 RMS
+    double vibration;               // deg/s amplitude on the gyro per motor at full speed
+    double stepUs;                  // simulation step, and interval of the state packets
+    double seed;                    // of the noise generator
+} simQuadParameters_t;
+
+bool simQuadSetParameter(const char *name, const char *value);
+void simQuadPrintParameters(void);
+void simQuadInit(void);
+void simQuadStep(const servo_packet *pwm, fdm_packet *state);
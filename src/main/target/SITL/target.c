@@ -27,6 +27,8 @@
 #include <errno.h>
 #include <time.h>
 
+#include "build/benchmark.h"
+
 #include "common/maths.h"
 
 #include "drivers/io.h"
@@ -56,6 +58,8 @@ const timerHardware_t timerHardware[1]; // unused
 
 #include "dyad.h"
 #include "target/SITL/udplink.h"
+#include "target/SITL/sim_quad.h"
+#include "target/SITL/scenario.h"
 
 uint32_t SystemCoreClock;
 
@@ -70,6 +74,21 @@ static udpLink_t stateLink, pwmLink;
 static pthread_mutex_t updateLock;
 static pthread_mutex_t mainLoopLock;
 
+// Lockstep mode: simulated time only advances while the main loop runs, up to the timestamp of the
+// last state packet. Sensors are updated and motor outputs sent only at those step boundaries, so
+// the firmware sees the same sequence of time and sensor values however fast the host is.
+#define LOCKSTEP_CLOCK_READ_NS 100 // simulated cost of each clock read, lets polling loops make progress
+
+static bool lockstep = false;
+static bool physics = false;    // built-in quad model instead of an external simulator, always in lockstep
+static bool scenarioRun = false;    // scripted flight with the built-in model, the EEPROM only lives in memory
+static const char *benchmarkFilename = NULL;    // time the hot path kernels once initialised and exit, the EEPROM only lives in memory
+static pthread_t mainThread;
+static volatile uint64_t lockstepNowNs;
+static uint64_t lockstepEndNs;
+static bool lockstepWaiting;
+static bool lockstepReplyPending;
+
 int timeval_sub(struct timespec *result, struct timespec *x, struct timespec *y);
 
 int lockMainPID(void)
@@ -93,16 +112,34 @@ void updateState(const fdm_packet* pkt)
     struct timespec now_ts;
     clock_gettime(CLOCK_MONOTONIC, &now_ts);
 
-    const uint64_t realtime_now = micros64_real();
-    if (realtime_now > last_realtime + 500*1e3) { // 500ms timeout
-        last_timestamp = pkt->timestamp;
-        last_realtime = realtime_now;
-        sendMotorUpdate();
-        return;
+    double deltaSim = pkt->timestamp - last_timestamp;  // in seconds
+
+    if (lockstep) {
+        static bool started = false;
+        if (!started || deltaSim < 0) { // first packet or simulator restarted, only sets the time reference
+            started = true;
+            deltaSim = 0;
+        }
+    } else {
+        const uint64_t realtime_now = micros64_real();
+        if (realtime_now > last_realtime + 500*1e3) { // 500ms timeout
+            last_timestamp = pkt->timestamp;
+            last_realtime = realtime_now;
+            sendMotorUpdate();
+            return;
+        }
+
+        if (deltaSim < 0) { // don't use old packet
+            return;
+        }
     }
 
-    const double deltaSim = pkt->timestamp - last_timestamp;  // in seconds
-    if (deltaSim < 0) { // don't use old packet
+    // in lockstep the first packets arrive while the firmware is still initialising
+    if (!fakeAccDev || !fakeGyroDev) {
+        last_timestamp = pkt->timestamp;
+        if (lockstep) {
+            lockstepEndNs += llround(deltaSim * 1e9);
+        }
         return;
     }
 
@@ -156,7 +193,9 @@ void updateState(const fdm_packet* pkt)
 #endif
 
 
-    if (deltaSim < 0.02 && deltaSim > 0) { // simulator should run faster than 50Hz
+    if (lockstep) {
+        lockstepEndNs += llround(deltaSim * 1e9);
+    } else if (deltaSim < 0.02 && deltaSim > 0) { // simulator should run faster than 50Hz
 //        simRate = simRate * 0.5 + (1e6 * deltaSim / (realtime_now - last_realtime)) * 0.5;
         struct timespec out_ts;
         timeval_sub(&out_ts, &now_ts, &last_ts);
@@ -194,6 +233,133 @@ static void* udpThread(void* data)
     return NULL;
 }
 
+// Called by the main loop once it has run up to the end of the step, reports the motor outputs for
+// the last state packet and blocks until a packet grants more time
+static void lockstepWaitForState(void)
+{
+    lockstepWaiting = true;
+
+    while (lockstepNowNs >= lockstepEndNs) {
+        if (physics) {
+            simQuadStep(&pwmPkt, &fdmPkt);
+            if (scenarioRun && !scenarioStep(&pwmPkt, &fdmPkt)) {
+                exit(scenarioFinish());
+            }
+            updateState(&fdmPkt);
+            continue;
+        }
+        if (lockstepReplyPending) {
+            sendMotorUpdate();
+            lockstepReplyPending = false;
+        }
+        if (udpRecv(&stateLink, &fdmPkt, sizeof(fdm_packet), 100) == sizeof(fdm_packet)) {
+            updateState(&fdmPkt);
+            lockstepReplyPending = true;
+        }
+    }
+
+    lockstepWaiting = false;
+}
+
+// Only the main thread moves the simulated clock, other threads just read it
+static uint64_t lockstepAdvance(uint64_t ns)
+{
+    if (pthread_equal(pthread_self(), mainThread) && !lockstepWaiting) {
+        while (lockstepNowNs + ns > lockstepEndNs) {
+            ns -= lockstepEndNs - lockstepNowNs;
+            lockstepNowNs = lockstepEndNs;
+            lockstepWaitForState();
+        }
+        lockstepNowNs += ns;
+    }
+
+    return lockstepNowNs;
+}
+
+void targetParseArgs(int argc, char *argv[])
+{
+    const char *scenarioFilename = NULL;
+    const char *scorecardFilename = NULL;
+    const char *traceFilename = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        char *value = strchr(argv[i], '=');
+        if (strcmp(argv[i], "--lockstep") == 0) {
+            lockstep = true;
+        } else if (strcmp(argv[i], "--physics") == 0) {
+            physics = true;
+            lockstep = true;
+        } else if (strncmp(argv[i], "--scenario=", 11) == 0) {
+            scenarioFilename = value + 1;
+        } else if (strncmp(argv[i], "--scorecard=", 12) == 0) {
+            scorecardFilename = value + 1;
+        } else if (strncmp(argv[i], "--trace=", 8) == 0) {
+            traceFilename = value + 1;
+        } else if (strncmp(argv[i], "--bench=", 8) == 0) {
+            benchmarkFilename = value + 1;
+        } else if (strncmp(argv[i], "--", 2) == 0 && value) {
+            // parameters of the built-in model
+            *value = '\0';
+            if (!simQuadSetParameter(argv[i] + 2, value + 1)) {
+                printf("Invalid model parameter %s=%s\n", argv[i], value + 1);
+                exit(1);
+            }
+        } else {
+            printf("Usage: %s [--lockstep] [--physics [--<parameter>=<value>...]]\n", argv[0]);
+            printf("       %s --scenario=<file> [--scorecard=<file>] [--trace=<file>] [--<parameter>=<value>...]\n", argv[0]);
+            printf("       %s --bench=<file or - for stdout>\n", argv[0]);
+            printf("Built-in model parameters and defaults:\n");
+            simQuadPrintParameters();
+            exit(1);
+        }
+    }
+
+    if (scenarioFilename) {
+        if (!scenarioLoad(scenarioFilename, scorecardFilename, traceFilename)) {
+            exit(1);
+        }
+        scenarioRun = true;
+        physics = true;
+        lockstep = true;
+    }
+}
+
+// Called once the configuration is loaded
+void targetPreInit(void)
+{
+    if (scenarioRun) {
+        scenarioConfigure();
+    }
+}
+
+#ifdef USE_BENCHMARK
+static FILE *benchmarkFile;
+
+static void benchmarkPrintLine(const char *line)
+{
+    fprintf(benchmarkFile, "%s\n", line);
+}
+#endif
+
+// Called once the firmware is initialised
+void targetPostInit(void)
+{
+#ifdef USE_BENCHMARK
+    if (benchmarkFilename) {
+        benchmarkFile = strcmp(benchmarkFilename, "-") == 0 ? stdout : fopen(benchmarkFilename, "w");
+        if (!benchmarkFile) {
+            fprintf(stderr, "[bench]failed to create '%s': %s\n", benchmarkFilename, strerror(errno));
+            exit(1);
+        }
+        benchmarkRun("", benchmarkPrintLine);
+        if (benchmarkFile != stdout) {
+            fclose(benchmarkFile);
+        }
+        exit(0);
+    }
+#endif
+}
+
 static void* tcpThread(void* data)
 {
     UNUSED(data);
@@ -217,6 +383,7 @@ void systemInit(void)
     int ret;
 
     clock_gettime(CLOCK_MONOTONIC, &start_time);
+    mainThread = pthread_self();
     printf("[system]Init...\n");
 
     SystemCoreClock = 500 * 1e6; // fake 500MHz
@@ -237,12 +404,24 @@ void systemInit(void)
         exit(1);
     }
 
+    if (physics) {
+        simQuadInit();
+        printf("[system]Built-in quad model, lockstep clock\n");
+        return;
+    }
+
     ret = udpInit(&pwmLink, "127.0.0.1", 9002, false);
     printf("init PwmOut UDP link...%d\n", ret);
 
     ret = udpInit(&stateLink, NULL, 9003, true);
     printf("start UDP server...%d\n", ret);
 
+    if (lockstep) {
+        // state packets are received by the main loop itself, at the end of each step
+        printf("[system]Lockstep clock, time advances with simulator state packets\n");
+        return;
+    }
+
     ret = pthread_create(&udpWorker, NULL, udpThread, NULL);
     if (ret != 0) {
         printf("Create udpWorker error!\n");
@@ -256,7 +435,9 @@ void systemReset(void)
     printf("[system]Reset!\n");
     workerRunning = false;
     pthread_join(tcpWorker, NULL);
-    pthread_join(udpWorker, NULL);
+    if (!lockstep) {
+        pthread_join(udpWorker, NULL);
+    }
     exit(0);
 }
 void systemResetToBootloader(bootloaderRequestType_e requestType)
@@ -266,7 +447,9 @@ void systemResetToBootloader(bootloaderRequestType_e requestType)
     printf("[system]ResetToBootloader!\n");
     workerRunning = false;
     pthread_join(tcpWorker, NULL);
-    pthread_join(udpWorker, NULL);
+    if (!lockstep) {
+        pthread_join(udpWorker, NULL);
+    }
     exit(0);
 }
 
@@ -314,8 +497,20 @@ uint64_t millis64_real(void)
     return 1.0e3*((ts.tv_sec + (ts.tv_nsec*1.0e-9)) - (start_time.tv_sec + (start_time.tv_nsec*1.0e-9)));
 }
 
+// CPU time used by the calling thread, which the simulated clock doesn't follow in lockstep
+uint64_t nanos64_thread_cpu(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
 uint64_t micros64(void)
 {
+    if (lockstep) {
+        return lockstepAdvance(LOCKSTEP_CLOCK_READ_NS) / 1000;
+    }
+
     static uint64_t last = 0;
     static uint64_t out = 0;
     uint64_t now = nanos64_real();
@@ -329,6 +524,10 @@ uint64_t micros64(void)
 
 uint64_t millis64(void)
 {
+    if (lockstep) {
+        return lockstepAdvance(LOCKSTEP_CLOCK_READ_NS) / 1000000;
+    }
+
     static uint64_t last = 0;
     static uint64_t out = 0;
     uint64_t now = nanos64_real();
@@ -379,16 +578,30 @@ void microsleep(uint32_t usec)
 
 void delayMicroseconds(uint32_t us)
 {
+    if (lockstep) {
+        lockstepAdvance(us * 1000ULL);
+        return;
+    }
     microsleep(us / simRate);
 }
 
 void delayMicroseconds_real(uint32_t us)
 {
+    if (lockstep) {
+        // nothing runs in real time in lockstep, the idle time between scheduler passes is simulated too
+        lockstepAdvance(us * 1000ULL);
+        return;
+    }
     microsleep(us);
 }
 
 void delay(uint32_t ms)
 {
+    if (lockstep) {
+        lockstepAdvance(ms * 1000000ULL);
+        return;
+    }
+
     uint64_t start = millis64();
 
     while ((millis64() - start) < ms) {
@@ -501,6 +714,9 @@ static void pwmCompleteMotorUpdate(void)
     pwmPkt.motor_speed[1] = motorsPwm[2] / outScale;
     pwmPkt.motor_speed[2] = motorsPwm[3] / outScale;
 
+    // in lockstep the outputs are sent when the step completes
+    if (lockstep) return;
+
     // get one "fdm_packet" can only send one "servo_packet"!!
     if (pthread_mutex_trylock(&updateLock) != 0) return;
     udpSend(&pwmLink, &pwmPkt, sizeof(servo_packet));
@@ -565,6 +781,11 @@ static FILE *eepromFd = NULL;
 
 void FLASH_Unlock(void)
 {
+    if (scenarioRun || benchmarkFilename) {
+        // scenarios and benchmarks always start from the defaults
+        return;
+    }
+
     if (eepromFd != NULL) {
         fprintf(stderr, "[FLASH_Unlock] eepromFd != NULL\n");
         return;
@@ -599,6 +820,10 @@ void FLASH_Unlock(void)
 
 void FLASH_Lock(void)
 {
+    if (scenarioRun || benchmarkFilename) {
+        return;
+    }
+
     // flush & close
     if (eepromFd != NULL) {
         fseek(eepromFd, 0, SEEK_SET);
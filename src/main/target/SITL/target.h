@@ -71,6 +71,14 @@
 
 #define USABLE_TIMER_CHANNEL_COUNT 0
 
+// motor outputs go to the simulator, see pwmCompleteMotorUpdate()
+#define USE_PWM_OUTPUT
+
+// scripted flights configure the firmware once the configuration is loaded, see targetPreInit()
+#define TARGET_PREINIT
+// benchmarks run once the firmware is initialised, see targetPostInit()
+#define TARGET_POSTINIT
+
 #define USE_UART1
 #define USE_UART2
 #define USE_UART3
@@ -255,10 +263,12 @@ FLASH_Status FLASH_ProgramWord(uintptr_t addr, uint32_t Data);
 uint64_t nanos64_real(void);
 uint64_t micros64_real(void);
 uint64_t millis64_real(void);
+uint64_t nanos64_thread_cpu(void);
 void delayMicroseconds_real(uint32_t us);
 uint64_t micros64(void);
 uint64_t millis64(void);
 
 int lockMainPID(void);
+void targetParseArgs(int argc, char *argv[]);
 
 
@@ -303,6 +303,11 @@
 #define USE_SPI_GYRO
 #endif
 
+// Gyro ISR filtering runs from the SPI DMA completion callback
+#if !defined(USE_SPI_GYRO)
+#undef USE_GYRO_ISR_FILTERING
+#endif
+
 // CX10 is a special case of SPI RX which requires XN297
 #if defined(USE_RX_CX10)
 #define USE_RX_XN297
@@ -46,6 +46,7 @@
 #define USE_RPM_FILTER
 #define USE_DYN_IDLE
 #define USE_DYN_NOTCH_FILTER
+#define USE_FIXED_POINT_FILTERS
 #define USE_ADC_INTERNAL
 #define USE_USB_CDC_HID
 #define USE_USB_MSC
@@ -69,6 +70,7 @@
 #define USE_RPM_FILTER
 #define USE_DYN_IDLE
 #define USE_DYN_NOTCH_FILTER
+#define USE_GYRO_ISR_FILTERING
 #define USE_OVERCLOCK
 #define USE_ADC_INTERNAL
 #define USE_USB_CDC_HID
@@ -93,6 +95,8 @@
 #define USE_RPM_FILTER
 #define USE_DYN_IDLE
 #define USE_DYN_NOTCH_FILTER
+#define USE_FIXED_POINT_FILTERS
+#define USE_GYRO_ISR_FILTERING
 #define USE_ADC_INTERNAL
 #define USE_USB_CDC_HID
 #define USE_DMA_SPEC
@@ -110,6 +114,7 @@
 #define USE_DYN_IDLE
 #define USE_OVERCLOCK
 #define USE_DYN_NOTCH_FILTER
+#define USE_FIXED_POINT_FILTERS
 #define USE_ADC_INTERNAL
 #define USE_USB_MSC
 #define USE_USB_CDC_HID
@@ -471,6 +476,11 @@ extern uint8_t _dmaram_end__;
 #define USE_EMFAT_AUTORUN
 #define USE_EMFAT_ICON
 #define USE_BATTERY_CONTINUE
+#define USE_LATENCY_STATS       // gyro to motor latency histograms
+#define USE_TASK_TRACE          // per task timing histograms and a trace of recent scheduling decisions
+#define USE_BLACKBOX_COMPRESSION // opt-in log data version 3 with adaptive predictors and Rice coded P-frames
+#define USE_BLACKBOX_DEFERRED   // opt-in queue of main frames logged by TASK_BLACKBOX instead of the PID loop
+#define USE_BENCHMARK           // 'bench' CLI command timing the hot path kernels
 
 #if !defined(CLOUD_BUILD)
 #define USE_GPS_PLUS_CODES
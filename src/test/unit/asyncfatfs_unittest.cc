@@ -0,0 +1,531 @@
+/*
+ * This file is part of Cleanflight and Betaflight.
+ *
+ * Cleanflight and Betaflight are free software. You can redistribute
+ * this software and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Cleanflight and Betaflight are distributed in the hope that they
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <vector>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "common/maths.h"
+    #include "common/utils.h"
+
+    #include "drivers/sdcard.h"
+
+    #include "io/asyncfatfs/asyncfatfs.h"
+    #include "io/asyncfatfs/fat_standard.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+// A 64MB card with one FAT16 partition of 16000 4kB clusters, so a supercluster (one FAT sector of clusters) is 1MB
+#define FAKE_BLOCK_SIZE             512
+#define FAKE_PARTITION_START        64
+#define FAKE_RESERVED_SECTORS       4
+#define FAKE_FAT_SECTORS            64
+#define FAKE_ROOT_ENTRIES           512
+#define FAKE_SECTORS_PER_CLUSTER    8
+#define FAKE_CLUSTERS               16000
+#define FAKE_FAT_START              (FAKE_PARTITION_START + FAKE_RESERVED_SECTORS)
+#define FAKE_ROOT_START             (FAKE_FAT_START + 2 * FAKE_FAT_SECTORS)
+#define FAKE_DATA_START             (FAKE_ROOT_START + FAKE_ROOT_ENTRIES * FAT_DIRECTORY_ENTRY_SIZE / FAKE_BLOCK_SIZE)
+#define FAKE_BLOCKS                 (FAKE_DATA_START + FAKE_CLUSTERS * FAKE_SECTORS_PER_CLUSTER)
+#define FAKE_CLUSTER_SIZE           (FAKE_SECTORS_PER_CLUSTER * FAKE_BLOCK_SIZE)
+#define FAKE_SUPERCLUSTER_SIZE      (FAKE_CLUSTER_SIZE * FAKE_BLOCK_SIZE / 2)
+
+/*
+ * Rough timings of a card on an SPI bus. A block takes FAKE_TRANSFER_US to send, after which the driver calls back.
+ * Blocks that continue a multiple block write into pre-erased space are programmed as they arrive, but a single block
+ * write elsewhere has the card busy for FAKE_SINGLE_PROGRAM_US, and ending a multiple block write for FAKE_STOP_US.
+ */
+#define FAKE_TRANSFER_US            100
+#define FAKE_READ_US                300
+#define FAKE_SINGLE_PROGRAM_US      15000
+#define FAKE_STOP_US                5000
+
+#define LOG_FRAME_SIZE              64
+#define LOG_FRAME_INTERVAL_US       250
+
+static std::vector<uint8_t> fakeCard;
+static uint32_t fakeTimeUs;
+static uint32_t fakeBusyUntilUs;
+
+static sdcard_operationCompleteCallback_c fakeCallback;
+static sdcardBlockOperation_e fakeCallbackOperation;
+static uint32_t fakeCallbackBlock;
+static uint8_t *fakeCallbackBuffer;
+static uint32_t fakeCallbackData;
+static uint32_t fakeCallbackUs;
+
+static bool fakeMultiWrite;
+static uint32_t fakeMultiWriteNextBlock;
+static uint32_t fakeMultiWriteBlocksRemain;
+
+static uint32_t fakeMultiWrites;       // multiple block writes started
+static uint32_t fakeSingleWrites;
+
+static afatfsFilePtr_t testFile;
+
+static uint8_t *fakeBlock(uint32_t block)
+{
+    return &fakeCard[block * FAKE_BLOCK_SIZE];
+}
+
+static void fakeCardFormat(void)
+{
+    fakeCard.assign(FAKE_BLOCKS * FAKE_BLOCK_SIZE, 0);
+
+    mbrPartitionEntry_t *partition = (mbrPartitionEntry_t *)(fakeBlock(0) + 446);
+    partition->type = MBR_PARTITION_TYPE_FAT16;
+    partition->lbaBegin = FAKE_PARTITION_START;
+    partition->numSectors = FAKE_BLOCKS - FAKE_PARTITION_START;
+    fakeBlock(0)[510] = 0x55;
+    fakeBlock(0)[511] = 0xAA;
+
+    fatVolumeID_t *volume = (fatVolumeID_t *)fakeBlock(FAKE_PARTITION_START);
+    volume->bytesPerSector = FAKE_BLOCK_SIZE;
+    volume->sectorsPerCluster = FAKE_SECTORS_PER_CLUSTER;
+    volume->reservedSectorCount = FAKE_RESERVED_SECTORS;
+    volume->numFATs = 2;
+    volume->rootEntryCount = FAKE_ROOT_ENTRIES;
+    volume->totalSectors32 = FAKE_BLOCKS - FAKE_PARTITION_START;
+    volume->media = 0xF8;
+    volume->FATSize16 = FAKE_FAT_SECTORS;
+    fakeBlock(FAKE_PARTITION_START)[510] = FAT_VOLUME_ID_SIGNATURE_1;
+    fakeBlock(FAKE_PARTITION_START)[511] = FAT_VOLUME_ID_SIGNATURE_2;
+
+    for (int fat = 0; fat < 2; fat++) {
+        uint16_t *entries = (uint16_t *)fakeBlock(FAKE_FAT_START + fat * FAKE_FAT_SECTORS);
+        entries[0] = 0xFFF8;
+        entries[1] = 0xFFFF;
+    }
+
+    fakeTimeUs = 0;
+    fakeBusyUntilUs = 0;
+    fakeCallback = NULL;
+    fakeMultiWrite = false;
+    fakeMultiWrites = 0;
+    fakeSingleWrites = 0;
+}
+
+static uint16_t fakeCardFATEntry(uint32_t cluster)
+{
+    return ((uint16_t *)fakeBlock(FAKE_FAT_START))[cluster];
+}
+
+static const fatDirectoryEntry_t *fakeCardFindFile(const char *filename)
+{
+    uint8_t fatFilename[FAT_FILENAME_LENGTH];
+
+    fat_convertFilenameToFATStyle(filename, fatFilename);
+
+    const fatDirectoryEntry_t *entries = (const fatDirectoryEntry_t *)fakeBlock(FAKE_ROOT_START);
+    for (int i = 0; i < FAKE_ROOT_ENTRIES; i++) {
+        if (memcmp(entries[i].filename, fatFilename, FAT_FILENAME_LENGTH) == 0) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+static bool fakeCardBusy(void)
+{
+    return fakeCallback || (int32_t)(fakeTimeUs - fakeBusyUntilUs) < 0;
+}
+
+static void fakeCardEndMultiWrite(void)
+{
+    if (fakeMultiWrite) {
+        fakeMultiWrite = false;
+        fakeBusyUntilUs = fakeTimeUs + FAKE_STOP_US;
+    }
+}
+
+static void fakeCardCallBackAt(sdcard_operationCompleteCallback_c callback, sdcardBlockOperation_e operation,
+    uint32_t blockIndex, uint8_t *buffer, uint32_t callbackData, uint32_t atUs)
+{
+    fakeCallback = callback;
+    fakeCallbackOperation = operation;
+    fakeCallbackBlock = blockIndex;
+    fakeCallbackBuffer = buffer;
+    fakeCallbackData = callbackData;
+    fakeCallbackUs = atUs;
+}
+
+extern "C" {
+    bool sdcard_readBlock(uint32_t blockIndex, uint8_t *buffer, sdcard_operationCompleteCallback_c callback, uint32_t callbackData)
+    {
+        if (fakeCardBusy()) {
+            return false;
+        }
+        fakeCardEndMultiWrite();
+        if (fakeCardBusy()) {
+            return false;
+        }
+
+        memcpy(buffer, fakeBlock(blockIndex), FAKE_BLOCK_SIZE);
+        fakeBusyUntilUs = fakeTimeUs + FAKE_READ_US;
+        fakeCardCallBackAt(callback, SDCARD_BLOCK_OPERATION_READ, blockIndex, buffer, callbackData, fakeBusyUntilUs);
+
+        return true;
+    }
+
+    sdcardOperationStatus_e sdcard_beginWriteBlocks(uint32_t blockIndex, uint32_t blockCount)
+    {
+        if (fakeCardBusy()) {
+            return SDCARD_OPERATION_BUSY;
+        }
+        if (fakeMultiWrite) {
+            if (blockIndex == fakeMultiWriteNextBlock) {
+                return SDCARD_OPERATION_SUCCESS;
+            }
+            fakeCardEndMultiWrite();
+            return SDCARD_OPERATION_BUSY;
+        }
+
+        fakeMultiWrite = true;
+        fakeMultiWriteNextBlock = blockIndex;
+        fakeMultiWriteBlocksRemain = blockCount;
+        fakeMultiWrites++;
+
+        return SDCARD_OPERATION_SUCCESS;
+    }
+
+    sdcardOperationStatus_e sdcard_writeBlock(uint32_t blockIndex, uint8_t *buffer, sdcard_operationCompleteCallback_c callback, uint32_t callbackData)
+    {
+        if (fakeCardBusy()) {
+            return SDCARD_OPERATION_BUSY;
+        }
+        if (fakeMultiWrite && blockIndex != fakeMultiWriteNextBlock) {
+            fakeCardEndMultiWrite();
+            return SDCARD_OPERATION_BUSY;
+        }
+
+        EXPECT_NE(0u, blockIndex);
+        EXPECT_LT(blockIndex, (uint32_t)FAKE_BLOCKS);
+        memcpy(fakeBlock(blockIndex), buffer, FAKE_BLOCK_SIZE);
+
+        if (fakeMultiWrite) {
+            fakeMultiWriteNextBlock++;
+            fakeBusyUntilUs = fakeTimeUs + FAKE_TRANSFER_US;
+            if (--fakeMultiWriteBlocksRemain == 0) {
+                fakeMultiWrite = false;
+                fakeBusyUntilUs += FAKE_STOP_US;
+            }
+        } else {
+            fakeSingleWrites++;
+            fakeBusyUntilUs = fakeTimeUs + FAKE_TRANSFER_US + FAKE_SINGLE_PROGRAM_US;
+        }
+        fakeCardCallBackAt(callback, SDCARD_BLOCK_OPERATION_WRITE, blockIndex, buffer, callbackData, fakeTimeUs + FAKE_TRANSFER_US);
+
+        return SDCARD_OPERATION_IN_PROGRESS;
+    }
+
+    bool sdcard_poll(void)
+    {
+        if (fakeCallback && (int32_t)(fakeTimeUs - fakeCallbackUs) >= 0) {
+            sdcard_operationCompleteCallback_c callback = fakeCallback;
+
+            fakeCallback = NULL;
+            callback(fakeCallbackOperation, fakeCallbackBlock, fakeCallbackBuffer, fakeCallbackData);
+        }
+
+        return !fakeCardBusy();
+    }
+
+    void sdcard_setProfilerCallback(sdcard_profilerCallback_c) {}
+}
+
+static void pollFor(uint32_t us)
+{
+    for (uint32_t end = fakeTimeUs + us; (int32_t)(fakeTimeUs - end) < 0; fakeTimeUs += LOG_FRAME_INTERVAL_US) {
+        afatfs_poll();
+    }
+}
+
+static uint8_t logByte(uint32_t offset)
+{
+    return offset * 7 + (offset >> 9);
+}
+
+static void testFileOpened(afatfsFilePtr_t file)
+{
+    testFile = file;
+}
+
+static void openFile(const char *filename, const char *mode)
+{
+    testFile = NULL;
+    ASSERT_TRUE(afatfs_fopen(filename, mode, testFileOpened));
+    while (!testFile) {
+        pollFor(LOG_FRAME_INTERVAL_US);
+    }
+}
+
+static void mount(void)
+{
+    afatfs_init();
+    while (afatfs_getFilesystemState() == AFATFS_FILESYSTEM_STATE_INITIALIZATION) {
+        pollFor(LOG_FRAME_INTERVAL_US);
+    }
+    ASSERT_EQ(AFATFS_FILESYSTEM_STATE_READY, afatfs_getFilesystemState());
+}
+
+static void mountAndOpenLog(uint32_t preallocate)
+{
+    fakeCardFormat();
+    mount();
+    openFile("LOG00001.BFL", "as");
+    afatfs_fpreallocate(testFile, preallocate);
+}
+
+
+typedef struct logResult_s {
+    uint32_t length;
+    uint32_t worstStallUs;
+} logResult_t;
+
+// Writes frames at a constant rate like the blackbox does, dropping those that the cache has no room for
+static logResult_t writeLog(uint32_t offset, uint32_t length)
+{
+    logResult_t result = { offset, 0 };
+    uint32_t stallStartUs = 0;
+    bool stalled = false;
+
+    while (result.length < offset + length) {
+        uint8_t frame[LOG_FRAME_SIZE];
+        uint32_t written = 0;
+
+        if (afatfs_getFreeBufferSpace() >= LOG_FRAME_SIZE) {
+            for (unsigned i = 0; i < sizeof(frame); i++) {
+                frame[i] = logByte(result.length + i);
+            }
+            written = afatfs_fwrite(testFile, frame, sizeof(frame));
+            result.length += written;
+        }
+
+        if (written < sizeof(frame)) {
+            if (!stalled) {
+                stalled = true;
+                stallStartUs = fakeTimeUs;
+            }
+        } else if (stalled) {
+            stalled = false;
+            result.worstStallUs = MAX(result.worstStallUs, fakeTimeUs - stallStartUs);
+        }
+
+        pollFor(LOG_FRAME_INTERVAL_US);
+    }
+
+    return result;
+}
+
+static void closeLogAndUnmount(void)
+{
+    ASSERT_TRUE(afatfs_fclose(testFile, NULL));
+    while (!afatfs_destroy(false)) {
+        pollFor(LOG_FRAME_INTERVAL_US);
+    }
+}
+
+// Follows the FAT chain of the log on the card, checking its contents, and returns the number of clusters in the chain
+static uint32_t checkLogOnCard(uint32_t length)
+{
+    const fatDirectoryEntry_t *entry = fakeCardFindFile("LOG00001.BFL");
+    EXPECT_TRUE(entry != NULL);
+    if (!entry) {
+        return 0;
+    }
+    EXPECT_EQ(length, entry->fileSize);
+
+    uint32_t clusters = 0;
+    uint32_t offset = 0;
+    for (uint32_t cluster = entry->firstClusterLow; cluster < 0xFFF8; cluster = fakeCardFATEntry(cluster)) {
+        const uint8_t *data = fakeBlock(FAKE_DATA_START + (cluster - FAT_SMALLEST_LEGAL_CLUSTER_NUMBER) * FAKE_SECTORS_PER_CLUSTER);
+
+        for (int i = 0; i < FAKE_CLUSTER_SIZE && offset < length; i++, offset++) {
+            if (data[i] != logByte(offset)) {
+                ADD_FAILURE() << "log differs at offset " << offset;
+                return clusters;
+            }
+        }
+        clusters++;
+        EXPECT_LE(clusters, (uint32_t)FAKE_CLUSTERS);
+        if (clusters > FAKE_CLUSTERS) {
+            break;
+        }
+    }
+    EXPECT_EQ(length, offset);
+
+    return clusters;
+}
+
+TEST(AsyncFatFsTest, TestLogWithoutPreallocation)
+{
+    mountAndOpenLog(0);
+    const uint32_t freeSpace = afatfs_getContiguousFreeSpace();
+
+    logResult_t log = writeLog(0, 2 * FAKE_SUPERCLUSTER_SIZE + 1000);
+    EXPECT_EQ(freeSpace - 3 * FAKE_SUPERCLUSTER_SIZE, afatfs_getContiguousFreeSpace());
+
+    closeLogAndUnmount();
+    EXPECT_EQ(3u * FAKE_SUPERCLUSTER_SIZE / FAKE_CLUSTER_SIZE, checkLogOnCard(log.length));
+}
+
+TEST(AsyncFatFsTest, TestPreallocatedLogReturnsUnusedSpace)
+{
+    mountAndOpenLog(8 * FAKE_SUPERCLUSTER_SIZE);
+    const uint32_t freeSpace = afatfs_getContiguousFreeSpace();
+
+    logResult_t log = writeLog(0, 2 * FAKE_SUPERCLUSTER_SIZE + 1000);
+
+    // The whole extent was taken at once, and the directory claims all of it in case power is lost
+    EXPECT_EQ(freeSpace - 8 * FAKE_SUPERCLUSTER_SIZE, afatfs_getContiguousFreeSpace());
+    const fatDirectoryEntry_t *entry = fakeCardFindFile("LOG00001.BFL");
+    ASSERT_TRUE(entry != NULL);
+    EXPECT_EQ(8u * FAKE_SUPERCLUSTER_SIZE, entry->fileSize);
+    const uint32_t firstCluster = entry->firstClusterLow;
+
+    closeLogAndUnmount();
+
+    // The log keeps 3 superclusters and the other 5 went back to the front of the freefile
+    EXPECT_EQ(3u * FAKE_SUPERCLUSTER_SIZE / FAKE_CLUSTER_SIZE, checkLogOnCard(log.length));
+
+    const uint32_t keepEndCluster = firstCluster + 3 * FAKE_SUPERCLUSTER_SIZE / FAKE_CLUSTER_SIZE;
+    EXPECT_EQ(0xFFFF, fakeCardFATEntry(keepEndCluster - 1));
+    EXPECT_EQ(keepEndCluster + 1, fakeCardFATEntry(keepEndCluster));
+
+    const fatDirectoryEntry_t *freeFile = fakeCardFindFile("FREESPAC.E");
+    ASSERT_TRUE(freeFile != NULL);
+    EXPECT_EQ(keepEndCluster, freeFile->firstClusterLow);
+    EXPECT_EQ(freeSpace - 3 * FAKE_SUPERCLUSTER_SIZE, freeFile->fileSize);
+    EXPECT_EQ(0xFFFF, fakeCardFATEntry(keepEndCluster + freeFile->fileSize / FAKE_CLUSTER_SIZE - 1));
+}
+
+TEST(AsyncFatFsTest, TestPreallocationLimitedByFreeSpace)
+{
+    mountAndOpenLog(UINT32_MAX);
+    const uint32_t freeSpace = afatfs_getContiguousFreeSpace();
+
+    logResult_t log = writeLog(0, 1000);
+    EXPECT_FALSE(afatfs_isFull());
+    EXPECT_GT((uint32_t)FAKE_SUPERCLUSTER_SIZE, afatfs_getContiguousFreeSpace());
+
+    closeLogAndUnmount();
+    EXPECT_EQ((uint32_t)FAKE_SUPERCLUSTER_SIZE / FAKE_CLUSTER_SIZE, checkLogOnCard(log.length));
+
+    const fatDirectoryEntry_t *freeFile = fakeCardFindFile("FREESPAC.E");
+    ASSERT_TRUE(freeFile != NULL);
+    EXPECT_EQ(freeSpace - FAKE_SUPERCLUSTER_SIZE, freeFile->fileSize);
+}
+
+TEST(AsyncFatFsTest, TestFileDataWrittenInMultipleBlockWrites)
+{
+    static const uint32_t length = 64 * 1024;
+
+    // A regular (not contiguous) file has its clusters allocated one at a time, between its data sectors
+    fakeCardFormat();
+    mount();
+    openFile("LOG00001.BFL", "a");
+
+    const uint32_t singleWrites = fakeSingleWrites;
+    uint32_t offset = 0;
+    while (offset < length) {
+        uint8_t buffer[FAKE_BLOCK_SIZE];
+        for (unsigned i = 0; i < sizeof(buffer); i++) {
+            buffer[i] = logByte(offset + i);
+        }
+        offset += afatfs_fwrite(testFile, buffer, MIN(length - offset, (uint32_t)sizeof(buffer)));
+        pollFor(LOG_FRAME_INTERVAL_US);
+    }
+    closeLogAndUnmount();
+
+    // Those are the only single block writes, the data went in runs of sectors
+    const uint32_t clusters = checkLogOnCard(length);
+    EXPECT_EQ(length / FAKE_CLUSTER_SIZE, clusters);
+    EXPECT_LT(fakeSingleWrites - singleWrites, 4 * clusters);
+    EXPECT_GT(fakeMultiWrites, clusters);
+}
+
+TEST(AsyncFatFsTest, TestSequentialReadsAreReadAhead)
+{
+    static const uint32_t length = 256 * 1024;
+
+    mountAndOpenLog(0);
+    writeLog(0, length);
+    closeLogAndUnmount();
+
+    mount();
+    openFile("LOG00001.BFL", "r");
+
+    const uint32_t hits = afatfs_getCacheHits();
+    const uint32_t misses = afatfs_getCacheMisses();
+    uint32_t offset = 0;
+    while (offset < length) {
+        uint8_t buffer[FAKE_BLOCK_SIZE];
+        uint32_t read = afatfs_fread(testFile, buffer, sizeof(buffer));
+
+        for (uint32_t i = 0; i < read; i++, offset++) {
+            ASSERT_EQ(logByte(offset), buffer[i]);
+        }
+        // Spend about as long handling each sector as the card takes to read one
+        fakeTimeUs += FAKE_READ_US;
+        afatfs_poll();
+    }
+    const uint32_t sectors = length / FAKE_BLOCK_SIZE;
+    const uint32_t clusters = length / FAKE_CLUSTER_SIZE;
+
+    // Only the first sector of each cluster has to wait for the card
+    EXPECT_LE(afatfs_getCacheMisses() - misses, 2 * clusters);
+    EXPECT_GE(afatfs_getCacheHits() - hits, sectors - clusters);
+
+    ASSERT_TRUE(afatfs_fclose(testFile, NULL));
+    while (!afatfs_destroy(false)) {
+        pollFor(LOG_FRAME_INTERVAL_US);
+    }
+}
+
+// Preallocation shortens the longest time the log can't be written while recording at 256kB/s, once the log header
+// is on the card
+TEST(AsyncFatFsTest, TestPreallocationShortensWorstCaseWriteStall)
+{
+    static const uint32_t preallocations[] = { 0, 32 };
+    static const uint32_t logLength = 20 * FAKE_SUPERCLUSTER_SIZE;
+    uint32_t worstStallUs[ARRAYLEN(preallocations)];
+
+    for (unsigned i = 0; i < ARRAYLEN(preallocations); i++) {
+        mountAndOpenLog(preallocations[i] * FAKE_SUPERCLUSTER_SIZE);
+
+        logResult_t header = writeLog(0, 4096);
+        pollFor(100000);
+
+        logResult_t log = writeLog(header.length, logLength);
+        worstStallUs[i] = log.worstStallUs;
+
+        closeLogAndUnmount();
+        checkLogOnCard(log.length);
+    }
+
+    EXPECT_LT(worstStallUs[1], worstStallUs[0]);
+}
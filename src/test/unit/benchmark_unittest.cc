@@ -0,0 +1,162 @@
+/*
+ * This file is part of Cleanflight and Betaflight.
+ *
+ * Cleanflight and Betaflight are free software. You can redistribute
+ * this software and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Cleanflight and Betaflight are distributed in the hope that they
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "build/benchmark.h"
+    #include "build/version.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define READ_CYCLES 7   // every read of the fake cycle counter takes this long
+
+static uint32_t cycleCounter;
+static const uint32_t *kernelCycles;    // cost of each call, in order
+static int kernelCalls;
+static bool kernelInitialised;
+static std::vector<std::string> lines;
+
+static void fakeInit(void)
+{
+    EXPECT_EQ(0, kernelCalls);
+    kernelInitialised = true;
+}
+
+static void fakeRun(void)
+{
+    EXPECT_TRUE(kernelInitialised);
+    cycleCounter += kernelCycles[kernelCalls++];
+}
+
+static uint32_t cheapCycles[BENCHMARK_WARMUP + BENCHMARK_SAMPLES];
+static uint32_t costlyCycles[BENCHMARK_WARMUP + BENCHMARK_SAMPLES];
+
+static void cheapRun(void)
+{
+    kernelCycles = cheapCycles;
+    fakeRun();
+}
+
+static void costlyRun(void)
+{
+    kernelCycles = costlyCycles;
+    fakeRun();
+}
+
+static void resetKernel(void)
+{
+    kernelCalls = 0;
+}
+
+static void printLine(const char *line)
+{
+    lines.push_back(line);
+}
+
+extern "C" {
+    const benchmarkKernel_t benchmarkKernels[] = {
+        { "cheap", resetKernel, cheapRun },
+        { "cheapest", resetKernel, cheapRun },
+        { "costly", resetKernel, costlyRun },
+    };
+    const unsigned benchmarkKernelCount = ARRAYLEN(benchmarkKernels);
+}
+
+TEST(BenchmarkUnittest, TestMeasure)
+{
+    uint32_t cycles[BENCHMARK_WARMUP + BENCHMARK_SAMPLES];
+    std::vector<uint32_t> samples;
+
+    // slow warmup calls are not sampled
+    for (int i = 0; i < BENCHMARK_WARMUP; i++) {
+        cycles[i] = 10000;
+    }
+    for (int i = 0; i < BENCHMARK_SAMPLES; i++) {
+        const uint32_t sample = i == 40 ? 5000 : 20 + (i * 37) % 50;
+        cycles[BENCHMARK_WARMUP + i] = sample;
+        samples.push_back(sample);
+    }
+    std::sort(samples.begin(), samples.end());
+
+    kernelCycles = cycles;
+    kernelCalls = 0;
+    kernelInitialised = false;
+    const benchmarkKernel_t kernel = { "fake", fakeInit, fakeRun };
+    benchmarkResult_t result;
+    benchmarkMeasure(&kernel, &result);
+
+    EXPECT_EQ(BENCHMARK_WARMUP + BENCHMARK_SAMPLES, kernelCalls);
+    // reading the counter is not counted
+    EXPECT_EQ(20, result.min);
+    EXPECT_EQ(samples[BENCHMARK_SAMPLES / 2], result.median);
+    EXPECT_EQ(5000, result.max);
+}
+
+TEST(BenchmarkUnittest, TestRun)
+{
+    for (int i = 0; i < BENCHMARK_WARMUP + BENCHMARK_SAMPLES; i++) {
+        cheapCycles[i] = 12;
+        costlyCycles[i] = i < BENCHMARK_WARMUP + BENCHMARK_SAMPLES / 2 ? 1000 : 123456;
+    }
+
+    lines.clear();
+    EXPECT_EQ(3, benchmarkRun("", printLine));
+    ASSERT_EQ(5, lines.size());
+    EXPECT_EQ("# benchmark TEST " FC_VERSION_STRING " abc1234 cycles 101 samples", lines[0]);
+    EXPECT_EQ("#     min   median      max  kernel", lines[1]);
+    EXPECT_EQ("       12       12       12  cheap", lines[2]);
+    EXPECT_EQ("       12       12       12  cheapest", lines[3]);
+    EXPECT_EQ("     1000   123456   123456  costly", lines[4]);
+
+    // kernels are picked by the start of their names, ignoring case
+    lines.clear();
+    EXPECT_EQ(2, benchmarkRun("CHEAP", printLine));
+    ASSERT_EQ(4, lines.size());
+    EXPECT_EQ("       12       12       12  cheap", lines[2]);
+    EXPECT_EQ("       12       12       12  cheapest", lines[3]);
+
+    lines.clear();
+    EXPECT_EQ(0, benchmarkRun("pid", printLine));
+    EXPECT_EQ(2, lines.size());
+}
+
+// STUBS
+
+extern "C" {
+    const char * const targetName = "TEST";
+    const char * const shortGitRevision = "abc1234";
+
+    uint32_t getCycleCounter(void)
+    {
+        const uint32_t now = cycleCounter;
+        cycleCounter += READ_CYCLES;
+        return now;
+    }
+}
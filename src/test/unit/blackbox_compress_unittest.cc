@@ -0,0 +1,474 @@
+/*
+ * This file is part of Cleanflight and Betaflight.
+ *
+ * Cleanflight and Betaflight are free software. You can redistribute
+ * this software and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Cleanflight and Betaflight are distributed in the hope that they
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include <string>
+#include <vector>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "blackbox/blackbox.h"
+    #include "blackbox/blackbox_compress.h"
+    #include "blackbox/blackbox_encoding.h"
+    #include "blackbox/blackbox_fielddefs.h"
+    #include "blackbox/blackbox_io.h"
+
+    #include "pg/pg.h"
+    #include "pg/pg_ids.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define I_INTERVAL 32
+
+static std::vector<uint8_t> output;
+
+typedef std::vector<int32_t> frame_t;
+
+// The main fields of a log and their values in each frame
+typedef struct replayLog_s {
+    std::vector<std::string> names;
+    std::vector<frame_t> frames;
+} replayLog_t;
+
+static void flushOutput(void)
+{
+    blackboxFlushFrame();
+}
+
+static void writeIntraframeValues(const frame_t &frame)
+{
+    blackboxWrite('I');
+    for (int32_t value : frame) {
+        blackboxWriteSignedVB(value);
+    }
+}
+
+// Emulates the main frame writers of blackbox.c, with a fixed I-frame interval and every other frame a P-frame
+static void encodeLog(const replayLog_t &log)
+{
+    static blackboxCompressState_t state;
+    const int fieldCount = log.names.size();
+
+    blackboxCompressReset(&state);
+
+    const frame_t *prev1 = nullptr;
+    const frame_t *prev2 = nullptr;
+    for (size_t i = 0; i < log.frames.size(); i++) {
+        const frame_t &curr = log.frames[i];
+
+        if (i % I_INTERVAL == 0) {
+            writeIntraframeValues(curr);
+            blackboxCompressWriteIntraframe(&state, fieldCount);
+            prev2 = &curr;
+        } else {
+            blackboxWrite('P');
+            blackboxCompressWriteInterframe(&state, curr.data(), prev1->data(), prev2->data(), UINT64_MAX);
+            prev2 = prev1;
+        }
+        prev1 = &curr;
+    }
+    flushOutput();
+}
+
+// An independent decoder for log data version 3 main frames, written from the description in blackbox_compress.c
+class Decoder {
+public:
+    Decoder(const std::vector<uint8_t> &data, int fieldCount) : data(data), fieldCount(fieldCount) {}
+
+    std::vector<frame_t> decode(void)
+    {
+        std::vector<frame_t> frames;
+        frame_t prev1, prev2;
+
+        while (bytePos() < data.size()) {
+            const uint8_t marker = readBits(8);
+            frame_t curr(fieldCount);
+
+            if (marker == 'I') {
+                for (int field = 0; field < fieldCount; field++) {
+                    curr[field] = zigzagDecode(readVB());
+                }
+                predictors.assign(fieldCount, 0);
+                for (int field = 0; field < fieldCount; field++) {
+                    predictors[field] = readBits(BLACKBOX_COMPRESS_PREDICTOR_BITS);
+                }
+                align();
+                riceSum.assign(fieldCount, 0);
+                riceCount = 1;
+                prev2 = curr;
+            } else {
+                EXPECT_EQ('P', marker);
+                for (int field = 0; field < fieldCount; field++) {
+                    const uint32_t residual = readRice(field);
+                    curr[field] = predict(predictors[field], prev1[field], prev2[field]) + (uint32_t)zigzagDecode(residual);
+                }
+                align();
+                if (++riceCount == BLACKBOX_COMPRESS_RICE_WINDOW) {
+                    for (uint32_t &sum : riceSum) {
+                        sum /= 2;
+                    }
+                    riceCount /= 2;
+                }
+                prev2 = prev1;
+            }
+            prev1 = curr;
+            frames.push_back(curr);
+        }
+        return frames;
+    }
+
+    std::vector<uint8_t> predictors;
+
+private:
+    const std::vector<uint8_t> &data;
+    const int fieldCount;
+    size_t bitPos = 0;
+    std::vector<uint32_t> riceSum;
+    uint32_t riceCount = 1;
+
+    size_t bytePos(void) const { return bitPos / 8; }
+    void align(void) { bitPos = (bitPos + 7) & ~7; }
+
+    uint32_t readBits(unsigned count)
+    {
+        uint32_t value = 0;
+        for (unsigned i = 0; i < count; i++, bitPos++) {
+            EXPECT_LT(bytePos(), data.size());
+            value = (value << 1) | ((data[bytePos()] >> (7 - bitPos % 8)) & 1);
+        }
+        return value;
+    }
+
+    uint32_t readVB(void)
+    {
+        uint32_t value = 0;
+        for (unsigned shift = 0; ; shift += 7) {
+            const uint8_t byte = readBits(8);
+            value |= (uint32_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                return value;
+            }
+        }
+    }
+
+    uint32_t readRice(int field)
+    {
+        unsigned k = 0;
+        while (k < BLACKBOX_COMPRESS_RICE_MAX_K && ((uint64_t)riceCount << k) < riceSum[field]) {
+            k++;
+        }
+
+        unsigned quotient = 0;
+        while (quotient < BLACKBOX_COMPRESS_RICE_ESCAPE && readBits(1)) {
+            quotient++;
+        }
+        uint32_t value;
+        if (quotient == BLACKBOX_COMPRESS_RICE_ESCAPE) {
+            value = readBits(32);
+        } else {
+            value = (quotient << k) | readBits(k);
+        }
+        riceSum[field] += std::min<uint32_t>(value, 1U << BLACKBOX_COMPRESS_RICE_MAX_K);
+        return value;
+    }
+
+    static int32_t zigzagDecode(uint32_t value)
+    {
+        return (value >> 1) ^ -(int32_t)(value & 1);
+    }
+
+    static uint32_t predict(uint8_t predictor, int32_t prev1, int32_t prev2)
+    {
+        switch (blackboxCompressPredictors[predictor]) {
+        case FLIGHT_LOG_FIELD_PREDICTOR_STRAIGHT_LINE:
+            return 2 * (uint32_t)prev1 - (uint32_t)prev2;
+        case FLIGHT_LOG_FIELD_PREDICTOR_AVERAGE_2:
+            return (int32_t)(((int64_t)prev1 + prev2) / 2);
+        default:
+            return prev1;
+        }
+    }
+};
+
+static uint32_t randomState;
+
+static int32_t noise(int amplitude)
+{
+    randomState = randomState * 1664525 + 1013904223;
+    return (int32_t)((randomState >> 8) % (2 * amplitude + 1)) - amplitude;
+}
+
+static void addField(replayLog_t *log, const char *name)
+{
+    log->names.push_back(name);
+}
+
+// Stands in for a recorded log: the main fields of a quad at 2kHz P-frame rate, a few rolls and flips in
+static replayLog_t syntheticFlight(int frameCount)
+{
+    replayLog_t log;
+    static const char *axes[] = { "[0]", "[1]", "[2]" };
+
+    addField(&log, "time");
+    const char *pidTerms[] = { "axisP", "axisI", "axisD", "axisF" };
+    for (const char *term : pidTerms) {
+        for (const char *axis : axes) {
+            addField(&log, (std::string(term) + axis).c_str());
+        }
+    }
+    for (int i = 0; i < 4; i++) {
+        addField(&log, "rcCommand");
+    }
+    for (int i = 0; i < 4; i++) {
+        addField(&log, "setpoint");
+    }
+    addField(&log, "vbatLatest");
+    addField(&log, "amperageLatest");
+    addField(&log, "rssi");
+    for (const char *axis : axes) {
+        addField(&log, (std::string("gyroADC") + axis).c_str());
+    }
+    for (const char *axis : axes) {
+        addField(&log, (std::string("accSmooth") + axis).c_str());
+    }
+    for (int i = 0; i < 4; i++) {
+        addField(&log, "debug");
+    }
+    for (int i = 0; i < 4; i++) {
+        addField(&log, "motor");
+    }
+
+    randomState = 1;
+    uint32_t time = 1000000;
+    int32_t integral[3] = { 0, 0, 0 };
+    for (int i = 0; i < frameCount; i++) {
+        frame_t frame;
+        const float t = i / 2000.0f;
+
+        time += 500 + noise(1);
+        frame.push_back(time);
+
+        int32_t setpoint[3], gyro[3], error[3];
+        for (int axis = 0; axis < 3; axis++) {
+            setpoint[axis] = lrintf(400 * sinf(t * (1.1f + axis)) * (axis < 2 ? 1 : 0.3f));
+            gyro[axis] = setpoint[axis] - lrintf(20 * sinf(t * 7)) + noise(6) + lrintf(15 * sinf(i * 2.1f));
+            error[axis] = setpoint[axis] - gyro[axis];
+            integral[axis] += error[axis] / 8;
+            integral[axis] = integral[axis] * 63 / 64;
+        }
+        for (int axis = 0; axis < 3; axis++) {
+            frame.push_back(error[axis] * 3 / 2);
+        }
+        for (int axis = 0; axis < 3; axis++) {
+            frame.push_back(integral[axis] / 4);
+        }
+        for (int axis = 0; axis < 3; axis++) {
+            frame.push_back(axis < 2 ? noise(40) + lrintf(30 * sinf(i * 2.1f)) : 0);
+        }
+        for (int axis = 0; axis < 3; axis++) {
+            frame.push_back(lrintf(200 * cosf(t * (1.1f + axis))));
+        }
+        for (int axis = 0; axis < 3; axis++) {
+            frame.push_back(setpoint[axis] / 2);
+        }
+        frame.push_back(1400 + (i / 40) % 50);
+        for (int axis = 0; axis < 3; axis++) {
+            frame.push_back(setpoint[axis]);
+        }
+        frame.push_back(400 + (i / 40) % 50);
+        frame.push_back(1620 - i / 2000);
+        frame.push_back(1200 + noise(3));
+        frame.push_back(1023);
+        for (int axis = 0; axis < 3; axis++) {
+            frame.push_back(gyro[axis]);
+        }
+        for (int axis = 0; axis < 3; axis++) {
+            frame.push_back((axis == 2 ? 2048 : 0) + noise(30));
+        }
+        for (int d = 0; d < 4; d++) {
+            frame.push_back(0);
+        }
+        for (int motor = 0; motor < 4; motor++) {
+            frame.push_back(1200 + (i / 40) % 50 * 4 + error[motor & 1] / 2 + noise(20));
+        }
+
+        log.frames.push_back(frame);
+    }
+
+    return log;
+}
+
+static replayLog_t singleFieldLog(const std::vector<int32_t> &values)
+{
+    replayLog_t log;
+    addField(&log, "value");
+    for (int32_t value : values) {
+        log.frames.push_back(frame_t(1, value));
+    }
+    return log;
+}
+
+static void expectRoundTrip(const replayLog_t &log)
+{
+    output.clear();
+    encodeLog(log);
+
+    Decoder decoder(output, log.names.size());
+    const std::vector<frame_t> decoded = decoder.decode();
+
+    ASSERT_EQ(log.frames.size(), decoded.size());
+    for (size_t i = 0; i < decoded.size(); i++) {
+        ASSERT_EQ(log.frames[i], decoded[i]) << "frame " << i;
+    }
+}
+
+TEST(BlackboxCompressTest, TestRoundTrip)
+{
+    expectRoundTrip(syntheticFlight(10 * I_INTERVAL + 5));
+}
+
+TEST(BlackboxCompressTest, TestRoundTripExtremes)
+{
+    // residuals that need the escape, wrap around 32 bits, or push k to its limit
+    std::vector<int32_t> values;
+    for (int i = 0; i < 3 * I_INTERVAL; i++) {
+        values.push_back(i % 2 ? INT32_MIN : INT32_MAX);
+    }
+    for (int i = 0; i < 3 * I_INTERVAL; i++) {
+        values.push_back(i % 5 ? i : 1 << 28);
+    }
+    for (int i = 0; i < 3 * I_INTERVAL; i++) {
+        values.push_back((uint32_t)UINT32_MAX - 3 * i);
+    }
+    expectRoundTrip(singleFieldLog(values));
+}
+
+TEST(BlackboxCompressTest, TestPredictorSelection)
+{
+    replayLog_t log;
+    addField(&log, "ramp");
+    addField(&log, "steps");
+    addField(&log, "alternating");
+    for (int i = 0; i < 2 * I_INTERVAL + 1; i++) {
+        log.frames.push_back({ 1000 + 250 * i, (i / 8) * 100, i % 2 ? 50 : -50 });
+    }
+
+    output.clear();
+    encodeLog(log);
+
+    Decoder decoder(output, log.names.size());
+    decoder.decode();
+
+    // the predictors chosen at the last I-frame, from the interval before it
+    ASSERT_EQ(3U, decoder.predictors.size());
+    EXPECT_EQ(FLIGHT_LOG_FIELD_PREDICTOR_STRAIGHT_LINE, blackboxCompressPredictors[decoder.predictors[0]]);
+    EXPECT_EQ(FLIGHT_LOG_FIELD_PREDICTOR_PREVIOUS, blackboxCompressPredictors[decoder.predictors[1]]);
+    EXPECT_EQ(FLIGHT_LOG_FIELD_PREDICTOR_AVERAGE_2, blackboxCompressPredictors[decoder.predictors[2]]);
+}
+
+TEST(BlackboxCompressTest, TestFirstIntervalUsesPrevious)
+{
+    static blackboxCompressState_t state;
+    blackboxCompressReset(&state);
+
+    output.clear();
+    blackboxCompressWriteIntraframe(&state, 5);
+    flushOutput();
+
+    // 5 two bit entries of zero, padded to whole bytes
+    EXPECT_EQ(2U, output.size());
+    EXPECT_EQ(0, output[0]);
+    EXPECT_EQ(0, output[1]);
+}
+
+TEST(BlackboxCompressTest, TestFieldCountChangeForgetsPredictors)
+{
+    static blackboxCompressState_t state;
+    blackboxCompressReset(&state);
+
+    const int32_t prev2[2] = { 0, 0 };
+    const int32_t prev1[2] = { 100, 100 };
+    const int32_t curr[2] = { 200, 200 };
+
+    blackboxCompressWriteIntraframe(&state, 2);
+    blackboxCompressWriteInterframe(&state, curr, prev1, prev2, UINT64_MAX);
+    blackboxCompressWriteIntraframe(&state, 2);
+    EXPECT_EQ(FLIGHT_LOG_FIELD_PREDICTOR_STRAIGHT_LINE, blackboxCompressPredictors[state.predictor[0]]);
+
+    blackboxCompressWriteInterframe(&state, curr, prev1, prev2, UINT64_MAX);
+    blackboxCompressWriteIntraframe(&state, 1);
+    EXPECT_EQ(FLIGHT_LOG_FIELD_PREDICTOR_PREVIOUS, blackboxCompressPredictors[state.predictor[0]]);
+    flushOutput();
+}
+
+TEST(BlackboxCompressTest, TestSkippedFieldsNotCoded)
+{
+    static blackboxCompressState_t state;
+    blackboxCompressReset(&state);
+
+    const int32_t prev2[3] = { 0, 0, 0 };
+    const int32_t prev1[3] = { 0, 0, 0 };
+    const int32_t curr[3] = { 1000, 0, 1000 };
+
+    output.clear();
+    blackboxCompressWriteIntraframe(&state, 3);
+    flushOutput();
+    output.clear();
+
+    // only the middle field, a zero residual with k = 0 is the single bit 0
+    blackboxCompressWriteInterframe(&state, curr, prev1, prev2, 1 << 1);
+    flushOutput();
+    ASSERT_EQ(1U, output.size());
+    EXPECT_EQ(0, output[0]);
+    EXPECT_EQ(0U, state.residualSum[0][0]);
+    EXPECT_EQ(0U, state.riceSum[2]);
+}
+
+// STUBS
+
+extern "C" {
+    PG_REGISTER(blackboxConfig_t, blackboxConfig, PG_BLACKBOX_CONFIG, 0);
+
+    int32_t blackboxHeaderBudget;
+    uint8_t blackboxFrameBuffer[BLACKBOX_FRAME_BUFFER_SIZE];
+    uint16_t blackboxFrameBufferLength;
+
+    void blackboxFlushFrame(void)
+    {
+        output.insert(output.end(), blackboxFrameBuffer, blackboxFrameBuffer + blackboxFrameBufferLength);
+        blackboxFrameBufferLength = 0;
+    }
+
+    int blackboxWriteString(const char *s)
+    {
+        const int length = strlen(s);
+        for (int i = 0; i < length; i++) {
+            blackboxWrite(s[i]);
+        }
+        return length;
+    }
+}
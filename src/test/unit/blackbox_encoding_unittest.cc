@@ -22,6 +22,7 @@ extern "C" {
 
     #include "blackbox/blackbox.h"
     #include "blackbox/blackbox_encoding.h"
+    #include "blackbox/blackbox_io.h"
     #include "common/utils.h"
 
     #include "pg/pg.h"
@@ -52,6 +53,13 @@ void serialWrite(serialPort_t *instance, uint8_t ch)
     serialWriteBuffer[serialWritePos++] = ch;
 }
 
+// Encoded bytes are staged in the blackbox frame buffer, pass them on as the device would
+static void flushFrameBuffer(void)
+{
+    serialWriteBuf(blackboxPort, blackboxFrameBuffer, blackboxFrameBufferLength);
+    blackboxFrameBufferLength = 0;
+}
+
 void serialWriteBuf(serialPort_t *instance, const uint8_t *data, int count)
 {
     while(count--)
@@ -105,6 +113,7 @@ void serialTestResetBuffers()
     serialReadEnd = 0;
     memset(&serialWriteBuffer, 0, sizeof(serialWriteBuffer));
     serialWritePos = 0;
+    blackboxFrameBufferLength = 0;
 }
 
 TEST(BlackboxEncodingTest, TestWriteUnsignedVB)
@@ -112,8 +121,11 @@ TEST(BlackboxEncodingTest, TestWriteUnsignedVB)
     serialTestResetBuffers();
 
     blackboxWriteUnsignedVB(0);
+
+    flushFrameBuffer();
     EXPECT_EQ(0, serialWriteBuffer[0]);
     blackboxWriteUnsignedVB(128);
+    flushFrameBuffer();
     EXPECT_EQ(0x80, serialWriteBuffer[1]);
     EXPECT_EQ(1, serialWriteBuffer[2]);
 }
@@ -130,6 +142,7 @@ TEST(BlackboxTest, TestWriteTag2_3SVariable_BITS2)
     v[1] = 0;
     v[2] = 0;
     selector = blackboxWriteTag2_3SVariable(v);
+    flushFrameBuffer();
     EXPECT_EQ(0, selector);
     EXPECT_EQ(0, buf[0]);
     EXPECT_EQ(0, buf[1]); // ensure next byte has not been written
@@ -137,6 +150,7 @@ TEST(BlackboxTest, TestWriteTag2_3SVariable_BITS2)
 
     v[0] = 1;
     selector = blackboxWriteTag2_3SVariable(v);
+    flushFrameBuffer();
     EXPECT_EQ(0x10, buf[0]); // 00010000
     EXPECT_EQ(0, buf[1]); // ensure next byte has not been written
     ++buf;
@@ -145,6 +159,7 @@ TEST(BlackboxTest, TestWriteTag2_3SVariable_BITS2)
     v[1] = 1;
     v[2] = 1;
     selector = blackboxWriteTag2_3SVariable(v);
+    flushFrameBuffer();
     EXPECT_EQ(0, selector);
     EXPECT_EQ(0x15, buf[0]); // 00010101
     EXPECT_EQ(0, buf[1]); // ensure next byte has not been written
@@ -154,6 +169,7 @@ TEST(BlackboxTest, TestWriteTag2_3SVariable_BITS2)
     v[1] = -1;
     v[2] = -1;
     selector = blackboxWriteTag2_3SVariable(v);
+    flushFrameBuffer();
     EXPECT_EQ(0, selector);
     EXPECT_EQ(0x3F, buf[0]); // 00111111
     EXPECT_EQ(0, buf[1]); // ensure next byte has not been written
@@ -163,6 +179,7 @@ TEST(BlackboxTest, TestWriteTag2_3SVariable_BITS2)
     v[1] = -2;
     v[2] = -2;
     selector = blackboxWriteTag2_3SVariable(v);
+    flushFrameBuffer();
     EXPECT_EQ(0, selector);
     EXPECT_EQ(0x2A, buf[0]); // 00101010
     EXPECT_EQ(0, buf[1]); // ensure next byte has not been written
@@ -182,6 +199,7 @@ TEST(BlackboxTest, TestWriteTag2_3SVariable_BITS554)
     v[1] = 15;
     v[2] = 7;
     selector = blackboxWriteTag2_3SVariable(v);
+    flushFrameBuffer();
     EXPECT_EQ(1, selector);
     EXPECT_EQ(0x5E, buf[0]); // 0101 1110
     EXPECT_EQ(0xF7, buf[1]); // 1111 0111
@@ -192,6 +210,7 @@ TEST(BlackboxTest, TestWriteTag2_3SVariable_BITS554)
     v[1] = -16;
     v[2] = -8;
     selector = blackboxWriteTag2_3SVariable(v);
+    flushFrameBuffer();
     EXPECT_EQ(1, selector);
     EXPECT_EQ(0x61, buf[0]); // 0110 0001
     EXPECT_EQ(0x08, buf[1]); // 0000 1000
@@ -202,6 +221,7 @@ TEST(BlackboxTest, TestWriteTag2_3SVariable_BITS554)
     v[1] = 8;
     v[2] = 5;
     selector = blackboxWriteTag2_3SVariable(v);
+    flushFrameBuffer();
     EXPECT_EQ(1, selector);
     EXPECT_EQ(0x4E, buf[0]); // 0100 1110
     EXPECT_EQ(0x85, buf[1]); // 1000 0101
@@ -222,6 +242,7 @@ TEST(BlackboxTest, TestWriteTag2_3SVariable_BITS887)
     v[1] = 63;
     v[2] = 63;
     selector = blackboxWriteTag2_3SVariable(v);
+    flushFrameBuffer();
     EXPECT_EQ(2, selector);
     EXPECT_EQ(0x9F, buf[0]); // 1001 1111
     EXPECT_EQ(0xDF, buf[1]); // 1101 1111
@@ -233,6 +254,7 @@ TEST(BlackboxTest, TestWriteTag2_3SVariable_BITS887)
     v[1] = -64;
     v[2] = -64;
     selector = blackboxWriteTag2_3SVariable(v);
+    flushFrameBuffer();
     EXPECT_EQ(2, selector);
     EXPECT_EQ(0xA0, buf[0]); // 1010 0000
     EXPECT_EQ(0x20, buf[1]); // 0010 0000
@@ -245,12 +267,14 @@ extern "C" {
 PG_REGISTER(blackboxConfig_t, blackboxConfig, PG_BLACKBOX_CONFIG, 0);
 int32_t blackboxHeaderBudget;
 void mspSerialAllocatePorts(void) {}
-void blackboxWrite(uint8_t value) {serialWrite(blackboxPort, value);}
+uint8_t blackboxFrameBuffer[BLACKBOX_FRAME_BUFFER_SIZE];
+uint16_t blackboxFrameBufferLength;
+void blackboxFlushFrame(void) {flushFrameBuffer();}
 int blackboxWriteString(const char *s)
 {
     const uint8_t *pos = (uint8_t*)s;
     while (*pos) {
-        serialWrite(blackboxPort, *pos);
+        blackboxWrite(*pos);
         pos++;
     }
     const int length = pos - (uint8_t*)s;
@@ -0,0 +1,258 @@
+/*
+ * This file is part of Cleanflight and Betaflight.
+ *
+ * Cleanflight and Betaflight are free software. You can redistribute
+ * this software and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Cleanflight and Betaflight are distributed in the hope that they
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "build/debug.h"
+    #include "build/version.h"
+
+    #include "blackbox/blackbox.h"
+    #include "blackbox/blackbox_encoding.h"
+    #include "blackbox/blackbox_io.h"
+    #include "common/utils.h"
+
+    #include "config/config.h"
+
+    #include "drivers/serial.h"
+
+    #include "io/asyncfatfs/asyncfatfs.h"
+    #include "io/flashfs.h"
+    #include "io/serial.h"
+
+    #include "pg/pg.h"
+    #include "pg/pg_ids.h"
+
+    PG_REGISTER(blackboxConfig_t, blackboxConfig, PG_BLACKBOX_CONFIG, 0);
+    PG_REGISTER(pilotConfig_t, pilotConfig, PG_PILOT_CONFIG, 0);
+
+    uint32_t targetPidLooptime;
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define DEVICE_BUFFER_SIZE 4096
+
+// Every device stub appends to the same buffer and counts its write calls
+static uint8_t deviceBuffer[DEVICE_BUFFER_SIZE];
+static int deviceLength;
+static int deviceWrites;
+static uint32_t serialTxFree;
+
+static serialPort_t serialTestPort;
+
+static void deviceWrite(const uint8_t *data, int length)
+{
+    EXPECT_LE(deviceLength + length, DEVICE_BUFFER_SIZE);
+    memcpy(&deviceBuffer[deviceLength], data, length);
+    deviceLength += length;
+    deviceWrites++;
+}
+
+static void resetDevice(uint8_t device)
+{
+    blackboxConfigMutable()->device = device;
+    memset(deviceBuffer, 0, sizeof(deviceBuffer));
+    deviceLength = 0;
+    deviceWrites = 0;
+    serialTxFree = DEVICE_BUFFER_SIZE;
+
+    blackboxDeviceOpen();
+}
+
+TEST(BlackboxIoTest, TestFrameWrittenInOneCall)
+{
+    static const uint8_t devices[] = { BLACKBOX_DEVICE_SERIAL, BLACKBOX_DEVICE_FLASH, BLACKBOX_DEVICE_SDCARD };
+
+    for (unsigned i = 0; i < ARRAYLEN(devices); i++) {
+        resetDevice(devices[i]);
+
+        blackboxWrite('P');
+        blackboxWriteUnsignedVB(128);
+        blackboxWriteString("abc");
+        EXPECT_EQ(0, deviceWrites);
+
+        blackboxDeviceFlush();
+        EXPECT_EQ(1, deviceWrites);
+        EXPECT_EQ(6, deviceLength);
+        EXPECT_EQ(0, memcmp("P\x80\x01" "abc", deviceBuffer, 6));
+
+        // nothing further is written while the frame buffer is empty
+        blackboxDeviceFlush();
+        EXPECT_EQ(1, deviceWrites);
+    }
+}
+
+TEST(BlackboxIoTest, TestFrameBufferOverflow)
+{
+    resetDevice(BLACKBOX_DEVICE_FLASH);
+
+    for (int i = 0; i < BLACKBOX_FRAME_BUFFER_SIZE + 10; i++) {
+        blackboxWrite(i);
+    }
+    EXPECT_EQ(1, deviceWrites);
+    EXPECT_EQ(BLACKBOX_FRAME_BUFFER_SIZE, deviceLength);
+
+    // a write larger than the frame buffer goes straight to the device, after what was staged before it
+    uint8_t large[BLACKBOX_FRAME_BUFFER_SIZE + 1];
+    memset(large, 0xaa, sizeof(large));
+    blackboxWriteBuf(large, sizeof(large));
+    EXPECT_EQ(3, deviceWrites);
+    EXPECT_EQ(2 * BLACKBOX_FRAME_BUFFER_SIZE + 11, deviceLength);
+
+    for (int i = 0; i < BLACKBOX_FRAME_BUFFER_SIZE + 10; i++) {
+        EXPECT_EQ(i & 0xff, deviceBuffer[i]);
+    }
+    EXPECT_EQ(0xaa, deviceBuffer[BLACKBOX_FRAME_BUFFER_SIZE + 10]);
+    EXPECT_EQ(0xaa, deviceBuffer[2 * BLACKBOX_FRAME_BUFFER_SIZE + 10]);
+}
+
+TEST(BlackboxIoTest, TestSerialDropsWhatDoesNotFit)
+{
+    resetDevice(BLACKBOX_DEVICE_SERIAL);
+    serialTxFree = 4;
+
+    blackboxWriteString("abcdef");
+    blackboxDeviceFlush();
+    EXPECT_EQ(4, deviceLength);
+    EXPECT_EQ(0, memcmp("abcd", deviceBuffer, 4));
+
+    // and the frame buffer is empty for the next frame
+    serialTxFree = 0;
+    blackboxWrite('x');
+    blackboxDeviceFlush();
+    EXPECT_EQ(4, deviceLength);
+}
+
+// A representative main frame with all fields enabled
+static void writeMainFrame(int iteration)
+{
+    int32_t values[32];
+    for (unsigned i = 0; i < ARRAYLEN(values); i++) {
+        values[i] = ((iteration * 7 + i * 13) % 200) - 100;
+    }
+
+    blackboxWrite('P');
+    blackboxWriteSignedVB(iteration & 0xff);
+    blackboxWriteSignedVBArray(values, 9);
+    blackboxWriteTag2_3S32(&values[9]);
+    blackboxWriteTag8_4S16(&values[12]);
+    blackboxWriteSignedVBArray(&values[16], 8);
+    blackboxWriteTag8_8SVB(&values[24], 8);
+}
+
+TEST(BlackboxIoTest, TestDevicesReceiveTheSameFrames)
+{
+    static const uint8_t devices[] = { BLACKBOX_DEVICE_SERIAL, BLACKBOX_DEVICE_FLASH, BLACKBOX_DEVICE_SDCARD };
+    static const int frames = 40;
+    static uint8_t serialBytes[DEVICE_BUFFER_SIZE];
+    int serialLength = 0;
+
+    for (unsigned i = 0; i < ARRAYLEN(devices); i++) {
+        resetDevice(devices[i]);
+
+        for (int frame = 0; frame < frames; frame++) {
+            writeMainFrame(frame);
+            blackboxDeviceFlush();
+        }
+
+        // one hand over per frame, with the same bytes whatever the backend
+        EXPECT_EQ(frames, deviceWrites);
+        if (devices[i] == BLACKBOX_DEVICE_SERIAL) {
+            serialLength = deviceLength;
+            memcpy(serialBytes, deviceBuffer, deviceLength);
+        } else {
+            EXPECT_EQ(serialLength, deviceLength);
+            EXPECT_EQ(0, memcmp(serialBytes, deviceBuffer, deviceLength));
+        }
+    }
+}
+
+// STUBS
+
+extern "C" {
+    uint8_t debugMode;
+    int16_t debug[DEBUG16_VALUE_COUNT];
+    int32_t blackboxHeaderBudget;
+    const uint32_t baudRates[] = {0, 9600, 19200, 38400, 57600, 115200, 230400, 250000,
+        400000, 460800, 500000, 921600, 1000000, 1500000, 2000000, 2470000};
+
+    const char * const shortGitRevision = "0000000";
+
+    uint32_t millis(void) { return 0; }
+    void blackboxInit(void) {}
+
+    void mspSerialReleasePortIfAllocated(serialPort_t *) {}
+    void mspSerialAllocatePorts(void) {}
+    serialPort_t *findSharedSerialPort(uint16_t, serialPortFunction_e) { return NULL; }
+    const serialPortConfig_t *findSerialPortConfig(serialPortFunction_e)
+    {
+        static serialPortConfig_t portConfig;
+        return &portConfig;
+    }
+    portSharing_e determinePortSharing(const serialPortConfig_t *, serialPortFunction_e) { return PORTSHARING_UNUSED; }
+    serialPort_t *openSerialPort(serialPortIdentifier_e, serialPortFunction_e, serialReceiveCallbackPtr, void *, uint32_t, portMode_e, portOptions_e)
+    {
+        return &serialTestPort;
+    }
+    void closeSerialPort(serialPort_t *) {}
+    uint32_t serialTxBytesFree(const serialPort_t *) { return serialTxFree; }
+    bool isSerialTransmitBufferEmpty(const serialPort_t *) { return true; }
+    void serialWriteBuf(serialPort_t *, const uint8_t *data, int count) { deviceWrite(data, count); }
+    void serialBeginWrite(serialPort_t *) {}
+    void serialEndWrite(serialPort_t *) {}
+
+    void flashfsWrite(const uint8_t *data, unsigned int len, bool) { deviceWrite(data, len); }
+    bool flashfsFlushAsync(bool) { return true; }
+    void flashfsClose(void) {}
+    void flashfsEraseCompletely(void) {}
+    uint32_t flashfsGetWriteBufferFreeSpace(void) { return DEVICE_BUFFER_SIZE; }
+    uint32_t flashfsGetWriteBufferSize(void) { return DEVICE_BUFFER_SIZE; }
+    bool flashfsIsEOF(void) { return false; }
+    bool flashfsIsReady(void) { return true; }
+    bool flashfsIsSupported(void) { return true; }
+    void flashfsLogBegin(const flashfsLogEntry_t *) {}
+    void flashfsLogEnd(void) {}
+
+    uint32_t afatfs_fwrite(afatfsFilePtr_t, const uint8_t *buffer, uint32_t len) { deviceWrite(buffer, len); return len; }
+    bool afatfs_fopen(const char *, const char *, afatfsFileCallback_t) { return true; }
+    bool afatfs_fclose(afatfsFilePtr_t, afatfsCallback_t) { return true; }
+    void afatfs_fpreallocate(afatfsFilePtr_t, uint32_t) {}
+    bool afatfs_funlink(afatfsFilePtr_t, afatfsCallback_t) { return true; }
+    bool afatfs_mkdir(const char *, afatfsFileCallback_t) { return true; }
+    bool afatfs_chdir(afatfsFilePtr_t) { return true; }
+    void afatfs_findFirst(afatfsFilePtr_t, afatfsFinder_t *) {}
+    afatfsOperationStatus_e afatfs_findNext(afatfsFilePtr_t, afatfsFinder_t *, fatDirectoryEntry_t **) { return AFATFS_OPERATION_FAILURE; }
+    void afatfs_findLast(afatfsFilePtr_t) {}
+    bool afatfs_flush(void) { return true; }
+    uint32_t afatfs_getFreeBufferSpace(void) { return DEVICE_BUFFER_SIZE; }
+    bool afatfs_isFull(void) { return false; }
+    afatfsFilesystemState_e afatfs_getFilesystemState(void) { return AFATFS_FILESYSTEM_STATE_READY; }
+    bool afatfs_sectorCacheInSync(void) { return true; }
+    bool fat_isDirectoryEntryTerminator(fatDirectoryEntry_t *) { return true; }
+    bool sdcard_isInserted(void) { return true; }
+    bool sdcard_isFunctional(void) { return true; }
+}
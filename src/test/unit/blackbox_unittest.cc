@@ -16,6 +16,9 @@
 
 #include <stdint.h>
 #include <string.h>
+#include <math.h>
+
+#include <vector>
 
 extern "C" {
     #include "platform.h"
@@ -23,6 +26,7 @@ extern "C" {
     #include "build/debug.h"
 
     #include "blackbox/blackbox.h"
+    #include "blackbox/blackbox_compress.h"
     #include "common/utils.h"
 
     #include "pg/pg.h"
@@ -40,13 +44,17 @@ extern "C" {
 
     #include "fc/rc_controls.h"
     #include "fc/rc_modes.h"
+    #include "fc/runtime_config.h"
 
     #include "io/gps.h"
     #include "io/serial.h"
 
     #include "rx/rx.h"
 
+    #include "sensors/acceleration.h"
+    #include "sensors/barometer.h"
     #include "sensors/battery.h"
+    #include "sensors/compass.h"
     #include "sensors/gyro.h"
 
     extern int16_t blackboxIInterval;
@@ -223,6 +231,49 @@ TEST(BlackboxTest, Test_zero_p_interval)
     EXPECT_FALSE(blackboxShouldLogPFrame());
 }
 
+TEST(BlackboxTest, Test_RateGroups)
+{
+    blackboxConfigMutable()->sample_rate = 1;
+    blackboxConfigMutable()->compression = true;
+    blackboxConfigMutable()->rate_group_denom[BLACKBOX_RATE_GROUP_MOTOR] = 2;
+    blackboxConfigMutable()->rate_group_denom[BLACKBOX_RATE_GROUP_RC_COMMANDS] = 4;
+    // 2kHz PIDloop, P-frames every 2 iterations
+    targetPidLooptime = 500;
+    blackboxInit();
+    EXPECT_EQ(64, blackboxIInterval);
+    EXPECT_EQ(2, blackboxPInterval);
+
+    int pFrames = 0;
+    for (int iteration = 0; iteration < 2 * blackboxIInterval; iteration++) {
+        if (!blackboxShouldLogIFrame() && blackboxShouldLogPFrame()) {
+            const int slot = (iteration % blackboxIInterval) / blackboxPInterval;
+            const uint32_t groups = blackboxPFrameRateGroups();
+            EXPECT_TRUE(groups & BIT(BLACKBOX_RATE_GROUP_GYRO));
+            EXPECT_TRUE(groups & BIT(BLACKBOX_RATE_GROUP_PID));
+            EXPECT_EQ(slot % 2 == 0, (groups & BIT(BLACKBOX_RATE_GROUP_MOTOR)) != 0);
+            EXPECT_EQ(slot % 4 == 0, (groups & BIT(BLACKBOX_RATE_GROUP_RC_COMMANDS)) != 0);
+            pFrames++;
+        }
+        blackboxAdvanceIterationTimers();
+    }
+    EXPECT_EQ(2 * 31, pFrames);
+
+    // data version 2 P-frames always log every group
+    blackboxConfigMutable()->compression = false;
+    for (int iteration = 0; iteration < blackboxIInterval; iteration++) {
+        if (!blackboxShouldLogIFrame() && blackboxShouldLogPFrame()) {
+            EXPECT_EQ(BIT(BLACKBOX_RATE_GROUP_COUNT) - 1, blackboxPFrameRateGroups());
+        }
+        blackboxAdvanceIterationTimers();
+    }
+
+    // out of range denominators are fixed up, 1 logs the group in every P-frame
+    blackboxConfigMutable()->rate_group_denom[BLACKBOX_RATE_GROUP_RC_COMMANDS] = 0;
+    blackboxConfigMutable()->rate_group_denom[BLACKBOX_RATE_GROUP_MOTOR] = 1;
+    blackboxValidateConfig();
+    EXPECT_EQ(1, blackboxConfig()->rate_group_denom[BLACKBOX_RATE_GROUP_RC_COMMANDS]);
+}
+
 TEST(BlackboxTest, Test_CalculatePDenom)
 {
     blackboxConfigMutable()->sample_rate = 0;
@@ -329,6 +380,455 @@ TEST(BlackboxTest, Test_CalculateRates)
 
 }
 
+TEST(BlackboxTest, Test_QueueOrderAndWrap)
+{
+    blackboxQueueReset();
+    EXPECT_EQ(NULL, blackboxQueuePeek());
+    EXPECT_EQ(0U, blackboxGetQueuedFrames());
+
+    // a slot only reaches the consumer once it's committed
+    blackboxQueuedFrame_t *first = blackboxQueueReserve();
+    ASSERT_NE((blackboxQueuedFrame_t *)NULL, first);
+    EXPECT_EQ(first, blackboxQueueReserve());
+    EXPECT_EQ(NULL, blackboxQueuePeek());
+    blackboxQueueCommit();
+    EXPECT_EQ(first, blackboxQueuePeek());
+
+    // fill the ring up
+    uint32_t queued = 1;
+    blackboxQueuedFrame_t *frame;
+    while ((frame = blackboxQueueReserve())) {
+        EXPECT_NE(first, frame);
+        blackboxQueueCommit();
+        queued++;
+        ASSERT_LE(queued, 1024U);
+    }
+    EXPECT_EQ(queued, blackboxGetQueuedFrames());
+
+    // freeing the oldest frame lets the producer wrap round onto its slot
+    blackboxQueueRelease();
+    EXPECT_NE(first, blackboxQueuePeek());
+    EXPECT_EQ(first, blackboxQueueReserve());
+    blackboxQueueCommit();
+    EXPECT_EQ(NULL, blackboxQueueReserve());
+
+    // and the consumer sees it after everything queued before it
+    for (uint32_t i = 0; i < queued - 1; i++) {
+        EXPECT_NE(first, blackboxQueuePeek());
+        blackboxQueueRelease();
+    }
+    EXPECT_EQ(first, blackboxQueuePeek());
+    blackboxQueueRelease();
+    EXPECT_EQ(NULL, blackboxQueuePeek());
+    EXPECT_EQ(0U, blackboxGetQueuedFrames());
+    EXPECT_EQ(0U, blackboxGetQueueOverflows());
+}
+
+TEST(BlackboxTest, Test_DeferredUpdateOnlyQueuesWhileLogging)
+{
+    targetPidLooptime = 1000;
+    blackboxConfigMutable()->sample_rate = 0;
+    blackboxConfigMutable()->device = BLACKBOX_DEVICE_NONE;
+    blackboxConfigMutable()->deferred = true;
+    blackboxInit();
+    blackboxQueueReset();
+
+    // the log isn't running, so the PID loop has nothing to snapshot
+    for (int i = 0; i < 100; i++) {
+        blackboxUpdate(i * 1000);
+    }
+    EXPECT_EQ(0U, blackboxGetQueuedFrames());
+    EXPECT_EQ(0U, blackboxGetQueueOverflows());
+    EXPECT_TRUE(blackboxShouldLogIFrame());
+
+    blackboxConfigMutable()->deferred = false;
+}
+
+// The bytes written to the blackbox serial port
+static std::vector<uint8_t> logBytes;
+static uint32_t testMillis;
+static float testSetpoint[XYZ_AXIS_COUNT];
+static pidProfile_t pidProfile;
+
+static uint32_t randomState;
+
+static int32_t noise(int amplitude)
+{
+    randomState = randomState * 1664525 + 1013904223;
+    return (int32_t)((randomState >> 8) % (2 * amplitude + 1)) - amplitude;
+}
+
+// The flight controller state loadMainState() reads: a quad at 2kHz with stick sweeps, noise and motor vibration
+static void setFlightState(int iteration)
+{
+    const float t = iteration / 2000.0f;
+
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        testSetpoint[axis] = 400 * sinf(t * (1.1f + axis)) * (axis < 2 ? 1 : 0.3f);
+        gyro.gyroADCf[axis] = testSetpoint[axis] - 20 * sinf(t * 7) + noise(6) + 15 * sinf(iteration * 2.1f);
+        const float error = testSetpoint[axis] - gyro.gyroADCf[axis];
+        pidData[axis].P = error * 1.5f;
+        pidData[axis].I = pidData[axis].I * 0.98f + error / 8;
+        pidData[axis].D = axis < 2 ? noise(40) + 30 * sinf(iteration * 2.1f) : 0;
+        pidData[axis].F = 200 * cosf(t * (1.1f + axis));
+        rcCommand[axis] = testSetpoint[axis] / 2;
+    }
+    rcCommand[THROTTLE] = 1400 + (iteration / 40) % 50;
+    for (int i = 0; i < 4; i++) {
+        motor[i] = 1200 + (iteration / 40) % 50 * 4 + testSetpoint[i & 1] / 50 + noise(20);
+    }
+}
+
+// With blackbox_deferred on, the number of frames TASK_BLACKBOX logged on its first run after a stall
+static uint32_t framesLoggedAfterStall;
+
+// Arm and log a flight of the given number of PID loop iterations over the serial port, return the bytes after the header.
+// With blackbox_deferred on, TASK_BLACKBOX runs after every iteration except iterations 1 to taskStallIterations.
+static std::vector<uint8_t> logFlight(int iterations, int taskStallIterations = 0)
+{
+    const bool deferred = blackboxConfig()->deferred;
+
+    blackboxConfigMutable()->device = BLACKBOX_DEVICE_SERIAL;
+    targetPidLooptime = 500;
+    blackboxInit();
+
+    // D on roll and pitch only, as on most quads
+    pidProfile.pid[FD_ROLL].D = 30;
+    pidProfile.pid[FD_PITCH].D = 32;
+    pidProfile.pid[FD_YAW].D = 0;
+
+    logBytes.clear();
+    randomState = 1;
+    memset(pidData, 0, sizeof(pidData));
+    ENABLE_ARMING_FLAG(ARMED);
+
+    // send the header until the first I-frame follows it
+    size_t frameStart = 0;
+    setFlightState(0);
+    for (int update = 0; !frameStart; update++) {
+        testMillis += 1;
+        blackboxUpdate(0);
+        if (deferred) {
+            blackboxTaskUpdate(0);
+        }
+        for (size_t i = 1; i < logBytes.size(); i++) {
+            if (logBytes[i - 1] == '\n' && logBytes[i] != 'H') {
+                frameStart = i;
+                break;
+            }
+        }
+        if (update >= 100000) {
+            ADD_FAILURE() << "the header never finished";
+            break;
+        }
+    }
+
+    for (int iteration = 1; iteration < iterations; iteration++) {
+        setFlightState(iteration);
+        blackboxUpdate(iteration * targetPidLooptime);
+        if (deferred && iteration > taskStallIterations) {
+            const uint32_t queued = blackboxGetQueuedFrames();
+            blackboxTaskUpdate(iteration * targetPidLooptime);
+            if (iteration == taskStallIterations + 1) {
+                framesLoggedAfterStall = queued - blackboxGetQueuedFrames();
+            }
+        }
+    }
+
+    DISABLE_ARMING_FLAG(ARMED);
+    blackboxConfigMutable()->device = BLACKBOX_DEVICE_NONE;
+    blackboxInit();
+
+    return std::vector<uint8_t>(logBytes.begin() + frameStart, logBytes.end());
+}
+
+TEST(BlackboxTest, Test_CompressedLogSize)
+{
+    blackboxConfigMutable()->sample_rate = 1;
+
+    // both logs as written by the real frame writers, 1kHz logging for one second
+    blackboxConfigMutable()->compression = false;
+    const std::vector<uint8_t> version2 = logFlight(2000);
+    blackboxConfigMutable()->compression = true;
+    const std::vector<uint8_t> version3 = logFlight(2000);
+    blackboxConfigMutable()->compression = false;
+
+    ASSERT_EQ('I', version2[0]);
+    ASSERT_EQ('I', version3[0]);
+
+    // measured 22889 and 18976 bytes, version 3 takes 83% of the space
+    EXPECT_LT(version3.size() * 100, version2.size() * 85);
+}
+
+// Reads a log back the way a data version 3 decoder does
+class LogReader {
+public:
+    explicit LogReader(const std::vector<uint8_t> &bytes) : bytes(bytes) {}
+
+    bool atEnd(void) const { return pos >= bytes.size(); }
+    size_t position(void) const { return pos; }
+    uint8_t readByte(void) { return pos < bytes.size() ? bytes[pos++] : 0; }
+
+    uint32_t readUnsignedVB(void)
+    {
+        uint32_t result = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            const uint8_t byte = readByte();
+            result |= (uint32_t)(byte & 0x7F) << shift;
+            if (byte < 0x80) {
+                break;
+            }
+        }
+        return result;
+    }
+
+    int32_t readSignedVB(void) { return zigzagDecode(readUnsignedVB()); }
+
+    uint32_t readBits(unsigned count)
+    {
+        uint32_t result = 0;
+        while (count--) {
+            if (bit == 0) {
+                current = readByte();
+                bit = 8;
+            }
+            result = (result << 1) | ((current >> --bit) & 1);
+        }
+        return result;
+    }
+
+    // the rest of a partly read byte is padding
+    void alignToByte(void) { bit = 0; }
+
+    static int32_t zigzagDecode(uint32_t value) { return (value >> 1) ^ -(int32_t)(value & 1); }
+
+private:
+    const std::vector<uint8_t> &bytes;
+    size_t pos = 0;
+    uint8_t current = 0;
+    unsigned bit = 0;
+};
+
+TEST(BlackboxTest, Test_DeferredLogMatchesInline)
+{
+    blackboxConfigMutable()->sample_rate = 1;
+    const std::vector<uint8_t> inlineLog = logFlight(1000);
+    blackboxConfigMutable()->deferred = true;
+    const std::vector<uint8_t> deferredLog = logFlight(1000);
+    blackboxConfigMutable()->deferred = false;
+
+    ASSERT_EQ('I', inlineLog[0]);
+    EXPECT_EQ(0U, blackboxGetQueueOverflows());
+    EXPECT_EQ(inlineLog.size(), deferredLog.size());
+    EXPECT_TRUE(inlineLog == deferredLog);
+}
+
+TEST(BlackboxTest, Test_DeferredOverflowResumesAtIFrame)
+{
+    // 1kHz logging from a 2kHz loop, a main frame every other iteration and an I-frame every 64
+    blackboxConfigMutable()->sample_rate = 1;
+    const std::vector<uint8_t> inlineLog = logFlight(400);
+    blackboxConfigMutable()->deferred = true;
+    const std::vector<uint8_t> deferredLog = logFlight(400, 100);
+    blackboxConfigMutable()->deferred = false;
+
+    // the 32 frames from iterations 2 to 64 fill the queue, the frames from 66 are dropped until the I-frame at 128
+    EXPECT_EQ(31U, blackboxGetQueueOverflows());
+    EXPECT_EQ(8U, framesLoggedAfterStall);
+
+    // the log is the same up to the frames that were dropped
+    size_t same = 0;
+    while (same < deferredLog.size() && same < inlineLog.size() && deferredLog[same] == inlineLog[same]) {
+        same++;
+    }
+    ASSERT_LT(same, deferredLog.size());
+
+    // then the gap is marked with a resume event
+    LogReader reader(deferredLog);
+    for (size_t i = 0; i < same; i++) {
+        reader.readByte();
+    }
+    EXPECT_EQ('E', reader.readByte());
+    EXPECT_EQ(FLIGHT_LOG_EVENT_LOGGING_RESUME, reader.readByte());
+    EXPECT_EQ(128U, reader.readUnsignedVB());
+    EXPECT_EQ(128U * 500, reader.readUnsignedVB());
+
+    // and the rest of it is the inline log from the I-frame at 128 on
+    const std::vector<uint8_t> rest(deferredLog.begin() + reader.position(), deferredLog.end());
+    LogReader restReader(rest);
+    EXPECT_EQ('I', restReader.readByte());
+    EXPECT_EQ(128U, restReader.readUnsignedVB());
+    ASSERT_LE(rest.size(), inlineLog.size());
+    EXPECT_TRUE(std::equal(rest.begin(), rest.end(), inlineLog.end() - rest.size()));
+}
+
+// The gathered main fields for the test flight, in P-frame order: time, PID P, I, D (roll and pitch), F, rcCommand,
+// setpoint, gyro and motors
+static const int testFieldCount = 27;
+static const int testRcField = 12;
+static const int testGyroField = 20;
+static const int testMotorField = 23;
+
+static void loadTestFields(int iteration, int32_t *fields)
+{
+    int count = 0;
+    fields[count++] = iteration * targetPidLooptime;
+    for (int x = 0; x < XYZ_AXIS_COUNT; x++) {
+        fields[count++] = lrintf(pidData[x].P);
+    }
+    for (int x = 0; x < XYZ_AXIS_COUNT; x++) {
+        fields[count++] = lrintf(pidData[x].I);
+    }
+    for (int x = 0; x < 2; x++) {
+        fields[count++] = lrintf(pidData[x].D);
+    }
+    for (int x = 0; x < XYZ_AXIS_COUNT; x++) {
+        fields[count++] = lrintf(pidData[x].F);
+    }
+    for (int x = 0; x < 4; x++) {
+        fields[count++] = lrintf(rcCommand[x]);
+    }
+    for (int x = 0; x < XYZ_AXIS_COUNT; x++) {
+        fields[count++] = lrintf(testSetpoint[x]);
+    }
+    fields[count++] = lrintf(mixerGetThrottle() * 1000);
+    for (int x = 0; x < XYZ_AXIS_COUNT; x++) {
+        fields[count++] = lrintf(gyro.gyroADCf[x]);
+    }
+    for (int x = 0; x < 4; x++) {
+        fields[count++] = lrintf(motor[x]);
+    }
+}
+
+static void readTestIntraframe(LogReader &reader, int32_t *fields)
+{
+    int count = 0;
+    fields[count++] = reader.readUnsignedVB();
+    for (int x = 0; x < 11; x++) {
+        fields[count++] = reader.readSignedVB();
+    }
+    for (int x = 0; x < 3; x++) {
+        fields[count++] = reader.readSignedVB();
+    }
+    fields[count++] = reader.readUnsignedVB();
+    for (int x = 0; x < 7; x++) {
+        fields[count++] = reader.readSignedVB();
+    }
+    fields[count++] = reader.readUnsignedVB() + lrintf(getMotorOutputLow());
+    for (int x = 1; x < 4; x++) {
+        fields[count++] = reader.readSignedVB() + fields[testMotorField];
+    }
+}
+
+TEST(BlackboxTest, Test_RateGroupsCarryForward)
+{
+    blackboxConfigMutable()->sample_rate = 1;
+    blackboxConfigMutable()->compression = true;
+    blackboxConfigMutable()->rate_group_denom[BLACKBOX_RATE_GROUP_RC_COMMANDS] = 4;
+    const int iterations = 400;
+    const std::vector<uint8_t> log = logFlight(iterations);
+    blackboxConfigMutable()->rate_group_denom[BLACKBOX_RATE_GROUP_RC_COMMANDS] = 1;
+    blackboxConfigMutable()->compression = false;
+
+    // the values the flight controller had at each iteration
+    std::vector<std::vector<int32_t>> truth(iterations, std::vector<int32_t>(testFieldCount));
+    randomState = 1;
+    memset(pidData, 0, sizeof(pidData));
+    for (int iteration = 0; iteration < iterations; iteration++) {
+        setFlightState(iteration);
+        loadTestFields(iteration, truth[iteration].data());
+    }
+
+    LogReader reader(log);
+    int32_t prev1[testFieldCount] = {};
+    int32_t prev2[testFieldCount] = {};
+    uint8_t predictor[testFieldCount] = {};
+    uint32_t riceSum[testFieldCount] = {};
+    uint32_t riceCount = 1;
+    int iteration = -1;
+    int lastRcIteration = -1;
+    int pFrames = 0;
+    int skippedRc = 0;
+
+    while (!reader.atEnd()) {
+        const uint8_t frameType = reader.readByte();
+        if (frameType == 'S') {
+            reader.readUnsignedVB();
+            reader.readUnsignedVB();
+            reader.readByte();
+            continue;
+        }
+
+        int32_t fields[testFieldCount];
+        bool rcLogged = true;
+        if (frameType == 'I') {
+            iteration = reader.readUnsignedVB();
+            readTestIntraframe(reader, fields);
+            for (int field = 0; field < testFieldCount; field++) {
+                predictor[field] = reader.readBits(BLACKBOX_COMPRESS_PREDICTOR_BITS);
+                prev1[field] = prev2[field] = fields[field];
+                riceSum[field] = 0;
+            }
+            reader.alignToByte();
+            riceCount = 1;
+        } else {
+            ASSERT_EQ('P', frameType) << "after iteration " << iteration;
+            iteration += blackboxPInterval;
+            const int slot = (iteration % blackboxIInterval) / blackboxPInterval;
+            rcLogged = slot % 4 == 0;
+            for (int field = 0; field < testFieldCount; field++) {
+                if (!rcLogged && field >= testRcField && field < testRcField + 4) {
+                    fields[field] = prev1[field];
+                    continue;
+                }
+                uint8_t k = 0;
+                while (k < BLACKBOX_COMPRESS_RICE_MAX_K && (riceCount << k) < riceSum[field]) {
+                    k++;
+                }
+                unsigned quotient = 0;
+                while (quotient < BLACKBOX_COMPRESS_RICE_ESCAPE && reader.readBits(1)) {
+                    quotient++;
+                }
+                const uint32_t value = quotient < BLACKBOX_COMPRESS_RICE_ESCAPE ? (quotient << k) | reader.readBits(k) : reader.readBits(32);
+                riceSum[field] += MIN(value, 1U << BLACKBOX_COMPRESS_RICE_MAX_K);
+
+                uint32_t prediction = prev1[field];
+                if (predictor[field] == 1) {
+                    prediction = 2 * (uint32_t)prev1[field] - (uint32_t)prev2[field];
+                } else if (predictor[field] == 2) {
+                    prediction = (int32_t)(((int64_t)prev1[field] + prev2[field]) / 2);
+                }
+                fields[field] = prediction + LogReader::zigzagDecode(value);
+                prev2[field] = prev1[field];
+                prev1[field] = fields[field];
+            }
+            reader.alignToByte();
+            if (++riceCount == BLACKBOX_COMPRESS_RICE_WINDOW) {
+                for (int field = 0; field < testFieldCount; field++) {
+                    riceSum[field] /= 2;
+                }
+                riceCount /= 2;
+            }
+            pFrames++;
+        }
+
+        ASSERT_LT(iteration, iterations);
+        if (rcLogged) {
+            lastRcIteration = iteration;
+        } else {
+            skippedRc++;
+        }
+        for (int field = 0; field < testFieldCount; field++) {
+            const bool rcField = field >= testRcField && field < testRcField + 4;
+            // a skipped group keeps the value it had when it was last logged
+            EXPECT_EQ(truth[rcField ? lastRcIteration : iteration][field], fields[field]) << "field " << field << " at iteration " << iteration;
+        }
+    }
+
+    // P-frames every 2 iterations between the I-frames every 64, RC commands only in every 4th
+    EXPECT_EQ(iterations / 2 - 7, pFrames);
+    EXPECT_EQ(6 * 24 + 6, skippedRc);
+}
 
 // STUBS
 extern "C" {
@@ -353,8 +853,14 @@ int32_t GPS_home[2];
 gyro_t gyro;
 
 float motor_disarmed[MAX_SUPPORTED_MOTORS];
-struct pidProfile_s;
-struct pidProfile_s *currentPidProfile;
+pidProfile_t *currentPidProfile = &pidProfile;
+pidAxisData_t pidData[XYZ_AXIS_COUNT];
+float rcCommand[4];
+float motor[MAX_SUPPORTED_MOTORS];
+int16_t servo[MAX_SUPPORTED_SERVOS];
+acc_t acc;
+mag_t mag;
+baro_t baro;
 uint32_t targetPidLooptime;
 
 boxBitmask_t rcModeActivationMask;
@@ -366,16 +872,26 @@ uint8_t getMotorCount(void) {return 4;}
 bool areMotorsRunning(void) { return false; }
 bool IS_RC_MODE_ACTIVE(boxId_e) {return false;}
 bool isModeActivationConditionPresent(boxId_e) {return false;}
-uint32_t millis(void) {return 0;}
+uint32_t millis(void) {return testMillis;}
 bool sensors(uint32_t) {return false;}
 void serialWrite(serialPort_t *, uint8_t) {}
-uint32_t serialTxBytesFree(const serialPort_t *) {return 0;}
-bool isSerialTransmitBufferEmpty(const serialPort_t *) {return false;}
+void serialWriteBuf(serialPort_t *, const uint8_t *data, int count) {logBytes.insert(logBytes.end(), data, data + count);}
+uint32_t serialTxBytesFree(const serialPort_t *) {return UINT16_MAX;}
+bool isSerialTransmitBufferEmpty(const serialPort_t *) {return true;}
 bool featureIsEnabled(uint32_t) {return false;}
 void mspSerialReleasePortIfAllocated(serialPort_t *) {}
-const serialPortConfig_t *findSerialPortConfig(serialPortFunction_e ) {return NULL;}
+const serialPortConfig_t *findSerialPortConfig(serialPortFunction_e )
+{
+    static serialPortConfig_t portConfig;
+    portConfig.blackbox_baudrateIndex = BAUD_2000000;
+    return &portConfig;
+}
 serialPort_t *findSharedSerialPort(uint16_t , serialPortFunction_e ) {return NULL;}
-serialPort_t *openSerialPort(serialPortIdentifier_e, serialPortFunction_e, serialReceiveCallbackPtr, void *, uint32_t, portMode_e, portOptions_e) {return NULL;}
+serialPort_t *openSerialPort(serialPortIdentifier_e, serialPortFunction_e, serialReceiveCallbackPtr, void *, uint32_t, portMode_e, portOptions_e)
+{
+    static serialPort_t serialTestPort;
+    return &serialTestPort;
+}
 void closeSerialPort(serialPort_t *) {}
 portSharing_e determinePortSharing(const serialPortConfig_t *, serialPortFunction_e ) {return PORTSHARING_UNUSED;}
 failsafePhase_e failsafePhase(void) {return FAILSAFE_IDLE;}
@@ -383,5 +899,9 @@ bool rxAreFlightChannelsValid(void) {return false;}
 bool rxIsReceivingSignal(void) {return false;}
 bool isRssiConfigured(void) {return false;}
 float getMotorOutputLow(void) {return 0.0;}
+int32_t getAmperageLatest(void) {return 0;}
+uint16_t getRssi(void) {return 0;}
+float mixerGetThrottle(void) {return 0.5f;}
+float pidGetPreviousSetpoint(int axis) {return testSetpoint[axis];}
 float getMotorOutputHigh(void) {return 0.0;}
 }
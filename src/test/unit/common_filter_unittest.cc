@@ -24,6 +24,7 @@
 
 extern "C" {
     #include "common/filter.h"
+    #include "common/notch_bank.h"
 }
 
 #include "unittest_macros.h"
@@ -114,3 +115,114 @@ TEST(FilterUnittest, TestSlewFilter)
     slewFilterApply(&filter, 200.0f);
     EXPECT_EQ(200, filter.state);
 }
+
+TEST(FilterUnittest, TestNotchBankInit)
+{
+    notchBank_t bank;
+
+    notchBankInit(&bank, 12);
+    EXPECT_EQ(12, bank.count);
+    EXPECT_EQ(0, bank.weight[0]);
+
+    notchBankInit(&bank, NOTCH_BANK_SIZE + 1);
+    EXPECT_EQ(NOTCH_BANK_SIZE, bank.count);
+
+    // an empty bank passes values through
+    float values[XYZ_AXIS_COUNT] = { 100.0f, -200.0f, 300.0f };
+    notchBankInit(&bank, 0);
+    notchBankApply(&bank, values);
+    EXPECT_EQ(100, values[0]);
+    EXPECT_EQ(-200, values[1]);
+    EXPECT_EQ(300, values[2]);
+}
+
+TEST(FilterUnittest, TestNotchBankMatchesBiquadCascade)
+{
+    const int notchCount = 12;
+    const uint32_t looptimeUs = 125;
+    const float q = 5.0f;
+
+    notchBank_t bank;
+    biquadFilter_t reference[XYZ_AXIS_COUNT][notchCount];
+
+    notchBankInit(&bank, notchCount);
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        for (int i = 0; i < notchCount; i++) {
+            biquadFilterInit(&reference[axis][i], 100.0f, looptimeUs, q, FILTER_NOTCH, 0.0f);
+        }
+    }
+
+    float maxError = 0.0f;
+    for (int n = 0; n < 4000; n++) {
+        // sweep the notches like the RPM filter does, including faded out ones
+        if (n % 500 == 0) {
+            for (int i = 0; i < notchCount; i++) {
+                const float frequencyHz = 80.0f + 250.0f * i + 0.05f * n;
+                const float weight = (i % 4 == 0) ? 0.5f : 1.0f;
+                notchBankUpdate(&bank, i, frequencyHz, looptimeUs, q, weight);
+                for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+                    biquadFilterUpdate(&reference[axis][i], frequencyHz, looptimeUs, q, FILTER_NOTCH, weight);
+                }
+            }
+        }
+
+        const float t = n * looptimeUs * 1e-6f;
+        float values[XYZ_AXIS_COUNT];
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            values[axis] = 200.0f * sinf(2 * M_PI * (150.0f + 100.0f * axis) * t) + 50.0f * sinf(2 * M_PI * 1234.0f * t) + 10.0f * axis;
+        }
+
+        float expected[XYZ_AXIS_COUNT];
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            expected[axis] = values[axis];
+            for (int i = 0; i < notchCount; i++) {
+                expected[axis] = biquadFilterApplyDF1Weighted(&reference[axis][i], expected[axis]);
+            }
+        }
+
+        notchBankApply(&bank, values);
+
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            maxError = fmaxf(maxError, fabsf(values[axis] - expected[axis]));
+        }
+    }
+
+    // only the evaluation order differs from biquadFilterApplyDF1Weighted()
+    EXPECT_LT(maxError, 1e-2f);
+}
+
+TEST(FilterUnittest, TestNotchBankTableError)
+{
+    const uint32_t looptimes[] = { 125, 250, 500 };
+    const float q = 5.0f;
+
+    notchBankTable_t table;
+    notchBank_t bank;
+    notchBankInit(&bank, 1);
+
+    for (const uint32_t looptimeUs : looptimes) {
+        notchBankTableInit(&table, looptimeUs, q);
+
+        // worst case interpolation error versus the exact coefficients over the RPM filter range
+        const float maxHz = 0.48f * 1e6f / looptimeUs;
+        float maxError = 0.0f;
+        for (float frequencyHz = 50.0f; frequencyHz < maxHz; frequencyHz += 0.37f) {
+            biquadFilter_t exact;
+            biquadFilterUpdate(&exact, frequencyHz, looptimeUs, q, FILTER_NOTCH, 1.0f);
+            notchBankUpdateFromTable(&bank, 0, &table, frequencyHz, 1.0f);
+
+            maxError = fmaxf(maxError, fabsf(bank.b0[0] - exact.b0));
+            maxError = fmaxf(maxError, fabsf(bank.b1[0] - exact.b1));
+            maxError = fmaxf(maxError, fabsf(bank.a2[0] - exact.a2));
+        }
+
+        EXPECT_LT(maxError, 1e-4f);
+    }
+
+    // out of range frequencies are clamped to the table
+    notchBankUpdateFromTable(&bank, 0, &table, -10.0f, 0.5f);
+    EXPECT_FLOAT_EQ(table.b1[0], bank.b1[0]);
+    EXPECT_EQ(0.5f, bank.weight[0]);
+    notchBankUpdateFromTable(&bank, 0, &table, 1e6f, 1.0f);
+    EXPECT_FLOAT_EQ(table.b1[NOTCH_BANK_TABLE_STEPS], bank.b1[0]);
+}
@@ -0,0 +1,220 @@
+/*
+ * This file is part of Cleanflight and Betaflight.
+ *
+ * Cleanflight and Betaflight are free software. You can redistribute
+ * this software and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Cleanflight and Betaflight are distributed in the hope that they
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <math.h>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "build/debug.h"
+    #include "common/axis.h"
+    #include "common/maths.h"
+    #include "flight/dyn_notch_filter.h"
+    #include "sensors/gyro.h"
+
+    uint8_t debugMode;
+    int16_t debug[DEBUG16_VALUE_COUNT];
+    gyro_t gyro;
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+// Host harness: runs a gyro trace through dynNotchPush/dynNotchUpdate/dynNotchFilter at 8kHz
+// and measures how well the notches follow a motor noise peak and the delay they add.
+
+#define LOOPTIME_US      125
+#define CONTROL_TONE_HZ  40.0f
+
+typedef float (*peakFreqFn)(float t);
+
+typedef struct trackingResult_s {
+    float rmsErrorHz;   // distance of the closest active notch to the true peak
+    float delayUs;      // phase delay of the dyn notch chain at CONTROL_TONE_HZ
+    float minWeight;    // smallest depth of the notch on the peak
+} trackingResult_t;
+
+static uint32_t noiseState;
+
+static float noise(void)
+{
+    noiseState = noiseState * 1664525u + 1013904223u;
+    return ((noiseState >> 8) / 16777216.0f - 0.5f) * 2.0f;
+}
+
+static trackingResult_t runTrace(peakFreqFn peakFreq, float durationS, float peakAmplitude, float noiseAmplitude)
+{
+    const dynNotchConfig_t config = {
+        .dyn_notch_min_hz = 100,
+        .dyn_notch_max_hz = 600,
+        .dyn_notch_q = 300,
+        .dyn_notch_count = 3,
+    };
+
+    noiseState = 12345;
+    gyro.gyroDebugAxis = FD_ROLL;
+    dynNotchInit(&config, LOOPTIME_US);
+
+    const float dt = LOOPTIME_US * 1e-6f;
+    const int loops = durationS / dt;
+    const int settleLoops = loops / 4;
+
+    float phase = 0.0f;
+    double errorSq = 0.0;
+    int errorCount = 0;
+    float minWeight = 1.0f;
+    double inI = 0, inQ = 0, outI = 0, outQ = 0;
+
+    for (int n = 0; n < loops; n++) {
+        const float t = n * dt;
+        const float freq = peakFreq(t);
+        phase += 2.0f * M_PIf * freq * dt;
+
+        const float control = 50.0f * cosf(2.0f * M_PIf * CONTROL_TONE_HZ * t);
+        float value[XYZ_AXIS_COUNT];
+        value[FD_ROLL] = control + peakAmplitude * sinf(phase) + noiseAmplitude * noise();
+        value[FD_PITCH] = noiseAmplitude * noise();
+        value[FD_YAW] = noiseAmplitude * noise();
+
+        float out = 0.0f;
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            dynNotchPush(axis, value[axis]);
+            const float filtered = dynNotchFilter(axis, value[axis]);
+            if (axis == FD_ROLL) {
+                out = filtered;
+            }
+        }
+        dynNotchUpdate();
+
+        if (n >= settleLoops) {
+            // lock-in measurement of the control tone
+            const float c = cosf(2.0f * M_PIf * CONTROL_TONE_HZ * t);
+            const float s = sinf(2.0f * M_PIf * CONTROL_TONE_HZ * t);
+            inI += value[FD_ROLL] * c;
+            inQ += value[FD_ROLL] * s;
+            outI += out * c;
+            outQ += out * s;
+
+            if (n % 8 == 0) {
+                int closest = 0;
+                for (int p = 1; p < config.dyn_notch_count; p++) {
+                    if (fabsf(dynNotchGetCenterFreq(FD_ROLL, p) - freq) < fabsf(dynNotchGetCenterFreq(FD_ROLL, closest) - freq)) {
+                        closest = p;
+                    }
+                }
+                errorSq += sq(dynNotchGetCenterFreq(FD_ROLL, closest) - freq);
+                errorCount++;
+                minWeight = MIN(minWeight, dynNotchGetWeight(FD_ROLL, closest));
+            }
+        }
+    }
+
+    const float phaseDelay = atan2f(inQ, inI) - atan2f(outQ, outI);
+
+    trackingResult_t result = {
+        .rmsErrorHz = sqrtf(errorSq / errorCount),
+        .delayUs = -phaseDelay / (2.0f * M_PIf * CONTROL_TONE_HZ) * 1e6f,
+        .minWeight = minWeight,
+    };
+
+    return result;
+}
+
+static float steadyPeak(float t)
+{
+    UNUSED(t);
+    return 280.0f;
+}
+
+static float throttlePunch(float t)
+{
+    // cruise, then ramp the motor noise from 200Hz to 450Hz within 250ms and back
+    if (t < 1.0f) {
+        return 200.0f;
+    } else if (t < 1.25f) {
+        return 200.0f + 1000.0f * (t - 1.0f);
+    } else if (t < 2.0f) {
+        return 450.0f;
+    } else if (t < 2.25f) {
+        return 450.0f - 1000.0f * (t - 2.0f);
+    }
+    return 200.0f;
+}
+
+TEST(DynNotchUnittest, TestSteadyPeak)
+{
+    const trackingResult_t result = runTrace(steadyPeak, 2.0f, 100.0f, 20.0f);
+
+    EXPECT_LT(result.rmsErrorHz, 3.0f);
+    EXPECT_GT(result.minWeight, 0.9f);
+    EXPECT_LT(fabsf(result.delayUs), 500.0f) << "delay at " << CONTROL_TONE_HZ << " Hz";
+}
+
+TEST(DynNotchUnittest, TestThrottlePunch)
+{
+    const trackingResult_t result = runTrace(throttlePunch, 3.0f, 100.0f, 20.0f);
+
+    EXPECT_LT(result.rmsErrorHz, 18.0f);
+    EXPECT_LT(fabsf(result.delayUs), 500.0f) << "delay at " << CONTROL_TONE_HZ << " Hz";
+}
+
+TEST(DynNotchUnittest, TestNotchFadesWithoutPeak)
+{
+    const dynNotchConfig_t config = {
+        .dyn_notch_min_hz = 100,
+        .dyn_notch_max_hz = 600,
+        .dyn_notch_q = 300,
+        .dyn_notch_count = 3,
+    };
+    dynNotchInit(&config, LOOPTIME_US);
+    EXPECT_TRUE(isDynNotchActive());
+
+    // broadband noise has no peaks worth tracking, notches should mostly turn themselves off
+    noiseState = 4711;
+    float weightSum = 0.0f;
+    int weightCount = 0;
+    for (int n = 0; n < 16000; n++) {
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            dynNotchPush(axis, 20.0f * noise());
+        }
+        dynNotchUpdate();
+
+        if (n >= 8000 && n % 8 == 0) {
+            for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+                for (int p = 0; p < config.dyn_notch_count; p++) {
+                    weightSum += dynNotchGetWeight(axis, p);
+                    weightCount++;
+                }
+            }
+        }
+    }
+
+    EXPECT_LT(weightSum / weightCount, 0.5f);
+}
+
+// STUBS
+
+extern "C" {
+    uint32_t micros(void) { return 0; }
+    uint8_t calculateThrottlePercentAbs(void) { return 50; }
+}
@@ -0,0 +1,166 @@
+/*
+ * This file is part of Cleanflight and Betaflight.
+ *
+ * Cleanflight and Betaflight are free software. You can redistribute
+ * this software and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Cleanflight and Betaflight are distributed in the hope that they
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <math.h>
+
+extern "C" {
+    #include "common/filter.h"
+    #include "common/filter_chain.h"
+    #include "common/maths.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define LOOPTIME_US 125
+#define LPF_HZ 150
+
+static const char * const lowpassNames[FILTER_CHAIN_LPF_COUNT] = { "NONE", "PT1", "BIQUAD", "PT2", "PT3" };
+
+// Reference implementation, the per axis function pointer cascade the chain replaces
+typedef struct referenceChain_s {
+    filterApplyFnPtr notchApplyFn[FILTER_CHAIN_NOTCH_MAX];
+    biquadFilter_t notch[FILTER_CHAIN_NOTCH_MAX][XYZ_AXIS_COUNT];
+    filterApplyFnPtr lowpassApplyFn;
+    filterChainLowpass_t lowpass[XYZ_AXIS_COUNT];
+} referenceChain_t;
+
+static void initLowpass(filterChainLowpass_t *lowpass, filterChainLowpass_e type)
+{
+    const float dT = LOOPTIME_US * 1e-6f;
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        switch (type) {
+        case FILTER_CHAIN_LPF_PT1:
+            pt1FilterInit(&lowpass[axis].pt1, pt1FilterGain(LPF_HZ, dT));
+            break;
+        case FILTER_CHAIN_LPF_BIQUAD:
+            biquadFilterInitLPF(&lowpass[axis].biquad, LPF_HZ, LOOPTIME_US);
+            break;
+        case FILTER_CHAIN_LPF_PT2:
+            pt2FilterInit(&lowpass[axis].pt2, pt2FilterGain(LPF_HZ, dT));
+            break;
+        case FILTER_CHAIN_LPF_PT3:
+            pt3FilterInit(&lowpass[axis].pt3, pt3FilterGain(LPF_HZ, dT));
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+static void initChains(filterChain_t *chain, referenceChain_t *reference, int notchCount, filterChainLowpass_e lowpassType)
+{
+    static const float notchHz[FILTER_CHAIN_NOTCH_MAX] = { 260.0f, 190.0f };
+
+    filterChainInit(chain);
+    memset(reference, 0, sizeof(*reference));
+
+    for (int i = 0; i < FILTER_CHAIN_NOTCH_MAX; i++) {
+        reference->notchApplyFn[i] = nullFilterApply;
+        if (i < notchCount) {
+            const float q = filterGetNotchQ(notchHz[i], notchHz[i] * 0.7f);
+            EXPECT_TRUE(filterChainAddNotch(chain, notchHz[i], q, LOOPTIME_US));
+            reference->notchApplyFn[i] = (filterApplyFnPtr)biquadFilterApply;
+            for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+                biquadFilterInit(&reference->notch[i][axis], notchHz[i], LOOPTIME_US, q, FILTER_NOTCH, 1.0f);
+            }
+        }
+    }
+
+    static const filterApplyFnPtr lowpassApplyFn[FILTER_CHAIN_LPF_COUNT] = {
+        nullFilterApply,
+        (filterApplyFnPtr)pt1FilterApply,
+        (filterApplyFnPtr)biquadFilterApply,
+        (filterApplyFnPtr)pt2FilterApply,
+        (filterApplyFnPtr)pt3FilterApply,
+    };
+    filterChainSetLowpass(chain, lowpassType);
+    initLowpass(chain->lowpass, lowpassType);
+    reference->lowpassApplyFn = lowpassApplyFn[lowpassType];
+    initLowpass(reference->lowpass, lowpassType);
+}
+
+static void referenceApply(referenceChain_t *reference, float *values)
+{
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        float value = values[axis];
+        for (int i = 0; i < FILTER_CHAIN_NOTCH_MAX; i++) {
+            value = reference->notchApplyFn[i]((filter_t *)&reference->notch[i][axis], value);
+        }
+        values[axis] = reference->lowpassApplyFn((filter_t *)&reference->lowpass[axis], value);
+    }
+}
+
+static float sample(int n, int axis)
+{
+    const float t = n * LOOPTIME_US * 1e-6f;
+    return 200.0f * sinf(2 * M_PIf * 30.0f * t + axis) + 50.0f * sinf(2 * M_PIf * 260.0f * t) + 20.0f * sinf(2 * M_PIf * (190.0f + 5 * axis) * t);
+}
+
+TEST(FilterChainUnittest, TestChainInit)
+{
+    filterChain_t chain;
+    filterChainInit(&chain);
+
+    float values[XYZ_AXIS_COUNT] = { 1.0f, -2.0f, 3.0f };
+    filterChainApply(&chain, values);
+    EXPECT_EQ(1.0f, values[0]);
+    EXPECT_EQ(-2.0f, values[1]);
+    EXPECT_EQ(3.0f, values[2]);
+
+    EXPECT_TRUE(filterChainAddNotch(&chain, 200.0f, 3.0f, LOOPTIME_US));
+    EXPECT_TRUE(filterChainAddNotch(&chain, 300.0f, 3.0f, LOOPTIME_US));
+    EXPECT_FALSE(filterChainAddNotch(&chain, 400.0f, 3.0f, LOOPTIME_US));
+    EXPECT_EQ(FILTER_CHAIN_NOTCH_MAX, chain.notchCount);
+
+    EXPECT_EQ(FILTER_CHAIN_LPF_PT1, filterChainLowpassType(FILTER_PT1));
+    EXPECT_EQ(FILTER_CHAIN_LPF_BIQUAD, filterChainLowpassType(FILTER_BIQUAD));
+    EXPECT_EQ(FILTER_CHAIN_LPF_PT3, filterChainLowpassType(FILTER_PT3));
+}
+
+TEST(FilterChainUnittest, TestKernelsMatchFilterCascade)
+{
+    for (int notchCount = 0; notchCount <= FILTER_CHAIN_NOTCH_MAX; notchCount++) {
+        for (int lowpassType = 0; lowpassType < FILTER_CHAIN_LPF_COUNT; lowpassType++) {
+            filterChain_t chain;
+            referenceChain_t reference;
+            initChains(&chain, &reference, notchCount, (filterChainLowpass_e)lowpassType);
+
+            float maxError = 0;
+            for (int n = 0; n < 2000; n++) {
+                float values[XYZ_AXIS_COUNT];
+                float expected[XYZ_AXIS_COUNT];
+                for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+                    values[axis] = expected[axis] = sample(n, axis);
+                }
+                filterChainApply(&chain, values);
+                referenceApply(&reference, expected);
+                for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+                    maxError = fmaxf(maxError, fabsf(values[axis] - expected[axis]));
+                }
+            }
+            EXPECT_LT(maxError, 1e-3f) << notchCount << " notches, lowpass " << lowpassNames[lowpassType];
+        }
+    }
+}
@@ -0,0 +1,330 @@
+/*
+ * This file is part of Cleanflight and Betaflight.
+ *
+ * Cleanflight and Betaflight are free software. You can redistribute
+ * this software and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Cleanflight and Betaflight are distributed in the hope that they
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <math.h>
+
+extern "C" {
+    #include "common/filter.h"
+    #include "common/filter_chain.h"
+    #include "common/filter_fixed.h"
+    #include "common/maths.h"
+    #include "common/notch_bank.h"
+    #include "common/utils.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define LOOPTIME_US 125
+#define SAMPLE_RATE_HZ (1e6f / LOOPTIME_US)
+#define CUTOFF_HZ 100
+
+typedef enum {
+    TEST_PT1,
+    TEST_PT2,
+    TEST_PT3,
+    TEST_BIQUAD_LPF,
+    TEST_BIQUAD_NOTCH,
+    TEST_FILTER_COUNT
+} testFilter_e;
+
+static const char * const testFilterNames[TEST_FILTER_COUNT] = { "PT1", "PT2", "PT3", "BIQUAD_LPF", "BIQUAD_NOTCH" };
+
+// The same filter in float and in fixed point, fed with identical samples
+typedef struct filterPair_s {
+    testFilter_e type;
+    filterChainLowpass_t filter;
+    filterChainLowpass_t fixed;
+} filterPair_t;
+
+static void filterPairInit(filterPair_t *pair, testFilter_e type)
+{
+    const float dT = LOOPTIME_US * 1e-6f;
+    pair->type = type;
+
+    switch (type) {
+    case TEST_PT1:
+        pt1FilterInit(&pair->filter.pt1, pt1FilterGain(CUTOFF_HZ, dT));
+        pt1FilterFixedInit(&pair->fixed.pt1Fixed, pt1FilterGain(CUTOFF_HZ, dT));
+        break;
+    case TEST_PT2:
+        pt2FilterInit(&pair->filter.pt2, pt2FilterGain(CUTOFF_HZ, dT));
+        pt2FilterFixedInit(&pair->fixed.pt2Fixed, pt2FilterGain(CUTOFF_HZ, dT));
+        break;
+    case TEST_PT3:
+        pt3FilterInit(&pair->filter.pt3, pt3FilterGain(CUTOFF_HZ, dT));
+        pt3FilterFixedInit(&pair->fixed.pt3Fixed, pt3FilterGain(CUTOFF_HZ, dT));
+        break;
+    case TEST_BIQUAD_LPF:
+        biquadFilterInitLPF(&pair->filter.biquad, CUTOFF_HZ, LOOPTIME_US);
+        biquadFilterFixedInit(&pair->fixed.biquadFixed, &pair->filter.biquad);
+        break;
+    case TEST_BIQUAD_NOTCH:
+        biquadFilterInit(&pair->filter.biquad, 200, LOOPTIME_US, filterGetNotchQ(200, 150), FILTER_NOTCH, 1.0f);
+        biquadFilterFixedInit(&pair->fixed.biquadFixed, &pair->filter.biquad);
+        break;
+    default:
+        break;
+    }
+}
+
+static void filterPairApply(filterPair_t *pair, float input, float *output, float *outputFixed)
+{
+    const int32_t inputFixed = fixedFromFloat(input);
+
+    switch (pair->type) {
+    case TEST_PT1:
+        *output = pt1FilterApply(&pair->filter.pt1, input);
+        *outputFixed = fixedToFloat(pt1FilterFixedApply(&pair->fixed.pt1Fixed, inputFixed));
+        break;
+    case TEST_PT2:
+        *output = pt2FilterApply(&pair->filter.pt2, input);
+        *outputFixed = fixedToFloat(pt2FilterFixedApply(&pair->fixed.pt2Fixed, inputFixed));
+        break;
+    case TEST_PT3:
+        *output = pt3FilterApply(&pair->filter.pt3, input);
+        *outputFixed = fixedToFloat(pt3FilterFixedApply(&pair->fixed.pt3Fixed, inputFixed));
+        break;
+    default:
+        *output = biquadFilterApplyDF1(&pair->filter.biquad, input);
+        *outputFixed = fixedToFloat(biquadFilterFixedApplyDF1(&pair->fixed.biquadFixed, inputFixed));
+        break;
+    }
+}
+
+static uint32_t noiseSeed = 1;
+
+// uniform in [-1, 1)
+static float noise(void)
+{
+    noiseSeed = noiseSeed * 1664525u + 1013904223u;
+    return (int32_t)noiseSeed * (1.0f / 2147483648.0f);
+}
+
+TEST(FilterFixedUnittest, TestConversions)
+{
+    EXPECT_EQ(1 << FIXED_SAMPLE_SHIFT, fixedFromFloat(1.0f));
+    EXPECT_EQ(-(3 << (FIXED_SAMPLE_SHIFT - 1)), fixedFromFloat(-1.5f));
+    EXPECT_FLOAT_EQ(-1.5f, fixedToFloat(fixedFromFloat(-1.5f)));
+    EXPECT_FLOAT_EQ(123.25f, fixedToFloat(fixedFromFloat(123.25f)));
+
+    // samples saturate at the limit instead of wrapping
+    EXPECT_FLOAT_EQ(FIXED_SAMPLE_LIMIT, fixedToFloat(fixedFromFloat(1e6f)));
+    EXPECT_FLOAT_EQ(-FIXED_SAMPLE_LIMIT, fixedToFloat(fixedFromFloat(-1e6f)));
+
+    EXPECT_EQ(0, fixedGain(0.0f));
+    EXPECT_EQ(1 << 30, fixedGain(0.5f));
+    EXPECT_EQ(INT32_MAX, fixedGain(1.0f));
+    EXPECT_EQ(0, fixedGain(-0.5f));
+
+    EXPECT_EQ(1 << FIXED_COEFF_SHIFT, fixedCoeff(1.0f));
+    EXPECT_EQ(-(1 << FIXED_COEFF_SHIFT), fixedCoeff(-1.0f));
+    EXPECT_EQ(INT32_MIN, fixedCoeff(-2.0f));
+    EXPECT_EQ(INT32_MAX, fixedCoeff(2.0f));
+
+    EXPECT_EQ(INT32_MAX, fixedSaturate(1LL << 40));
+    EXPECT_EQ(INT32_MIN, fixedSaturate(-(1LL << 40)));
+}
+
+// Compares the gain of the float and the fixed point filter for sine inputs across the spectrum
+TEST(FilterFixedUnittest, TestFrequencyResponse)
+{
+    static const float frequencies[] = { 10, 50, 100, 150, 200, 250, 500, 1000, 2000, 3500 };
+
+    for (int type = 0; type < TEST_FILTER_COUNT; type++) {
+        for (unsigned f = 0; f < ARRAYLEN(frequencies); f++) {
+            filterPair_t pair;
+            filterPairInit(&pair, (testFilter_e)type);
+
+            const int settle = 4000;
+            const int measure = 8000;
+            double sumSq = 0, sumSqFixed = 0;
+            for (int n = 0; n < settle + measure; n++) {
+                const float input = 500.0f * sinf(2 * M_PIf * frequencies[f] * n / SAMPLE_RATE_HZ);
+                float output, outputFixed;
+                filterPairApply(&pair, input, &output, &outputFixed);
+                if (n >= settle) {
+                    sumSq += output * output;
+                    sumSqFixed += outputFixed * outputFixed;
+                }
+            }
+            const double gain = sqrt(sumSq / measure) / (500.0 / sqrt(2.0));
+            const double gainFixed = sqrt(sumSqFixed / measure) / (500.0 / sqrt(2.0));
+
+            // within 0.01 dB, or 1e-5 absolute where the filter attenuates strongly
+            const double dB = 20 * log10(gainFixed / gain);
+            EXPECT_TRUE(fabs(dB) < 0.01 || fabs(gainFixed - gain) < 1e-5)
+                << testFilterNames[type] << " at " << frequencies[f] << "Hz: gain " << gain << " fixed " << gainFixed;
+        }
+    }
+}
+
+// Error of the fixed point output relative to float, for quiet and for full scale input
+TEST(FilterFixedUnittest, TestNoiseFloor)
+{
+    static const float amplitudes[] = { 0.05f, 2000.0f };
+
+    for (int type = 0; type < TEST_FILTER_COUNT; type++) {
+        for (unsigned a = 0; a < ARRAYLEN(amplitudes); a++) {
+            filterPair_t pair;
+            filterPairInit(&pair, (testFilter_e)type);
+            noiseSeed = 1;
+
+            const int count = 20000;
+            double errorSq = 0;
+            for (int n = 0; n < count; n++) {
+                const float input = amplitudes[a] * noise();
+                float output, outputFixed;
+                filterPairApply(&pair, input, &output, &outputFixed);
+                errorSq += (outputFixed - output) * (outputFixed - output);
+            }
+            const double errorRms = sqrt(errorSq / count);
+
+            // a few LSB of Q16.16 for quiet input, float rounding dominates at full scale
+            const double limit = a == 0 ? 2e-4 : 2000.0 * 5e-6;
+            EXPECT_LT(errorRms, limit) << testFilterNames[type] << " amplitude " << amplitudes[a];
+        }
+    }
+}
+
+TEST(FilterFixedUnittest, TestSaturation)
+{
+    for (int type = 0; type < TEST_FILTER_COUNT; type++) {
+        filterPair_t pair;
+        filterPairInit(&pair, (testFilter_e)type);
+
+        // a step far beyond the sample limit must not wrap around
+        float output, outputFixed;
+        float minFixed = 0;
+        for (int n = 0; n < 2000; n++) {
+            filterPairApply(&pair, n & 1 ? 50000.0f : 40000.0f, &output, &outputFixed);
+            minFixed = fminf(minFixed, outputFixed);
+        }
+        EXPECT_GT(outputFixed, 0.9f * FIXED_SAMPLE_LIMIT) << testFilterNames[type];
+        EXPECT_GT(minFixed, -0.5f * FIXED_SAMPLE_LIMIT) << testFilterNames[type];
+    }
+}
+
+static void initChain(filterChain_t *chain, filterChainLowpass_e lowpassType)
+{
+    const float dT = LOOPTIME_US * 1e-6f;
+
+    filterChainInit(chain);
+    filterChainAddNotch(chain, 260, filterGetNotchQ(260, 180), LOOPTIME_US);
+    filterChainAddNotch(chain, 180, filterGetNotchQ(180, 120), LOOPTIME_US);
+    filterChainSetLowpass(chain, lowpassType);
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        switch (lowpassType) {
+        case FILTER_CHAIN_LPF_PT1:
+            pt1FilterInit(&chain->lowpass[axis].pt1, pt1FilterGain(CUTOFF_HZ, dT));
+            break;
+        case FILTER_CHAIN_LPF_BIQUAD:
+            biquadFilterInitLPF(&chain->lowpass[axis].biquad, CUTOFF_HZ, LOOPTIME_US);
+            break;
+        case FILTER_CHAIN_LPF_PT2:
+            pt2FilterInit(&chain->lowpass[axis].pt2, pt2FilterGain(CUTOFF_HZ, dT));
+            break;
+        case FILTER_CHAIN_LPF_PT3:
+            pt3FilterInit(&chain->lowpass[axis].pt3, pt3FilterGain(CUTOFF_HZ, dT));
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+TEST(FilterFixedUnittest, TestChainMatchesFloat)
+{
+    for (int lowpassType = 0; lowpassType < FILTER_CHAIN_LPF_COUNT; lowpassType++) {
+        filterChain_t chain;
+        filterChain_t chainFixed;
+        initChain(&chain, (filterChainLowpass_e)lowpassType);
+        initChain(&chainFixed, (filterChainLowpass_e)lowpassType);
+        filterChainSetFixedPoint(&chainFixed, true);
+        EXPECT_TRUE(chainFixed.fixedPoint);
+
+        float maxError = 0;
+        for (int n = 0; n < 4000; n++) {
+            // move the lowpass cutoff half way through, as the dynamic lowpass does
+            if (n == 2000) {
+                const float k = pt1FilterGain(2 * CUTOFF_HZ, LOOPTIME_US * 1e-6f);
+                filterChainUpdateLowpassGain(&chain, k);
+                filterChainUpdateLowpassGain(&chainFixed, k);
+                filterChainUpdateLowpassBiquad(&chain, 2 * CUTOFF_HZ, LOOPTIME_US);
+                filterChainUpdateLowpassBiquad(&chainFixed, 2 * CUTOFF_HZ, LOOPTIME_US);
+            }
+            float values[XYZ_AXIS_COUNT];
+            float valuesFixed[XYZ_AXIS_COUNT];
+            for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+                values[axis] = valuesFixed[axis] = 300.0f * sinf(2 * M_PIf * (40 + 90 * axis) * n / SAMPLE_RATE_HZ) + 20.0f * noise();
+            }
+            filterChainApply(&chain, values);
+            filterChainApply(&chainFixed, valuesFixed);
+            for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+                maxError = fmaxf(maxError, fabsf(values[axis] - valuesFixed[axis]));
+            }
+        }
+        // float notches run in direct form 2, fixed point in direct form 1.
+        // USE_DYN_LPF is defined so the float biquad lowpass is direct form 1 as well,
+        // direct form 2 would disagree after the cutoff change.
+        EXPECT_LT(maxError, 1e-2f) << "lowpass type " << lowpassType;
+    }
+}
+
+TEST(FilterFixedUnittest, TestNotchBankMatchesFloat)
+{
+    static notchBankTable_t table;
+    static notchBank_t bank;
+    static notchBank_t bankFixed;
+
+    const float q = 5.0f;
+    const int count = 12;
+    notchBankTableInit(&table, LOOPTIME_US, q);
+    notchBankInit(&bank, count);
+    notchBankInit(&bankFixed, count);
+    notchBankSetFixedPoint(&bankFixed, true);
+
+    float maxError = 0;
+    for (int n = 0; n < 8000; n++) {
+        // sweeping notches with changing weights, as the RPM filter does
+        for (int i = 0; i < count; i++) {
+            const float frequencyHz = 100.0f + 25.0f * i + 80.0f * sinf(2 * M_PIf * n / 4000.0f);
+            const float weight = constrainf(0.5f + sinf(2 * M_PIf * (n + 300 * i) / 3000.0f), 0.0f, 1.0f);
+            notchBankUpdateFromTable(&bank, i, &table, frequencyHz, weight);
+            notchBankUpdateFromTable(&bankFixed, i, &table, frequencyHz, weight);
+        }
+
+        float values[XYZ_AXIS_COUNT];
+        float valuesFixed[XYZ_AXIS_COUNT];
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            values[axis] = valuesFixed[axis] = 200.0f * sinf(2 * M_PIf * (150 + 60 * axis) * n / SAMPLE_RATE_HZ) + 10.0f * noise();
+        }
+        notchBankApply(&bank, values);
+        notchBankApply(&bankFixed, valuesFixed);
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            maxError = fmaxf(maxError, fabsf(values[axis] - valuesFixed[axis]));
+        }
+    }
+    // coefficients change every sample, float rounding differs slightly from the integer path
+    EXPECT_LT(maxError, 5e-2f);
+}
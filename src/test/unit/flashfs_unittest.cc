@@ -0,0 +1,712 @@
+/*
+ * This file is part of Cleanflight and Betaflight.
+ *
+ * Cleanflight and Betaflight are free software. You can redistribute
+ * this software and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Cleanflight and Betaflight are distributed in the hope that they
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <vector>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "common/maths.h"
+    #include "common/utils.h"
+
+    #include "drivers/flash.h"
+
+    #include "io/flashfs.h"
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+// A NOR flash with 256 byte pages. A program hands the data over by DMA, which takes dmaUs, after which the
+// driver calls back, and the device then stays busy for programUs. A sector erase keeps it busy for FAKE_ERASE_US.
+#define FAKE_PAGE_SIZE      256
+#define FAKE_SECTOR_SIZE    4096
+#define FAKE_SECTORS        64
+#define FAKE_SIZE           (FAKE_SECTOR_SIZE * FAKE_SECTORS)
+#define FAKE_ERASE_US       2000
+#define FAKE_VOLUME_SIZE    (FAKE_SIZE - FAKE_SECTOR_SIZE)   // the last sector holds the log index
+#define FAKE_RECORD_SIZE    64                                // a log index record, the header is the first
+
+typedef struct fakeProgram_s {
+    uint32_t address;
+    uint32_t length;
+    uint32_t startUs;
+} fakeProgram_t;
+
+static uint8_t fakeMemory[FAKE_SIZE];
+static std::vector<fakeProgram_t> fakePrograms;
+static std::vector<uint32_t> fakeErases;
+static uint32_t fakeTimeUs;
+static uint32_t fakeBusyUntilUs;
+static uint32_t fakeDmaDoneUs;
+static uint32_t fakeDmaUs;
+static uint32_t fakeProgramUs;
+static bool fakeCallbackImmediate;     // like a driver that programs synchronously within Continue
+static uint32_t fakePendingCallback;   // bytes of a DMA transfer still to call back for
+
+static uint32_t fakeProgramAddress;
+static void (*fakeCallback)(uint32_t arg);
+
+static flashGeometry_t fakeGeometry;
+static flashPartition_t fakePartition;
+
+static void fakeFlashAdvance(uint32_t us)
+{
+    for (uint32_t i = 0; i < us; i++) {
+        fakeTimeUs++;
+        if (fakePendingCallback && fakeTimeUs >= fakeDmaDoneUs) {
+            const uint32_t length = fakePendingCallback;
+            fakePendingCallback = 0;
+            if (fakeCallback) {
+                fakeCallback(length);
+            }
+        }
+    }
+}
+
+// Runs the device until the transfer in flight has been called back and the device is idle
+static void fakeFlashSettle(void)
+{
+    while (fakePendingCallback || fakeTimeUs < fakeBusyUntilUs) {
+        fakeFlashAdvance(1);
+    }
+}
+
+static void resetFlash(bool callbackImmediate, uint32_t dmaUs, uint32_t programUs, uint16_t eraseAheadSectors = 0)
+{
+    // let the previous test's writes finish first
+    if (fakeCallback) {
+        fakeFlashSettle();
+        flashfsFlushSync();
+    }
+
+    memset(fakeMemory, 0xff, sizeof(fakeMemory));
+    fakePrograms.clear();
+    fakeErases.clear();
+    fakeTimeUs = 0;
+    fakeBusyUntilUs = 0;
+    fakeDmaDoneUs = 0;
+    fakePendingCallback = 0;
+    fakeCallbackImmediate = callbackImmediate;
+    fakeDmaUs = dmaUs;
+    fakeProgramUs = programUs;
+
+    fakeGeometry.sectors = FAKE_SECTORS;
+    fakeGeometry.pageSize = FAKE_PAGE_SIZE;
+    fakeGeometry.sectorSize = FAKE_SECTOR_SIZE;
+    fakeGeometry.totalSize = FAKE_SIZE;
+    fakeGeometry.pagesPerSector = FAKE_SECTOR_SIZE / FAKE_PAGE_SIZE;
+    fakeGeometry.flashType = FLASH_TYPE_NOR;
+
+    fakePartition.type = FLASH_PARTITION_TYPE_FLASHFS;
+    fakePartition.startSector = 0;
+    fakePartition.endSector = FAKE_SECTORS - 1;
+
+    flashfsSetEraseAheadSectors(eraseAheadSectors);
+
+    flashfsInit();
+
+    // leave out what setting up the log index wrote
+    fakeFlashSettle();
+    fakePrograms.clear();
+}
+
+static uint8_t patternByte(uint32_t offset)
+{
+    return (offset * 7 + (offset >> 8)) & 0xff;
+}
+
+// Writes count pattern bytes continuing from offset, in chunks of varying size
+static uint32_t writePattern(uint32_t offset, uint32_t count, bool sync)
+{
+    uint8_t chunk[64];
+    uint32_t written = 0;
+
+    while (written < count) {
+        const uint32_t length = MIN(count - written, 1 + (offset + written) % (uint32_t)sizeof(chunk));
+        for (uint32_t i = 0; i < length; i++) {
+            chunk[i] = patternByte(offset + written + i);
+        }
+        flashfsWrite(chunk, length, sync);
+        written += length;
+    }
+
+    return offset + written;
+}
+
+static void expectPattern(uint32_t start, uint32_t end)
+{
+    for (uint32_t address = start; address < end; address++) {
+        ASSERT_EQ(patternByte(address), fakeMemory[address]) << "at address " << address;
+    }
+}
+
+TEST(FlashfsTest, TestWritesAreInOrderAndPageAligned)
+{
+    resetFlash(true, 0, 0);
+
+    // start part way into a page so the first program is a short one up to the page boundary
+    flashfsSeekAbs(100);
+    const uint32_t end = writePattern(100, 2000, false);
+    EXPECT_EQ(end, flashfsGetOffset());
+
+    flashfsFlushSync();
+    fakeFlashSettle();
+
+    expectPattern(100, end);
+    EXPECT_EQ(0xff, fakeMemory[99]);
+    EXPECT_EQ(0xff, fakeMemory[end]);
+
+    ASSERT_FALSE(fakePrograms.empty());
+    EXPECT_EQ(100U, fakePrograms[0].address);
+    EXPECT_EQ(156U, fakePrograms[0].length);
+
+    uint32_t address = 100;
+    for (const fakeProgram_t &program : fakePrograms) {
+        EXPECT_EQ(address, program.address);
+        address += program.length;
+    }
+    EXPECT_EQ(end, address);
+
+    flashfsWriteStats_t stats;
+    flashfsGetWriteStats(&stats);
+    EXPECT_EQ(fakePrograms.size(), stats.programs);
+    EXPECT_EQ(0U, stats.droppedBytes);
+}
+
+TEST(FlashfsTest, TestOnlyFullBuffersAreProgrammedUnlessForced)
+{
+    resetFlash(true, 0, 0);
+
+    const uint8_t data[10] = { 0 };
+    flashfsWrite(data, sizeof(data), false);
+    EXPECT_FALSE(flashfsFlushAsync(false));
+    EXPECT_TRUE(fakePrograms.empty());
+
+    EXPECT_TRUE(flashfsFlushAsync(true));
+    ASSERT_EQ(1U, fakePrograms.size());
+    EXPECT_EQ(10U, fakePrograms[0].length);
+
+    // the next buffer only runs up to the end of the page the forced flush left off in
+    writePattern(10, FAKE_PAGE_SIZE, false);
+    ASSERT_EQ(2U, fakePrograms.size());
+    EXPECT_EQ(10U, fakePrograms[1].address);
+    EXPECT_EQ(FAKE_PAGE_SIZE - 10U, fakePrograms[1].length);
+}
+
+TEST(FlashfsTest, TestBufferFillsWhileOtherIsProgrammed)
+{
+    resetFlash(false, 40, 300);
+
+    // 64 bytes every 100us stays below the device's 256 bytes per 340us
+    uint32_t offset = 0;
+    unsigned writesDuringProgram = 0;
+    for (int i = 0; i < 200; i++) {
+        if (fakePendingCallback || fakeTimeUs < fakeBusyUntilUs) {
+            writesDuringProgram++;
+        }
+        offset = writePattern(offset, 64, false);
+        flashfsFlushAsync(false);
+        fakeFlashAdvance(100);
+    }
+    fakeFlashSettle();
+    flashfsFlushSync();
+    fakeFlashSettle();
+
+    flashfsWriteStats_t stats;
+    flashfsGetWriteStats(&stats);
+    EXPECT_EQ(0U, stats.droppedBytes);
+    EXPECT_GT(writesDuringProgram, 100U);
+
+    expectPattern(0, offset);
+    for (const fakeProgram_t &program : fakePrograms) {
+        EXPECT_EQ(FAKE_PAGE_SIZE, program.length);
+    }
+}
+
+TEST(FlashfsTest, TestDropsAndStallsAreCounted)
+{
+    resetFlash(false, 40, 300);
+
+    // the first buffer is programmed straight away, the second fills up behind it and the rest is dropped
+    uint32_t offset = writePattern(0, 2 * FAKE_PAGE_SIZE, false);
+    EXPECT_EQ(1U, fakePrograms.size());
+    EXPECT_EQ(0U, flashfsGetWriteBufferFreeSpace());
+
+    const uint8_t extra[10] = { 0 };
+    flashfsWrite(extra, sizeof(extra), false);
+
+    flashfsWriteStats_t stats;
+    flashfsGetWriteStats(&stats);
+    EXPECT_EQ(10U, stats.droppedBytes);
+
+    // the full buffer goes out once the device is ready again, the wait is counted as a stall
+    while (!flashfsFlushAsync(false) && fakePrograms.size() < 2) {
+        fakeFlashAdvance(1);
+    }
+    ASSERT_EQ(2U, fakePrograms.size());
+    flashfsGetWriteStats(&stats);
+    EXPECT_EQ(2U, stats.programs);
+    EXPECT_GE(stats.stallUs, 300U);
+    EXPECT_LE(stats.stallUs, 345U);
+
+    fakeFlashSettle();
+    flashfsFlushSync();
+    expectPattern(0, offset);
+
+    flashfsResetWriteStats();
+    flashfsGetWriteStats(&stats);
+    EXPECT_EQ(0U, stats.droppedBytes);
+    EXPECT_EQ(0U, stats.stallUs);
+}
+
+TEST(FlashfsTest, TestEndOfVolume)
+{
+    resetFlash(true, 0, 0);
+
+    flashfsSeekAbs(FAKE_VOLUME_SIZE - 10);
+    EXPECT_EQ(10U, flashfsGetWriteBufferFreeSpace());
+
+    writePattern(FAKE_VOLUME_SIZE - 10, 20, false);
+    flashfsFlushSync();
+
+    expectPattern(FAKE_VOLUME_SIZE - 10, FAKE_VOLUME_SIZE);
+    EXPECT_TRUE(flashfsIsEOF());
+
+    flashfsWriteStats_t stats;
+    flashfsGetWriteStats(&stats);
+    EXPECT_EQ(10U, stats.droppedBytes);
+}
+
+// Erases the volume from the main task and lets the log index header be written after it
+static void eraseVolume(void)
+{
+    flashfsEraseCompletely();
+    for (int i = 0; i < 2 * FAKE_ERASE_US; i++) {
+        flashfsEraseAsync();
+        fakeFlashAdvance(1);
+    }
+    fakeFlashSettle();
+}
+
+TEST(FlashfsTest, TestEraseAheadWhileIdle)
+{
+    resetFlash(true, 0, 0, 4);
+
+    // old logs on most of the volume
+    memset(fakeMemory, 0, FAKE_VOLUME_SIZE);
+
+    // erasing only takes the log index, the old logs are logged over from the start of the volume
+    eraseVolume();
+    EXPECT_EQ(std::vector<uint32_t>{ FAKE_VOLUME_SIZE }, fakeErases);
+    EXPECT_EQ(0U, flashfsGetOffset());
+    EXPECT_EQ(0U, flashfsGetEraseAheadHeadroom());
+    EXPECT_EQ(0, flashfsGetLogCount());
+    fakeErases.clear();
+
+    for (int i = 0; i < 20000; i++) {
+        flashfsEraseAheadAsync();
+        fakeFlashAdvance(1);
+    }
+
+    const std::vector<uint32_t> expected = { 0, 1 * FAKE_SECTOR_SIZE, 2 * FAKE_SECTOR_SIZE, 3 * FAKE_SECTOR_SIZE };
+    EXPECT_EQ(expected, fakeErases);
+    EXPECT_EQ(4U * FAKE_SECTOR_SIZE, flashfsGetEraseAheadHeadroom());
+
+    // nothing is erased while there is data waiting to be written
+    const uint32_t end = writePattern(0, 5000, false);
+    for (int i = 0; i < 20000; i++) {
+        flashfsEraseAheadAsync();
+        fakeFlashAdvance(1);
+    }
+    EXPECT_EQ(expected, fakeErases);
+
+    flashfsFlushSync();
+    expectPattern(0, end);
+
+    // and the headroom is topped up again once it has been written
+    flashfsEraseAheadAsync();
+    EXPECT_EQ(5U, fakeErases.size());
+
+    flashfsWriteStats_t stats;
+    flashfsGetWriteStats(&stats);
+    EXPECT_EQ(0U, stats.droppedBytes);
+}
+
+TEST(FlashfsTest, TestEraseAheadCatchUp)
+{
+    resetFlash(false, 40, 300, 1);
+
+    memset(fakeMemory, 0, FAKE_VOLUME_SIZE);
+    eraseVolume();
+    fakeErases.clear();
+
+    // logging straight onto old logs, each sector is erased before the first program into it, while the buffer
+    // that goes there is filling so the logger doesn't have to wait
+    uint32_t offset = 0;
+    for (int i = 0; i < 3 * FAKE_SECTOR_SIZE / 64; i++) {
+        offset = writePattern(offset, 64, false);
+        flashfsFlushAsync(false);
+        fakeFlashAdvance(1000);
+    }
+    fakeFlashSettle();
+    flashfsFlushSync();
+    fakeFlashSettle();
+
+    const std::vector<uint32_t> expected = { 0, 1 * FAKE_SECTOR_SIZE, 2 * FAKE_SECTOR_SIZE };
+    EXPECT_EQ(expected, fakeErases);
+    expectPattern(0, offset);
+
+    flashfsWriteStats_t stats;
+    flashfsGetWriteStats(&stats);
+    EXPECT_EQ(0U, stats.droppedBytes);
+    EXPECT_EQ(0U, stats.stallUs);
+}
+
+static void beginLog(const char *craftName)
+{
+    flashfsLogEntry_t entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.timestamp = 1700000000;
+    strncpy(entry.firmwareRevision, "abcdef0", sizeof(entry.firmwareRevision));
+    strncpy(entry.craftName, craftName, sizeof(entry.craftName));
+
+    flashfsLogBegin(&entry);
+}
+
+TEST(FlashfsTest, TestLogIndex)
+{
+    resetFlash(true, 0, 0);
+
+    EXPECT_TRUE(flashfsLogIndexIsAvailable());
+    EXPECT_EQ((uint32_t)FAKE_VOLUME_SIZE, flashfsGetSize());
+    EXPECT_EQ(0, flashfsGetLogCount());
+
+    beginLog("first");
+    uint32_t offset = writePattern(0, 1000, false);
+
+    // the length of the log being written is what has been written so far
+    flashfsLogEntry_t entry;
+    ASSERT_TRUE(flashfsGetLogEntry(0, &entry));
+    EXPECT_EQ(0U, entry.start);
+    EXPECT_EQ(1000U, entry.length);
+
+    flashfsFlushSync();
+    flashfsLogEnd();
+
+    beginLog("second");
+    offset = writePattern(offset, 300, false);
+    flashfsLogEnd();
+    flashfsFlushSync();
+
+    // after a restart the index is read back and the free space starts right after the last log
+    flashfsInit();
+    EXPECT_EQ(offset, flashfsGetOffset());
+    ASSERT_EQ(2, flashfsGetLogCount());
+
+    ASSERT_TRUE(flashfsGetLogEntry(1, &entry));
+    EXPECT_EQ(1000U, entry.start);
+    EXPECT_EQ(300U, entry.length);
+    EXPECT_EQ(1700000000U, entry.timestamp);
+    EXPECT_EQ(0, strncmp("abcdef0", entry.firmwareRevision, sizeof(entry.firmwareRevision)));
+    EXPECT_EQ(0, strncmp("second", entry.craftName, sizeof(entry.craftName)));
+    EXPECT_FALSE(flashfsGetLogEntry(2, &entry));
+
+    expectPattern(0, offset);
+}
+
+TEST(FlashfsTest, TestLogIndexUpdatesDontWait)
+{
+    resetFlash(false, 40, 300);
+
+    // a program in flight
+    uint32_t offset = writePattern(0, FAKE_PAGE_SIZE, false);
+    ASSERT_EQ(1U, fakePrograms.size());
+
+    // starting a log only notes the entry, it can be read back straight away
+    beginLog("quad");
+    EXPECT_EQ(1U, fakePrograms.size());
+    ASSERT_EQ(1, flashfsGetLogCount());
+    flashfsLogEntry_t entry;
+    ASSERT_TRUE(flashfsGetLogEntry(0, &entry));
+    EXPECT_EQ((uint32_t)FAKE_PAGE_SIZE, entry.start);
+    EXPECT_EQ(0, strncmp("quad", entry.craftName, sizeof(entry.craftName)));
+
+    // it is programmed by the flush once the device is free
+    while (fakePrograms.size() < 2 && fakeTimeUs < 10000) {
+        flashfsFlushAsync(false);
+        fakeFlashAdvance(1);
+    }
+    ASSERT_EQ(2U, fakePrograms.size());
+    EXPECT_EQ(FAKE_VOLUME_SIZE + FAKE_RECORD_SIZE, fakePrograms[1].address);
+
+    // closing the log doesn't program anything either, the main task writes the length with the rest of the log
+    offset = writePattern(offset, 100, false);
+    const size_t programs = fakePrograms.size();
+    flashfsLogEnd();
+    EXPECT_EQ(programs, fakePrograms.size());
+    for (int i = 0; i < 10000; i++) {
+        flashfsEraseAsync();
+        flashfsFlushAsync(true);
+        fakeFlashAdvance(1);
+    }
+    fakeFlashSettle();
+
+    flashfsInit();
+    EXPECT_EQ(offset, flashfsGetOffset());
+    ASSERT_TRUE(flashfsGetLogEntry(0, &entry));
+    EXPECT_EQ(100U, entry.length);
+}
+
+TEST(FlashfsTest, TestLogIndexUnclosedLog)
+{
+    resetFlash(true, 0, 0);
+
+    beginLog("quad");
+    writePattern(0, 5000, false);
+    flashfsFlushSync();
+
+    // power lost before the log was closed, the free space is searched for instead
+    flashfsInit();
+    EXPECT_EQ(6144U, flashfsGetOffset());
+    ASSERT_EQ(1, flashfsGetLogCount());
+
+    flashfsLogEntry_t entry;
+    ASSERT_TRUE(flashfsGetLogEntry(0, &entry));
+    EXPECT_EQ(0U, entry.start);
+    EXPECT_EQ(FLASHFS_LOG_LENGTH_UNKNOWN, entry.length);
+}
+
+TEST(FlashfsTest, TestLogIndexAddedToUsedChip)
+{
+    resetFlash(true, 0, 0);
+
+    // logs written without an index, its sector is still erased
+    memset(fakeMemory, 0xff, sizeof(fakeMemory));
+    memset(fakeMemory, 0x55, 3000);
+    flashfsInit();
+
+    EXPECT_EQ(4096U, flashfsGetOffset());
+    ASSERT_EQ(1, flashfsGetLogCount());
+
+    flashfsLogEntry_t entry;
+    ASSERT_TRUE(flashfsGetLogEntry(0, &entry));
+    EXPECT_EQ(0U, entry.start);
+    EXPECT_EQ(4096U, entry.length);
+}
+
+TEST(FlashfsTest, TestNoLogIndexOverLogData)
+{
+    resetFlash(true, 0, 0);
+
+    // a full chip from before there was an index, the last sector stays readable
+    memset(fakeMemory, 0x55, sizeof(fakeMemory));
+    flashfsInit();
+
+    EXPECT_FALSE(flashfsLogIndexIsAvailable());
+    EXPECT_EQ((uint32_t)FAKE_SIZE, flashfsGetSize());
+    EXPECT_TRUE(flashfsIsEOF());
+
+    // until it is erased
+    flashfsEraseCompletely();
+    EXPECT_TRUE(flashfsLogIndexIsAvailable());
+    EXPECT_EQ((uint32_t)FAKE_VOLUME_SIZE, flashfsGetSize());
+
+    beginLog("quad");
+    EXPECT_EQ(1, flashfsGetLogCount());
+
+    // the header goes back once the erase is done, before the entry
+    for (int i = 0; i < 10 * FAKE_ERASE_US; i++) {
+        flashfsEraseAsync();
+        fakeFlashAdvance(1);
+    }
+    EXPECT_EQ('L', fakeMemory[FAKE_VOLUME_SIZE]);
+    EXPECT_EQ('L', fakeMemory[FAKE_VOLUME_SIZE + FAKE_RECORD_SIZE]);
+}
+
+TEST(FlashfsTest, TestLogIndexAfterEraseAhead)
+{
+    resetFlash(true, 0, 0, 2);
+
+    memset(fakeMemory, 0, FAKE_VOLUME_SIZE);
+    eraseVolume();
+
+    beginLog("quad");
+    const uint32_t end = writePattern(0, 5000, true);
+    flashfsLogEnd();
+    flashfsFlushSync();
+    fakeFlashSettle();
+
+    // after a restart the index finds the end of the new log, the old logs after it are still to be erased
+    flashfsInit();
+    EXPECT_EQ(end, flashfsGetOffset());
+    EXPECT_EQ(2U * FAKE_SECTOR_SIZE - end, flashfsGetEraseAheadHeadroom());
+    ASSERT_EQ(1, flashfsGetLogCount());
+
+    flashfsLogEntry_t entry;
+    ASSERT_TRUE(flashfsGetLogEntry(0, &entry));
+    EXPECT_EQ(0U, entry.start);
+    EXPECT_EQ(end, entry.length);
+    expectPattern(0, end);
+    EXPECT_EQ(0, fakeMemory[2 * FAKE_SECTOR_SIZE]);
+}
+
+// The writer keeps a device with the given timings busy, on the fake flash clock so the result doesn't depend on the host
+TEST(FlashfsTest, TestSustainedThroughput)
+{
+    static const struct {
+        uint32_t dmaUs;
+        uint32_t programUs;
+    } timings[] = {
+        { 40, 300 },
+        { 40, 700 },
+        { 100, 1500 },
+    };
+
+    for (unsigned i = 0; i < ARRAYLEN(timings); i++) {
+        resetFlash(false, timings[i].dmaUs, timings[i].programUs);
+
+        // offer more than the device can take, 32 bytes every 10us
+        uint32_t offset = 0;
+        for (int step = 0; step < 20000; step++) {
+            offset = writePattern(offset, 32, false);
+            flashfsFlushAsync(false);
+            fakeFlashAdvance(10);
+        }
+        const uint32_t elapsedUs = fakeTimeUs;
+
+        flashfsWriteStats_t stats;
+        flashfsGetWriteStats(&stats);
+        const double deviceLimit = FAKE_PAGE_SIZE * 1e6 / (timings[i].dmaUs + timings[i].programUs);
+        const double achieved = stats.programs * FAKE_PAGE_SIZE * 1e6 / elapsedUs;
+
+        // whatever was not dropped makes it to the device
+        fakeFlashSettle();
+        flashfsFlushSync();
+        fakeFlashSettle();
+        flashfsGetWriteStats(&stats);
+        uint32_t programmed = 0;
+        for (const fakeProgram_t &program : fakePrograms) {
+            programmed += program.length;
+        }
+        EXPECT_EQ(offset, programmed + stats.droppedBytes);
+        EXPECT_GT(achieved, 0.95 * deviceLimit) << "dma " << timings[i].dmaUs << "us program " << timings[i].programUs << "us";
+    }
+}
+
+// STUBS
+
+extern "C" {
+    uint32_t micros(void) { return fakeTimeUs; }
+
+    bool flashIsReady(void)
+    {
+        static uint32_t lastPollUs;
+        static unsigned pollsSinceAdvance;
+
+        if (fakePendingCallback || fakeTimeUs < fakeBusyUntilUs) {
+            // a caller spinning on the device still sees time pass
+            pollsSinceAdvance = (fakeTimeUs == lastPollUs) ? pollsSinceAdvance + 1 : 0;
+            if (pollsSinceAdvance >= 100) {
+                fakeFlashAdvance(1);
+            }
+            lastPollUs = fakeTimeUs;
+            return false;
+        }
+        return true;
+    }
+
+    void flashPageProgramBegin(uint32_t address, void (*callback)(uint32_t arg))
+    {
+        EXPECT_TRUE(fakeTimeUs >= fakeBusyUntilUs);
+        EXPECT_EQ(0U, fakePendingCallback);
+        fakeProgramAddress = address;
+        fakeCallback = callback;
+    }
+
+    uint32_t flashPageProgramContinue(const uint8_t **buffers, uint32_t *bufferSizes, uint32_t bufferCount)
+    {
+        EXPECT_EQ(1U, bufferCount);
+
+        const uint32_t address = fakeProgramAddress;
+        const uint32_t length = bufferSizes[0];
+        EXPECT_GT(length, 0U);
+        EXPECT_LE(address + length, (uint32_t)FAKE_SIZE);
+        EXPECT_EQ(address / FAKE_PAGE_SIZE, (address + length - 1) / FAKE_PAGE_SIZE) << "program straddles a page";
+
+        for (uint32_t i = 0; i < length; i++) {
+            fakeMemory[address + i] &= buffers[0][i];
+        }
+        fakePrograms.push_back({ address, length, fakeTimeUs });
+
+        fakeDmaDoneUs = fakeTimeUs + fakeDmaUs;
+        fakeBusyUntilUs = fakeDmaDoneUs + fakeProgramUs;
+
+        if (fakeCallbackImmediate) {
+            if (fakeCallback) {
+                fakeCallback(length);
+            }
+        } else {
+            fakePendingCallback = length;
+        }
+
+        return length;
+    }
+
+    void flashPageProgramFinish(void) {}
+
+    void flashPageProgram(uint32_t address, const uint8_t *data, uint32_t length, void (*callback)(uint32_t length))
+    {
+        flashPageProgramBegin(address, callback);
+        flashPageProgramContinue(&data, &length, 1);
+        flashPageProgramFinish();
+    }
+
+    int flashReadBytes(uint32_t address, uint8_t *buffer, uint32_t length)
+    {
+        memcpy(buffer, &fakeMemory[address], length);
+        return length;
+    }
+
+    void flashEraseSector(uint32_t address)
+    {
+        EXPECT_TRUE(fakeTimeUs >= fakeBusyUntilUs);
+        EXPECT_EQ(0U, address % FAKE_SECTOR_SIZE);
+        fakeErases.push_back(address);
+        fakeBusyUntilUs = fakeTimeUs + FAKE_ERASE_US;
+        memset(&fakeMemory[address - address % FAKE_SECTOR_SIZE], 0xff, FAKE_SECTOR_SIZE);
+    }
+
+    void flashEraseCompletely(void)
+    {
+        fakeBusyUntilUs = fakeTimeUs + FAKE_ERASE_US;
+        memset(fakeMemory, 0xff, sizeof(fakeMemory));
+    }
+
+    void flashFlush(void) {}
+
+    const flashGeometry_t *flashGetGeometry(void) { return &fakeGeometry; }
+    flashPartition_t *flashPartitionFindByType(flashPartitionType_e) { return &fakePartition; }
+    int flashPartitionCount(void) { return 1; }
+}
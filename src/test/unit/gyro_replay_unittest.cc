@@ -0,0 +1,859 @@
+/*
+ * This file is part of Cleanflight and Betaflight.
+ *
+ * Cleanflight and Betaflight are free software. You can redistribute
+ * this software and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Cleanflight and Betaflight are distributed in the hope that they
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Replays gyro traces through the gyro and D-term filters of the firmware.
+//
+// Without arguments a synthetic trace is used and the results are checked. To replay a decoded
+// blackbox log, or any CSV with the columns described at replayReadTrace(), set these variables and
+// run ../../obj/test/gyro_replay_unittest/gyro_replay_unittest --gtest_also_run_disabled_tests --gtest_filter='*Replay.DISABLED_Replay'
+//
+//   GYRO_REPLAY_INPUT=log.csv                                      trace to replay
+//   GYRO_REPLAY_OUTPUT=filtered.csv                                every stage of every axis
+//   GYRO_REPLAY_SET="gyro_lpf1_static_hz=300 dyn_notch_count=2"    settings, see replayApplySettings()
+//
+// The report lists the delay of every stage for the stick motion in the trace, estimated from the
+// cross-spectrum of its input and output, and the time per PID loop spent in it. The unit tests are
+// built with -O0 and coverage, so the times only compare with each other, not with the flight controller.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <string>
+#include <vector>
+
+extern "C" {
+    #include <platform.h>
+
+    #include "build/debug.h"
+    #include "common/axis.h"
+    #include "common/filter.h"
+    #include "common/filter_chain.h"
+    #include "common/maths.h"
+    #include "common/utils.h"
+    #include "config/config.h"
+    #include "drivers/accgyro/accgyro.h"
+    #include "drivers/accgyro/accgyro_fake.h"
+    #include "drivers/sensor.h"
+    #include "drivers/sound_beeper.h"
+    #include "fc/core.h"
+    #include "fc/rc.h"
+    #include "fc/runtime_config.h"
+    #include "flight/dyn_notch_filter.h"
+    #include "flight/imu.h"
+    #include "flight/pid.h"
+    #include "flight/pid_init.h"
+    #include "flight/rpm_filter.h"
+    #include "io/beeper.h"
+    #include "pg/dyn_notch.h"
+    #include "pg/motor.h"
+    #include "pg/pg.h"
+    #include "pg/pg_ids.h"
+    #include "pg/rpm_filter.h"
+    #include "scheduler/scheduler.h"
+    #include "sensors/acceleration.h"
+    #include "sensors/gyro.h"
+    #include "sensors/gyro_init.h"
+    #include "sensors/sensors.h"
+
+    uint8_t debugMode;
+    int16_t debug[DEBUG16_VALUE_COUNT];
+
+    PG_REGISTER(accelerometerConfig_t, accelerometerConfig, PG_ACCELEROMETER_CONFIG, 0);
+    PG_REGISTER(systemConfig_t, systemConfig, PG_SYSTEM_CONFIG, 2);
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+extern gyroDev_t * const gyroDevPtr;
+
+#define REPLAY_MOTOR_COUNT_MAX 8
+#define REPLAY_DELAY_SEGMENT_US 1000000
+#define REPLAY_DELAY_MIN_HZ 10
+#define REPLAY_DELAY_MAX_HZ 50
+// same throttle schedule as the mixer uses for the dynamic lowpass filters
+#define REPLAY_DYN_LPF_THROTTLE_STEPS 100
+#define REPLAY_DYN_LPF_UPDATE_DELAY_US 5000
+
+typedef struct replayTrace_s {
+    uint32_t sampleRateHz;
+    std::vector<float> gyro[XYZ_AXIS_COUNT];            // deg/s, one entry per gyro sample
+    int motorCount;
+    std::vector<float> erpm[REPLAY_MOTOR_COUNT_MAX];    // as reported by the ESC telemetry, eRPM / 100
+    std::vector<float> throttle;                        // 0..1, empty when not in the trace
+} replayTrace_t;
+
+typedef enum {
+    REPLAY_STAGE_INPUT = 0,     // scaled gyro samples at the PID loop rate
+    REPLAY_STAGE_DOWNSAMPLE,    // gyro lowpass 2 or averaging
+    REPLAY_STAGE_RPM,
+    REPLAY_STAGE_STATIC,        // static notches and gyro lowpass 1
+    REPLAY_STAGE_DYN_NOTCH,     // the filtered gyro used by the PID controller
+    REPLAY_STAGE_DTERM,         // D-term notch and lowpass filters
+    REPLAY_STAGE_COUNT
+} replayStage_e;
+
+static const char * const replayStageNames[REPLAY_STAGE_COUNT] = {
+    "gyroUnfilt", "gyroDownsampled", "gyroRpm", "gyroStatic", "gyroADC", "dterm"
+};
+
+typedef struct replayResult_s {
+    uint32_t looptimeUs;
+    std::vector<float> stage[REPLAY_STAGE_COUNT][XYZ_AXIS_COUNT];   // one entry per PID loop
+    double stageNs[REPLAY_STAGE_COUNT];                             // per PID loop
+    double loopNs;                                                  // gyroUpdate() to rpmFilterUpdate(), per PID loop
+} replayResult_t;
+
+// motor telemetry seen by the RPM filter for the PID loop being run
+static const replayTrace_t *telemetryTrace;
+static int telemetrySample;
+
+// Columns are found by name in the header line, as written by blackbox_decode:
+//   "time (us)" or "time"           sample time, gives the gyro rate unless gyro_rate_hz is set
+//   "gyroUnfilt[0..2]"              unfiltered gyro, "gyroADC[0..2]" is used when it is missing
+//   "eRPM[0..7]"                    motor telemetry, enables the RPM filter
+//   "throttle" or "setpoint[3]"     0..1 or 0..1000, drives the dynamic lowpass filters
+static bool replayReadTrace(const char *filename, replayTrace_t *trace)
+{
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        return false;
+    }
+
+    int timeColumn = -1;
+    int gyroColumn[XYZ_AXIS_COUNT] = { -1, -1, -1 };
+    int gyroFilteredColumn[XYZ_AXIS_COUNT] = { -1, -1, -1 };
+    int erpmColumn[REPLAY_MOTOR_COUNT_MAX];
+    int throttleColumn = -1;
+    float throttleScale = 1.0f;
+    for (int i = 0; i < REPLAY_MOTOR_COUNT_MAX; i++) {
+        erpmColumn[i] = -1;
+    }
+
+    char line[4096];
+    if (!fgets(line, sizeof(line), file)) {
+        fclose(file);
+        return false;
+    }
+    int column = 0;
+    for (char *name = strtok(line, ",\r\n"); name; name = strtok(NULL, ",\r\n"), column++) {
+        while (*name == ' ') {
+            name++;
+        }
+        int index;
+        char bracket;
+        if (strcmp(name, "time (us)") == 0 || strcmp(name, "time") == 0) {
+            timeColumn = column;
+        } else if (sscanf(name, "gyroUnfilt[%d%c", &index, &bracket) == 2 && index >= 0 && index < XYZ_AXIS_COUNT) {
+            gyroColumn[index] = column;
+        } else if (sscanf(name, "gyroADC[%d%c", &index, &bracket) == 2 && index >= 0 && index < XYZ_AXIS_COUNT) {
+            gyroFilteredColumn[index] = column;
+        } else if (sscanf(name, "eRPM[%d%c", &index, &bracket) == 2 && index >= 0 && index < REPLAY_MOTOR_COUNT_MAX) {
+            erpmColumn[index] = column;
+        } else if (strcmp(name, "throttle") == 0) {
+            throttleColumn = column;
+        } else if (strcmp(name, "setpoint[3]") == 0 && throttleColumn < 0) {
+            throttleColumn = column;
+            throttleScale = 0.001f;
+        }
+    }
+
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        if (gyroColumn[axis] < 0) {
+            gyroColumn[axis] = gyroFilteredColumn[axis];
+        }
+        if (gyroColumn[axis] < 0) {
+            fclose(file);
+            return false;
+        }
+    }
+    trace->motorCount = 0;
+    while (trace->motorCount < REPLAY_MOTOR_COUNT_MAX && erpmColumn[trace->motorCount] >= 0) {
+        trace->motorCount++;
+    }
+
+    std::vector<double> times;
+    std::vector<double> values;
+    while (fgets(line, sizeof(line), file)) {
+        values.clear();
+        for (char *field = strtok(line, ",\r\n"); field; field = strtok(NULL, ",\r\n")) {
+            values.push_back(strtod(field, NULL));
+        }
+        if ((int)values.size() < column) {
+            continue;
+        }
+        if (timeColumn >= 0) {
+            times.push_back(values[timeColumn]);
+        }
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            trace->gyro[axis].push_back(values[gyroColumn[axis]]);
+        }
+        for (int motor = 0; motor < trace->motorCount; motor++) {
+            trace->erpm[motor].push_back(values[erpmColumn[motor]]);
+        }
+        if (throttleColumn >= 0) {
+            trace->throttle.push_back(constrainf(values[throttleColumn] * throttleScale, 0.0f, 1.0f));
+        }
+    }
+    fclose(file);
+
+    // the median interval is not upset by the gaps of a log that was paused
+    trace->sampleRateHz = 8000;
+    if (times.size() > 2) {
+        std::vector<double> intervals;
+        for (size_t i = 1; i < times.size(); i++) {
+            intervals.push_back(times[i] - times[i - 1]);
+        }
+        std::nth_element(intervals.begin(), intervals.begin() + intervals.size() / 2, intervals.end());
+        const double intervalUs = intervals[intervals.size() / 2];
+        if (intervalUs > 0) {
+            trace->sampleRateHz = lrint(1e6 / intervalUs);
+        }
+    }
+
+    return !trace->gyro[X].empty();
+}
+
+static bool replayWriteTrace(const char *filename, const replayResult_t *result)
+{
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        return false;
+    }
+
+    fprintf(file, "time (us)");
+    for (int stage = 0; stage < REPLAY_STAGE_COUNT; stage++) {
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            fprintf(file, ", %s[%d]", replayStageNames[stage], axis);
+        }
+    }
+    fprintf(file, "\n");
+
+    for (size_t i = 0; i < result->stage[0][0].size(); i++) {
+        fprintf(file, "%u", (unsigned)(i * result->looptimeUs));
+        for (int stage = 0; stage < REPLAY_STAGE_COUNT; stage++) {
+            for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+                fprintf(file, ", %.3f", (double)result->stage[stage][axis][i]);
+            }
+        }
+        fprintf(file, "\n");
+    }
+
+    return fclose(file) == 0;
+}
+
+// Settings take the CLI names and values, separated by spaces or commas, lowpass types can be given by name.
+static bool replayApplySettings(const char *settings, uint32_t *gyroRateHz)
+{
+    gyroConfig_t *gyroConfig = gyroConfigMutable();
+    pidProfile_t *pidProfile = pidProfilesMutable(0);
+    dynNotchConfig_t *dynNotchConfig = dynNotchConfigMutable();
+    rpmFilterConfig_t *rpmFilterConfig = rpmFilterConfigMutable();
+
+#define REPLAY_SETTING(name, config, field) { name, &config->field, sizeof(config->field) }
+    const struct {
+        const char *name;
+        void *value;
+        size_t size;
+    } settingTable[] = {
+        REPLAY_SETTING("gyro_lpf1_type", gyroConfig, gyro_lpf1_type),
+        REPLAY_SETTING("gyro_lpf1_static_hz", gyroConfig, gyro_lpf1_static_hz),
+        REPLAY_SETTING("gyro_lpf1_dyn_min_hz", gyroConfig, gyro_lpf1_dyn_min_hz),
+        REPLAY_SETTING("gyro_lpf1_dyn_max_hz", gyroConfig, gyro_lpf1_dyn_max_hz),
+        REPLAY_SETTING("gyro_lpf1_dyn_expo", gyroConfig, gyro_lpf1_dyn_expo),
+        REPLAY_SETTING("gyro_lpf2_type", gyroConfig, gyro_lpf2_type),
+        REPLAY_SETTING("gyro_lpf2_static_hz", gyroConfig, gyro_lpf2_static_hz),
+        REPLAY_SETTING("gyro_notch1_hz", gyroConfig, gyro_soft_notch_hz_1),
+        REPLAY_SETTING("gyro_notch1_cutoff", gyroConfig, gyro_soft_notch_cutoff_1),
+        REPLAY_SETTING("gyro_notch2_hz", gyroConfig, gyro_soft_notch_hz_2),
+        REPLAY_SETTING("gyro_notch2_cutoff", gyroConfig, gyro_soft_notch_cutoff_2),
+        REPLAY_SETTING("gyro_filter_fixed_point", gyroConfig, gyro_filter_fixed_point),
+        REPLAY_SETTING("dyn_notch_count", dynNotchConfig, dyn_notch_count),
+        REPLAY_SETTING("dyn_notch_q", dynNotchConfig, dyn_notch_q),
+        REPLAY_SETTING("dyn_notch_min_hz", dynNotchConfig, dyn_notch_min_hz),
+        REPLAY_SETTING("dyn_notch_max_hz", dynNotchConfig, dyn_notch_max_hz),
+        REPLAY_SETTING("rpm_filter_harmonics", rpmFilterConfig, rpm_filter_harmonics),
+        REPLAY_SETTING("rpm_filter_q", rpmFilterConfig, rpm_filter_q),
+        REPLAY_SETTING("rpm_filter_min_hz", rpmFilterConfig, rpm_filter_min_hz),
+        REPLAY_SETTING("rpm_filter_fade_range_hz", rpmFilterConfig, rpm_filter_fade_range_hz),
+        REPLAY_SETTING("rpm_filter_lpf_hz", rpmFilterConfig, rpm_filter_lpf_hz),
+        REPLAY_SETTING("motor_poles", motorConfigMutable(), motorPoleCount),
+        REPLAY_SETTING("dterm_lpf1_type", pidProfile, dterm_lpf1_type),
+        REPLAY_SETTING("dterm_lpf1_static_hz", pidProfile, dterm_lpf1_static_hz),
+        REPLAY_SETTING("dterm_lpf1_dyn_min_hz", pidProfile, dterm_lpf1_dyn_min_hz),
+        REPLAY_SETTING("dterm_lpf1_dyn_max_hz", pidProfile, dterm_lpf1_dyn_max_hz),
+        REPLAY_SETTING("dterm_lpf1_dyn_expo", pidProfile, dterm_lpf1_dyn_expo),
+        REPLAY_SETTING("dterm_lpf2_type", pidProfile, dterm_lpf2_type),
+        REPLAY_SETTING("dterm_lpf2_static_hz", pidProfile, dterm_lpf2_static_hz),
+        REPLAY_SETTING("dterm_notch_hz", pidProfile, dterm_notch_hz),
+        REPLAY_SETTING("dterm_notch_cutoff", pidProfile, dterm_notch_cutoff),
+        REPLAY_SETTING("pid_process_denom", pidConfigMutable(), pid_process_denom),
+        { "gyro_rate_hz", gyroRateHz, sizeof(*gyroRateHz) },
+    };
+#undef REPLAY_SETTING
+    static const char * const lowpassTypeNames[] = { "PT1", "BIQUAD", "PT2", "PT3" };
+
+    if (!settings) {
+        return true;
+    }
+    std::string copy(settings);
+    char *save;
+    for (char *setting = strtok_r(&copy[0], " ,", &save); setting; setting = strtok_r(NULL, " ,", &save)) {
+        char *value = strchr(setting, '=');
+        if (!value) {
+            return false;
+        }
+        *value++ = '\0';
+
+        char *end;
+        long parsed = strtol(value, &end, 10);
+        if (end == value || *end != '\0') {
+            parsed = -1;
+            for (unsigned i = 0; i < ARRAYLEN(lowpassTypeNames); i++) {
+                if (strcasecmp(value, lowpassTypeNames[i]) == 0) {
+                    parsed = i;
+                }
+            }
+            if (parsed < 0) {
+                return false;
+            }
+        }
+
+        unsigned i = 0;
+        while (i < ARRAYLEN(settingTable) && strcmp(setting, settingTable[i].name) != 0) {
+            i++;
+        }
+        if (i == ARRAYLEN(settingTable) || parsed < 0) {
+            return false;
+        }
+        switch (settingTable[i].size) {
+        case sizeof(uint8_t):
+            *(uint8_t *)settingTable[i].value = parsed;
+            break;
+        case sizeof(uint16_t):
+            *(uint16_t *)settingTable[i].value = parsed;
+            break;
+        default:
+            *(uint32_t *)settingTable[i].value = parsed;
+            break;
+        }
+    }
+    return true;
+}
+
+static void replayInit(const replayTrace_t *trace, const char *settings)
+{
+    telemetryTrace = trace;
+    telemetrySample = 0;
+
+    pgResetAll();
+    uint32_t gyroRateHz = trace->sampleRateHz;
+    ASSERT_TRUE(replayApplySettings(settings, &gyroRateHz)) << "bad setting in \"" << settings << "\"";
+    motorConfigMutable()->dev.useDshotTelemetry = trace->motorCount > 0;
+
+    ASSERT_TRUE(gyroInit());
+    // finer than the 1 deg/s per LSB the fake gyro has on the host
+    gyroDevPtr->scale = GYRO_SCALE_2000DPS;
+    gyro.sampleRateHz = gyroRateHz;
+    gyroSetTargetLooptime(MAX(pidConfig()->pid_process_denom, 1));
+
+    // calibrate to a zero offset, so the trace is used as it is
+    gyroStartCalibration(false);
+    while (!gyroIsCalibrationComplete()) {
+        fakeGyroSet(gyroDevPtr, 0, 0, 0);
+        gyroUpdate();
+    }
+
+    // start from the same state as each stage does, without what was downsampled while calibrating
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        gyro.sampleSum[axis] = 0;
+    }
+    gyro.sampleCount = 0;
+    gyroInitFilters();
+    pidInit(pidProfilesMutable(0));
+}
+
+// The mixer updates the dynamic lowpass cutoffs at most every 5ms when the quantised throttle changes,
+// returns the throttle to update with after each PID loop, or -1.
+static std::vector<float> replayDynLpfSchedule(const replayTrace_t *trace, int loops, int denom, uint32_t looptimeUs)
+{
+    std::vector<float> schedule(loops, -1.0f);
+    if (trace->throttle.empty()) {
+        return schedule;
+    }
+
+    int previousQuantizedThrottle = -1;
+    uint32_t lastUpdateUs = 0;
+    for (int loop = 0; loop < loops; loop++) {
+        const uint32_t timeUs = loop * looptimeUs;
+        if (timeUs - lastUpdateUs >= REPLAY_DYN_LPF_UPDATE_DELAY_US) {
+            const int quantizedThrottle = lrintf(trace->throttle[(loop + 1) * denom - 1] * REPLAY_DYN_LPF_THROTTLE_STEPS);
+            if (quantizedThrottle != previousQuantizedThrottle) {
+                schedule[loop] = (float)quantizedThrottle / REPLAY_DYN_LPF_THROTTLE_STEPS;
+                previousQuantizedThrottle = quantizedThrottle;
+                lastUpdateUs = timeUs;
+            }
+        }
+    }
+    return schedule;
+}
+
+// Runs the trace through gyroUpdate() and gyroFiltering() as the gyro task does, followed by the
+// D-term filters and the RPM filter update of the PID controller, then runs it again one stage at a
+// time over the whole trace to tap and time every stage. Both runs give the same gyro and D-term output.
+static void replayRun(const replayTrace_t *trace, const char *settings, replayResult_t *result)
+{
+    replayInit(trace, settings);
+    if (::testing::Test::HasFatalFailure()) {
+        return;
+    }
+
+    const int denom = activePidLoopDenom;
+    const int loops = trace->gyro[X].size() / denom;
+    const std::vector<float> dynLpfSchedule = replayDynLpfSchedule(trace, loops, denom, gyro.targetLooptime);
+    std::vector<float> samples[XYZ_AXIS_COUNT];
+    std::vector<float> pipeline[2][XYZ_AXIS_COUNT];
+
+    result->looptimeUs = gyro.targetLooptime;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int loop = 0; loop < loops; loop++) {
+        for (int i = loop * denom; i < (loop + 1) * denom; i++) {
+            fakeGyroSet(gyroDevPtr,
+                constrain(lrintf(trace->gyro[X][i] / GYRO_SCALE_2000DPS), INT16_MIN, INT16_MAX),
+                constrain(lrintf(trace->gyro[Y][i] / GYRO_SCALE_2000DPS), INT16_MIN, INT16_MAX),
+                constrain(lrintf(trace->gyro[Z][i] / GYRO_SCALE_2000DPS), INT16_MIN, INT16_MAX));
+            gyroUpdate();
+            for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+                samples[axis].push_back(gyro.gyroADC[axis]);
+            }
+        }
+
+        gyroFiltering(loop * gyro.targetLooptime);
+
+        float dterm[XYZ_AXIS_COUNT];
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            dterm[axis] = gyro.gyroADCf[axis];
+        }
+        filterChainApply(&pidRuntime.dtermFilter, dterm);
+        filterChainApply(&pidRuntime.dtermLowpass2, dterm);
+
+        telemetrySample = (loop + 1) * denom - 1;
+        rpmFilterUpdate();
+        if (dynLpfSchedule[loop] >= 0) {
+            dynLpfGyroUpdate(dynLpfSchedule[loop]);
+            dynLpfDTermUpdate(dynLpfSchedule[loop]);
+        }
+
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            pipeline[0][axis].push_back(gyro.gyroADCf[axis]);
+            pipeline[1][axis].push_back(dterm[axis]);
+        }
+    }
+    result->loopNs = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() / MAX(loops, 1);
+
+    // same filters from their initial state, one stage at a time
+    gyroInitFilters();
+    pidInitFilters(pidProfilesMutable(0));
+    rpmFilterInit(rpmFilterConfig(), gyro.targetLooptime);
+
+    for (int stage = 0; stage < REPLAY_STAGE_COUNT; stage++) {
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            result->stage[stage][axis].assign(loops, 0.0f);
+        }
+        result->stageNs[stage] = 0;
+    }
+    for (int loop = 0; loop < loops; loop++) {
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            // the last sample of each group, as DEBUG_GYRO_SCALED records it
+            result->stage[REPLAY_STAGE_INPUT][axis][loop] = samples[axis][(loop + 1) * denom - 1];
+        }
+    }
+
+    for (int stage = REPLAY_STAGE_DOWNSAMPLE; stage < REPLAY_STAGE_COUNT; stage++) {
+        std::vector<float> *in = result->stage[stage - 1];
+        std::vector<float> *out = result->stage[stage];
+
+        start = std::chrono::steady_clock::now();
+        for (int loop = 0; loop < loops; loop++) {
+            float values[XYZ_AXIS_COUNT];
+            for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+                values[axis] = in[axis][loop];
+            }
+
+            switch (stage) {
+            case REPLAY_STAGE_DOWNSAMPLE:
+                for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+                    float sum = 0;
+                    for (int i = loop * denom; i < (loop + 1) * denom; i++) {
+                        if (gyro.downsampleFilterEnabled) {
+                            sum = gyro.lowpass2FilterApplyFn((filter_t *)&gyro.lowpass2Filter[axis], samples[axis][i]);
+                        } else {
+                            sum += samples[axis][i];
+                        }
+                    }
+                    values[axis] = gyro.downsampleFilterEnabled ? sum : sum / denom;
+                }
+                break;
+            case REPLAY_STAGE_RPM:
+                rpmFilterApply(values);
+                telemetrySample = (loop + 1) * denom - 1;
+                rpmFilterUpdate();
+                break;
+            case REPLAY_STAGE_STATIC:
+                filterChainApply(&gyro.filterChain, values);
+                if (dynLpfSchedule[loop] >= 0) {
+                    dynLpfGyroUpdate(dynLpfSchedule[loop]);
+                }
+                break;
+            case REPLAY_STAGE_DYN_NOTCH:
+                if (isDynNotchActive()) {
+                    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+                        dynNotchPush(axis, values[axis]);
+                        values[axis] = dynNotchFilter(axis, values[axis]);
+                    }
+                    dynNotchUpdate();
+                }
+                break;
+            case REPLAY_STAGE_DTERM:
+                filterChainApply(&pidRuntime.dtermFilter, values);
+                filterChainApply(&pidRuntime.dtermLowpass2, values);
+                if (dynLpfSchedule[loop] >= 0) {
+                    dynLpfDTermUpdate(dynLpfSchedule[loop]);
+                }
+                break;
+            }
+
+            for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+                out[axis][loop] = values[axis];
+            }
+        }
+        result->stageNs[stage] = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() / MAX(loops, 1);
+    }
+
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        for (int loop = 0; loop < loops; loop++) {
+            ASSERT_EQ(pipeline[0][axis][loop], result->stage[REPLAY_STAGE_DYN_NOTCH][axis][loop]) << "axis " << axis << " loop " << loop;
+            ASSERT_EQ(pipeline[1][axis][loop], result->stage[REPLAY_STAGE_DTERM][axis][loop]) << "axis " << axis << " loop " << loop;
+        }
+    }
+}
+
+// Delay of the output behind the input from the phase of their cross-spectrum from 10Hz to 50Hz,
+// where stick inputs and propwash are and motor noise is not. The spectrum is averaged over Hann
+// windowed segments of one second overlapping by half, and each frequency is weighted by its magnitude.
+static double replayDelayUs(const std::vector<float> &in, const std::vector<float> &out, uint32_t looptimeUs)
+{
+    const int count = in.size();
+    const int segment = REPLAY_DELAY_SEGMENT_US / looptimeUs;
+    const double binHz = 1e6 / (segment * looptimeUs);
+    if (count < segment) {
+        return 0;
+    }
+
+    std::vector<std::complex<double>> kernel(segment);
+    double delaySum = 0, weightSum = 0;
+    for (int bin = lrint(REPLAY_DELAY_MIN_HZ / binHz); bin * binHz <= REPLAY_DELAY_MAX_HZ; bin++) {
+        for (int i = 0; i < segment; i++) {
+            const double window = 0.5 - 0.5 * cos(2 * M_PI * i / segment);
+            kernel[i] = std::polar(window, -2 * M_PI * bin * i / segment);
+        }
+        std::complex<double> cross = 0;
+        for (int start = 0; start + segment <= count; start += segment / 2) {
+            std::complex<double> inBin = 0, outBin = 0;
+            for (int i = 0; i < segment; i++) {
+                inBin += kernel[i] * (double)in[start + i];
+                outBin += kernel[i] * (double)out[start + i];
+            }
+            cross += std::conj(inBin) * outBin;
+        }
+        const double weight = std::abs(cross);
+        delaySum += weight * -std::arg(cross) / (2 * M_PI * bin * binHz) * 1e6;
+        weightSum += weight;
+    }
+    return weightSum > 0 ? delaySum / weightSum : 0;
+}
+
+static void replayReport(const replayResult_t *result, double delayUs[REPLAY_STAGE_COUNT][XYZ_AXIS_COUNT])
+{
+    printf("gyro replay: %u loops at %uus, %.1f ns/loop for gyroUpdate() to rpmFilterUpdate()\n",
+        (unsigned)result->stage[0][0].size(), (unsigned)result->looptimeUs, result->loopNs);
+    printf("%-16s %10s %10s %10s %10s\n", "stage", "ns/loop", "roll us", "pitch us", "yaw us");
+    for (int stage = REPLAY_STAGE_DOWNSAMPLE; stage < REPLAY_STAGE_COUNT; stage++) {
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            delayUs[stage][axis] = replayDelayUs(result->stage[stage - 1][axis], result->stage[stage][axis], result->looptimeUs);
+        }
+        printf("%-16s %10.1f %10.1f %10.1f %10.1f\n", replayStageNames[stage], result->stageNs[stage],
+            delayUs[stage][X], delayUs[stage][Y], delayUs[stage][Z]);
+    }
+}
+
+// xorshift32, the same trace on every run
+static uint32_t noiseState = 1;
+static float noiseUniform(void)
+{
+    noiseState ^= noiseState << 13;
+    noiseState ^= noiseState >> 17;
+    noiseState ^= noiseState << 5;
+    return noiseState / 4294967296.0f - 0.5f;
+}
+
+// Stick motion, a slow sine plus random moves below about 20Hz, plus motor noise at the first two
+// harmonics of four motors speeding up from 150Hz to 300Hz, plus white noise. The same trace without
+// the noise is returned separately.
+static void replaySyntheticTrace(replayTrace_t *trace, replayTrace_t *clean, float seconds)
+{
+    static const float motionHz[XYZ_AXIS_COUNT] = { 3, 4, 2 };
+    static const float motionDps[XYZ_AXIS_COUNT] = { 200, 150, 100 };
+    static const float movesRmsDps = 40;
+    static const float noiseGain[XYZ_AXIS_COUNT] = { 1.0f, 0.8f, 0.5f };
+    const int count = seconds * 8000;
+    const float dt = 1.0f / 8000;
+    float phase[4] = { 0, 1, 2, 3 };
+
+    noiseState = 1;
+    std::vector<float> moves[XYZ_AXIS_COUNT];
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        pt1Filter_t lowpass[2];
+        pt1FilterInit(&lowpass[0], pt1FilterGain(20, dt));
+        pt1FilterInit(&lowpass[1], pt1FilterGain(20, dt));
+        double sum = 0;
+        for (int i = 0; i < count; i++) {
+            const float move = pt1FilterApply(&lowpass[1], pt1FilterApply(&lowpass[0], noiseUniform()));
+            moves[axis].push_back(move);
+            sum += sq(move);
+        }
+        const float gain = movesRmsDps / sqrt(sum / count);
+        for (int i = 0; i < count; i++) {
+            moves[axis][i] *= gain;
+        }
+    }
+
+    trace->sampleRateHz = 8000;
+    trace->motorCount = 4;
+    for (int i = 0; i < count; i++) {
+        const float t = i * dt;
+        float noise = 0;
+        for (int motor = 0; motor < trace->motorCount; motor++) {
+            const float motorHz = 150 + 150 * t / seconds + 7 * motor;
+            phase[motor] = fmodf(phase[motor] + 2 * M_PIf * motorHz * dt, 2 * M_PIf);
+            noise += 20 * sinf(phase[motor]) + 8 * sinf(2 * phase[motor]);
+            // eRPM / 100 of a 14 pole motor
+            trace->erpm[motor].push_back(motorHz * 60 * 7 / 100);
+        }
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            const float motion = motionDps[axis] * sinf(2 * M_PIf * motionHz[axis] * t) + moves[axis][i];
+            clean->gyro[axis].push_back(motion);
+            trace->gyro[axis].push_back(motion + noiseGain[axis] * noise + 4 * noiseUniform());
+        }
+        trace->throttle.push_back(0.3f + 0.4f * t / seconds);
+    }
+
+    clean->sampleRateHz = trace->sampleRateHz;
+    clean->motorCount = trace->motorCount;
+    for (int motor = 0; motor < trace->motorCount; motor++) {
+        clean->erpm[motor] = trace->erpm[motor];
+    }
+    clean->throttle = trace->throttle;
+}
+
+// RMS difference after the first second, while the filters settle
+static float replayRms(const std::vector<float> &a, const std::vector<float> &b, uint32_t looptimeUs)
+{
+    double sum = 0;
+    int count = 0;
+    for (size_t i = 1000000 / looptimeUs; i < a.size(); i++) {
+        sum += sq(a[i] - b[i]);
+        count++;
+    }
+    return sqrt(sum / MAX(count, 1));
+}
+
+TEST(GyroReplay, ReadWriteTrace)
+{
+    const char *filename = "gyro_replay_trace.csv";
+    FILE *file = fopen(filename, "w");
+    ASSERT_TRUE(file != NULL);
+    fprintf(file, "loopIteration, time (us), gyroADC[0], gyroADC[1], gyroADC[2], gyroUnfilt[0], gyroUnfilt[1], gyroUnfilt[2], setpoint[3], eRPM[0], eRPM[1]\n");
+    fprintf(file, "0, 1000, 9, 9, 9, 1.5, -2, 3, 500, 1000, 1100\n");
+    fprintf(file, "1, 1250, 9, 9, 9, 4, 5, -6.25, 1000, 1001, 1101\n");
+    fprintf(file, "2, 1500, 9, 9, 9, 7, 8, 9, 0, 1002, 1102\n");
+    fclose(file);
+
+    replayTrace_t trace;
+    ASSERT_TRUE(replayReadTrace(filename, &trace));
+    remove(filename);
+
+    EXPECT_EQ(4000U, trace.sampleRateHz);
+    ASSERT_EQ(3U, trace.gyro[X].size());
+    EXPECT_FLOAT_EQ(1.5f, trace.gyro[X][0]);
+    EXPECT_FLOAT_EQ(-2.0f, trace.gyro[Y][0]);
+    EXPECT_FLOAT_EQ(-6.25f, trace.gyro[Z][1]);
+    EXPECT_EQ(2, trace.motorCount);
+    EXPECT_FLOAT_EQ(1102.0f, trace.erpm[1][2]);
+    ASSERT_EQ(3U, trace.throttle.size());
+    EXPECT_FLOAT_EQ(0.5f, trace.throttle[0]);
+    EXPECT_FLOAT_EQ(1.0f, trace.throttle[1]);
+
+    replayResult_t result;
+    result.looptimeUs = 250;
+    for (int stage = 0; stage < REPLAY_STAGE_COUNT; stage++) {
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            result.stage[stage][axis] = trace.gyro[axis];
+        }
+    }
+    ASSERT_TRUE(replayWriteTrace(filename, &result));
+
+    // the gyro output is read back as the filtered gyro when there is no unfiltered one
+    replayTrace_t filtered;
+    ASSERT_TRUE(replayReadTrace(filename, &filtered));
+    remove(filename);
+    EXPECT_EQ(4000U, filtered.sampleRateHz);
+    EXPECT_EQ(0, filtered.motorCount);
+    EXPECT_TRUE(filtered.throttle.empty());
+    EXPECT_FLOAT_EQ(-6.25f, filtered.gyro[Z][1]);
+}
+
+TEST(GyroReplay, Settings)
+{
+    pgResetAll();
+    uint32_t gyroRateHz = 8000;
+    EXPECT_TRUE(replayApplySettings("gyro_lpf1_static_hz=321,dyn_notch_count=2 dterm_lpf2_type=biquad gyro_rate_hz=3200", &gyroRateHz));
+    EXPECT_EQ(321, gyroConfig()->gyro_lpf1_static_hz);
+    EXPECT_EQ(2, dynNotchConfig()->dyn_notch_count);
+    EXPECT_EQ(FILTER_BIQUAD, pidProfilesMutable(0)->dterm_lpf2_type);
+    EXPECT_EQ(3200U, gyroRateHz);
+
+    EXPECT_FALSE(replayApplySettings("gyro_lpf9_static_hz=100", &gyroRateHz));
+    EXPECT_FALSE(replayApplySettings("gyro_lpf1_static_hz", &gyroRateHz));
+    EXPECT_FALSE(replayApplySettings("gyro_lpf1_type=FIR", &gyroRateHz));
+}
+
+TEST(GyroReplay, SyntheticTrace)
+{
+    replayTrace_t trace, clean;
+    replaySyntheticTrace(&trace, &clean, 2.0f);
+
+    // without the RPM filter three dynamic notches are left to chase eight motor lines
+    static const struct {
+        const char *settings;
+        float noiseRatioMax;
+    } configs[] = {
+        { "", 0.2f },
+        { "pid_process_denom=2 gyro_lpf2_type=PT2", 0.2f },
+        { "rpm_filter_harmonics=0 dyn_notch_count=3", 0.35f },
+        { "gyro_filter_fixed_point=1", 0.2f },
+    };
+    for (unsigned i = 0; i < ARRAYLEN(configs); i++) {
+        const char *settings = configs[i].settings;
+        SCOPED_TRACE(settings);
+        replayResult_t result, cleanResult;
+        replayRun(&trace, settings, &result);
+        replayRun(&clean, settings, &cleanResult);
+        if (HasFatalFailure()) {
+            return;
+        }
+
+        printf("settings \"%s\"\n", settings);
+        double delayUs[REPLAY_STAGE_COUNT][XYZ_AXIS_COUNT];
+        replayReport(&result, delayUs);
+
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            // most of the noise is removed, measured against the same filters run without it
+            const float noiseIn = replayRms(result.stage[REPLAY_STAGE_INPUT][axis], cleanResult.stage[REPLAY_STAGE_INPUT][axis], result.looptimeUs);
+            const float noiseOut = replayRms(result.stage[REPLAY_STAGE_DYN_NOTCH][axis], cleanResult.stage[REPLAY_STAGE_DYN_NOTCH][axis], result.looptimeUs);
+            EXPECT_LT(noiseOut, configs[i].noiseRatioMax * noiseIn) << "axis " << axis;
+
+            double gyroDelayUs = 0;
+            for (int stage = REPLAY_STAGE_DOWNSAMPLE; stage <= REPLAY_STAGE_DYN_NOTCH; stage++) {
+                EXPECT_GE(delayUs[stage][axis], 0) << replayStageNames[stage] << " axis " << axis;
+                gyroDelayUs += delayUs[stage][axis];
+            }
+            EXPECT_GT(gyroDelayUs, 500) << "axis " << axis;
+            EXPECT_LT(gyroDelayUs, 3000) << "axis " << axis;
+            EXPECT_GT(delayUs[REPLAY_STAGE_DTERM][axis], 500) << "axis " << axis;
+            EXPECT_LT(delayUs[REPLAY_STAGE_DTERM][axis], 5000) << "axis " << axis;
+        }
+    }
+}
+
+// Not a pass/fail test, replays GYRO_REPLAY_INPUT, or the synthetic trace, with the settings in
+// GYRO_REPLAY_SET and writes every stage to GYRO_REPLAY_OUTPUT. Not run by default, see the top of the file.
+TEST(GyroReplay, DISABLED_Replay)
+{
+    replayTrace_t trace;
+    const char *input = getenv("GYRO_REPLAY_INPUT");
+    if (input) {
+        ASSERT_TRUE(replayReadTrace(input, &trace)) << "can't read gyro trace " << input;
+    } else {
+        replayTrace_t clean;
+        replaySyntheticTrace(&trace, &clean, 3.0f);
+    }
+
+    replayResult_t result;
+    replayRun(&trace, getenv("GYRO_REPLAY_SET"), &result);
+    if (HasFatalFailure()) {
+        return;
+    }
+
+    double delayUs[REPLAY_STAGE_COUNT][XYZ_AXIS_COUNT];
+    replayReport(&result, delayUs);
+
+    const char *output = getenv("GYRO_REPLAY_OUTPUT");
+    if (output) {
+        EXPECT_TRUE(replayWriteTrace(output, &result)) << "can't write " << output;
+    }
+}
+
+// STUBS
+
+extern "C" {
+
+uint32_t micros(void) { return 0; }
+uint32_t getCycleCounter(void) { return 0; }
+void beeper(beeperMode_e) {}
+uint8_t detectedSensors[] = { GYRO_NONE, ACC_NONE };
+timeDelta_t getGyroUpdateRate(void) { return gyro.targetLooptime; }
+void schedulerResetTaskStatistics(taskId_e) {}
+void writeEEPROM(void) {}
+
+uint8_t getMotorCount(void) { return telemetryTrace ? telemetryTrace->motorCount : 0; }
+uint16_t getDshotTelemetry(uint8_t index) { return lrintf(telemetryTrace->erpm[index][telemetrySample]); }
+
+// the PID controller itself is not run
+attitudeEulerAngles_t attitude;
+void initRcProcessing(void) {}
+void beeperConfirmationBeeps(uint8_t) {}
+void systemBeep(bool) {}
+uint8_t calculateThrottlePercentAbs(void) { return 0; }
+float getRcDeflection(int) { return 0; }
+float getSetpointRate(int) { return 0; }
+float getMotorMixRange(void) { return 0; }
+bool isLaunchControlActive(void) { return false; }
+void disarm(flightLogDisarmReason_e) {}
+
+}
@@ -0,0 +1,192 @@
+/*
+ * This file is part of Cleanflight and Betaflight.
+ *
+ * Cleanflight and Betaflight are free software. You can redistribute
+ * this software and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Cleanflight and Betaflight are distributed in the hope that they
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "common/utils.h"
+
+    #include "fc/latency.h"
+
+    uint32_t targetPidLooptime;
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define CYCLES_PER_US 100
+
+static void recordUs(latencyStage_e stage, uint32_t sampleCycles, uint32_t latencyUs)
+{
+    latencyRecord(stage, sampleCycles, sampleCycles + latencyUs * CYCLES_PER_US);
+}
+
+TEST(LatencyUnittest, TestEmpty)
+{
+    targetPidLooptime = 125;
+    latencyReset();
+
+    // two loop periods over 64 buckets, rounded up
+    EXPECT_EQ(4, latencyGetBucketWidthUs());
+
+    for (int stage = 0; stage < LATENCY_STAGE_COUNT; stage++) {
+        latencyStats_t stats;
+        latencyGetStats((latencyStage_e)stage, &stats);
+        EXPECT_EQ(0, stats.count);
+        EXPECT_EQ(0, stats.p50Us);
+        EXPECT_EQ(0, stats.p99Us);
+        EXPECT_EQ(0, stats.maxUs);
+    }
+}
+
+TEST(LatencyUnittest, TestPercentiles)
+{
+    targetPidLooptime = 125;
+    latencyReset();
+
+    // 1..100us, p50 lands in the 48..51us bucket and p99 in the 96..99us bucket
+    for (uint32_t us = 1; us <= 100; us++) {
+        recordUs(LATENCY_STAGE_PID, 1000, us);
+    }
+
+    latencyStats_t stats;
+    latencyGetStats(LATENCY_STAGE_PID, &stats);
+    EXPECT_EQ(100, stats.count);
+    EXPECT_EQ(52, stats.p50Us);
+    EXPECT_EQ(100, stats.p99Us);
+    EXPECT_EQ(100, stats.maxUs);
+    EXPECT_EQ(100, latencyGetLastUs(LATENCY_STAGE_PID));
+
+    // stages are independent
+    latencyGetStats(LATENCY_STAGE_MOTOR, &stats);
+    EXPECT_EQ(0, stats.count);
+}
+
+TEST(LatencyUnittest, TestMeanAndJitter)
+{
+    targetPidLooptime = 125;
+    latencyReset();
+
+    static const uint32_t latencyUs[] = { 100, 120, 80, 100 };
+    for (unsigned i = 0; i < ARRAYLEN(latencyUs); i++) {
+        recordUs(LATENCY_STAGE_MOTOR, 1000, latencyUs[i]);
+    }
+
+    latencyStats_t stats;
+    latencyGetStats(LATENCY_STAGE_MOTOR, &stats);
+    EXPECT_EQ(4, stats.count);
+    EXPECT_EQ(80, stats.minUs);
+    EXPECT_EQ(120, stats.maxUs);
+    EXPECT_EQ(1000, stats.average10thUs);
+    // standard deviation is sqrt(200)
+    EXPECT_EQ(141, stats.jitter10thUs);
+}
+
+TEST(LatencyUnittest, TestPercentileNeverExceedsMax)
+{
+    targetPidLooptime = 125;
+    latencyReset();
+
+    for (int i = 0; i < 10; i++) {
+        recordUs(LATENCY_STAGE_FILTER, 5000, 9);
+    }
+
+    latencyStats_t stats;
+    latencyGetStats(LATENCY_STAGE_FILTER, &stats);
+    EXPECT_EQ(10, stats.count);
+    EXPECT_EQ(9, stats.p50Us);
+    EXPECT_EQ(9, stats.p99Us);
+    EXPECT_EQ(9, stats.maxUs);
+}
+
+TEST(LatencyUnittest, TestOverflowBucket)
+{
+    targetPidLooptime = 125;
+    latencyReset();
+
+    for (int i = 0; i < 98; i++) {
+        recordUs(LATENCY_STAGE_MOTOR, 0, 60);
+    }
+    // beyond the histogram range, and across the cycle counter wrap
+    recordUs(LATENCY_STAGE_MOTOR, UINT32_MAX - 50, 700);
+    recordUs(LATENCY_STAGE_MOTOR, UINT32_MAX - 50, 1500);
+
+    latencyStats_t stats;
+    latencyGetStats(LATENCY_STAGE_MOTOR, &stats);
+    EXPECT_EQ(100, stats.count);
+    EXPECT_EQ(64, stats.p50Us);
+    EXPECT_EQ(1500, stats.p99Us);
+    EXPECT_EQ(1500, stats.maxUs);
+}
+
+TEST(LatencyUnittest, TestSampleAfterStage)
+{
+    targetPidLooptime = 125;
+    latencyReset();
+
+    // a sample newer than the stage timestamp is recorded as no latency
+    latencyRecord(LATENCY_STAGE_FILTER, 2000, 1000);
+
+    latencyStats_t stats;
+    latencyGetStats(LATENCY_STAGE_FILTER, &stats);
+    EXPECT_EQ(1, stats.count);
+    EXPECT_EQ(0, stats.p50Us);
+    EXPECT_EQ(0, stats.maxUs);
+}
+
+TEST(LatencyUnittest, TestReset)
+{
+    targetPidLooptime = 500;
+    latencyReset();
+    EXPECT_EQ(16, latencyGetBucketWidthUs());
+
+    recordUs(LATENCY_STAGE_MOTOR, 0, 300);
+    EXPECT_EQ(300, latencyGetLastUs(LATENCY_STAGE_MOTOR));
+
+    latencyReset();
+
+    latencyStats_t stats;
+    latencyGetStats(LATENCY_STAGE_MOTOR, &stats);
+    EXPECT_EQ(0, stats.count);
+    EXPECT_EQ(0, stats.maxUs);
+    EXPECT_EQ(0, latencyGetLastUs(LATENCY_STAGE_MOTOR));
+}
+
+// STUBS
+
+extern "C" {
+    int32_t clockCyclesToMicros(int32_t clockCycles)
+    {
+        return clockCycles / CYCLES_PER_US;
+    }
+
+    int32_t clockCyclesTo10thMicros(int32_t clockCycles)
+    {
+        return clockCycles * 10 / CYCLES_PER_US;
+    }
+
+    uint32_t clockMicrosToCycles(uint32_t micros)
+    {
+        return micros * CYCLES_PER_US;
+    }
+}
@@ -0,0 +1,493 @@
+/*
+ * This file is part of Cleanflight and Betaflight.
+ *
+ * Cleanflight and Betaflight are free software. You can redistribute
+ * this software and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Cleanflight and Betaflight are distributed in the hope that they
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <deque>
+#include <vector>
+
+extern "C" {
+    #include "platform.h"
+
+    #include "common/crc.h"
+    #include "common/maths.h"
+    #include "common/streambuf.h"
+    #include "common/utils.h"
+
+    #include "drivers/serial.h"
+    #include "drivers/system.h"
+
+    #include "io/serial.h"
+
+    #include "msp/msp.h"
+    #include "msp/msp_protocol.h"
+    #include "msp/msp_protocol_v2_betaflight.h"
+    #include "msp/msp_serial.h"
+
+    #include "pg/msp.h"
+    #include "pg/pg.h"
+    #include "pg/pg_ids.h"
+
+    PG_REGISTER(mspConfig_t, mspConfig, PG_MSP_CONFIG, 0);
+    PG_REGISTER(serialConfig_t, serialConfig, PG_SERIAL_CONFIG, 0);
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+#define TASK_SERIAL_PERIOD_US   10000   // TASK_SERIAL runs at 100Hz
+#define STEP_US                 100
+#define FLASH_SIZE              (256 * 1024)
+
+/*
+ * Loopback serial port: bytes written are queued in a transmit buffer of the port's size and delivered to the host
+ * side at the link rate. A write that does not fit is queued anyway, which is what the blocking serialWriteBuf
+ * amounts to for throughput. The host side parses MSPv2 frames and sends commands back through the receive queue.
+ */
+static serialPort_t loopbackPort;
+static serialPortConfig_t loopbackPortConfig;
+static std::deque<uint8_t> txQueue;
+static std::deque<uint8_t> rxQueue;
+static double linkBytesPerUs;
+static double linkCredit;
+static uint32_t nowUs;
+
+// host side decoder state
+static std::vector<uint8_t> hostFrame;
+static unsigned hostFrameSize;
+static int hostFrames;
+static int hostBadFrames;
+static int hostLargestFrame;
+static bool hostEndSeen;
+static uint32_t hostNextAddress;
+static uint32_t hostBytes;
+static uint32_t hostLastDataUs;
+static int hostGaps;
+static uint32_t hostRequestDueUs;   // request/response mode, 0 when no request is due
+
+static uint8_t flashByte(uint32_t address)
+{
+    return (address * 7 + (address >> 8)) & 0xff;
+}
+
+static void resetLoopback(uint8_t identifier, uint32_t txBufferSize, uint32_t baudRate)
+{
+    memset(&loopbackPort, 0, sizeof(loopbackPort));
+    loopbackPort.identifier = identifier;
+    loopbackPort.txBufferSize = txBufferSize;
+    loopbackPortConfig.identifier = (serialPortIdentifier_e)identifier;
+
+    txQueue.clear();
+    rxQueue.clear();
+    // 10 bits per byte on a UART, USB full speed CDC manages about 1MB/s
+    linkBytesPerUs = identifier == SERIAL_PORT_USB_VCP ? 1.0 : baudRate / 10e6;
+    linkCredit = 0;
+    nowUs = 0;
+
+    hostFrame.clear();
+    hostFrameSize = 0;
+    hostFrames = 0;
+    hostBadFrames = 0;
+    hostLargestFrame = 0;
+    hostEndSeen = false;
+    hostNextAddress = 0;
+    hostBytes = 0;
+    hostLastDataUs = 0;
+    hostGaps = 0;
+    hostRequestDueUs = 0;
+
+    mspSerialInit();
+}
+
+static void hostSendCommand(uint16_t cmd, const uint8_t *payload, uint16_t size)
+{
+    uint8_t header[] = { '$', 'X', '<', 0, (uint8_t)(cmd & 0xff), (uint8_t)(cmd >> 8), (uint8_t)(size & 0xff), (uint8_t)(size >> 8) };
+    uint8_t checksum = crc8_dvb_s2_update(0, &header[3], sizeof(header) - 3);
+    checksum = crc8_dvb_s2_update(checksum, payload, size);
+
+    rxQueue.insert(rxQueue.end(), header, header + sizeof(header));
+    rxQueue.insert(rxQueue.end(), payload, payload + size);
+    rxQueue.push_back(checksum);
+}
+
+static void hostStartStream(uint32_t start, uint32_t end)
+{
+    const uint8_t payload[] = {
+        (uint8_t)start, (uint8_t)(start >> 8), (uint8_t)(start >> 16), (uint8_t)(start >> 24),
+        (uint8_t)end, (uint8_t)(end >> 8), (uint8_t)(end >> 16), (uint8_t)(end >> 24),
+    };
+    hostSendCommand(MSP2_DATAFLASH_STREAM, payload, sizeof(payload));
+}
+
+static void hostRequestRead(uint32_t address, uint16_t size)
+{
+    const uint8_t payload[] = {
+        (uint8_t)address, (uint8_t)(address >> 8), (uint8_t)(address >> 16), (uint8_t)(address >> 24),
+        (uint8_t)size, (uint8_t)(size >> 8),
+    };
+    hostSendCommand(MSP_DATAFLASH_READ, payload, sizeof(payload));
+}
+
+static uint16_t readU16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t readU32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// payload is an MSP_DATAFLASH_READ reply, followed by its CRC16-CCITT for stream frames
+static void hostProcessReply(uint16_t cmd, const uint8_t *payload, unsigned size)
+{
+    const bool streamed = cmd == MSP2_DATAFLASH_STREAM;
+    if (streamed && size == 0) {
+        return; // acknowledgement of a start or stop request
+    }
+    if (size < 7 + (streamed ? 2 : 0)) {
+        hostBadFrames++;
+        return;
+    }
+    if (streamed) {
+        size -= 2;
+        uint16_t crc = 0;
+        for (unsigned i = 0; i < size; i++) {
+            crc = crc16_ccitt(crc, payload[i]);
+        }
+        if (crc != readU16(&payload[size])) {
+            hostBadFrames++;
+            return;
+        }
+    }
+
+    const uint32_t address = readU32(payload);
+    const uint16_t length = readU16(&payload[4]);
+    if (length != size - 7) {
+        hostBadFrames++;
+        return;
+    }
+    if (address != hostNextAddress) {
+        hostGaps++;
+    }
+    for (unsigned i = 0; i < length; i++) {
+        if (payload[7 + i] != flashByte(address + i)) {
+            hostBadFrames++;
+            return;
+        }
+    }
+    if (length == 0) {
+        hostEndSeen = true;
+    } else {
+        hostLastDataUs = nowUs;
+    }
+    hostNextAddress = address + length;
+    hostBytes += length;
+}
+
+static void hostReceive(uint8_t c)
+{
+    hostFrame.push_back(c);
+    if (hostFrame.size() == 8) {
+        hostFrameSize = 8 + readU16(&hostFrame[6]) + 1;
+    }
+    if (hostFrame.size() < 8 || hostFrame.size() < hostFrameSize) {
+        return;
+    }
+
+    hostFrames++;
+    hostLargestFrame = MAX(hostLargestFrame, (int)hostFrameSize);
+    const uint8_t checksum = crc8_dvb_s2_update(0, &hostFrame[3], hostFrameSize - 4);
+    if (hostFrame[0] != '$' || hostFrame[1] != 'X' || hostFrame[2] != '>' || checksum != hostFrame[hostFrameSize - 1]) {
+        hostBadFrames++;
+    } else {
+        const uint16_t cmd = readU16(&hostFrame[4]);
+        hostProcessReply(cmd, &hostFrame[8], hostFrameSize - 9);
+        if (cmd == MSP_DATAFLASH_READ) {
+            hostRequestDueUs = nowUs + 1000;     // host turnaround and the request on the wire
+        }
+    }
+    hostFrame.clear();
+    hostFrameSize = 0;
+}
+
+// Mirrors the dataflash handlers of msp.c on a test pattern
+static struct {
+    uint32_t address;
+    uint32_t end;
+} stream;
+
+static uint16_t serializeTestReadReply(sbuf_t *dst, uint32_t address, uint16_t size)
+{
+    const int bytesRemainingInBuf = sbufBytesRemaining(dst) - MSP_PORT_DATAFLASH_INFO_SIZE;
+    const uint16_t readLen = MIN(MIN((int)size, bytesRemainingInBuf), (int)(FLASH_SIZE - address));
+
+    sbufWriteU32(dst, address);
+    sbufWriteU16(dst, readLen);
+    sbufWriteU8(dst, 0);
+    for (unsigned i = 0; i < readLen; i++) {
+        sbufWriteU8(dst, flashByte(address + i));
+    }
+    return readLen;
+}
+
+static bool testStreamFrame(sbuf_t *dst)
+{
+    uint8_t *frameStart = sbufPtr(dst);
+    const uint32_t size = stream.address < stream.end ? stream.end - stream.address : 0;
+
+    stream.address += serializeTestReadReply(dst, stream.address, MIN(size, (uint32_t)UINT16_MAX));
+    crc16_ccitt_sbuf_append(dst, frameStart);
+
+    return size > 0;
+}
+
+static mspResult_e testProcessCommand(mspDescriptor_t srcDesc, mspPacket_t *cmd, mspPacket_t *reply, mspPostProcessFnPtr *)
+{
+    sbuf_t *src = &cmd->buf;
+    reply->cmd = cmd->cmd;
+
+    switch (cmd->cmd) {
+    case MSP2_DATAFLASH_STREAM:
+        if (sbufBytesRemaining(src) >= 4) {
+            stream.address = sbufReadU32(src);
+            stream.end = sbufBytesRemaining(src) >= 4 ? sbufReadU32(src) : FLASH_SIZE;
+            if (!mspSerialStreamStart(srcDesc, cmd->cmd, testStreamFrame)) {
+                return MSP_RESULT_ERROR;
+            }
+        } else {
+            mspSerialStreamStop(testStreamFrame);
+        }
+        return MSP_RESULT_ACK;
+
+    case MSP_DATAFLASH_READ:
+        {
+            const uint32_t address = sbufReadU32(src);
+            const uint16_t size = sbufReadU16(src);
+            serializeTestReadReply(&reply->buf, address, size);
+        }
+        return MSP_RESULT_ACK;
+
+    default:
+        return MSP_RESULT_ERROR;
+    }
+}
+
+static void testProcessReply(mspPacket_t *) {}
+
+// Advances time, delivering bytes over the link and running the MSP task at its rate
+static void runFor(uint32_t durationUs, uint32_t readEnd = 0, uint16_t readSize = 0)
+{
+    for (uint32_t endUs = nowUs + durationUs; nowUs < endUs; nowUs += STEP_US) {
+        linkCredit += linkBytesPerUs * STEP_US;
+        while (linkCredit >= 1 && !txQueue.empty()) {
+            hostReceive(txQueue.front());
+            txQueue.pop_front();
+            linkCredit--;
+        }
+        if (txQueue.empty()) {
+            linkCredit = 0;
+        }
+
+        if (hostRequestDueUs && nowUs >= hostRequestDueUs) {
+            hostRequestDueUs = 0;
+            if (hostNextAddress < readEnd) {
+                hostRequestRead(hostNextAddress, MIN((uint32_t)readSize, readEnd - hostNextAddress));
+            }
+        }
+
+        if (nowUs % TASK_SERIAL_PERIOD_US == 0) {
+            mspSerialProcess(MSP_SKIP_NON_MSP_DATA, testProcessCommand, testProcessReply);
+        }
+    }
+}
+
+TEST(MspSerialTest, TestStreamFramesFitUartTxBuffer)
+{
+    resetLoopback(SERIAL_PORT_USART1, 256, 115200);
+
+    hostStartStream(1000, 11000);
+    hostNextAddress = 1000;
+    runFor(2000000);
+
+    EXPECT_EQ(0, hostBadFrames);
+    EXPECT_EQ(0, hostGaps);
+    EXPECT_TRUE(hostEndSeen);
+    EXPECT_EQ(11000U, hostNextAddress);
+    EXPECT_EQ(10000U, hostBytes);
+    EXPECT_LE(hostLargestFrame, 256);
+
+    // and nothing more once the stream has ended
+    const int frames = hostFrames;
+    runFor(100000);
+    EXPECT_EQ(frames, hostFrames);
+}
+
+TEST(MspSerialTest, TestStreamVcpFramesUseReplyBuffer)
+{
+    resetLoopback(SERIAL_PORT_USB_VCP, 2048, 0);
+
+    hostStartStream(0, 3 * MSP_PORT_DATAFLASH_BUFFER_SIZE);
+    runFor(100000);
+
+    EXPECT_EQ(0, hostBadFrames);
+    EXPECT_EQ(0, hostGaps);
+    EXPECT_TRUE(hostEndSeen);
+    EXPECT_EQ(3U * MSP_PORT_DATAFLASH_BUFFER_SIZE, hostBytes);
+    EXPECT_GT(hostLargestFrame, MSP_PORT_DATAFLASH_BUFFER_SIZE);
+    EXPECT_LE(hostLargestFrame, MSP_PORT_OUTBUF_SIZE + MSP_MAX_HEADER_SIZE + MSP_MAX_CHECKSUM_SIZE);
+}
+
+TEST(MspSerialTest, TestStreamStopAndResume)
+{
+    resetLoopback(SERIAL_PORT_USART1, 256, 115200);
+
+    hostStartStream(0, 20000);
+    runFor(500000);
+
+    uint8_t none = 0;
+    hostSendCommand(MSP2_DATAFLASH_STREAM, &none, 0);
+    runFor(100000);
+    EXPECT_FALSE(hostEndSeen);
+    EXPECT_GT(hostNextAddress, 0U);
+    EXPECT_LT(hostNextAddress, 20000U);
+
+    // nothing is sent while stopped
+    const int frames = hostFrames;
+    runFor(100000);
+    EXPECT_EQ(frames, hostFrames);
+
+    // resume where the host got to
+    hostStartStream(hostNextAddress, 20000);
+    runFor(2500000);
+
+    EXPECT_EQ(0, hostBadFrames);
+    EXPECT_EQ(0, hostGaps);
+    EXPECT_TRUE(hostEndSeen);
+    EXPECT_EQ(20000U, hostBytes);
+}
+
+TEST(MspSerialTest, TestStreamCorruptionDetected)
+{
+    resetLoopback(SERIAL_PORT_USART1, 256, 115200);
+
+    hostStartStream(0, 1000);
+    runFor(20000);
+    ASSERT_GT(txQueue.size(), 100U);
+    txQueue[txQueue.size() - 50] ^= 0x10;
+    runFor(200000);
+
+    EXPECT_EQ(1, hostBadFrames);
+    EXPECT_EQ(1, hostGaps);
+}
+
+TEST(MspSerialTest, TestStreamOnlyOnSerialPorts)
+{
+    resetLoopback(SERIAL_PORT_USART1, 256, 115200);
+
+    EXPECT_FALSE(mspSerialStreamStart(-1, MSP2_DATAFLASH_STREAM, testStreamFrame));
+}
+
+// Streamed dataflash reads are no slower than a request per chunk, for chunks the size of a stream frame. Runs on the
+// loopback's simulated clock, so the result doesn't depend on the host
+TEST(MspSerialTest, TestStreamNoSlowerThanRequests)
+{
+    static const struct {
+        uint8_t identifier;
+        uint32_t txBufferSize;
+        uint32_t baudRate;
+        const char *name;
+    } links[] = {
+        { SERIAL_PORT_USART1, 256, 115200, "UART 115200" },
+        { SERIAL_PORT_USART1, 256, 921600, "UART 921600" },
+        { SERIAL_PORT_USART1, 1280, 921600, "UART 921600/1280" },
+        { SERIAL_PORT_USB_VCP, 2048, 0, "USB VCP" },
+    };
+    static const uint32_t size = 64 * 1024;
+
+    for (unsigned i = 0; i < ARRAYLEN(links); i++) {
+        const bool vcp = links[i].identifier == SERIAL_PORT_USB_VCP;
+        const uint16_t chunk = (vcp ? MSP_PORT_OUTBUF_SIZE : links[i].txBufferSize - MSP_MAX_HEADER_SIZE - MSP_MAX_CHECKSUM_SIZE) - MSP_PORT_DATAFLASH_INFO_SIZE;
+
+        resetLoopback(links[i].identifier, links[i].txBufferSize, links[i].baudRate);
+        hostRequestRead(0, chunk);
+        while (hostNextAddress < size && nowUs < 60000000) {
+            runFor(TASK_SERIAL_PERIOD_US, size, chunk);
+        }
+        EXPECT_EQ(size, hostBytes);
+        const uint32_t requestUs = hostLastDataUs;
+
+        resetLoopback(links[i].identifier, links[i].txBufferSize, links[i].baudRate);
+        hostStartStream(0, size);
+        while (!hostEndSeen && nowUs < 60000000) {
+            runFor(TASK_SERIAL_PERIOD_US);
+        }
+        EXPECT_EQ(size, hostBytes);
+        EXPECT_EQ(0, hostBadFrames);
+
+        // allowing a task period for the start request, which the stream answers before sending data
+        EXPECT_LE(hostLastDataUs, requestUs + TASK_SERIAL_PERIOD_US) << links[i].name;
+    }
+}
+
+// STUBS
+
+extern "C" {
+    const uint32_t baudRates[] = {0, 9600, 19200, 38400, 57600, 115200, 230400, 250000,
+        400000, 460800, 500000, 921600, 1000000, 1500000, 2000000, 2470000};
+
+    static mspDescriptor_t descriptors;
+
+    uint32_t millis(void) { return nowUs / 1000; }
+    mspDescriptor_t mspDescriptorAlloc(void) { return descriptors++; }
+    void cliEnter(serialPort_t *) {}
+    void systemResetToBootloader(bootloaderRequestType_e) {}
+
+    const serialPortConfig_t *findSerialPortConfig(serialPortFunction_e)
+    {
+        return &loopbackPortConfig;
+    }
+    const serialPortConfig_t *findNextSerialPortConfig(serialPortFunction_e) { return NULL; }
+    bool isSerialPortShared(const serialPortConfig_t *, uint16_t, serialPortFunction_e) { return false; }
+    serialPort_t *openSerialPort(serialPortIdentifier_e, serialPortFunction_e, serialReceiveCallbackPtr, void *, uint32_t, portMode_e, portOptions_e)
+    {
+        return &loopbackPort;
+    }
+    void closeSerialPort(serialPort_t *) {}
+    void waitForSerialPortToFinishTransmitting(serialPort_t *) {}
+
+    uint32_t serialRxBytesWaiting(const serialPort_t *) { return rxQueue.size(); }
+    uint8_t serialRead(serialPort_t *)
+    {
+        const uint8_t c = rxQueue.front();
+        rxQueue.pop_front();
+        return c;
+    }
+    uint32_t serialTxBytesFree(const serialPort_t *instance)
+    {
+        return txQueue.size() < instance->txBufferSize ? instance->txBufferSize - txQueue.size() : 0;
+    }
+    bool isSerialTransmitBufferEmpty(const serialPort_t *) { return txQueue.empty(); }
+    void serialWriteBuf(serialPort_t *, const uint8_t *data, int count) { txQueue.insert(txQueue.end(), data, data + count); }
+    void serialBeginWrite(serialPort_t *) {}
+    void serialEndWrite(serialPort_t *) {}
+}
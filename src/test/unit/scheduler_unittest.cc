@@ -16,8 +16,13 @@
  */
 
 #include <stdint.h>
+#include <stdio.h>
+
+#include <chrono>
+#include <vector>
 
 extern "C" {
+    #include "common/utils.h"
     #include "drivers/accgyro/accgyro.h"
     #include "platform.h"
     #include "pg/pg.h"
@@ -57,12 +62,15 @@ const int TEST_UPDATE_OSD_TIME = 30;
 extern "C" {
     task_t * unittest_scheduler_selectedTask;
     uint8_t unittest_scheduler_selectedTaskDynPrio;
+    extern uint8_t unittest_scheduler_selectedTaskDynamicPriority;
     timeDelta_t unittest_scheduler_taskRequiredTimeUs;
     bool taskGyroRan = false;
     bool taskFilterRan = false;
     bool taskPidRan = false;
     bool taskFilterReady = false;
     bool taskPidReady = false;
+    bool rxCheckResult = false;
+    int rxCheckCount = 0;
     uint8_t activePidLoopDenom = 1;
 
     int16_t debug[1];
@@ -94,7 +102,7 @@ extern "C" {
     void taskUpdateAccelerometer(timeUs_t) { simulatedTime += TEST_UPDATE_ACCEL_TIME; }
     void taskHandleSerial(timeUs_t) { simulatedTime += TEST_HANDLE_SERIAL_TIME; }
     void taskUpdateBatteryVoltage(timeUs_t) { simulatedTime += TEST_UPDATE_BATTERY_TIME; }
-    bool rxUpdateCheck(timeUs_t, timeDelta_t) { simulatedTime += TEST_UPDATE_RX_CHECK_TIME; return false; }
+    bool rxUpdateCheck(timeUs_t, timeDelta_t) { simulatedTime += TEST_UPDATE_RX_CHECK_TIME; rxCheckCount++; return rxCheckResult; }
     void taskUpdateRxMain(timeUs_t) { simulatedTime += TEST_UPDATE_RX_MAIN_TIME; }
     void imuUpdateAttitude(timeUs_t) { simulatedTime += TEST_IMU_UPDATE_TIME; }
     void dispatchProcess(timeUs_t) { simulatedTime += TEST_DISPATCH_TIME; }
@@ -548,6 +556,357 @@ TEST(SchedulerUnittest, TestPriorityBump)
     EXPECT_EQ(11000 + TEST_UPDATE_ACCEL_TIME, simulatedTime);
 }
 
+static void enableOnlyTasks(const taskId_e *taskIds, int count)
+{
+    for (int taskId = 0; taskId < TASK_COUNT; ++taskId) {
+        setTaskEnabled(static_cast<taskId_e>(taskId), false);
+    }
+    for (int i = 0; i < count; i++) {
+        setTaskEnabled(taskIds[i], true);
+    }
+}
+
+TEST(SchedulerUnittest, TestDueTimeNotSlotAligned)
+{
+    static const taskId_e enabled[] = { TASK_ACCEL };
+    enableOnlyTasks(enabled, ARRAYLEN(enabled));
+
+    // due part way through a timer wheel slot, the task must run neither early nor late
+    static const uint32_t startTime = 20003;
+    simulatedTime = startTime;
+    tasks[TASK_ACCEL].lastExecutedAtUs = startTime;
+
+    for (uint32_t offset = 0; offset < 1000; offset += 37) {
+        simulatedTime = startTime + offset;
+        scheduler();
+        EXPECT_EQ(static_cast<task_t*>(0), unittest_scheduler_selectedTask) << "offset " << offset;
+    }
+    simulatedTime = startTime + 999;
+    scheduler();
+    EXPECT_EQ(static_cast<task_t*>(0), unittest_scheduler_selectedTask);
+
+    simulatedTime = startTime + 1000;
+    scheduler();
+    EXPECT_EQ(&tasks[TASK_ACCEL], unittest_scheduler_selectedTask);
+    EXPECT_EQ(startTime + 1000, tasks[TASK_ACCEL].lastExecutedAtUs);
+}
+
+TEST(SchedulerUnittest, TestPeriodBeyondTimerWheel)
+{
+    static const taskId_e enabled[] = { TASK_SYSTEM };
+    enableOnlyTasks(enabled, ARRAYLEN(enabled));
+
+    // TASK_SYSTEM runs at 10Hz, many turns of the timer wheel
+    static const uint32_t startTime = 30000;
+    simulatedTime = startTime;
+    tasks[TASK_SYSTEM].lastExecutedAtUs = startTime;
+
+    for (uint32_t offset = 0; offset < TASK_PERIOD_HZ(10); offset += 500) {
+        simulatedTime = startTime + offset;
+        scheduler();
+        EXPECT_EQ(static_cast<task_t*>(0), unittest_scheduler_selectedTask) << "offset " << offset;
+    }
+
+    simulatedTime = startTime + TASK_PERIOD_HZ(10);
+    scheduler();
+    EXPECT_EQ(&tasks[TASK_SYSTEM], unittest_scheduler_selectedTask);
+}
+
+TEST(SchedulerUnittest, TestRescheduleTask)
+{
+    static const taskId_e enabled[] = { TASK_ACCEL };
+    enableOnlyTasks(enabled, ARRAYLEN(enabled));
+
+    static const uint32_t startTime = 150000;
+    simulatedTime = startTime;
+    tasks[TASK_ACCEL].lastExecutedAtUs = startTime;
+    scheduler();
+    EXPECT_EQ(static_cast<task_t*>(0), unittest_scheduler_selectedTask);
+
+    simulatedTime = startTime + 500;
+    scheduler();
+    EXPECT_EQ(static_cast<task_t*>(0), unittest_scheduler_selectedTask);
+
+    // a shorter period makes the waiting task due immediately
+    rescheduleTask(TASK_ACCEL, 400);
+    scheduler();
+    EXPECT_EQ(&tasks[TASK_ACCEL], unittest_scheduler_selectedTask);
+
+    // and a longer one delays it
+    rescheduleTask(TASK_ACCEL, 2000);
+    simulatedTime = startTime + 500 + 1999;
+    scheduler();
+    EXPECT_EQ(static_cast<task_t*>(0), unittest_scheduler_selectedTask);
+    simulatedTime = startTime + 500 + 2000;
+    scheduler();
+    EXPECT_EQ(&tasks[TASK_ACCEL], unittest_scheduler_selectedTask);
+
+    rescheduleTask(TASK_ACCEL, TASK_PERIOD_HZ(1000));
+}
+
+TEST(SchedulerUnittest, TestEventTaskCheckedUntilSignalled)
+{
+    static const taskId_e enabled[] = { TASK_ACCEL, TASK_RX };
+    enableOnlyTasks(enabled, ARRAYLEN(enabled));
+
+    static const uint32_t startTime = 200000;
+    simulatedTime = startTime;
+    tasks[TASK_RX].lastExecutedAtUs = startTime;
+    tasks[TASK_RX].dynamicPriority = 0;
+    tasks[TASK_RX].anticipatedExecutionTime = 0;
+    // TASK_ACCEL has aged by three periods
+    tasks[TASK_ACCEL].lastExecutedAtUs = startTime - 3 * TASK_PERIOD_HZ(1000);
+
+    rxCheckCount = 0;
+    rxCheckResult = true;
+    scheduler();
+    // the aged TASK_ACCEL outranks the freshly signalled, higher priority TASK_RX
+    EXPECT_EQ(1, rxCheckCount);
+    EXPECT_EQ(&tasks[TASK_ACCEL], unittest_scheduler_selectedTask);
+    EXPECT_EQ(1 + TASK_PRIORITY_HIGH, tasks[TASK_RX].dynamicPriority);
+    EXPECT_EQ(1, tasks[TASK_RX].taskAgePeriods);
+
+    // once signalled the check function is not called again until the task has run
+    scheduler();
+    EXPECT_EQ(1, rxCheckCount);
+    EXPECT_EQ(&tasks[TASK_RX], unittest_scheduler_selectedTask);
+    EXPECT_EQ(0, tasks[TASK_RX].dynamicPriority);
+
+    rxCheckResult = false;
+    scheduler();
+    EXPECT_EQ(2, rxCheckCount);
+    EXPECT_EQ(static_cast<task_t*>(0), unittest_scheduler_selectedTask);
+    EXPECT_EQ(0, tasks[TASK_RX].taskAgePeriods);
+}
+
+TEST(SchedulerUnittest, TestEventTaskAgeing)
+{
+    static const taskId_e enabled[] = { TASK_RX };
+    enableOnlyTasks(enabled, ARRAYLEN(enabled));
+
+    static const uint32_t startTime = 300000;
+    simulatedTime = startTime;
+
+    // a signalled task that has waited two and a half periods
+    tasks[TASK_RX].lastSignaledAtUs = startTime - (5 * TASK_PERIOD_HZ(50)) / 2;
+    tasks[TASK_RX].dynamicPriority = 1 + TASK_PRIORITY_HIGH;
+    tasks[TASK_RX].anticipatedExecutionTime = 0;
+
+    rxCheckCount = 0;
+    scheduler();
+    EXPECT_EQ(0, rxCheckCount);
+    EXPECT_EQ(&tasks[TASK_RX], unittest_scheduler_selectedTask);
+    EXPECT_EQ(3, tasks[TASK_RX].taskAgePeriods);
+    EXPECT_EQ(1 + TASK_PRIORITY_HIGH * 3, unittest_scheduler_selectedTaskDynamicPriority);
+}
+
+TEST(SchedulerUnittest, TestDisableReadyTask)
+{
+    static const taskId_e enabled[] = { TASK_ACCEL, TASK_ATTITUDE };
+    enableOnlyTasks(enabled, ARRAYLEN(enabled));
+
+    static const uint32_t startTime = 400000;
+    simulatedTime = startTime;
+    tasks[TASK_ACCEL].lastExecutedAtUs = startTime - 1500;
+    tasks[TASK_ATTITUDE].lastExecutedAtUs = startTime;
+
+    setTaskEnabled(TASK_ACCEL, false);
+    scheduler();
+    EXPECT_EQ(static_cast<task_t*>(0), unittest_scheduler_selectedTask);
+
+    setTaskEnabled(TASK_ACCEL, true);
+    scheduler();
+    EXPECT_EQ(&tasks[TASK_ACCEL], unittest_scheduler_selectedTask);
+}
+
+TEST(SchedulerUnittest, TestTimeWrap)
+{
+    static const taskId_e enabled[] = { TASK_ACCEL };
+    enableOnlyTasks(enabled, ARRAYLEN(enabled));
+
+    simulatedTime = UINT32_MAX - 400;
+    tasks[TASK_ACCEL].lastExecutedAtUs = simulatedTime;
+    scheduler();
+    EXPECT_EQ(static_cast<task_t*>(0), unittest_scheduler_selectedTask);
+
+    simulatedTime = 598;
+    scheduler();
+    EXPECT_EQ(static_cast<task_t*>(0), unittest_scheduler_selectedTask);
+
+    simulatedTime = 599;
+    scheduler();
+    EXPECT_EQ(&tasks[TASK_ACCEL], unittest_scheduler_selectedTask);
+}
+
+// Selection the scheduler must make, worked out from the task state by a linear scan of the queue as the
+// scheduler originally did. Only valid while no task is deferred for lack of time.
+static task_t *expectedSelection(timeUs_t currentTimeUs)
+{
+    task_t *expected = NULL;
+    int expectedPriority = 0;
+
+    for (int i = 0; i < taskQueueSize; i++) {
+        task_t *task = taskQueueArray[i];
+        const task_attribute_t *attribute = task->attribute;
+        int dynamicPriority = task->dynamicPriority;
+
+        if (attribute->staticPriority == TASK_PRIORITY_REALTIME) {
+            continue;
+        }
+        if (attribute->checkFunc) {
+            if (task->dynamicPriority > 0) {
+                dynamicPriority = 1 + attribute->staticPriority * (1 + cmpTimeUs(currentTimeUs, task->lastSignaledAtUs) / attribute->desiredPeriodUs);
+            } else if (task == &tasks[TASK_RX] && rxCheckResult) {
+                dynamicPriority = 1 + attribute->staticPriority;
+            }
+        } else {
+            const int agePeriods = cmpTimeUs(currentTimeUs, task->lastExecutedAtUs) / attribute->desiredPeriodUs;
+            if (agePeriods > 0) {
+                dynamicPriority = 1 + attribute->staticPriority * agePeriods;
+            }
+        }
+        if (dynamicPriority > expectedPriority) {
+            expectedPriority = dynamicPriority;
+            expected = task;
+        }
+    }
+
+    return expected;
+}
+
+TEST(SchedulerUnittest, TestSelectionMatchesLinearScan)
+{
+    static const taskId_e enabled[] = { TASK_SYSTEM, TASK_ACCEL, TASK_ATTITUDE, TASK_RX, TASK_SERIAL, TASK_BATTERY_VOLTAGE };
+    enableOnlyTasks(enabled, ARRAYLEN(enabled));
+
+    simulatedTime = 1000000;
+    for (unsigned i = 0; i < ARRAYLEN(enabled); i++) {
+        tasks[enabled[i]].lastExecutedAtUs = simulatedTime - 100 * i;
+        tasks[enabled[i]].dynamicPriority = 0;
+        tasks[enabled[i]].anticipatedExecutionTime = 0;
+    }
+
+    uint32_t seed = 12345;
+    int selections = 0;
+    for (int pass = 0; pass < 20000; pass++) {
+        seed = seed * 1664525 + 1013904223;
+        simulatedTime += (seed >> 24) % 300;
+        rxCheckResult = ((seed >> 8) & 0x3f) == 0;
+
+        task_t *expected = expectedSelection(simulatedTime);
+        scheduler();
+        ASSERT_EQ(expected, unittest_scheduler_selectedTask) << "pass " << pass;
+        selections += expected != NULL;
+    }
+    EXPECT_GT(selections, 1000);
+
+    rxCheckResult = false;
+}
+
+TEST(SchedulerUnittest, TestTaskTrace)
+{
+    static const taskId_e enabled[] = { TASK_ACCEL };
+    enableOnlyTasks(enabled, ARRAYLEN(enabled));
+    schedulerResetTaskTrace();
+
+    static const uint32_t startTime = 600000;
+    simulatedTime = startTime;
+    // first run starts 5us after the task became due
+    tasks[TASK_ACCEL].lastExecutedAtUs = startTime - TASK_PERIOD_HZ(1000) - 5;
+
+    static const int runs = TASK_TRACE_LENGTH + 6;
+    for (int i = 0; i < runs; i++) {
+        simulatedTime = startTime + i * TASK_PERIOD_HZ(1000);
+        scheduler();
+        EXPECT_EQ(&tasks[TASK_ACCEL], unittest_scheduler_selectedTask);
+    }
+
+    taskHistogram_t histogram;
+    schedulerGetTaskHistogram(TASK_ACCEL, &histogram);
+    for (int i = 0; i < TASK_HISTOGRAM_BUCKET_COUNT; i++) {
+        // TEST_UPDATE_ACCEL_TIME is in the 32 to 63us bucket
+        EXPECT_EQ(i == 6 ? runs : 0, histogram.executionTime[i]) << "bucket " << i;
+        // 5us is in the 4 to 7us bucket, on time runs in the first
+        EXPECT_EQ(i == 0 ? runs - 1 : i == 3 ? 1 : 0, histogram.startDelay[i]) << "bucket " << i;
+    }
+    schedulerGetTaskHistogram(TASK_ATTITUDE, &histogram);
+    EXPECT_EQ(0, histogram.executionTime[0]);
+
+    // the trace holds the most recent runs, oldest first
+    taskTraceEntry_t entries[TASK_TRACE_LENGTH];
+    EXPECT_EQ(4U, schedulerGetTaskTrace(entries, 4));
+    EXPECT_EQ(startTime + (runs - 4) * TASK_PERIOD_HZ(1000), entries[0].startUs);
+    EXPECT_EQ(startTime + (runs - 1) * TASK_PERIOD_HZ(1000), entries[3].startUs);
+
+    EXPECT_EQ(static_cast<unsigned>(TASK_TRACE_LENGTH), schedulerGetTaskTrace(entries, TASK_TRACE_LENGTH));
+    EXPECT_EQ(startTime + (runs - TASK_TRACE_LENGTH) * TASK_PERIOD_HZ(1000), entries[0].startUs);
+    for (int i = 0; i < TASK_TRACE_LENGTH; i++) {
+        EXPECT_EQ(TASK_ACCEL, entries[i].taskId);
+        EXPECT_EQ(TEST_UPDATE_ACCEL_TIME, entries[i].durationUs);
+    }
+
+    schedulerResetTaskTrace();
+    EXPECT_EQ(0U, schedulerGetTaskTrace(entries, TASK_TRACE_LENGTH));
+    schedulerGetTaskHistogram(TASK_ACCEL, &histogram);
+    EXPECT_EQ(0, histogram.executionTime[6]);
+}
+
+static bool benchmarkCheck(timeUs_t, timeDelta_t)
+{
+    static uint32_t calls;
+    return (++calls & 0xf) == 0;
+}
+
+static void benchmarkTask(timeUs_t)
+{
+}
+
+// Reports the cost of a scheduler pass against the number of enabled tasks, not run by default.
+// Run with: obj/test/scheduler_unittest/scheduler_unittest --gtest_also_run_disabled_tests --gtest_filter='*SchedulerOverhead'
+TEST(SchedulerUnittest, DISABLED_BenchmarkSchedulerOverhead)
+{
+    static const int passes = 200000;
+    std::vector<task_attribute_t> attributes;
+    std::vector<taskId_e> benchmarkTasks;
+
+    attributes.reserve(TASK_COUNT);
+    for (int taskId = 0; taskId < TASK_COUNT; ++taskId) {
+        if (taskId == TASK_GYRO || taskId == TASK_FILTER || taskId == TASK_PID) {
+            continue;
+        }
+        // a mix of event driven and time driven tasks over the usual range of priorities and periods
+        const bool eventDriven = (taskId % 4) == 0;
+        attributes.push_back({ "BENCHMARK", NULL, eventDriven ? benchmarkCheck : NULL, benchmarkTask,
+            TASK_PERIOD_HZ(1000 >> (taskId % 6)), static_cast<int8_t>(TASK_PRIORITY_LOW + taskId % 5) });
+        tasks[taskId].attribute = &attributes.back();
+        benchmarkTasks.push_back(static_cast<taskId_e>(taskId));
+    }
+
+    const unsigned taskCounts[] = { 1, 2, 4, 8, 16, static_cast<unsigned>(benchmarkTasks.size()) };
+    for (const unsigned count : taskCounts) {
+        enableOnlyTasks(benchmarkTasks.data(), count);
+        simulatedTime = 500000;
+        for (unsigned i = 0; i < count; i++) {
+            tasks[benchmarkTasks[i]].lastExecutedAtUs = simulatedTime - 10 * i;
+            tasks[benchmarkTasks[i]].dynamicPriority = 0;
+            tasks[benchmarkTasks[i]].anticipatedExecutionTime = 0;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        for (int pass = 0; pass < passes; pass++) {
+            simulatedTime += 10;
+            scheduler();
+        }
+        const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+
+        printf("scheduler overhead: %2u tasks %6.1f ns/pass\n", count, static_cast<double>(elapsed.count()) / passes);
+    }
+
+    for (int taskId = 0; taskId < TASK_COUNT; ++taskId) {
+        tasks[taskId].attribute = &task_attributes[taskId];
+    }
+}
+
 TEST(SchedulerUnittest, TestGyroTask)
 {
     static const uint32_t startTime = 4000;
@@ -632,4 +991,3 @@ TEST(SchedulerUnittest, TestGyroTask)
     // expect that no other tasks other tasks should have run
     EXPECT_EQ(static_cast<task_t*>(0), unittest_scheduler_selectedTask);
 }
-
@@ -0,0 +1,53 @@
+/*
+ * This file is part of Cleanflight and Betaflight.
+ *
+ * Cleanflight and Betaflight are free software. You can redistribute
+ * this software and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Cleanflight and Betaflight are distributed in the hope that they
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+extern "C" {
+    float testSdftBatchError_C(int startBin, int endBin, int numBatches, int sampleCount);
+    int testSdftAxesMismatch_C(int startBin, int endBin, int numBatches, int sampleCount);
+    int testSdftPeakBin_C(int toneBin, int numBatches);
+}
+
+#include "unittest_macros.h"
+#include "gtest/gtest.h"
+
+TEST(SdftUnittest, TestBatchesMatchWholePush)
+{
+    // single batch, batches spanning several bins and more batches than bins
+    EXPECT_LT(testSdftBatchError_C(3, 30, 1, 300), 1e-5f);
+    EXPECT_LT(testSdftBatchError_C(3, 30, 6, 300), 1e-5f);
+    EXPECT_LT(testSdftBatchError_C(10, 13, 8, 300), 1e-5f);
+}
+
+TEST(SdftUnittest, TestAxesMatchSingleSpectra)
+{
+    EXPECT_EQ(0, testSdftAxesMismatch_C(2, 35, 1, 200));
+    EXPECT_EQ(0, testSdftAxesMismatch_C(2, 35, 6, 200));
+    EXPECT_EQ(0, testSdftAxesMismatch_C(5, 20, 13, 200));
+}
+
+TEST(SdftUnittest, TestPeakBin)
+{
+    EXPECT_EQ(5, testSdftPeakBin_C(5, 1));
+    EXPECT_EQ(12, testSdftPeakBin_C(12, 4));
+    EXPECT_EQ(20, testSdftPeakBin_C(20, 6));
+}
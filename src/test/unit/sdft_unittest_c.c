@@ -0,0 +1,126 @@
+/*
+ * This file is part of Cleanflight and Betaflight.
+ *
+ * Cleanflight and Betaflight are free software. You can redistribute
+ * this software and/or modify this software under the terms of the
+ * GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Cleanflight and Betaflight are distributed in the hope that they
+ * will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.
+ *
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// sdft.h uses C99 complex types, which are not usable from C++, so the spectra are driven from here
+
+#include <math.h>
+
+#include "platform.h"
+
+#include "common/axis.h"
+#include "common/maths.h"
+#include "common/sdft.h"
+
+static float testSample(int n, int axis)
+{
+    // deterministic mix of two tones and a little broadband content
+    return 100.0f * sinf(0.7f * n + axis) + 30.0f * sinf(2.3f * n) + (float)((n * 7919 + axis * 104729) % 201 - 100);
+}
+
+// Largest relative difference between the windowed power of a spectrum pushed in batches and one pushed whole
+float testSdftBatchError_C(int startBin, int endBin, int numBatches, int sampleCount)
+{
+    sdft_t batched;
+    sdft_t whole;
+    float batchedWinSq[SDFT_BIN_COUNT];
+    float wholeWinSq[SDFT_BIN_COUNT];
+    float maxError = 0.0f;
+
+    sdftInit(&batched, startBin, endBin, numBatches);
+    sdftInit(&whole, startBin, endBin, 1);
+
+    for (int n = 0; n < sampleCount; n++) {
+        for (int batch = 0; batch < numBatches; batch++) {
+            sdftPushBatch(&batched, testSample(n, 0), batch);
+        }
+        sdftPush(&whole, testSample(n, 0));
+
+        sdftWinSq(&batched, batchedWinSq);
+        sdftWinSq(&whole, wholeWinSq);
+        for (int bin = batched.startBin + 1; bin < batched.endBin; bin++) {
+            maxError = fmaxf(maxError, fabsf(batchedWinSq[bin] - wholeWinSq[bin]) / fmaxf(wholeWinSq[bin], 1.0f));
+        }
+    }
+
+    return maxError;
+}
+
+// Number of bins differing between sdftPushBatchAxes() and individual sdftPushBatch() calls
+int testSdftAxesMismatch_C(int startBin, int endBin, int numBatches, int sampleCount)
+{
+    sdft_t single[XYZ_AXIS_COUNT];
+    sdft_t interleaved[XYZ_AXIS_COUNT];
+    int mismatch = 0;
+
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        sdftInit(&single[axis], startBin, endBin, numBatches);
+        sdftInit(&interleaved[axis], startBin, endBin, numBatches);
+    }
+
+    for (int n = 0; n < sampleCount; n++) {
+        float samples[XYZ_AXIS_COUNT];
+        for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+            samples[axis] = testSample(n, axis);
+        }
+
+        for (int batch = 0; batch < numBatches; batch++) {
+            for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+                sdftPushBatch(&single[axis], samples[axis], batch);
+            }
+            sdftPushBatchAxes(interleaved, samples, batch);
+        }
+    }
+
+    for (int axis = 0; axis < XYZ_AXIS_COUNT; axis++) {
+        for (int bin = 0; bin < SDFT_BIN_COUNT; bin++) {
+            if (single[axis].data[bin] != interleaved[axis].data[bin]) {
+                mismatch++;
+            }
+        }
+    }
+
+    return mismatch;
+}
+
+// Bin with the largest windowed power after pushing a pure tone centered on toneBin
+int testSdftPeakBin_C(int toneBin, int numBatches)
+{
+    sdft_t sdft;
+    sdftInit(&sdft, 2, SDFT_BIN_COUNT - 2, numBatches);
+
+    for (int n = 0; n < 4 * SDFT_SAMPLE_SIZE; n++) {
+        const float sample = 100.0f * cosf(2.0f * M_PIf * toneBin * n / SDFT_SAMPLE_SIZE);
+        for (int batch = 0; batch < numBatches; batch++) {
+            sdftPushBatch(&sdft, sample, batch);
+        }
+    }
+
+    float power[SDFT_BIN_COUNT] = { 0 };
+    sdftWinSq(&sdft, power);
+
+    int peakBin = 0;
+    for (int bin = sdft.startBin + 1; bin < sdft.endBin; bin++) {
+        if (power[bin] > power[peakBin]) {
+            peakBin = bin;
+        }
+    }
+
+    return peakBin;
+}
@@ -151,11 +151,96 @@ TEST(SensorGyro, Update)
     EXPECT_NEAR(90 * gyroDevPtr->scale, gyro.gyroADC[Z], 1e-3);
 }
 
+TEST(SensorGyro, IsrFiltering)
+{
+    pgResetAll();
+    // turn off filters
+    gyroConfigMutable()->gyro_lpf1_static_hz = 0;
+    gyroConfigMutable()->gyro_lpf2_static_hz = 0;
+    gyroConfigMutable()->gyro_soft_notch_hz_1 = 0;
+    gyroConfigMutable()->gyro_soft_notch_hz_2 = 0;
+    gyroConfigMutable()->gyro_isr_filtering = true;
+    gyroInit();
+    gyroSetTargetLooptime(1);
+    gyroInitFilters();
+    // attached only once the gyro task hands over
+    EXPECT_TRUE(gyroDevPtr->sampleFn == NULL);
+
+    gyroDevPtr->readFn = fakeGyroRead;
+    gyroStartCalibration(false);
+    while (!gyroIsCalibrationComplete()) {
+        fakeGyroSet(gyroDevPtr, 5, 6, 7);
+        gyroUpdate();
+    }
+    gyroFiltering(0);
+
+    // the ISR only takes over once the gyro is read by DMA
+    EXPECT_FALSE(gyroIsrFilteringActive());
+    gyroDevPtr->gyroModeSPI = GYRO_EXTI_INT_DMA;
+    EXPECT_TRUE(gyroIsrFilteringActive());
+    EXPECT_TRUE(gyroDevPtr->sampleFn == gyroSampleIsr);
+
+    // nothing published yet, the PID loop keeps the previous values
+    gyro.gyroADCf[X] = 1.0f;
+    gyroFiltering(0);
+    EXPECT_FLOAT_EQ(1.0f, gyro.gyroADCf[X]);
+
+    // the ISR publishes the filtered sample without touching gyroADCf
+    fakeGyroSet(gyroDevPtr, 15, 26, 97);
+    gyroDevPtr->gyroLastEXTI = 1234;
+    gyroSampleIsr(gyroDevPtr);
+    EXPECT_EQ(1U, gyro.isrSamples.sequence);
+    EXPECT_FLOAT_EQ(1.0f, gyro.gyroADCf[X]);
+
+    gyroFiltering(0);
+    EXPECT_NEAR(10 * gyroDevPtr->scale, gyro.gyroADCf[X], 1e-3);
+    EXPECT_NEAR(20 * gyroDevPtr->scale, gyro.gyroADCf[Y], 1e-3);
+    EXPECT_NEAR(90 * gyroDevPtr->scale, gyro.gyroADCf[Z], 1e-3);
+    EXPECT_EQ(1234U, gyroGetFilteredSampleCycles());
+
+    // with two samples published between reads the newest one is used
+    fakeGyroSet(gyroDevPtr, 25, 36, 47);
+    gyroSampleIsr(gyroDevPtr);
+    fakeGyroSet(gyroDevPtr, 35, 46, 57);
+    gyroDevPtr->gyroLastEXTI = 2345;
+    gyroSampleIsr(gyroDevPtr);
+    gyroFiltering(0);
+    EXPECT_NEAR(30 * gyroDevPtr->scale, gyro.gyroADCf[X], 1e-3);
+    EXPECT_NEAR(40 * gyroDevPtr->scale, gyro.gyroADCf[Y], 1e-3);
+    EXPECT_NEAR(50 * gyroDevPtr->scale, gyro.gyroADCf[Z], 1e-3);
+    EXPECT_EQ(2345U, gyroGetFilteredSampleCycles());
+
+    // calibrating hands sampling back to the gyro task
+    gyroStartCalibration(false);
+    gyroSampleIsr(gyroDevPtr);
+    EXPECT_EQ(3U, gyro.isrSamples.sequence);
+    EXPECT_TRUE(gyroDevPtr->sampleFn == NULL);
+    EXPECT_FALSE(gyroIsrFilteringActive());
+
+    // reinitialising the filters detaches the ISR before touching them
+    gyroDevPtr->gyroModeSPI = GYRO_EXTI_INIT;
+    while (!gyroIsCalibrationComplete()) {
+        fakeGyroSet(gyroDevPtr, 5, 6, 7);
+        gyroUpdate();
+    }
+    gyroDevPtr->gyroModeSPI = GYRO_EXTI_INT_DMA;
+    EXPECT_TRUE(gyroIsrFilteringActive());
+    gyroInitFilters();
+    EXPECT_TRUE(gyroDevPtr->sampleFn == NULL);
+    EXPECT_FALSE(gyro.isrFilteringActive);
+    gyroSampleIsr(gyroDevPtr);
+    EXPECT_EQ(3U, gyro.isrSamples.sequence);
+    EXPECT_FALSE(gyro.isrRunning);
+
+    gyroDevPtr->gyroModeSPI = GYRO_EXTI_INIT;
+}
+
 // STUBS
 
 extern "C" {
 
 uint32_t micros(void) {return 0;}
+uint32_t getCycleCounter(void) {return 0;}
 void beeper(beeperMode_e) {}
 uint8_t detectedSensors[] = { GYRO_NONE, ACC_NONE };
 timeDelta_t getGyroUpdateRate(void) {return gyro.targetLooptime;}